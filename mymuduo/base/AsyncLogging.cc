@@ -25,6 +25,7 @@ AsyncLogging::AsyncLogging(const string &basename,
       rollSize_(rollSize), // 预留日志大小
       thread_(std::bind(&AsyncLogging::threadFunc, this), "Logging"),
       latch_(1),
+      droppedBuffers_(0),
       mutex_(),
       cond_(mutex_),
       currentBuffer_(new Buffer),
@@ -113,6 +114,7 @@ void AsyncLogging::threadFunc()
             fputs(buf, stderr);
             output.append(buf, static_cast<int>(strlen(buf)));
             // buffer vector 只留下两个 buffer 使用 std::move 移动，节省资源
+            droppedBuffers_.fetch_add(static_cast<int64_t>(buffersToWrite.size() - 2), std::memory_order_relaxed);
             buffersToWrite.erase(buffersToWrite.begin() + 2, buffersToWrite.end());
         }
 
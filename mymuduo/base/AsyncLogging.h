@@ -58,6 +58,9 @@ namespace mymuduo
             thread_.join();
         }
 
+        /// 后端来不及写盘时丢弃的缓冲区总数，可以在任意线程读取
+        int64_t droppedBuffers() const { return droppedBuffers_.load(std::memory_order_relaxed); }
+
     private:
         // 线程执行函数
         void threadFunc();
@@ -72,6 +75,7 @@ namespace mymuduo
         const off_t rollSize_;      // 滚动最大值
         mymuduo::Thread thread_;
         mymuduo::CountDownLatch latch_;
+        std::atomic<int64_t> droppedBuffers_;
         mymuduo::MutexLock mutex_; // 用来锁所有的缓冲，同时只能有一个线程在读或写
         mymuduo::Condition cond_ GUARDED_BY(mutex_);
         BufferPtr currentBuffer_ GUARDED_BY(mutex_); // 当前正在使用的缓冲区
@@ -58,7 +58,7 @@ namespace mymuduo
         public:
             AtomicIntegerT() : value_(0) {}
             T get() { return __sync_val_compare_and_swap(&value_, 0, 0); }
-            T getAndAdd(T x) { return __sync_fetch_and_and(&value_, x); }
+            T getAndAdd(T x) { return __sync_fetch_and_add(&value_, x); }
             T addAndGet(T x) { return __sync_add_and_fetch(&value_, x); }
             T incrementAndGet() { return addAndGet(1); }
             T decrementAndGet() { return addAndGet(-1); }
@@ -261,6 +261,18 @@ ProcessInfo::CpuTime ProcessInfo::cpuTime()
   return t;
 }
 
+int64_t ProcessInfo::residentSetSize()
+{
+  int64_t result = 0;
+  string status = procStatus();
+  size_t pos = status.find("VmRSS:");
+  if (pos != string::npos)
+  {
+    result = ::atoll(status.c_str() + pos + 6) * 1024; // 单位为 kB
+  }
+  return result;
+}
+
 int ProcessInfo::numThreads()
 {
   int result = 0;
@@ -80,6 +80,9 @@ namespace mymuduo
     };
     CpuTime cpuTime();
 
+    /// 常驻内存（/proc/self/status 中的 VmRSS），单位字节
+    int64_t residentSetSize();
+
     int numThreads();
     std::vector<pid_t> threads();
   } // namespace ProcessInfo
@@ -0,0 +1,30 @@
+#ifndef MYMUDUO_BASE_TESTS_TESTCHECK_H
+#define MYMUDUO_BASE_TESTS_TESTCHECK_H
+
+#include <stdio.h>
+
+/**
+ * 测试程序共用的检查宏：条件不成立时打印位置并计数，不中止，
+ * 让一次运行报告出全部失败。main 最后 return testResult();
+ * 每个测试程序只有一个翻译单元包含本文件
+ */
+static int g_failures = 0;
+
+#define CHECK(cond)                                                        \
+    do                                                                     \
+    {                                                                      \
+        if (!(cond))                                                       \
+        {                                                                  \
+            printf("%s:%d CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+            ++g_failures;                                                  \
+        }                                                                  \
+    } while (0)
+
+/// 打印 PASS/FAIL，返回进程的退出码
+inline int testResult()
+{
+    printf("%s\n", g_failures == 0 ? "PASS" : "FAIL");
+    return g_failures == 0 ? 0 : 1;
+}
+
+#endif // MYMUDUO_BASE_TESTS_TESTCHECK_H
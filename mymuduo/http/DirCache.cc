@@ -0,0 +1,419 @@
+#include "mymuduo/http/DirCache.h"
+
+#include "mymuduo/base/Logging.h"
+
+#include <algorithm>
+#include <ctype.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace mymuduo;
+using namespace mymuduo::net;
+
+namespace mymuduo
+{
+    namespace net
+    {
+        namespace detail
+        {
+            const uint32_t kWatchMask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+                                        IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+
+            void appendHtmlEscaped(string *out, const string &s)
+            {
+                for (char c : s)
+                {
+                    switch (c)
+                    {
+                    case '&': out->append("&amp;"); break;
+                    case '<': out->append("&lt;"); break;
+                    case '>': out->append("&gt;"); break;
+                    case '"': out->append("&quot;"); break;
+                    default: out->push_back(c); break;
+                    }
+                }
+            }
+
+            // href 中除了非保留字符之外都做百分号编码
+            void appendUrlEncoded(string *out, const string &s)
+            {
+                static const char kHex[] = "0123456789ABCDEF";
+                for (char c : s)
+                {
+                    unsigned char u = static_cast<unsigned char>(c);
+                    if (isalnum(u) || c == '-' || c == '_' || c == '.' || c == '~')
+                    {
+                        out->push_back(c);
+                    }
+                    else
+                    {
+                        out->push_back('%');
+                        out->push_back(kHex[u >> 4]);
+                        out->push_back(kHex[u & 0x0f]);
+                    }
+                }
+            }
+
+            void appendJsonEscaped(string *out, const string &s)
+            {
+                static const char kHex[] = "0123456789abcdef";
+                for (char c : s)
+                {
+                    unsigned char u = static_cast<unsigned char>(c);
+                    if (c == '"' || c == '\\')
+                    {
+                        out->push_back('\\');
+                        out->push_back(c);
+                    }
+                    else if (u < 0x20)
+                    {
+                        out->append("\\u00");
+                        out->push_back(kHex[u >> 4]);
+                        out->push_back(kHex[u & 0x0f]);
+                    }
+                    else
+                    {
+                        out->push_back(c);
+                    }
+                }
+            }
+
+            void appendNumber(string *out, size_t n)
+            {
+                char buf[32];
+                int len = snprintf(buf, sizeof buf, "%zu", n);
+                out->append(buf, static_cast<size_t>(len));
+            }
+
+            void renderHtml(string *out, const std::vector<DirCache::Entry> &entries, const string &title,
+                            size_t begin, size_t end, size_t page, size_t pages)
+            {
+                out->reserve(512 + (end - begin) * 64);
+                out->append("<!DOCTYPE HTML PUBLIC \"-//W3C//DTD HTML 4.01//EN\" \"http://www.w3.org/TR/html4/strict.dtd\">\n"
+                            "<html>\n<head>\n"
+                            "<meta http-equiv=\"Content-Type\" content=\"text/html; charset=utf-8\">\n"
+                            "<title>Directory listing for ");
+                appendHtmlEscaped(out, title);
+                out->append("</title>\n</head>\n<body>\n<h1>Directory listing for ");
+                appendHtmlEscaped(out, title);
+                out->append("</h1>\n<hr>\n<ul>\n");
+                // <li><a href="branches/">branches/</a></li>
+                for (size_t i = begin; i < end; ++i)
+                {
+                    const DirCache::Entry &entry = entries[i];
+                    out->append("<li><a href=\"");
+                    appendUrlEncoded(out, entry.name);
+                    if (entry.isDir)
+                        out->push_back('/');
+                    out->append("\">");
+                    appendHtmlEscaped(out, entry.name);
+                    if (entry.isDir)
+                        out->push_back('/');
+                    out->append("</a></li>\n");
+                }
+                out->append("</ul>\n<hr>\n");
+                if (pages > 1)
+                {
+                    out->append("<p>");
+                    if (page > 0)
+                    {
+                        out->append("<a href=\"?page=");
+                        appendNumber(out, page - 1);
+                        out->append("\">Previous</a> ");
+                    }
+                    out->append("Page ");
+                    appendNumber(out, page + 1);
+                    out->append(" of ");
+                    appendNumber(out, pages);
+                    if (page + 1 < pages)
+                    {
+                        out->append(" <a href=\"?page=");
+                        appendNumber(out, page + 1);
+                        out->append("\">Next</a>");
+                    }
+                    out->append("</p>\n");
+                }
+                out->append("</body>\n</html>");
+            }
+
+            // {"path":"/dir","total":2,"page":0,"pages":1,"entries":[{"name":"a","type":"file"},...]}
+            void renderJson(string *out, const std::vector<DirCache::Entry> &entries, const string &title,
+                            size_t begin, size_t end, size_t page, size_t pages)
+            {
+                out->reserve(128 + (end - begin) * 48);
+                out->append("{\"path\":\"");
+                appendJsonEscaped(out, title);
+                out->append("\",\"total\":");
+                appendNumber(out, entries.size());
+                out->append(",\"page\":");
+                appendNumber(out, page);
+                out->append(",\"pages\":");
+                appendNumber(out, pages);
+                out->append(",\"entries\":[");
+                for (size_t i = begin; i < end; ++i)
+                {
+                    if (i != begin)
+                        out->push_back(',');
+                    out->append("{\"name\":\"");
+                    appendJsonEscaped(out, entries[i].name);
+                    out->append(entries[i].isDir ? "\",\"type\":\"directory\"}" : "\",\"type\":\"file\"}");
+                }
+                out->append("]}");
+            }
+
+            DirCache::DataPtr renderPage(const std::vector<DirCache::Entry> &entries, const string &title,
+                                         DirCache::Format format, size_t page, size_t pageSize)
+            {
+                size_t pages = std::max((entries.size() + pageSize - 1) / pageSize, static_cast<size_t>(1));
+                size_t begin = page < pages ? std::min(page * pageSize, entries.size()) : entries.size();
+                size_t end = std::min(begin + pageSize, entries.size());
+                std::shared_ptr<string> out(new string);
+                if (format == DirCache::kJson)
+                    renderJson(out.get(), entries, title, begin, end, page, pages);
+                else
+                    renderHtml(out.get(), entries, title, begin, end, page, pages);
+                return out;
+            }
+        }
+    }
+}
+
+DirCache::DirCache(size_t pageSize, size_t maxDirs)
+    : maxDirs_(maxDirs),
+      pageSize_(std::max(pageSize, static_cast<size_t>(1))),
+      inotifyFd_(::inotify_init1(IN_NONBLOCK | IN_CLOEXEC))
+{
+    if (inotifyFd_ < 0)
+    {
+        // 没有 inotify 时不缓存，每次都重新扫描
+        LOG_SYSERR << "DirCache inotify_init1";
+    }
+}
+
+DirCache::~DirCache()
+{
+    if (inotifyFd_ >= 0)
+    {
+        ::close(inotifyFd_);
+    }
+}
+
+bool DirCache::scan(const string &path, std::vector<Entry> *entries)
+{
+    DIR *dir = ::opendir(path.c_str());
+    if (!dir)
+        return false;
+    const int dirFd = ::dirfd(dir);
+    struct dirent *dirp;
+    while ((dirp = ::readdir(dir)))
+    {
+        const char *name = dirp->d_name;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
+            continue;
+        bool isDir = dirp->d_type == DT_DIR;
+        if (dirp->d_type == DT_UNKNOWN || dirp->d_type == DT_LNK)
+        {
+            // 符号链接按指向的目标显示
+            struct stat st;
+            isDir = ::fstatat(dirFd, name, &st, 0) == 0 && S_ISDIR(st.st_mode);
+        }
+        entries->push_back(Entry{name, isDir});
+    }
+    ::closedir(dir);
+    std::sort(entries->begin(), entries->end(),
+              [](const Entry &a, const Entry &b) { return a.name < b.name; });
+    return true;
+}
+
+DirCache::ListingPtr DirCache::get(const string &path, const string &title)
+{
+    drainEvents();
+    {
+        MutexLockGuard lock(mutex_);
+        auto it = index_.find(path);
+        if (it != index_.end())
+        {
+            lru_.splice(lru_.begin(), lru_, it->second);
+            hits_.increment();
+            return it->second->listing;
+        }
+    }
+    misses_.increment();
+
+    // 先加监视再扫描，扫描期间的变化不会漏掉
+    int wd = inotifyFd_ >= 0 ? ::inotify_add_watch(inotifyFd_, path.c_str(), detail::kWatchMask) : -1;
+    int64_t events = 0;
+    if (wd >= 0)
+    {
+        MutexLockGuard lock(mutex_);
+        Watch &watch = watches_[wd];
+        ++watch.scans;
+        events = watch.events;
+    }
+    std::shared_ptr<Listing> listing(new Listing);
+    bool ok = scan(path, &listing->entries);
+    if (ok)
+    {
+        for (int i = 0; i < kNumFormats; ++i)
+        {
+            listing->firstPage[i] = detail::renderPage(listing->entries, title, static_cast<Format>(i), 0, pageSize_);
+        }
+    }
+
+    drainEvents();
+    MutexLockGuard lock(mutex_);
+    if (wd >= 0)
+    {
+        Watch &watch = watches_[wd];
+        --watch.scans;
+        // 只看这个目录自己的事件，其他目录的变化不影响本次结果
+        if (ok && watch.events == events && index_.find(path) == index_.end())
+        {
+            lru_.push_front(CacheEntry{path, listing, wd});
+            index_[path] = lru_.begin();
+            watch.paths.insert(path);
+        }
+        else
+        {
+            // 扫描失败或期间收到过事件，结果可能已经过期，不缓存，下次重新扫描
+            releaseWatch(wd);
+        }
+        while (lru_.size() > maxDirs_)
+        {
+            erase(--lru_.end());
+        }
+    }
+    return ok ? listing : ListingPtr();
+}
+
+DirCache::DataPtr DirCache::render(const ListingPtr &listing, const string &title, Format format, size_t page) const
+{
+    if (page == 0)
+        return listing->firstPage[format];
+    return detail::renderPage(listing->entries, title, format, page, pageSize_);
+}
+
+void DirCache::drainEvents()
+{
+    if (inotifyFd_ < 0)
+        return;
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t n;
+    while ((n = ::read(inotifyFd_, buf, sizeof buf)) > 0)
+    {
+        MutexLockGuard lock(mutex_);
+        for (const char *p = buf; p < buf + n;)
+        {
+            const struct inotify_event *event = reinterpret_cast<const struct inotify_event *>(p);
+            p += sizeof(struct inotify_event) + event->len;
+            if (event->mask & IN_Q_OVERFLOW)
+            {
+                // 事件丢失，无法确定哪些目录变了
+                clearLocked();
+                continue;
+            }
+            auto watch = watches_.find(event->wd);
+            if (watch == watches_.end())
+                continue;
+            ++watch->second.events;
+            for (const string &path : watch->second.paths)
+            {
+                auto it = index_.find(path);
+                if (it != index_.end())
+                {
+                    lru_.erase(it->second);
+                    index_.erase(it);
+                }
+            }
+            watch->second.paths.clear();
+            if (event->mask & IN_IGNORED)
+            {
+                // 内核已经移除了监视
+                if (watch->second.scans == 0)
+                    watches_.erase(watch);
+            }
+            else
+            {
+                releaseWatch(event->wd);
+            }
+        }
+    }
+}
+
+// 没有缓存的路径也没有进行中的扫描时移除监视
+void DirCache::releaseWatch(int wd)
+{
+    auto watch = watches_.find(wd);
+    if (watch != watches_.end() && watch->second.paths.empty() && watch->second.scans == 0)
+    {
+        ::inotify_rm_watch(inotifyFd_, wd);
+        watches_.erase(watch);
+    }
+}
+
+void DirCache::erase(EntryList::iterator it)
+{
+    auto watch = watches_.find(it->wd);
+    if (watch != watches_.end())
+    {
+        watch->second.paths.erase(it->path);
+        releaseWatch(it->wd);
+    }
+    index_.erase(it->path);
+    lru_.erase(it);
+}
+
+void DirCache::invalidate(const string &path)
+{
+    MutexLockGuard lock(mutex_);
+    auto it = index_.find(path);
+    if (it != index_.end())
+    {
+        erase(it->second);
+    }
+}
+
+void DirCache::clear()
+{
+    MutexLockGuard lock(mutex_);
+    clearLocked();
+}
+
+void DirCache::clearLocked()
+{
+    for (auto it = watches_.begin(); it != watches_.end();)
+    {
+        if (it->second.scans == 0)
+        {
+            ::inotify_rm_watch(inotifyFd_, it->first);
+            it = watches_.erase(it);
+        }
+        else
+        {
+            // 进行中的扫描结果同样作废，wd 留给扫描结束时移除
+            ++it->second.events;
+            it->second.paths.clear();
+            ++it;
+        }
+    }
+    index_.clear();
+    lru_.clear();
+}
+
+void DirCache::setPageSize(size_t pageSize)
+{
+    MutexLockGuard lock(mutex_);
+    pageSize_ = std::max(pageSize, static_cast<size_t>(1));
+    clearLocked();
+}
+
+size_t DirCache::size() const
+{
+    MutexLockGuard lock(mutex_);
+    return lru_.size();
+}
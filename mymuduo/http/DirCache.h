@@ -0,0 +1,108 @@
+#ifndef MYMUDUO_HTTP_DIRCACHE_H
+#define MYMUDUO_HTTP_DIRCACHE_H
+
+#include "mymuduo/base/Atomic.h"
+#include "mymuduo/base/Mutex.h"
+#include "mymuduo/base/noncopyable.h"
+#include "mymuduo/base/Types.h"
+
+#include <list>
+#include <memory>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+namespace mymuduo
+{
+    namespace net
+    {
+        /**
+         * 目录列表缓存：每个目录只在第一次请求或内容变化后扫描一次，第一页的 HTML/JSON 扫描时就生成好。
+         * 扫描时直接使用 readdir 返回的 d_type，文件系统不提供类型或条目是符号链接时才 fstatat。
+         *
+         * 已缓存的目录以 inotify 监视，目录中有条目增删/改名时条目失效。
+         * 查找时以非阻塞方式读取积压的事件，目录没有变化时只多一次返回 EAGAIN 的 read。
+         * 条目很多的目录按 pageSize 分页，每页只生成该页的条目
+         */
+        class DirCache : noncopyable
+        {
+        public:
+            typedef std::shared_ptr<const string> DataPtr;
+
+            enum Format
+            {
+                kHtml,
+                kJson,
+                kNumFormats
+            };
+
+            struct Entry
+            {
+                string name;
+                bool isDir;
+            };
+
+            struct Listing
+            {
+                std::vector<Entry> entries;     // 按名字排序
+                DataPtr firstPage[kNumFormats]; // 预先生成的第一页
+            };
+            typedef std::shared_ptr<const Listing> ListingPtr;
+
+            explicit DirCache(size_t pageSize = 1000, size_t maxDirs = 256);
+            ~DirCache();
+
+            /// 目录无法打开时返回空指针，title 为页面上显示的路径
+            ListingPtr get(const string &path, const string &title);
+            /// 第 page 页（从 0 开始），超出范围时返回没有条目的页面
+            DataPtr render(const ListingPtr &listing, const string &title, Format format, size_t page) const;
+
+            void invalidate(const string &path);
+            void clear();
+
+            /// 调整后清空缓存
+            void setPageSize(size_t pageSize);
+            size_t pageSize() const { return pageSize_; }
+            size_t size() const;
+            int64_t hits() const { return hits_.get(); }
+            int64_t misses() const { return misses_.get(); }
+
+            /// 读取目录的条目，不含 "." 和 ".."，失败时返回 false
+            static bool scan(const string &path, std::vector<Entry> *entries);
+
+        private:
+            struct CacheEntry
+            {
+                string path;
+                ListingPtr listing;
+                int wd; // inotify watch descriptor
+            };
+            typedef std::list<CacheEntry> EntryList;
+
+            struct Watch
+            {
+                std::set<string> paths; // 同一个目录可能以不同的路径被缓存
+                int64_t events;         // 该 wd 上收到的事件数，扫描期间有变化时不缓存结果
+                int scans;              // 正在进行的扫描，不为 0 时保留 wd
+            };
+
+            void drainEvents();
+            void erase(EntryList::iterator it) REQUIRES(mutex_);
+            void releaseWatch(int wd) REQUIRES(mutex_);
+            void clearLocked() REQUIRES(mutex_);
+
+            const size_t maxDirs_;
+            size_t pageSize_;
+            const int inotifyFd_;
+            mutable MutexLock mutex_;
+            EntryList lru_ GUARDED_BY(mutex_); // 队首为最近使用
+            std::unordered_map<string, EntryList::iterator> index_ GUARDED_BY(mutex_);
+            // inotify 对同一 inode 返回相同的 wd
+            std::unordered_map<int, Watch> watches_ GUARDED_BY(mutex_);
+            mutable AtomicInt64 hits_;
+            mutable AtomicInt64 misses_;
+        };
+    }
+}
+
+#endif
@@ -0,0 +1,276 @@
+#include "mymuduo/http/FileCache.h"
+
+#include "mymuduo/base/Logging.h"
+#include "mymuduo/base/Timestamp.h"
+
+#include <fcntl.h>
+#include <functional>
+
+using namespace mymuduo;
+using namespace mymuduo::net;
+
+namespace mymuduo
+{
+    namespace net
+    {
+        namespace detail
+        {
+            bool sameFile(const struct stat &a, const struct stat &b)
+            {
+                return a.st_ino == b.st_ino && a.st_dev == b.st_dev && a.st_size == b.st_size &&
+                       a.st_mtim.tv_sec == b.st_mtim.tv_sec && a.st_mtim.tv_nsec == b.st_mtim.tv_nsec;
+            }
+
+            size_t contentBytes(const SmallFileCache::Content &content)
+            {
+                return content.body->size() + content.headers->size() + content.etag.size();
+            }
+        }
+    }
+}
+
+FileCache::FileCache(size_t maxEntries, double ttlSeconds, size_t numShards)
+    : maxEntriesPerShard_(std::max(maxEntries / numShards, static_cast<size_t>(1))),
+      ttl_(static_cast<int64_t>(ttlSeconds * 1000000))
+{
+    for (size_t i = 0; i < numShards; ++i)
+    {
+        shards_.emplace_back(new Shard);
+    }
+}
+
+FileCache::Shard &FileCache::shardFor(const string &path)
+{
+    return *shards_[std::hash<string>()(path) % shards_.size()];
+}
+
+bool FileCache::lookup(const string &path, struct stat *st, FileHandlePtr *file)
+{
+    Shard &shard = shardFor(path);
+    int64_t now = Timestamp::now().microSecondsSinceEpoch();
+    FileHandlePtr cached;
+    struct stat cachedSt;
+    memZero(&cachedSt, sizeof cachedSt);
+    {
+        MutexLockGuard lock(shard.mutex);
+        auto it = shard.index.find(path);
+        if (it != shard.index.end())
+        {
+            shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+            const Entry &entry = *it->second;
+            if (now - entry.checked < ttl_)
+            {
+                hits_.increment();
+                *st = entry.st;
+                *file = entry.file;
+                return true;
+            }
+            cached = entry.file;
+            cachedSt = entry.st;
+        }
+    }
+
+    // 系统调用都在锁外进行
+    if (::stat(path.c_str(), st) != 0)
+    {
+        if (cached)
+            invalidate(path);
+        return false;
+    }
+    if (!S_ISREG(st->st_mode))
+    {
+        file->reset();
+        return true;
+    }
+    if (cached && detail::sameFile(cachedSt, *st))
+    {
+        revalidations_.increment();
+        *file = cached;
+        insert(shard, path, *st, cached, now);
+        return true;
+    }
+
+    misses_.increment();
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        LOG_SYSERR << "FileCache open " << path;
+        file->reset();
+        return true;
+    }
+    FileHandlePtr opened(std::make_shared<FileHandle>(fd));
+    // stat 与 open 之间文件可能被替换，以 fd 的实际状态为准
+    ::fstat(fd, st);
+    *file = opened;
+    insert(shard, path, *st, opened, now);
+    return true;
+}
+
+void FileCache::insert(Shard &shard, const string &path, const struct stat &st, const FileHandlePtr &file, int64_t checked)
+{
+    MutexLockGuard lock(shard.mutex);
+    auto it = shard.index.find(path);
+    if (it != shard.index.end())
+    {
+        Entry &entry = *it->second;
+        entry.st = st;
+        entry.file = file;
+        entry.checked = checked;
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+        return;
+    }
+    Entry entry;
+    entry.path = path;
+    entry.st = st;
+    entry.file = file;
+    entry.checked = checked;
+    shard.lru.push_front(entry);
+    shard.index[path] = shard.lru.begin();
+    while (shard.lru.size() > maxEntriesPerShard_)
+    {
+        shard.index.erase(shard.lru.back().path);
+        shard.lru.pop_back();
+    }
+}
+
+void FileCache::invalidate(const string &path)
+{
+    Shard &shard = shardFor(path);
+    MutexLockGuard lock(shard.mutex);
+    auto it = shard.index.find(path);
+    if (it != shard.index.end())
+    {
+        shard.lru.erase(it->second);
+        shard.index.erase(it);
+    }
+}
+
+void FileCache::clear()
+{
+    for (auto &shard : shards_)
+    {
+        MutexLockGuard lock(shard->mutex);
+        shard->index.clear();
+        shard->lru.clear();
+    }
+}
+
+size_t FileCache::size() const
+{
+    size_t n = 0;
+    for (const auto &shard : shards_)
+    {
+        MutexLockGuard lock(shard->mutex);
+        n += shard->lru.size();
+    }
+    return n;
+}
+
+SmallFileCache::SmallFileCache(size_t maxFileSize, size_t maxBytes)
+    : maxFileSize_(maxFileSize),
+      maxBytes_(maxBytes),
+      bytes_(0)
+{
+}
+
+SmallFileCache::ContentPtr SmallFileCache::get(const string &path, const struct stat &st)
+{
+    MutexLockGuard lock(mutex_);
+    auto it = index_.find(path);
+    if (it == index_.end())
+    {
+        misses_.increment();
+        return ContentPtr();
+    }
+    if (!detail::sameFile(it->second->content->st, st))
+    {
+        // 文件已经改变
+        erase(path);
+        misses_.increment();
+        return ContentPtr();
+    }
+    lru_.splice(lru_.begin(), lru_, it->second);
+    hits_.increment();
+    return it->second->content;
+}
+
+void SmallFileCache::put(const string &path, const ContentPtr &content)
+{
+    size_t n = detail::contentBytes(*content);
+    MutexLockGuard lock(mutex_);
+    if (content->body->size() > maxFileSize_ || n > maxBytes_)
+    {
+        return;
+    }
+    // 多个线程同时读入了同一个文件
+    erase(path);
+    lru_.push_front(Entry{path, content, n});
+    index_[path] = lru_.begin();
+    bytes_ += n;
+    evict();
+}
+
+void SmallFileCache::invalidate(const string &path)
+{
+    MutexLockGuard lock(mutex_);
+    erase(path);
+}
+
+void SmallFileCache::setLimits(size_t maxFileSize, size_t maxBytes)
+{
+    MutexLockGuard lock(mutex_);
+    maxFileSize_ = maxFileSize;
+    maxBytes_ = maxBytes;
+    // 只在启动时调整，直接清空
+    index_.clear();
+    lru_.clear();
+    bytes_ = 0;
+}
+
+void SmallFileCache::clear()
+{
+    MutexLockGuard lock(mutex_);
+    index_.clear();
+    lru_.clear();
+    bytes_ = 0;
+}
+
+size_t SmallFileCache::maxFileSize() const
+{
+    MutexLockGuard lock(mutex_);
+    return maxFileSize_;
+}
+
+size_t SmallFileCache::bytes() const
+{
+    MutexLockGuard lock(mutex_);
+    return bytes_;
+}
+
+size_t SmallFileCache::size() const
+{
+    MutexLockGuard lock(mutex_);
+    return lru_.size();
+}
+
+void SmallFileCache::erase(const string &path)
+{
+    auto it = index_.find(path);
+    if (it != index_.end())
+    {
+        bytes_ -= it->second->bytes;
+        lru_.erase(it->second);
+        index_.erase(it);
+    }
+}
+
+void SmallFileCache::evict()
+{
+    while (bytes_ > maxBytes_ && !lru_.empty())
+    {
+        const Entry &last = lru_.back();
+        bytes_ -= last.bytes;
+        index_.erase(last.path);
+        lru_.pop_back();
+    }
+}
@@ -0,0 +1,138 @@
+#ifndef MYMUDUO_HTTP_FILECACHE_H
+#define MYMUDUO_HTTP_FILECACHE_H
+
+#include "mymuduo/base/Atomic.h"
+#include "mymuduo/base/Mutex.h"
+#include "mymuduo/base/noncopyable.h"
+#include "mymuduo/base/Types.h"
+#include "mymuduo/net/FileHandle.h"
+
+#include <sys/stat.h>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace mymuduo
+{
+    namespace net
+    {
+        /**
+         * 已打开文件的缓存：路径 -> (struct stat, fd)，fd 以 FileHandlePtr 共享，
+         * 正在发送的连接持有引用，被淘汰的条目在最后一个传输结束后才真正 close。
+         *
+         * 条目在 ttl 内直接使用，不做任何系统调用；过期后重新 stat，
+         * inode/大小/mtime 都没变时沿用原来的 fd，否则重新 open。
+         * 按路径哈希分成多个分片，各自加锁并按 LRU 淘汰，多个 IO 线程并发查找时竞争很小
+         */
+        class FileCache : noncopyable
+        {
+        public:
+            explicit FileCache(size_t maxEntries = 1024, double ttlSeconds = 1.0, size_t numShards = 16);
+
+            /**
+             * 查找 path，不存在时返回 false。
+             * 普通文件的 *file 为共享的只读 fd（打开失败时为空），其他类型（如目录）只返回 stat 且不缓存
+             */
+            bool lookup(const string &path, struct stat *st, FileHandlePtr *file);
+            /// 文件被本进程修改（如上传）后立即失效，不必等 ttl
+            void invalidate(const string &path);
+            void clear();
+
+            /// 应在服务启动前设置
+            void setTtl(double seconds) { ttl_ = static_cast<int64_t>(seconds * 1000000); }
+            size_t size() const;
+            /// 命中：ttl 内直接返回；重新验证：过期后 stat 发现文件未变；未命中：需要 open
+            int64_t hits() const { return hits_.get(); }
+            int64_t revalidations() const { return revalidations_.get(); }
+            int64_t misses() const { return misses_.get(); }
+
+        private:
+            struct Entry
+            {
+                string path;
+                struct stat st;
+                FileHandlePtr file;
+                int64_t checked; // 上次 stat 的时间，微秒
+            };
+            typedef std::list<Entry> EntryList;
+
+            struct Shard
+            {
+                mutable MutexLock mutex;
+                EntryList lru GUARDED_BY(mutex); // 队首为最近使用
+                std::unordered_map<string, EntryList::iterator> index GUARDED_BY(mutex);
+            };
+
+            Shard &shardFor(const string &path);
+            void insert(Shard &shard, const string &path, const struct stat &st, const FileHandlePtr &file, int64_t checked);
+
+            std::vector<std::unique_ptr<Shard>> shards_;
+            const size_t maxEntriesPerShard_;
+            int64_t ttl_;
+            mutable AtomicInt64 hits_;
+            mutable AtomicInt64 revalidations_;
+            mutable AtomicInt64 misses_;
+        };
+
+        /**
+         * 小文件的响应缓存：内容连同预先编码好的首部一起放在内存里，
+         * 命中时 HTTP/1.x 响应只需一次 writev，不再有单独的 sendfile。
+         * 按总字节数 LRU 淘汰，文件的 inode/大小/mtime 变化后条目失效。
+         * 键由调用方决定，FileServer 把压缩后的表示放在 路径 + '\0' + 编码名 下
+         */
+        class SmallFileCache : noncopyable
+        {
+        public:
+            typedef std::shared_ptr<const string> DataPtr;
+
+            struct Content
+            {
+                struct stat st;    // 缓存时的文件状态，用于验证
+                string etag;       // 条件请求时比较
+                DataPtr headers;   // 预先编码的首部行
+                DataPtr body;      // 文件内容或压缩后的内容
+            };
+            typedef std::shared_ptr<const Content> ContentPtr;
+
+            SmallFileCache(size_t maxFileSize, size_t maxBytes);
+
+            /// st 为文件当前的状态，未命中或文件已改变时返回空指针
+            ContentPtr get(const string &path, const struct stat &st);
+            void put(const string &path, const ContentPtr &content);
+            void invalidate(const string &path);
+            void clear();
+
+            /// maxFileSize 为 0 时不缓存
+            void setLimits(size_t maxFileSize, size_t maxBytes);
+            size_t maxFileSize() const;
+            size_t bytes() const;
+            size_t size() const;
+            int64_t hits() const { return hits_.get(); }
+            int64_t misses() const { return misses_.get(); }
+
+        private:
+            struct Entry
+            {
+                string path;
+                ContentPtr content;
+                size_t bytes;
+            };
+            typedef std::list<Entry> EntryList;
+
+            void evict() REQUIRES(mutex_);
+            void erase(const string &path) REQUIRES(mutex_);
+
+            mutable MutexLock mutex_;
+            EntryList lru_ GUARDED_BY(mutex_); // 队首为最近使用
+            std::unordered_map<string, EntryList::iterator> index_ GUARDED_BY(mutex_);
+            size_t maxFileSize_ GUARDED_BY(mutex_);
+            size_t maxBytes_ GUARDED_BY(mutex_);
+            size_t bytes_ GUARDED_BY(mutex_);
+            mutable AtomicInt64 hits_;
+            mutable AtomicInt64 misses_;
+        };
+    }
+}
+
+#endif
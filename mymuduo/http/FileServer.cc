@@ -1,15 +1,23 @@
 #include "mymuduo/http/FileServer.h"
 
+#include "mymuduo/base/Atomic.h"
 #include "mymuduo/base/Logging.h"
+#include "mymuduo/base/ThreadPool.h"
+#include "mymuduo/base/Timestamp.h"
 #include "mymuduo/http/HttpContext.h"
 #include "mymuduo/http/HttpRequest.h"
 #include "mymuduo/http/HttpResponse.h"
 
 #include <sys/stat.h>
 #include <cmath>
-#include <sstream>
-#include <dirent.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <stdlib.h>
 #include <fcntl.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <set>
 #include <vector>
 
 using namespace mymuduo;
@@ -21,6 +29,20 @@ namespace mymuduo
     {
         namespace detail
         {
+            // mimeType 依次匹配完整类型、主类型通配（"image/*"）和空串
+            template <typename T>
+            const T *matchMimeType(const std::map<string, T> &table, const string &type)
+            {
+                // 去掉 ";charset=..." 等参数
+                string mime = type.substr(0, type.find(';'));
+                typename std::map<string, T>::const_iterator it = table.find(mime);
+                if (it == table.end())
+                    it = table.find(mime.substr(0, mime.find('/')) + "/*");
+                if (it == table.end())
+                    it = table.find("");
+                return it != table.end() ? &it->second : NULL;
+            }
+
             string get404Html(string &msg)
             {
                 return R"(<!DOCTYPE HTML PUBLIC "-//W3C//DTD HTML 4.01//EN" "http://www.w3.org/TR/html4/strict.dtd">
@@ -40,42 +62,425 @@ namespace mymuduo
 )";
             }
 
-            void scanDir(const string &path, string &list)
+            const size_t kCompressCacheSize = 64 * 1024 * 1024;
+            // 超过该大小的文件不压缩，直接 sendfile
+            const off_t kMaxCompressFileSize = 16 * 1024 * 1024;
+            // 缓存未命中时，不超过该大小的文件在 IO 线程中即时压缩，更大的交给 file read pool
+            const off_t kMaxInlineCompressSize = 1024 * 1024;
+            // 内存中缓存的小文件
+            const size_t kSmallFileSize = 32 * 1024;
+            const size_t kSmallFileCacheSize = 32 * 1024 * 1024;
+
+            // 读入整个文件，文件在读取过程中被截断时返回 false
+            bool readFile(const string &path, size_t size, string *content)
+            {
+                int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+                if (fd < 0)
+                {
+                    LOG_SYSERR << "open " << path;
+                    return false;
+                }
+                content->resize(size);
+                size_t nread = 0;
+                while (nread < size)
+                {
+                    ssize_t n = ::pread(fd, &(*content)[nread], size - nread, static_cast<off_t>(nread));
+                    if (n <= 0)
+                    {
+                        if (n < 0 && errno == EINTR)
+                            continue;
+                        break;
+                    }
+                    nread += static_cast<size_t>(n);
+                }
+                ::close(fd);
+                return nread == size;
+            }
+
+            // 正在后台压缩的键（路径 + 编码），同一个键同时只有一个任务
+            struct CompressJobs
+            {
+                MutexLock mutex;
+                std::set<string> running GUARDED_BY(mutex);
+            };
+
+            // 强 ETag："inode-size-mtime"（十六进制，mtime 精确到纳秒）
+            string makeETag(const struct stat &st, bool weak)
+            {
+                char buf[80];
+                int64_t mtime = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+                snprintf(buf, sizeof buf, "%s\"%lx-%lx-%lx\"", weak ? "W/" : "",
+                         static_cast<unsigned long>(st.st_ino),
+                         static_cast<unsigned long>(st.st_size),
+                         static_cast<unsigned long>(mtime));
+                return buf;
+            }
+
+            // 压缩后的表示使用不同的 ETag："...-gzip"
+            string encodedETag(const string &etag, const char *encoding)
+            {
+                if (etag.empty())
+                    return etag;
+                return etag.substr(0, etag.size() - 1) + "-" + encoding + "\"";
+            }
+
+            // 小文件缓存的键：不压缩时为路径，否则为 路径 + '\0' + 编码名
+            string smallFileKey(const string &path, compress::Encoding encoding)
+            {
+                if (encoding == compress::kIdentity)
+                    return path;
+                string key = path;
+                key += '\0';
+                key += compress::encodingName(encoding);
+                return key;
+            }
+
+            // IMF-fixdate，如 Sun, 06 Nov 1994 08:49:37 GMT
+            string formatHttpDate(time_t t)
+            {
+                struct tm tm;
+                char buf[64];
+                gmtime_r(&t, &tm);
+                strftime(buf, sizeof buf, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+                return buf;
+            }
+
+            bool parseHttpDate(const string &date, time_t *t)
+            {
+                struct tm tm;
+                memZero(&tm, sizeof tm);
+                const char *end = strptime(date.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+                if (!end || *end != '\0')
+                    return false;
+                *t = timegm(&tm);
+                return true;
+            }
+
+            // 弱比较：忽略 W/ 前缀，同一文件压缩前后的 ETag 视为匹配
+            bool etagMatches(string tag, const string &etag)
+            {
+                string base = etag.compare(0, 2, "W/") == 0 ? etag.substr(2) : etag;
+                if (tag.compare(0, 2, "W/") == 0)
+                    tag = tag.substr(2);
+                if (tag == base)
+                    return true;
+                size_t dash = tag.rfind('-');
+                return dash != string::npos && dash + 1 < tag.size() &&
+                       tag.compare(0, dash, base, 0, base.size() - 1) == 0 && dash == base.size() - 1;
+            }
+
+            // If-None-Match 中的 entity-tag 列表，"*" 匹配任意存在的文件
+            bool noneMatchHit(const string &header, const string &etag)
+            {
+                size_t pos = 0;
+                while (pos < header.size())
+                {
+                    size_t comma = header.find(',', pos);
+                    if (comma == string::npos)
+                        comma = header.size();
+                    size_t b = header.find_first_not_of(" \t", pos);
+                    size_t e = header.find_last_not_of(" \t", comma - 1);
+                    if (b != string::npos && b < comma && e >= b)
+                    {
+                        string tag = header.substr(b, e - b + 1);
+                        if (tag == "*" || etagMatches(tag, etag))
+                            return true;
+                    }
+                    pos = comma + 1;
+                }
+                return false;
+            }
+
+            /**
+             * GET/HEAD 的缓存验证，If-None-Match 存在时忽略 If-Modified-Since，
+             * 返回 true 表示客户端的副本仍然有效，应当返回 304
+             */
+            bool notModified(const HttpRequest &req, const string &etag, time_t mtime)
+            {
+                if (req.method() != HttpRequest::kGet && req.method() != HttpRequest::kHead)
+                    return false;
+                const string &noneMatch = req.getHeader("If-None-Match");
+                if (!noneMatch.empty())
+                    return noneMatchHit(noneMatch, etag);
+                time_t since;
+                const string &modifiedSince = req.getHeader("If-Modified-Since");
+                return !modifiedSince.empty() && parseHttpDate(modifiedSince, &since) && mtime <= since;
+            }
+
+            // If-Range 只接受强验证器：强 ETag 完全相同，或者日期与 Last-Modified 相同
+            bool ifRangeMatches(const string &ifRange, const string &etag, time_t mtime)
+            {
+                if (ifRange.empty())
+                    return true;
+                if (ifRange[0] == '"')
+                    return etag.compare(0, 2, "W/") != 0 && ifRange == etag;
+                time_t date;
+                return ifRange.compare(0, 2, "W/") != 0 && parseHttpDate(ifRange, &date) && date == mtime;
+            }
+
+            /**
+             * 规范化以 '/' 开头的请求路径：合并连续的 '/'，去掉 "." 段，保留结尾的 '/'，
+             * 同一个文件只对应一个缓存项。含有 ".." 段时返回 false，避免访问工作目录之外
+             */
+            bool normalizePath(const string &path, string *out)
+            {
+                if (path.empty() || path[0] != '/')
+                    return false;
+                out->clear();
+                out->reserve(path.size());
+                size_t begin = 1;
+                while (begin < path.size())
+                {
+                    size_t end = path.find('/', begin);
+                    if (end == string::npos)
+                        end = path.size();
+                    size_t len = end - begin;
+                    if (len == 2 && path[begin] == '.' && path[begin + 1] == '.')
+                        return false;
+                    if (len > 0 && !(len == 1 && path[begin] == '.'))
+                    {
+                        out->push_back('/');
+                        out->append(path, begin, len);
+                    }
+                    begin = end + 1;
+                }
+                if (out->empty() || path[path.size() - 1] == '/')
+                    out->push_back('/');
+                return true;
+            }
+
+            /**
+             * PUT 上传的写入端，数据先写入临时文件，全部接收成功后再 rename 到目标路径，
+             * 中途失败不会留下不完整的目标文件。临时文件由 mkstemp 在目标所在目录创建，
+             * 同一目标的并发上传各写各的文件，最后完成的一个生效
+             */
+            class FileUploader : noncopyable
+            {
+            public:
+                FileUploader(const string &path, FileCache *cache, SmallFileCache *smallCache)
+                    : path_(path),
+                      cache_(cache),
+                      smallCache_(smallCache),
+                      tmpPath_(path + ".XXXXXX"),
+                      existed_(::access(path.c_str(), F_OK) == 0),
+                      fd_(createTemp(&tmpPath_)),
+                      written_(0)
+                {
+                    if (fd_ < 0)
+                    {
+                        LOG_SYSERR << "FileUploader open " << tmpPath_;
+                    }
+                }
+
+                ~FileUploader()
+                {
+                    if (fd_ >= 0)
+                    {
+                        // 没有走到 finish，连接中途断开
+                        ::close(fd_);
+                        ::unlink(tmpPath_.c_str());
+                    }
+                }
+
+                // 出错后继续消费数据但不再写入，保证后续请求的解析不受影响
+                size_t write(const char *data, size_t len)
+                {
+                    size_t done = 0;
+                    while (fd_ >= 0 && done < len)
+                    {
+                        ssize_t n = ::write(fd_, data + done, len - done);
+                        if (n < 0)
+                        {
+                            if (errno == EINTR)
+                                continue;
+                            LOG_SYSERR << "FileUploader write " << tmpPath_;
+                            ::close(fd_);
+                            ::unlink(tmpPath_.c_str());
+                            fd_ = -1;
+                            break;
+                        }
+                        done += static_cast<size_t>(n);
+                    }
+                    written_ += done;
+                    return len;
+                }
+
+                void finish(const HttpRequest &, HttpResponse *resp)
+                {
+                    bool ok = fd_ >= 0 && ::close(fd_) == 0 && ::rename(tmpPath_.c_str(), path_.c_str()) == 0;
+                    fd_ = -1;
+                    if (ok)
+                    {
+                        LOG_INFO << "Upload " << path_ << " " << written_ << " bytes";
+                        cache_->invalidate(path_);
+                        smallCache_->invalidate(path_);
+                        smallCache_->invalidate(detail::smallFileKey(path_, compress::kGzip));
+                        smallCache_->invalidate(detail::smallFileKey(path_, compress::kDeflate));
+                        if (existed_)
+                        {
+                            resp->setStatusCode(HttpResponse::k204NoContent);
+                            resp->setStatusMessage("No Content");
+                        }
+                        else
+                        {
+                            resp->setStatusCode(HttpResponse::k201Created);
+                            resp->setStatusMessage("Created");
+                        }
+                    }
+                    else
+                    {
+                        ::unlink(tmpPath_.c_str());
+                        resp->setStatusCode(HttpResponse::k500InternalError);
+                        resp->setStatusMessage("Internal Server Error");
+                        resp->setCloseConnection(true);
+                    }
+                }
+
+            private:
+                // 按模板创建唯一的临时文件，成功时把模板替换为实际的文件名
+                static int createTemp(string *pathTemplate)
+                {
+                    std::vector<char> name(pathTemplate->begin(), pathTemplate->end());
+                    name.push_back('\0');
+                    int fd = ::mkostemp(name.data(), O_CLOEXEC);
+                    if (fd >= 0)
+                    {
+                        // mkstemp 创建的文件只有属主可读写，改为普通文件的权限
+                        ::fchmod(fd, 0644);
+                        pathTemplate->assign(name.data());
+                    }
+                    return fd;
+                }
+
+                const string path_;
+                FileCache *cache_;
+                SmallFileCache *smallCache_;
+                string tmpPath_;
+                const bool existed_;
+                int fd_;
+                int64_t written_;
+            };
+
+            struct ByteRange
+            {
+                off64_t first;
+                off64_t last; // 包含
+            };
+
+            // [begin, end) 全部为数字时返回 true，溢出时返回 false
+            bool parseOffset(const string &s, size_t begin, size_t end, off64_t *value)
             {
-                // <li><a href="branches/">branches/</a></li>
-                struct stat buffer;
-                struct dirent *dirp; // return value for readdir()
-                DIR *dir;            // return value for opendir()
-
-                char fullname[100];     // to store files full name
-                size_t n = path.size(); // fullname[n]=='\0'
-                strcpy(fullname, path.c_str());
-                if (fullname[n - 1] != '/')
+                if (begin == end)
+                    return false;
+                off64_t v = 0;
+                for (size_t i = begin; i < end; ++i)
                 {
-                    fullname[n] = '/';
-                    fullname[n + 1] = '\0';
-                    n++;
+                    if (!isdigit(static_cast<unsigned char>(s[i])) || v > (INT64_MAX - 9) / 10)
+                        return false;
+                    v = v * 10 + (s[i] - '0');
                 }
+                *value = v;
+                return true;
+            }
+
+            const size_t kMaxRanges = 32;
 
-                dir = opendir(path.c_str());
-                if (!dir)
-                    return;
-                while ((dirp = readdir(dir)))
+            /**
+             * 解析 Range: bytes=0-99, 200-, -50（RFC 7233），区间按文件大小截断，偏移均为 64 位。
+             * 语法错误、区间过多、或者区间总长超过文件本身（重叠区间造成放大）时返回 false，此时忽略 Range；
+             * 所有区间都无法满足时 ranges 为空，应当返回 416
+             */
+            bool parseRanges(const string &header, off64_t size, std::vector<ByteRange> *ranges)
+            {
+                if (header.compare(0, 6, "bytes=") != 0)
+                    return false;
+                size_t count = 0;
+                off64_t total = 0;
+                size_t pos = 6;
+                while (pos <= header.size())
                 {
-                    if (strcmp(dirp->d_name, ".") == 0 || strcmp(dirp->d_name, "..") == 0)
-                        continue;
-                    strcpy(&fullname[n], dirp->d_name);
-                    stat(fullname, &buffer);
-
-                    char name[600];
-                    if (S_ISDIR(buffer.st_mode))
-                        snprintf(name, sizeof(name), "<li><a href=\"%s/\">%s/</a></li>", dirp->d_name, dirp->d_name);
+                    size_t end = header.find(',', pos);
+                    if (end == string::npos)
+                        end = header.size();
+                    size_t b = pos, e = end;
+                    pos = end + 1;
+                    while (b < e && (header[b] == ' ' || header[b] == '\t'))
+                        ++b;
+                    while (e > b && (header[e - 1] == ' ' || header[e - 1] == '\t'))
+                        --e;
+                    if (b == e)
+                        continue; // 允许空的列表元素
+                    if (++count > kMaxRanges)
+                        return false;
+
+                    size_t dash = header.find('-', b);
+                    if (dash >= e)
+                        return false;
+                    off64_t first = 0, last = 0;
+                    bool hasFirst = b != dash, hasLast = dash + 1 != e;
+                    if ((hasFirst && !parseOffset(header, b, dash, &first)) ||
+                        (hasLast && !parseOffset(header, dash + 1, e, &last)) ||
+                        (!hasFirst && !hasLast) || (hasFirst && hasLast && last < first))
+                    {
+                        return false;
+                    }
+                    if (!hasFirst)
+                    {
+                        // 最后 last 个字节
+                        if (last == 0 || size == 0)
+                            continue;
+                        first = std::max(size - last, static_cast<off64_t>(0));
+                        last = size - 1;
+                    }
                     else
-                        snprintf(name, sizeof(name), "<li><a href=\"%s\">%s</a></li>", dirp->d_name, dirp->d_name);
-                    list.append(name);
-                    list.push_back('\n');
+                    {
+                        if (first >= size)
+                            continue;
+                        last = hasLast ? std::min(last, size - 1) : size - 1;
+                    }
+                    ranges->push_back(ByteRange{first, last});
+                    total += last - first + 1;
+                }
+                return count > 0 && total <= size;
+            }
+
+            // multipart 的分隔符，不需要不可预测，只要不与文件内容冲突
+            string makeBoundary()
+            {
+                static AtomicInt64 counter;
+                uint64_t seed = static_cast<uint64_t>(Timestamp::now().microSecondsSinceEpoch()) * 0x9E3779B97F4A7C15ULL +
+                                static_cast<uint64_t>(counter.incrementAndGet());
+                char buf[32];
+                snprintf(buf, sizeof buf, "%016llx", static_cast<unsigned long long>(seed));
+                return string("mymuduo-") + buf;
+            }
+
+            // query（带有开头的 '?'）中 key 对应的值，不存在时返回空串
+            string queryParam(const string &query, const char *key)
+            {
+                const size_t keyLen = strlen(key);
+                size_t pos = 1;
+                while (pos < query.size())
+                {
+                    size_t end = query.find('&', pos);
+                    if (end == string::npos)
+                        end = query.size();
+                    if (end - pos > keyLen && query.compare(pos, keyLen, key) == 0 && query[pos + keyLen] == '=')
+                        return query.substr(pos + keyLen + 1, end - pos - keyLen - 1);
+                    pos = end + 1;
                 }
-                closedir(dir);
+                return string();
+            }
+
+            // ?format=json 或 Accept 首选 application/json 时返回 JSON
+            DirCache::Format listingFormat(const HttpRequest &req)
+            {
+                string format = queryParam(req.query(), "format");
+                if (format == "json")
+                    return DirCache::kJson;
+                if (format.empty() && req.getHeader("Accept").compare(0, 16, "application/json") == 0)
+                    return DirCache::kJson;
+                return DirCache::kHtml;
             }
         }
     }
@@ -126,184 +531,254 @@ FileServer::FileServer(const string &path,
                        const string &name,
                        TcpServer::Option option)
     : workPath_(path),
-      server_(loop, listenAddr, name, option)
+      uploadEnabled_(false),
+      compressEnabled_(true),
+      compressCache_(std::make_shared<CompressCache>(detail::kCompressCacheSize)),
+      compressJobs_(std::make_shared<detail::CompressJobs>()),
+      compressPool_(NULL),
+      smallFileCache_(detail::kSmallFileSize, detail::kSmallFileCacheSize),
+      weakETag_(false),
+      server_(new HttpServer(loop, listenAddr, name, option))
 {
-    server_.setConnectionCallback(std::bind(&FileServer::onConnection, this, _1));
-    server_.setMessageCallback(std::bind(&FileServer::onMessage, this, _1, _2, _3));
+    initRoutes();
+    server_->setHttpCallback(std::bind(&FileServer::onRequest, this, _1, _2));
+    server_->setHttpStreamCallback(std::bind(&FileServer::onRequestHeaders, this, _1, _2));
 }
 
-void FileServer::start()
+FileServer::FileServer(const string &path)
+    : workPath_(path),
+      uploadEnabled_(false),
+      compressEnabled_(true),
+      compressCache_(std::make_shared<CompressCache>(detail::kCompressCacheSize)),
+      compressJobs_(std::make_shared<detail::CompressJobs>()),
+      compressPool_(NULL),
+      smallFileCache_(detail::kSmallFileSize, detail::kSmallFileCacheSize),
+      weakETag_(false)
 {
-    LOG_WARN << "FileServer[" << server_.name()
-             << "] starts listening on " << server_.ipPort();
-    server_.start();
+    initRoutes();
 }
 
-void FileServer::onConnection(const TcpConnectionPtr &conn)
+extern char favicon[555];
+void FileServer::initRoutes()
+{
+    // 网站图标
+    router_.get("/favicon.ico", [](const HttpRequest &, const HttpRouter::Params &, HttpResponse *response) {
+        response->setStatusCode(HttpResponse::k200Ok);
+        response->setStatusMessage("OK");
+        response->setContentType("image/png");
+        response->setBody(string(favicon, sizeof favicon));
+    });
+    router_.get("/*filepath", handler("filepath"));
+    router_.put("/*filepath", [](const HttpRequest &, const HttpRouter::Params &, HttpResponse *response) {
+        // 走到这里说明上传未开启、路径非法或者请求没有 Content-Length
+        response->setStatusCode(HttpResponse::k403Forbidden);
+        response->setStatusMessage("Forbidden");
+        response->setCloseConnection(true);
+    });
+}
+
+void FileServer::setFileReadPool(ThreadPool *pool)
 {
-    if (conn->connected())
+    compressPool_ = pool;
+    if (server_)
     {
-        conn->setContext(HttpContext());
+        server_->setFileReadPool(pool);
     }
 }
 
-void FileServer::onMessage(const TcpConnectionPtr &conn,
-                           Buffer *buf,
-                           Timestamp receiveTime)
+void FileServer::start()
 {
-    HttpContext *context = boost::any_cast<HttpContext>(conn->getMutableContext());
+    assert(server_);
+    LOG_WARN << "FileServer[" << server_->name()
+             << "] starts listening on " << server_->ipPort();
+    server_->start();
+}
 
-    if (!context->parseRequest(buf, receiveTime))
-    {
-        conn->send("HTTP/1.1 400 Bad Request\r\n\r\n");
-        conn->shutdown();
-    }
-    if (context->gotAll())
+void FileServer::setMetrics(HttpMetrics *metrics, const string &path)
+{
+    // 静态路由优先于文件服务的通配路由
+    router_.get(path, metrics->handler());
+    if (server_)
     {
-        onRequest(conn, context->request());
-        context->reset();
+        metrics->addServer(server_.get());
     }
 }
 
-extern char favicon[555];
-void FileServer::onRequest(const TcpConnectionPtr &conn, const HttpRequest &req)
+HttpRouter::Handler FileServer::handler(const string &param)
 {
-    LOG_WARN << "Request : " << req.methodString() << " " << req.path();
-    if (req.getVersion() == HttpRequest::kHttp10)
-        LOG_WARN << "Http 1.0";
-    else
-        LOG_WARN << "Http 1.1";
-    const string &connection = req.getHeader("Connection");
-    bool close = connection == "close" ||
-                 (req.getVersion() == HttpRequest::kHttp10 && connection != "Keep-Alive");
-    HttpResponse response(close);
+    return [this, param](const HttpRequest &req, const HttpRouter::Params &params, HttpResponse *resp) {
+        serve("/" + params.get(param).as_string(), req, resp);
+    };
+}
 
-    // 网站图标
-    if (req.path() == "/favicon.ico")
+void FileServer::serve(const string &path, const HttpRequest &req, HttpResponse *resp)
+{
+    string normalized;
+    if (!detail::normalizePath(path, &normalized))
     {
-        response.setStatusCode(HttpResponse::k200Ok);
-        response.setStatusMessage("OK");
-        response.setContentType("image/png");
-        response.setBody(string(favicon, sizeof favicon));
+        LOG_WARN << "Reject path " << path;
+        resp->setStatusCode(HttpResponse::k403Forbidden);
+        resp->setStatusMessage("Forbidden");
+        return;
     }
-    else
-        setResponseBody(req, response);
+    setResponseBody(normalized, req, *resp);
+}
 
-    Buffer buf;
-    response.appendToBuffer(&buf);
-    conn->send(&buf);
-    if (response.needSendFile())
+HttpBodyHandler FileServer::onRequestHeaders(const TcpConnectionPtr &conn, const HttpRequest &req)
+{
+    HttpBodyHandler handler;
+    if (req.method() != HttpRequest::kPut || !uploadEnabled_)
     {
-        // 需要发送文件
-        int fd = response.getFd();
-        size_t needLen = static_cast<size_t>(response.getSendLen());
-        conn->sendFile(fd, needLen);
+        // 其他请求的实体很小，照旧缓存
+        return handler;
     }
-
-    if (response.closeConnection())
+    string relPath;
+    if (!detail::normalizePath(req.path(), &relPath) || relPath[relPath.size() - 1] == '/')
     {
-        conn->shutdown();
+        LOG_WARN << "Reject upload to " << req.path();
+        return handler;
     }
+    string path = workPath_ + relPath;
+    std::shared_ptr<detail::FileUploader> uploader(new detail::FileUploader(path, &fileCache_, &smallFileCache_));
+    handler.onData = std::bind(&detail::FileUploader::write, uploader, _1, _2);
+    handler.onComplete = std::bind(&detail::FileUploader::finish, uploader, _1, _2);
+    return handler;
+}
+
+void FileServer::onRequest(const HttpRequest &req, HttpResponse *response)
+{
+    LOG_WARN << "Request : " << req.methodString() << " " << req.path();
+    if (req.getVersion() == HttpRequest::kHttp10)
+        LOG_WARN << "Http 1.0";
+    else if (req.getVersion() == HttpRequest::kHttp20)
+        LOG_WARN << "Http 2";
+    else
+        LOG_WARN << "Http 1.1";
+    router_.dispatch(req, response);
 }
 
-void FileServer::setResponseBody(const HttpRequest &req, HttpResponse &res)
+void FileServer::setResponseBody(const string &relPath, const HttpRequest &req, HttpResponse &res)
 {
     // static const off64_t maxSendLen = 1024 * 1024 * 100;
-    string path = workPath_ + req.path();
+    string path = workPath_ + relPath;
     struct stat buffer;
-    if (stat(path.c_str(), &buffer) == 0)
+    FileHandlePtr file;
+    if (fileCache_.lookup(path, &buffer, &file))
     {
         if (S_ISDIR(buffer.st_mode))
         { // 目录
-            string list, html, show_path = path[0] == '.' ? path.substr(1) : path;
-            detail::scanDir(path, list);
-            html = R"(<!DOCTYPE HTML PUBLIC "-//W3C//DTD HTML 4.01//EN" "http://www.w3.org/TR/html4/strict.dtd">
-<html>
-<head>
-<meta http-equiv="Content-Type" content="text/html; charset=utf-8">
-<title>Directory listing for )" +
-                   show_path +
-                   R"(</title>
-</head>
-<body>
-<h1>Directory listing for )" +
-                   show_path +
-                   R"(</h1>
-<hr>
-<ul>)" +
-                   "\n" + list +
-                   R"(</ul>
-<hr>
-</body>
-</html>)";
+            string show_path = path[0] == '.' ? path.substr(1) : path;
+            DirCache::ListingPtr listing = dirCache_.get(path, show_path);
+            if (!listing)
+            {
+                res.setStatusCode(HttpResponse::k403Forbidden);
+                res.setStatusMessage("Forbidden");
+                return;
+            }
+            DirCache::Format format = detail::listingFormat(req);
+            size_t page = static_cast<size_t>(strtoul(detail::queryParam(req.query(), "page").c_str(), NULL, 10));
             res.setStatusCode(HttpResponse::k200Ok);
-            res.setContentType("text/html;charset=utf-8");
-            res.setBody(html);
+            res.setContentType(format == DirCache::kJson ? "application/json" : "text/html;charset=utf-8");
+            res.setBody(dirCache_.render(listing, show_path, format, page));
+        }
+        else if (S_ISREG(buffer.st_mode) && !file)
+        {
+            res.setStatusCode(HttpResponse::k403Forbidden);
+            res.setStatusMessage("Forbidden");
         }
         else if (S_ISREG(buffer.st_mode))
         { // 常规文件
-            int fd = ::open(path.c_str(), O_RDONLY);
-            // off64_t len = lseek(fd, 0, SEEK_END) - lseek(fd, 0, SEEK_SET);
-            off64_t len = buffer.st_size;
-            res.setFd(fd);
+            // 小文件命中时首部和内容都已就绪，不再查 MIME、生成 ETag 和格式化日期
+            if (serveSmallFile(path, buffer, req, res))
+                return;
 
             string suffix;
-            size_t pos = req.path().find_last_of('.');
-            if (pos != req.path().npos)
-                suffix = req.path().substr(pos);
+            size_t pos = relPath.find_last_of('.');
+            if (pos != relPath.npos)
+                suffix = relPath.substr(pos);
             else
                 suffix = "";
             LOG_DEBUG << "File suffix: " << suffix;
             string type = MimeType::getMime(suffix);
+            bool compressible = compressEnabled_ && compress::isCompressibleType(type);
+
+            // 304 也需要带上验证器和缓存策略
+            string etag = detail::makeETag(buffer, weakETag_);
+            res.addHeader(HttpResponse::kETag, etag);
+            res.addHeader(HttpResponse::kLastModified, detail::formatHttpDate(buffer.st_mtime));
+            const string &cacheControl = cacheControlFor(type);
+            if (!cacheControl.empty())
+                res.addHeader(HttpResponse::kCacheControl, cacheControl);
+            if (compressible)
+                res.addHeader(HttpResponse::kVary, "Accept-Encoding");
+            if (detail::notModified(req, etag, buffer.st_mtime))
+            {
+                res.setStatusCode(HttpResponse::k304NotModified);
+                res.setStatusMessage("Not Modified");
+                return;
+            }
+
             res.setContentType(type);
-            res.addHeader("Accept-Ranges", "bytes");
+            res.addHeader(HttpResponse::kAcceptRanges, "bytes");
 
             string range = req.getHeader("Range");
-            if (range != "")
+            if (!range.empty() && !detail::ifRangeMatches(req.getHeader("If-Range"), etag, buffer.st_mtime))
+            {
+                // 客户端手里的部分内容已经过期，发送完整文件
+                range.clear();
+            }
+            // 范围请求针对原始内容，不压缩
+            if (compressible && range.empty() && setCompressedBody(path, buffer, req, res))
+            {
+                cacheCompressedSmallFile(detail::smallFileKey(path, compress::negotiate(req.getHeader("Accept-Encoding"))),
+                                         buffer, res);
+                return;
+            }
+
+            off64_t len = buffer.st_size;
+            res.setFile(file, 0);
+            const StreamRateLimit *rateLimit = detail::matchMimeType(streamRateLimits_, type);
+            if (rateLimit)
+                res.setRateLimit(rateLimit->rate, rateLimit->burst);
+
+            std::vector<detail::ByteRange> ranges;
+            if (!range.empty() && detail::parseRanges(range, len, &ranges))
             {
-                res.setStatusCode(HttpResponse::k206Partitial);
-                res.setStatusMessage("Partial Content");
-
-                off64_t beg_num = 0, end_num = 0;
-                string range_value = req.getHeader("Range").substr(6);
-                pos = range_value.find("-");
-                string beg = range_value.substr(0, pos);
-                string end = range_value.substr(pos + 1);
-                if (beg != "" && end != "")
+                if (ranges.empty())
                 {
-                    beg_num = stoi(beg);
-                    end_num = stoi(end);
+                    res.setStatusCode(HttpResponse::k416RangeNotSatisfiable);
+                    res.setStatusMessage("Range Not Satisfiable");
+                    res.setFile(FileHandlePtr(), -1);
+                    res.setContentRange(-1, -1, len);
                 }
-                else if (beg != "" && end == "")
+                else if (ranges.size() == 1)
                 {
-                    beg_num = stoi(beg);
-                    end_num = len - 1;
+                    const detail::ByteRange &r = ranges[0];
+                    off64_t need_len = r.last - r.first + 1;
+                    res.setStatusCode(HttpResponse::k206Partitial);
+                    res.setStatusMessage("Partial Content");
+                    // 共享的 fd 不能 lseek，以显式偏移发送
+                    res.setFile(file, r.first);
+                    res.setSendLen(need_len);
+                    res.setContentLength(need_len);
+                    res.setContentRange(r.first, r.last, len);
+                    LOG_INFO << "bytes " << r.first << "-" << r.last << "/" << len;
                 }
-                else if (beg == "" && end != "")
+                else
                 {
-                    beg_num = len - stoi(end);
-                    end_num = len - 1;
+                    setMultipartRanges(ranges, len, type, res);
                 }
-
-                // 需要读need_len个字节
-                // off64_t need_len = std::min(end_num - beg_num + 1, maxSendLen);
-                off64_t need_len = end_num - beg_num + 1;
-                end_num = beg_num + need_len - 1;
-                lseek(fd, beg_num, SEEK_SET);
-                res.setSendLen(static_cast<int>(need_len));
-
-                std::ostringstream os_range;
-                os_range << "bytes " << beg_num << "-" << end_num << "/" << len;
-                res.addHeader("Content-Range", os_range.str());
-                res.addHeader("Content-Length", std::to_string(need_len));
-                LOG_INFO << os_range.str();
             }
             else
             {
                 res.setStatusCode(HttpResponse::k200Ok);
                 res.setStatusMessage("OK");
                 res.setSendLen(len);
-                res.addHeader("Content-Length", std::to_string(len));
+                res.setContentLength(len);
+                // 以客户端协商出的编码为键：不可压缩或太小的文件按原样缓存在该键下
+                compress::Encoding accepted = compressEnabled_ ? compress::negotiate(req.getHeader("Accept-Encoding"))
+                                                               : compress::kIdentity;
+                cacheSmallFile(detail::smallFileKey(path, accepted), buffer, file, res);
             }
         }
         else
@@ -324,6 +799,207 @@ void FileServer::setResponseBody(const HttpRequest &req, HttpResponse &res)
     }
 }
 
+/**
+ * 客户端接受压缩时：
+ *  1. gzip 且存在不旧于原文件的 path.gz，直接 sendfile 该文件
+ *  2. 否则读入并压缩原文件，结果按 路径/mtime/大小 缓存，之后的请求不再消耗 CPU
+ * 返回 false 时照常发送原文件
+ */
+bool FileServer::setCompressedBody(const string &path, const struct stat &st, const HttpRequest &req, HttpResponse &res)
+{
+    compress::Encoding encoding = compress::negotiate(req.getHeader("Accept-Encoding"));
+    if (encoding == compress::kIdentity)
+        return false;
+
+    if (encoding == compress::kGzip)
+    {
+        string gzPath = path + ".gz";
+        struct stat gzSt;
+        FileHandlePtr gzFile;
+        if (fileCache_.lookup(gzPath, &gzSt, &gzFile) && S_ISREG(gzSt.st_mode) && gzSt.st_mtime >= st.st_mtime)
+        {
+            if (gzFile)
+            {
+                res.setStatusCode(HttpResponse::k200Ok);
+                res.setStatusMessage("OK");
+                res.setFile(gzFile, 0);
+                res.setSendLen(gzSt.st_size);
+                res.setContentLength(gzSt.st_size);
+                res.addHeader(HttpResponse::kContentEncoding, "gzip");
+                res.addHeader(HttpResponse::kETag, detail::encodedETag(res.header(HttpResponse::kETag), "gzip"));
+                return true;
+            }
+        }
+    }
+
+    if (st.st_size < static_cast<off_t>(compress::kMinCompressSize) || st.st_size > detail::kMaxCompressFileSize)
+        return false;
+
+    int64_t mtime = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    CompressCache::DataPtr data = compressCache_->get(path, encoding, mtime, st.st_size);
+    if (!data && st.st_size > detail::kMaxInlineCompressSize)
+    {
+        // 不在 IO 线程中读入和压缩大文件：交给 pool 在后台压缩，这一次先发送原文件
+        if (compressPool_)
+        {
+            startCompress(path, encoding, mtime, st.st_size);
+        }
+        return false;
+    }
+    if (!data)
+    {
+        string content;
+        std::shared_ptr<string> compressed(new string);
+        if (!detail::readFile(path, static_cast<size_t>(st.st_size), &content) ||
+            !compress::compress(encoding, content.data(), content.size(), compressed.get()))
+        {
+            return false;
+        }
+        LOG_DEBUG << "Compressed " << path << " " << content.size() << " -> " << compressed->size();
+        data = compressed;
+        compressCache_->put(path, encoding, mtime, st.st_size, data);
+    }
+
+    res.setStatusCode(HttpResponse::k200Ok);
+    res.setStatusMessage("OK");
+    res.setBody(data);
+    res.addHeader(HttpResponse::kContentEncoding, compress::encodingName(encoding));
+    res.addHeader(HttpResponse::kETag, detail::encodedETag(res.header(HttpResponse::kETag), compress::encodingName(encoding)));
+    return true;
+}
+
+void FileServer::startCompress(const string &path, compress::Encoding encoding, int64_t mtime, int64_t size)
+{
+    string key = path;
+    key += '\0';
+    key += compress::encodingName(encoding);
+    {
+        MutexLockGuard lock(compressJobs_->mutex);
+        if (!compressJobs_->running.insert(key).second)
+            return;
+    }
+    std::shared_ptr<CompressCache> cache(compressCache_);
+    std::shared_ptr<detail::CompressJobs> jobs(compressJobs_);
+    compressPool_->run([cache, jobs, key, path, encoding, mtime, size]() {
+        string content;
+        std::shared_ptr<string> compressed(new string);
+        if (detail::readFile(path, static_cast<size_t>(size), &content) &&
+            compress::compress(encoding, content.data(), content.size(), compressed.get()))
+        {
+            LOG_DEBUG << "Compressed " << path << " " << content.size() << " -> " << compressed->size();
+            cache->put(path, encoding, mtime, size, compressed);
+        }
+        MutexLockGuard lock(jobs->mutex);
+        jobs->running.erase(key);
+    });
+}
+
+/**
+ * 小文件缓存只用于不带 Range 的 HTTP/1.x 请求，按 路径 + 协商出的编码 查找：
+ * 接受压缩的客户端命中压缩后的表示，条件请求命中时照常生成 304
+ */
+bool FileServer::serveSmallFile(const string &path, const struct stat &st, const HttpRequest &req, HttpResponse &res)
+{
+    if (req.getVersion() == HttpRequest::kHttp20 || st.st_size > static_cast<off_t>(smallFileCache_.maxFileSize()) ||
+        !req.getHeader("Range").empty())
+    {
+        return false;
+    }
+    compress::Encoding accepted = compressEnabled_ ? compress::negotiate(req.getHeader("Accept-Encoding"))
+                                                   : compress::kIdentity;
+    SmallFileCache::ContentPtr content = smallFileCache_.get(detail::smallFileKey(path, accepted), st);
+    if (!content || detail::notModified(req, content->etag, st.st_mtime))
+    {
+        return false;
+    }
+    res.setStatusCode(HttpResponse::k200Ok);
+    res.setStatusMessage("OK");
+    res.setEncodedHeaders(content->headers);
+    res.setBody(content->body);
+    return true;
+}
+
+/**
+ * 多个区间以 multipart/byteranges 发送，每段的头部在内存中生成，
+ * 文件内容按显式偏移 sendfile（HTTP/2 时 pread），不读入用户态缓冲区
+ */
+void FileServer::setMultipartRanges(const std::vector<detail::ByteRange> &ranges, off64_t size, const string &type, HttpResponse &res)
+{
+    const string boundary = detail::makeBoundary();
+    const string sizeString = std::to_string(size);
+    int64_t total = 0;
+    for (const detail::ByteRange &r : ranges)
+    {
+        string header = "\r\n--" + boundary + "\r\nContent-Type: " + type + "\r\nContent-Range: bytes " +
+                        std::to_string(r.first) + "-" + std::to_string(r.last) + "/" + sizeString + "\r\n\r\n";
+        off64_t length = r.last - r.first + 1;
+        total += static_cast<int64_t>(header.size()) + length;
+        res.addFilePart(header, r.first, length);
+    }
+    string closing = "\r\n--" + boundary + "--\r\n";
+    total += static_cast<int64_t>(closing.size());
+    res.addFilePart(closing, 0, 0);
+
+    res.setStatusCode(HttpResponse::k206Partitial);
+    res.setStatusMessage("Partial Content");
+    res.setContentType("multipart/byteranges; boundary=" + boundary);
+    res.setContentLength(total);
+    LOG_INFO << ranges.size() << " ranges, " << total << " bytes";
+}
+
+// 完整发送的小文件读入内存，本次响应和之后的命中都直接发送内存中的内容
+void FileServer::cacheSmallFile(const string &key, const struct stat &st, const FileHandlePtr &file, HttpResponse &res)
+{
+    const size_t size = static_cast<size_t>(st.st_size);
+    if (size > smallFileCache_.maxFileSize())
+        return;
+    std::shared_ptr<string> body(new string(size, '\0'));
+    size_t got = 0;
+    while (got < size)
+    {
+        ssize_t n = ::pread(file->fd(), &(*body)[got], size - got, static_cast<off_t>(got));
+        if (n <= 0)
+        {
+            if (n < 0 && errno == EINTR)
+                continue;
+            LOG_SYSERR << "FileServer read " << key.c_str();
+            return;
+        }
+        got += static_cast<size_t>(n);
+    }
+
+    std::shared_ptr<SmallFileCache::Content> content(new SmallFileCache::Content);
+    content->st = st;
+    content->etag = res.header(HttpResponse::kETag);
+    content->headers = std::make_shared<const string>(res.encodeHeaders());
+    content->body = body;
+    smallFileCache_.put(key, content);
+
+    res.setFile(FileHandlePtr(), -1);
+    res.setSendLen(0);
+    res.setBody(content->body);
+}
+
+// 压缩后的小文件连同 Content-Encoding、Vary 和编码后的 ETag 一起缓存，path.gz 的 sendfile 不缓存
+void FileServer::cacheCompressedSmallFile(const string &key, const struct stat &st, const HttpResponse &res)
+{
+    if (!res.sharedBody() || static_cast<size_t>(st.st_size) > smallFileCache_.maxFileSize())
+        return;
+    std::shared_ptr<SmallFileCache::Content> content(new SmallFileCache::Content);
+    content->st = st;
+    content->etag = res.header(HttpResponse::kETag);
+    content->headers = std::make_shared<const string>(res.encodeHeaders());
+    content->body = res.sharedBody();
+    smallFileCache_.put(key, content);
+}
+
+const string &FileServer::cacheControlFor(const string &type) const
+{
+    static const string kNone;
+    const string *value = detail::matchMimeType(cacheControl_, type);
+    return value ? *value : kNone;
+}
+
 char favicon[555] = {
     '\x89',
     'P',
@@ -1,8 +1,16 @@
 #ifndef MYMUDUO_HTTP_FILESERVER_H
 #define MYMUDUO_HTTP_FILESERVER_H
 
-#include "mymuduo/net/TcpServer.h"
+#include "mymuduo/http/HttpServer.h"
+#include "mymuduo/http/HttpRouter.h"
+#include "mymuduo/http/HttpCompress.h"
+#include "mymuduo/http/FileCache.h"
+#include "mymuduo/http/DirCache.h"
+
+#include <boost/scoped_ptr.hpp>
+#include <sys/stat.h>
 #include <map>
+#include <vector>
 
 namespace mymuduo
 {
@@ -10,6 +18,11 @@ namespace mymuduo
     {
         class HttpRequest;
         class HttpResponse;
+        namespace detail
+        {
+            struct ByteRange;
+            struct CompressJobs;
+        }
 
         class MimeType
         {
@@ -29,8 +42,19 @@ namespace mymuduo
         /**
          * 模仿 python http.server 实现的本地文件服务器
          * 支持文件下载范围请求，即 range 首部字段
+         * 支持 PUT 上传，实体数据边接收边写入磁盘，不在内存中缓存整个文件
+         * 支持 gzip/deflate：优先发送同名的 .gz 文件，否则压缩文本类型并缓存压缩结果
+         * 支持条件请求：ETag / Last-Modified 验证器，If-None-Match / If-Modified-Since 返回 304，
+         * If-Range 不匹配时忽略 Range 发送完整文件
+         * 打开的文件连同 stat 结果缓存在 FileCache 中，热点文件不再重复 stat/open，
+         * 并发的传输共享同一个 fd，以显式偏移 sendfile；
+         * 小文件的内容和编码好的首部缓存在内存中，HTTP/1.x 命中时一次 writev 发出整个响应
+         * 目录列表缓存在 DirCache 中，以 inotify 失效，支持分页（?page=N）和 JSON（?format=json）
          * 用户只需要设置工作路径即可
          */
+        // 也可以只作为处理函数挂载到其他 HttpServer 的路由上：
+        //   FileServer files("./www");
+        //   router.get("/static/*filepath", files.handler());
         class FileServer : noncopyable
         {
         public:
@@ -39,22 +63,102 @@ namespace mymuduo
                        const InetAddress &listenAddr,
                        const string &name,
                        TcpServer::Option option = TcpServer::kNoReusePort);
+            // 不监听端口，只提供 handler()/serve()
+            explicit FileServer(const string &path);
 
-            EventLoop *getLoop() const { return server_.getLoop(); }
+            EventLoop *getLoop() const { return server_->getLoop(); }
 
-            void setThreadNum(int numThreads) { server_.setThreadNum(numThreads); }
+            void setThreadNum(int numThreads) { server_->setThreadNum(numThreads); }
+            // 冷文件由 pool 读入页缓存后再 sendfile，见 HttpServer::setFileReadPool；
+            // 较大文件的压缩也交给 pool 在后台进行
+            void setFileReadPool(ThreadPool *pool);
+            // 首部与文件数据合并发送，见 HttpServer::setWriteCoalescing
+            void setWriteCoalescing(bool on) { server_->setWriteCoalescing(on); }
+            // 发送限速，见 HttpServer::setConnectionRateLimit
+            void setConnectionRateLimit(double bytesPerSecond, size_t burst) { server_->setConnectionRateLimit(bytesPerSecond, burst); }
+            void setClientRateLimit(double bytesPerSecond, size_t burst) { server_->setClientRateLimit(bytesPerSecond, burst); }
+            void setGlobalRateLimit(double bytesPerSecond, size_t burst) { server_->setGlobalRateLimit(bytesPerSecond, burst); }
+            // 按 MIME 类型对文件响应限速，匹配规则同 setCacheControl。
+            // 开始的 initialBurst 字节不限速，之后按 bytesPerSecond 发送，比如视频设置为码率的 1.2 倍，
+            // 突发量为几秒的数据，播放器缓冲之后不会占满上行带宽
+            void setStreamRateLimit(const string &mimeType, double bytesPerSecond, size_t initialBurst)
+            {
+                streamRateLimits_[mimeType] = StreamRateLimit{bytesPerSecond, initialBurst};
+            }
+            // 是否允许 PUT 上传，默认关闭
+            void setUploadEnabled(bool on) { uploadEnabled_ = on; }
+            // 是否按 Accept-Encoding 压缩文本文件，默认开启
+            void setCompressEnabled(bool on) { compressEnabled_ = on; }
+            // 压缩结果缓存的总大小上限，默认 64MB
+            void setCompressCacheSize(size_t bytes) { compressCache_->setMaxBytes(bytes); }
+            const CompressCache &compressCache() const { return *compressCache_; }
+            // 已打开文件缓存的有效期，过期后重新 stat 验证，默认 1 秒
+            void setFileCacheTtl(double seconds) { fileCache_.setTtl(seconds); }
+            const FileCache &fileCache() const { return fileCache_; }
+            // 不超过 maxFileSize 的文件缓存在内存中，总大小不超过 maxBytes，默认 32KB/32MB，maxFileSize 为 0 时关闭
+            void setSmallFileCache(size_t maxFileSize, size_t maxBytes) { smallFileCache_.setLimits(maxFileSize, maxBytes); }
+            const SmallFileCache &smallFileCache() const { return smallFileCache_; }
+            // 目录列表每页的条目数，默认 1000
+            void setDirListingPageSize(size_t entries) { dirCache_.setPageSize(entries); }
+            const DirCache &dirCache() const { return dirCache_; }
+            // 使用弱 ETag（W/"..."），默认为强 ETag，由 inode、大小和 mtime 生成
+            // 缓存的首部随之失效
+            void setWeakETag(bool on)
+            {
+                weakETag_ = on;
+                smallFileCache_.clear();
+            }
+            // 按 MIME 类型设置 Cache-Control，mimeType 可以是完整类型（"text/css"）、
+            // 主类型通配（"image/*"）或空串（其他所有类型），匹配时优先级依次降低
+            void setCacheControl(const string &mimeType, const string &value)
+            {
+                cacheControl_[mimeType] = value;
+                smallFileCache_.clear();
+            }
+            /// 路由表，可以在 start() 之前添加额外的路由，文件服务本身挂在根路径的通配路由上
+            HttpRouter &router() { return router_; }
+            /// 在 path 上挂载 metrics 的处理函数，并导出本服务器的统计。Not thread safe, 在 start() 之前调用
+            void setMetrics(HttpMetrics *metrics, const string &path = "/metrics");
             void start();
 
+            /// 返回可挂载到 HttpRouter 的处理函数，文件路径（相对工作路径）取自参数 param
+            HttpRouter::Handler handler(const string &param = "filepath");
+            /// 响应工作路径下 path 对应的文件或目录，path 以 '/' 开头；先规范化，含有 ".." 段时返回 403
+            void serve(const string &path, const HttpRequest &req, HttpResponse *resp);
+
         private:
-            void onMessage(const TcpConnectionPtr &conn,
-                           Buffer *buf,
-                           Timestamp receiveTime);
-            void onRequest(const TcpConnectionPtr &, const HttpRequest &);
-            void onConnection(const TcpConnectionPtr &conn);
-            void setResponseBody(const HttpRequest &, HttpResponse &);
+            void initRoutes();
+            void onRequest(const HttpRequest &, HttpResponse *);
+            HttpBodyHandler onRequestHeaders(const TcpConnectionPtr &, const HttpRequest &);
+            void setResponseBody(const string &path, const HttpRequest &, HttpResponse &);
+            bool setCompressedBody(const string &path, const struct stat &, const HttpRequest &, HttpResponse &);
+            void startCompress(const string &path, compress::Encoding encoding, int64_t mtime, int64_t size);
+            void setMultipartRanges(const std::vector<detail::ByteRange> &ranges, off64_t size, const string &type, HttpResponse &);
+            bool serveSmallFile(const string &path, const struct stat &, const HttpRequest &, HttpResponse &);
+            void cacheSmallFile(const string &key, const struct stat &, const FileHandlePtr &, HttpResponse &);
+            void cacheCompressedSmallFile(const string &key, const struct stat &, const HttpResponse &);
+            const string &cacheControlFor(const string &type) const;
 
             string workPath_;
-            TcpServer server_;
+            bool uploadEnabled_;
+            bool compressEnabled_;
+            // 后台压缩的任务也持有压缩缓存，FileServer 可以先于任务结束析构
+            std::shared_ptr<CompressCache> compressCache_;
+            std::shared_ptr<detail::CompressJobs> compressJobs_;
+            ThreadPool *compressPool_;
+            FileCache fileCache_;
+            SmallFileCache smallFileCache_;
+            DirCache dirCache_;
+            bool weakETag_;
+            std::map<string, string> cacheControl_;
+            struct StreamRateLimit
+            {
+                double rate;
+                size_t burst;
+            };
+            std::map<string, StreamRateLimit> streamRateLimits_;
+            HttpRouter router_;
+            boost::scoped_ptr<HttpServer> server_;
         };
     }
 }
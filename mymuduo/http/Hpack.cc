@@ -0,0 +1,558 @@
+#include "mymuduo/http/Hpack.h"
+
+#include "mymuduo/base/Logging.h"
+
+#include <string.h>
+
+using namespace mymuduo;
+using namespace mymuduo::net;
+
+namespace mymuduo
+{
+    namespace net
+    {
+        namespace detail
+        {
+            struct StaticEntry
+            {
+                const char *name;
+                const char *value;
+            };
+
+            // RFC 7541 Appendix A，下标 0 对应索引 1
+            const StaticEntry kStaticTable[hpack::kStaticTableSize] = {
+                {":authority", ""},
+                {":method", "GET"},
+                {":method", "POST"},
+                {":path", "/"},
+                {":path", "/index.html"},
+                {":scheme", "http"},
+                {":scheme", "https"},
+                {":status", "200"},
+                {":status", "204"},
+                {":status", "206"},
+                {":status", "304"},
+                {":status", "400"},
+                {":status", "404"},
+                {":status", "500"},
+                {"accept-charset", ""},
+                {"accept-encoding", "gzip, deflate"},
+                {"accept-language", ""},
+                {"accept-ranges", ""},
+                {"accept", ""},
+                {"access-control-allow-origin", ""},
+                {"age", ""},
+                {"allow", ""},
+                {"authorization", ""},
+                {"cache-control", ""},
+                {"content-disposition", ""},
+                {"content-encoding", ""},
+                {"content-language", ""},
+                {"content-length", ""},
+                {"content-location", ""},
+                {"content-range", ""},
+                {"content-type", ""},
+                {"cookie", ""},
+                {"date", ""},
+                {"etag", ""},
+                {"expect", ""},
+                {"expires", ""},
+                {"from", ""},
+                {"host", ""},
+                {"if-match", ""},
+                {"if-modified-since", ""},
+                {"if-none-match", ""},
+                {"if-range", ""},
+                {"if-unmodified-since", ""},
+                {"last-modified", ""},
+                {"link", ""},
+                {"location", ""},
+                {"max-forwards", ""},
+                {"proxy-authenticate", ""},
+                {"proxy-authorization", ""},
+                {"range", ""},
+                {"referer", ""},
+                {"refresh", ""},
+                {"retry-after", ""},
+                {"server", ""},
+                {"set-cookie", ""},
+                {"strict-transport-security", ""},
+                {"transfer-encoding", ""},
+                {"user-agent", ""},
+                {"vary", ""},
+                {"via", ""},
+                {"www-authenticate", ""},
+            };
+
+            struct HuffmanCode
+            {
+                uint32_t code; // 右对齐
+                int bits;
+            };
+
+            // RFC 7541 Appendix B，下标为符号，256 为 EOS
+            const HuffmanCode kHuffmanCodes[257] = {
+                {0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28},
+                {0xfffffe4, 28}, {0xfffffe5, 28}, {0xfffffe6, 28}, {0xfffffe7, 28},
+                {0xfffffe8, 28}, {0xffffea, 24}, {0x3ffffffc, 30}, {0xfffffe9, 28},
+                {0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28}, {0xfffffec, 28},
+                {0xfffffed, 28}, {0xfffffee, 28}, {0xfffffef, 28}, {0xffffff0, 28},
+                {0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28},
+                {0xffffff4, 28}, {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28},
+                {0xffffff8, 28}, {0xffffff9, 28}, {0xffffffa, 28}, {0xffffffb, 28},
+                {0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12},
+                {0x1ff9, 13}, {0x15, 6}, {0xf8, 8}, {0x7fa, 11},
+                {0x3fa, 10}, {0x3fb, 10}, {0xf9, 8}, {0x7fb, 11},
+                {0xfa, 8}, {0x16, 6}, {0x17, 6}, {0x18, 6},
+                {0x0, 5}, {0x1, 5}, {0x2, 5}, {0x19, 6},
+                {0x1a, 6}, {0x1b, 6}, {0x1c, 6}, {0x1d, 6},
+                {0x1e, 6}, {0x1f, 6}, {0x5c, 7}, {0xfb, 8},
+                {0x7ffc, 15}, {0x20, 6}, {0xffb, 12}, {0x3fc, 10},
+                {0x1ffa, 13}, {0x21, 6}, {0x5d, 7}, {0x5e, 7},
+                {0x5f, 7}, {0x60, 7}, {0x61, 7}, {0x62, 7},
+                {0x63, 7}, {0x64, 7}, {0x65, 7}, {0x66, 7},
+                {0x67, 7}, {0x68, 7}, {0x69, 7}, {0x6a, 7},
+                {0x6b, 7}, {0x6c, 7}, {0x6d, 7}, {0x6e, 7},
+                {0x6f, 7}, {0x70, 7}, {0x71, 7}, {0x72, 7},
+                {0xfc, 8}, {0x73, 7}, {0xfd, 8}, {0x1ffb, 13},
+                {0x7fff0, 19}, {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6},
+                {0x7ffd, 15}, {0x3, 5}, {0x23, 6}, {0x4, 5},
+                {0x24, 6}, {0x5, 5}, {0x25, 6}, {0x26, 6},
+                {0x27, 6}, {0x6, 5}, {0x74, 7}, {0x75, 7},
+                {0x28, 6}, {0x29, 6}, {0x2a, 6}, {0x7, 5},
+                {0x2b, 6}, {0x76, 7}, {0x2c, 6}, {0x8, 5},
+                {0x9, 5}, {0x2d, 6}, {0x77, 7}, {0x78, 7},
+                {0x79, 7}, {0x7a, 7}, {0x7b, 7}, {0x7ffe, 15},
+                {0x7fc, 11}, {0x3ffd, 14}, {0x1ffd, 13}, {0xffffffc, 28},
+                {0xfffe6, 20}, {0x3fffd2, 22}, {0xfffe7, 20}, {0xfffe8, 20},
+                {0x3fffd3, 22}, {0x3fffd4, 22}, {0x3fffd5, 22}, {0x7fffd9, 23},
+                {0x3fffd6, 22}, {0x7fffda, 23}, {0x7fffdb, 23}, {0x7fffdc, 23},
+                {0x7fffdd, 23}, {0x7fffde, 23}, {0xffffeb, 24}, {0x7fffdf, 23},
+                {0xffffec, 24}, {0xffffed, 24}, {0x3fffd7, 22}, {0x7fffe0, 23},
+                {0xffffee, 24}, {0x7fffe1, 23}, {0x7fffe2, 23}, {0x7fffe3, 23},
+                {0x7fffe4, 23}, {0x1fffdc, 21}, {0x3fffd8, 22}, {0x7fffe5, 23},
+                {0x3fffd9, 22}, {0x7fffe6, 23}, {0x7fffe7, 23}, {0xffffef, 24},
+                {0x3fffda, 22}, {0x1fffdd, 21}, {0xfffe9, 20}, {0x3fffdb, 22},
+                {0x3fffdc, 22}, {0x7fffe8, 23}, {0x7fffe9, 23}, {0x1fffde, 21},
+                {0x7fffea, 23}, {0x3fffdd, 22}, {0x3fffde, 22}, {0xfffff0, 24},
+                {0x1fffdf, 21}, {0x3fffdf, 22}, {0x7fffeb, 23}, {0x7fffec, 23},
+                {0x1fffe0, 21}, {0x1fffe1, 21}, {0x3fffe0, 22}, {0x1fffe2, 21},
+                {0x7fffed, 23}, {0x3fffe1, 22}, {0x7fffee, 23}, {0x7fffef, 23},
+                {0xfffea, 20}, {0x3fffe2, 22}, {0x3fffe3, 22}, {0x3fffe4, 22},
+                {0x7ffff0, 23}, {0x3fffe5, 22}, {0x3fffe6, 22}, {0x7ffff1, 23},
+                {0x3ffffe0, 26}, {0x3ffffe1, 26}, {0xfffeb, 20}, {0x7fff1, 19},
+                {0x3fffe7, 22}, {0x7ffff2, 23}, {0x3fffe8, 22}, {0x1ffffec, 25},
+                {0x3ffffe2, 26}, {0x3ffffe3, 26}, {0x3ffffe4, 26}, {0x7ffffde, 27},
+                {0x7ffffdf, 27}, {0x3ffffe5, 26}, {0xfffff1, 24}, {0x1ffffed, 25},
+                {0x7fff2, 19}, {0x1fffe3, 21}, {0x3ffffe6, 26}, {0x7ffffe0, 27},
+                {0x7ffffe1, 27}, {0x3ffffe7, 26}, {0x7ffffe2, 27}, {0xfffff2, 24},
+                {0x1fffe4, 21}, {0x1fffe5, 21}, {0x3ffffe8, 26}, {0x3ffffe9, 26},
+                {0xffffffd, 28}, {0x7ffffe3, 27}, {0x7ffffe4, 27}, {0x7ffffe5, 27},
+                {0xfffec, 20}, {0xfffff3, 24}, {0xfffed, 20}, {0x1fffe6, 21},
+                {0x3fffe9, 22}, {0x1fffe7, 21}, {0x1fffe8, 21}, {0x7ffff3, 23},
+                {0x3fffea, 22}, {0x3fffeb, 22}, {0x1ffffee, 25}, {0x1ffffef, 25},
+                {0xfffff4, 24}, {0xfffff5, 24}, {0x3ffffea, 26}, {0x7ffff4, 23},
+                {0x3ffffeb, 26}, {0x7ffffe6, 27}, {0x3ffffec, 26}, {0x3ffffed, 26},
+                {0x7ffffe7, 27}, {0x7ffffe8, 27}, {0x7ffffe9, 27}, {0x7ffffea, 27},
+                {0x7ffffeb, 27}, {0xffffffe, 28}, {0x7ffffec, 27}, {0x7ffffed, 27},
+                {0x7ffffee, 27}, {0x7ffffef, 27}, {0x7fffff0, 27}, {0x3ffffee, 26},
+                {0x3fffffff, 30},
+            };
+
+            const int kEos = 256;
+
+            /**
+             * 由码表构造的二叉解码树，叶子节点保存符号，
+             * 一次只走一位，解码只在收到首部时发生，简单可靠比查表更重要
+             */
+            class HuffmanTree : noncopyable
+            {
+            public:
+                struct Node
+                {
+                    int16_t child[2];
+                    int16_t symbol; // -1 表示内部节点
+                };
+
+                HuffmanTree()
+                {
+                    nodes_.push_back(Node{{-1, -1}, -1});
+                    for (int sym = 0; sym <= kEos; ++sym)
+                    {
+                        const HuffmanCode &hc = kHuffmanCodes[sym];
+                        size_t n = 0;
+                        for (int i = hc.bits - 1; i >= 0; --i)
+                        {
+                            int bit = (hc.code >> i) & 1;
+                            if (nodes_[n].child[bit] < 0)
+                            {
+                                nodes_[n].child[bit] = static_cast<int16_t>(nodes_.size());
+                                nodes_.push_back(Node{{-1, -1}, -1});
+                            }
+                            n = static_cast<size_t>(nodes_[n].child[bit]);
+                        }
+                        nodes_[n].symbol = static_cast<int16_t>(sym);
+                    }
+                }
+
+                const Node &node(size_t i) const { return nodes_[i]; }
+
+            private:
+                std::vector<Node> nodes_;
+            };
+
+            const HuffmanTree &huffmanTree()
+            {
+                static HuffmanTree tree;
+                return tree;
+            }
+
+            // 整数表示（RFC 7541 5.1），first 为前缀之外已经设置好的高位
+            void appendInteger(string *out, uint8_t first, int prefixBits, uint64_t value)
+            {
+                uint64_t max = (1u << prefixBits) - 1;
+                if (value < max)
+                {
+                    out->push_back(static_cast<char>(first | value));
+                    return;
+                }
+                out->push_back(static_cast<char>(first | max));
+                value -= max;
+                while (value >= 128)
+                {
+                    out->push_back(static_cast<char>((value & 0x7f) | 0x80));
+                    value >>= 7;
+                }
+                out->push_back(static_cast<char>(value));
+            }
+
+            bool decodeInteger(const uint8_t **p, const uint8_t *end, int prefixBits, uint64_t *value)
+            {
+                if (*p >= end)
+                    return false;
+                uint64_t max = (1u << prefixBits) - 1;
+                *value = **p & max;
+                ++*p;
+                if (*value < max)
+                    return true;
+                int shift = 0;
+                while (*p < end)
+                {
+                    uint8_t b = **p;
+                    ++*p;
+                    if (shift > 56)
+                        return false; // 溢出
+                    *value += static_cast<uint64_t>(b & 0x7f) << shift;
+                    shift += 7;
+                    if ((b & 0x80) == 0)
+                        return true;
+                }
+                return false;
+            }
+
+            void appendString(string *out, const StringPiece &str)
+            {
+                size_t huffLen = hpack::huffmanEncodedLength(str);
+                if (huffLen < static_cast<size_t>(str.size()))
+                {
+                    appendInteger(out, 0x80, 7, huffLen);
+                    hpack::huffmanEncode(str, out);
+                }
+                else
+                {
+                    appendInteger(out, 0, 7, static_cast<uint64_t>(str.size()));
+                    out->append(str.data(), str.size());
+                }
+            }
+
+            bool decodeString(const uint8_t **p, const uint8_t *end, string *out)
+            {
+                if (*p >= end)
+                    return false;
+                bool huffman = (**p & 0x80) != 0;
+                uint64_t len;
+                if (!decodeInteger(p, end, 7, &len) || len > static_cast<uint64_t>(end - *p))
+                    return false;
+                const char *data = reinterpret_cast<const char *>(*p);
+                *p += len;
+                if (huffman)
+                {
+                    out->clear();
+                    return hpack::huffmanDecode(data, static_cast<size_t>(len), out);
+                }
+                out->assign(data, static_cast<size_t>(len));
+                return true;
+            }
+        }
+    }
+}
+
+size_t hpack::huffmanEncodedLength(const StringPiece &in)
+{
+    size_t bits = 0;
+    for (int i = 0; i < in.size(); ++i)
+    {
+        bits += static_cast<size_t>(detail::kHuffmanCodes[static_cast<uint8_t>(in[i])].bits);
+    }
+    return (bits + 7) / 8;
+}
+
+void hpack::huffmanEncode(const StringPiece &in, string *out)
+{
+    uint64_t acc = 0; // 低 nbits 位为尚未输出的位
+    int nbits = 0;
+    for (int i = 0; i < in.size(); ++i)
+    {
+        const detail::HuffmanCode &hc = detail::kHuffmanCodes[static_cast<uint8_t>(in[i])];
+        acc = (acc << hc.bits) | hc.code;
+        nbits += hc.bits;
+        while (nbits >= 8)
+        {
+            nbits -= 8;
+            out->push_back(static_cast<char>(acc >> nbits));
+        }
+    }
+    if (nbits > 0)
+    {
+        // 用 EOS 的高位（全 1）填充
+        out->push_back(static_cast<char>((acc << (8 - nbits)) | (0xff >> nbits)));
+    }
+}
+
+bool hpack::huffmanDecode(const char *data, size_t len, string *out)
+{
+    const detail::HuffmanTree &tree = detail::huffmanTree();
+    size_t node = 0;
+    int depth = 0;       // 自上一个符号以来走过的位数
+    bool allOnes = true; // 这些位是否全为 1
+    for (size_t i = 0; i < len; ++i)
+    {
+        uint8_t byte = static_cast<uint8_t>(data[i]);
+        for (int b = 7; b >= 0; --b)
+        {
+            int bit = (byte >> b) & 1;
+            int16_t next = tree.node(node).child[bit];
+            if (next < 0)
+                return false;
+            node = static_cast<size_t>(next);
+            ++depth;
+            allOnes = allOnes && bit == 1;
+            int16_t sym = tree.node(node).symbol;
+            if (sym >= 0)
+            {
+                if (sym == detail::kEos)
+                    return false;
+                out->push_back(static_cast<char>(sym));
+                node = 0;
+                depth = 0;
+                allOnes = true;
+            }
+        }
+    }
+    // 末尾的填充必须是 EOS 的前缀，且不超过 7 位
+    return depth < 8 && allOnes;
+}
+
+void hpack::DynamicTable::add(const string &name, const string &value)
+{
+    Header h(name, value);
+    size_t sz = entrySize(h);
+    if (sz > maxSize_)
+    {
+        // 比整个表还大的条目会清空动态表，自身也不加入
+        entries_.clear();
+        size_ = 0;
+        return;
+    }
+    size_ += sz;
+    entries_.push_front(std::move(h));
+    evict();
+}
+
+void hpack::DynamicTable::setMaxSize(size_t maxSize)
+{
+    maxSize_ = maxSize;
+    evict();
+}
+
+void hpack::DynamicTable::evict()
+{
+    while (size_ > maxSize_ && !entries_.empty())
+    {
+        size_ -= entrySize(entries_.back());
+        entries_.pop_back();
+    }
+}
+
+HpackDecoder::HpackDecoder(size_t maxTableSize, size_t maxHeaderListSize)
+    : table_(maxTableSize),
+      maxTableSize_(maxTableSize),
+      maxHeaderListSize_(maxHeaderListSize)
+{
+}
+
+bool HpackDecoder::lookup(uint64_t index, hpack::Header *header) const
+{
+    if (index == 0)
+        return false;
+    if (index <= hpack::kStaticTableSize)
+    {
+        const detail::StaticEntry &e = detail::kStaticTable[index - 1];
+        header->first = e.name;
+        header->second = e.value;
+        return true;
+    }
+    index -= hpack::kStaticTableSize + 1;
+    if (index >= table_.count())
+        return false;
+    *header = table_.get(static_cast<size_t>(index));
+    return true;
+}
+
+bool HpackDecoder::decode(const char *data, size_t len, hpack::HeaderList *headers)
+{
+    const uint8_t *p = reinterpret_cast<const uint8_t *>(data);
+    const uint8_t *end = p + len;
+    size_t listSize = 0;
+    bool fieldSeen = false;
+    while (p < end)
+    {
+        uint8_t b = *p;
+        hpack::Header header;
+        uint64_t index;
+        if (b & 0x80)
+        {
+            // 索引字段
+            if (!detail::decodeInteger(&p, end, 7, &index) || !lookup(index, &header))
+            {
+                LOG_ERROR << "HpackDecoder invalid index";
+                return false;
+            }
+        }
+        else if ((b & 0xe0) == 0x20)
+        {
+            // 动态表大小更新，只能出现在首部块开头
+            if (fieldSeen || !detail::decodeInteger(&p, end, 5, &index) || index > maxTableSize_)
+            {
+                LOG_ERROR << "HpackDecoder invalid table size update";
+                return false;
+            }
+            table_.setMaxSize(static_cast<size_t>(index));
+            continue;
+        }
+        else
+        {
+            // 字面量：01 加入动态表，0000 不加入，0001 永不加入
+            bool indexing = (b & 0xc0) == 0x40;
+            int prefixBits = indexing ? 6 : 4;
+            if (!detail::decodeInteger(&p, end, prefixBits, &index))
+                return false;
+            if (index == 0)
+            {
+                if (!detail::decodeString(&p, end, &header.first))
+                    return false;
+            }
+            else
+            {
+                hpack::Header named;
+                if (!lookup(index, &named))
+                {
+                    LOG_ERROR << "HpackDecoder invalid name index";
+                    return false;
+                }
+                header.first.swap(named.first);
+            }
+            if (!detail::decodeString(&p, end, &header.second))
+                return false;
+            if (indexing)
+            {
+                table_.add(header.first, header.second);
+            }
+        }
+
+        fieldSeen = true;
+        listSize += hpack::DynamicTable::entrySize(header);
+        if (listSize > maxHeaderListSize_)
+        {
+            LOG_ERROR << "HpackDecoder header list too large";
+            return false;
+        }
+        headers->push_back(std::move(header));
+    }
+    return true;
+}
+
+HpackEncoder::HpackEncoder()
+    : sizeUpdatePending_(false)
+{
+}
+
+void HpackEncoder::setMaxTableSize(size_t maxSize)
+{
+    // 本端不需要比默认值更大的表
+    maxSize = std::min(maxSize, hpack::kDefaultTableSize);
+    if (maxSize != table_.maxSize())
+    {
+        table_.setMaxSize(maxSize);
+        sizeUpdatePending_ = true;
+    }
+}
+
+size_t HpackEncoder::find(const StringPiece &name, const StringPiece &value, size_t *nameIndex) const
+{
+    *nameIndex = 0;
+    for (size_t i = 0; i < hpack::kStaticTableSize; ++i)
+    {
+        const detail::StaticEntry &e = detail::kStaticTable[i];
+        if (name == e.name)
+        {
+            if (value == e.value)
+                return i + 1;
+            if (*nameIndex == 0)
+                *nameIndex = i + 1;
+        }
+    }
+    for (size_t i = 0; i < table_.count(); ++i)
+    {
+        const hpack::Header &h = table_.get(i);
+        if (name == h.first)
+        {
+            if (value == h.second)
+                return hpack::kStaticTableSize + 1 + i;
+            if (*nameIndex == 0)
+                *nameIndex = hpack::kStaticTableSize + 1 + i;
+        }
+    }
+    return 0;
+}
+
+void HpackEncoder::encode(const StringPiece &name, const StringPiece &value, string *out, bool indexing)
+{
+    if (sizeUpdatePending_)
+    {
+        detail::appendInteger(out, 0x20, 5, table_.maxSize());
+        sizeUpdatePending_ = false;
+    }
+
+    size_t nameIndex;
+    size_t index = find(name, value, &nameIndex);
+    if (index > 0)
+    {
+        detail::appendInteger(out, 0x80, 7, index);
+        return;
+    }
+
+    if (indexing)
+        detail::appendInteger(out, 0x40, 6, nameIndex);
+    else
+        detail::appendInteger(out, 0x00, 4, nameIndex);
+    if (nameIndex == 0)
+    {
+        detail::appendString(out, name);
+    }
+    detail::appendString(out, value);
+    if (indexing)
+    {
+        table_.add(name.as_string(), value.as_string());
+    }
+}
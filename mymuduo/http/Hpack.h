@@ -0,0 +1,110 @@
+#ifndef MYMUDUO_HTTP_HPACK_H
+#define MYMUDUO_HTTP_HPACK_H
+
+#include "mymuduo/base/copyable.h"
+#include "mymuduo/base/noncopyable.h"
+#include "mymuduo/base/StringPiece.h"
+#include "mymuduo/base/Types.h"
+
+#include <deque>
+#include <utility>
+#include <vector>
+
+namespace mymuduo
+{
+    namespace net
+    {
+        /**
+         * HTTP/2 首部压缩 HPACK（RFC 7541）
+         */
+        namespace hpack
+        {
+            typedef std::pair<string, string> Header; // name -> value，name 均为小写
+            typedef std::vector<Header> HeaderList;
+
+            /// 静态表的条目数，动态表的索引从 kStaticTableSize + 1 开始
+            const size_t kStaticTableSize = 61;
+            /// SETTINGS_HEADER_TABLE_SIZE 的默认值
+            const size_t kDefaultTableSize = 4096;
+
+            /// Huffman 编码后的字节数
+            size_t huffmanEncodedLength(const StringPiece &in);
+            void huffmanEncode(const StringPiece &in, string *out);
+            /// 填充位不合法或者包含 EOS 时返回 false
+            bool huffmanDecode(const char *data, size_t len, string *out);
+
+            /**
+             * 动态表，新条目插入表头，超过 maxSize 时从表尾淘汰，
+             * 条目大小按 name + value + 32 字节计算
+             */
+            class DynamicTable : public mymuduo::copyable
+            {
+            public:
+                explicit DynamicTable(size_t maxSize = kDefaultTableSize) : size_(0), maxSize_(maxSize) {}
+
+                void add(const string &name, const string &value);
+                void setMaxSize(size_t maxSize);
+                size_t maxSize() const { return maxSize_; }
+                size_t size() const { return size_; }
+                size_t count() const { return entries_.size(); }
+                /// i 从 0 开始，0 为最新的条目
+                const Header &get(size_t i) const { return entries_[i]; }
+
+                static size_t entrySize(const Header &h) { return h.first.size() + h.second.size() + 32; }
+
+            private:
+                void evict();
+
+                std::deque<Header> entries_;
+                size_t size_;
+                size_t maxSize_;
+            };
+        }
+
+        class HpackDecoder : noncopyable
+        {
+        public:
+            /// maxTableSize 为本端通过 SETTINGS_HEADER_TABLE_SIZE 公布的上限
+            explicit HpackDecoder(size_t maxTableSize = hpack::kDefaultTableSize,
+                                  size_t maxHeaderListSize = 64 * 1024);
+
+            /**
+             * 解码一个完整的首部块（HEADERS + CONTINUATION 拼接后的内容），追加到 headers，
+             * 出错返回 false，此时应当以 COMPRESSION_ERROR 关闭连接
+             */
+            bool decode(const char *data, size_t len, hpack::HeaderList *headers);
+
+        private:
+            bool lookup(uint64_t index, hpack::Header *header) const;
+
+            hpack::DynamicTable table_;
+            size_t maxTableSize_;
+            size_t maxHeaderListSize_;
+        };
+
+        class HpackEncoder : noncopyable
+        {
+        public:
+            HpackEncoder();
+
+            /// 对端 SETTINGS_HEADER_TABLE_SIZE 变化时调用，下一个首部块开头会带上表大小更新
+            void setMaxTableSize(size_t maxSize);
+
+            /**
+             * 编码一个首部字段追加到 out，name 必须为小写。
+             * 完全匹配时输出索引；否则输出字面量，indexing 为 true 时加入动态表，
+             * 取值经常变化的字段（如 content-length）应当传 false
+             */
+            void encode(const StringPiece &name, const StringPiece &value, string *out, bool indexing = true);
+
+        private:
+            // 返回完全匹配的索引，没有时 *nameIndex 为名字匹配的索引（都没有为 0）
+            size_t find(const StringPiece &name, const StringPiece &value, size_t *nameIndex) const;
+
+            hpack::DynamicTable table_;
+            bool sizeUpdatePending_;
+        };
+    }
+}
+
+#endif
@@ -0,0 +1,1211 @@
+#include "mymuduo/http/Http2Connection.h"
+
+#include "mymuduo/base/Logging.h"
+#include "mymuduo/base/ThreadPool.h"
+#include "mymuduo/http/HttpResponse.h"
+#include "mymuduo/net/Buffer.h"
+#include "mymuduo/net/EventLoop.h"
+#include "mymuduo/net/TcpConnection.h"
+
+#include <deque>
+#include <string.h>
+#include <unistd.h>
+
+using namespace mymuduo;
+using namespace mymuduo::net;
+
+namespace mymuduo
+{
+    namespace net
+    {
+        namespace detail
+        {
+            const uint32_t kMaxConcurrentStreams = 100;
+            const size_t kMaxHeaderListSize = 64 * 1024;
+            const size_t kMaxHeaderBlockSize = 256 * 1024;
+            const size_t kMaxRequestBodySize = 16 * 1024 * 1024;
+            // 连接级接收窗口，也就是所有流中还没有交给处理方的请求实体的总量上限，
+            // 不小于单个请求实体的上限，保证一个最大的请求总能收齐
+            const int64_t kConnectionWindowSize = static_cast<int64_t>(kMaxRequestBodySize);
+            // 输出缓冲区积压超过该值后暂停组装 DATA 帧
+            const size_t kOutputHighWaterMark = 64 * 1024;
+            // 每次检查页缓存的范围，与 TcpConnection 相同
+            const size_t kResidencyWindow = 1024 * 1024;
+
+            // 与 HttpResponse::HeaderName 一一对应，HTTP/2 的首部名必须小写
+            const char *const kResponseHeaderNames[HttpResponse::kNumHeaderNames] = {
+                "content-type",
+                "content-encoding",
+                "transfer-encoding",
+                "accept-ranges",
+                "cache-control",
+                "etag",
+                "last-modified",
+                "expires",
+                "location",
+                "allow",
+                "vary",
+                "server",
+            };
+
+            uint32_t readUint32(const char *p)
+            {
+                const uint8_t *u = reinterpret_cast<const uint8_t *>(p);
+                return static_cast<uint32_t>(u[0]) << 24 | static_cast<uint32_t>(u[1]) << 16 |
+                       static_cast<uint32_t>(u[2]) << 8 | static_cast<uint32_t>(u[3]);
+            }
+
+            void encodeFrameHeader(char *p, size_t length, http2::FrameType type, uint8_t flags, uint32_t streamId)
+            {
+                p[0] = static_cast<char>(length >> 16);
+                p[1] = static_cast<char>(length >> 8);
+                p[2] = static_cast<char>(length);
+                p[3] = static_cast<char>(type);
+                p[4] = static_cast<char>(flags);
+                p[5] = static_cast<char>((streamId >> 24) & 0x7f);
+                p[6] = static_cast<char>(streamId >> 16);
+                p[7] = static_cast<char>(streamId >> 8);
+                p[8] = static_cast<char>(streamId);
+            }
+
+            void appendRstStream(Buffer *buf, uint32_t streamId, http2::ErrorCode error)
+            {
+                http2::appendFrameHeader(buf, 4, http2::kRstStream, 0, streamId);
+                buf->appendInt32(static_cast<int32_t>(error));
+            }
+
+            // HTTP2-Settings 使用 base64url 编码，不带填充
+            bool base64UrlDecode(const string &in, string *out)
+            {
+                uint32_t acc = 0;
+                int bits = 0;
+                for (char c : in)
+                {
+                    int v;
+                    if (c >= 'A' && c <= 'Z')
+                        v = c - 'A';
+                    else if (c >= 'a' && c <= 'z')
+                        v = c - 'a' + 26;
+                    else if (c >= '0' && c <= '9')
+                        v = c - '0' + 52;
+                    else if (c == '-' || c == '+')
+                        v = 62;
+                    else if (c == '_' || c == '/')
+                        v = 63;
+                    else if (c == '=')
+                        break;
+                    else
+                        return false;
+                    acc = (acc << 6) | static_cast<uint32_t>(v);
+                    bits += 6;
+                    if (bits >= 8)
+                    {
+                        bits -= 8;
+                        out->push_back(static_cast<char>(acc >> bits));
+                    }
+                }
+                return true;
+            }
+
+            // accept-encoding -> Accept-Encoding，与 HTTP/1.x 的写法一致，处理函数不必区分协议
+            string canonicalHeaderName(const string &name)
+            {
+                string result(name);
+                bool upper = true;
+                for (char &c : result)
+                {
+                    if (upper && c >= 'a' && c <= 'z')
+                        c = static_cast<char>(c - 'a' + 'A');
+                    upper = c == '-';
+                }
+                return result;
+            }
+
+            // 连接级别的首部在 HTTP/2 中是非法的
+            bool isConnectionHeader(const string &name)
+            {
+                return ::strcasecmp(name.c_str(), "connection") == 0 ||
+                       ::strcasecmp(name.c_str(), "keep-alive") == 0 ||
+                       ::strcasecmp(name.c_str(), "proxy-connection") == 0 ||
+                       ::strcasecmp(name.c_str(), "transfer-encoding") == 0 ||
+                       ::strcasecmp(name.c_str(), "upgrade") == 0;
+            }
+        }
+    }
+}
+
+void http2::appendFrameHeader(Buffer *buf, size_t length, FrameType type, uint8_t flags, uint32_t streamId)
+{
+    char header[kFrameHeaderLength];
+    detail::encodeFrameHeader(header, length, type, flags, streamId);
+    buf->append(header, sizeof header);
+}
+
+struct Http2Connection::Stream
+{
+    Stream(uint32_t streamId, int64_t window)
+        : id(streamId),
+          method(HttpRequest::kInvalid),
+          headersReceived(false),
+          endStreamReceived(false),
+          dispatched(false),
+          sendWindow(window),
+          recvWindow(http2::kDefaultWindowSize),
+          recvConsumed(0),
+          bodyReceived(0),
+          bodyOffset(0),
+          fileOffset(0),
+          fileRemaining(0),
+          residentEnd(0),
+          prefetching(false),
+          dataRemaining(0),
+          dataPending(false),
+          dependency(0),
+          weight(http2::kDefaultWeight),
+          pass(0)
+    {
+    }
+
+    int64_t remaining() const { return dataRemaining; }
+    // 现在就可以组装 DATA 帧
+    bool sendable() const { return dataPending && !prefetching && sendWindow > 0; }
+
+    uint32_t id;
+    HttpRequest request;
+    HttpRequest::Method method; // request 交给处理方后仍需要知道是否为 HEAD
+    bool headersReceived;
+    bool endStreamReceived; // half-closed (remote)
+    bool dispatched;
+    int64_t sendWindow;
+    int64_t recvWindow;  // 对端在这个流上还可以发送的字节数
+    size_t recvConsumed; // 已经收下但还没有归还的流级窗口
+    size_t bodyReceived; // 从 DATA 帧收到、还没有交给处理方的实体字节数，占用连接级窗口
+
+    // 待发送的响应实体：先发送内存中的 body，再发送文件中的 [fileOffset, fileOffset + fileRemaining)，
+    // 多段实体依次从 parts 中取出下一段的 body 和文件区间
+    string body;
+    size_t bodyOffset;
+    FileHandlePtr file;
+    off64_t fileOffset;
+    int64_t fileRemaining;
+    off64_t residentEnd; // [fileOffset, residentEnd) 已确认在页缓存中
+    bool prefetching;    // 文件接下来的部分正在线程池中读入页缓存，期间不发送
+    std::deque<HttpResponse::FilePart> parts;
+    int64_t dataRemaining; // 实体中尚未发送的字节数
+    bool dataPending;
+
+    // 优先级：依赖的父流与权重，pass 为已经获得的加权带宽（越小越优先）
+    uint32_t dependency;
+    int weight;
+    uint64_t pass;
+};
+
+Http2Connection::Http2Connection(const TcpConnectionPtr &conn, const RequestCallback &cb)
+    : conn_(conn),
+      requestCallback_(cb),
+      decoder_(hpack::kDefaultTableSize, detail::kMaxHeaderListSize),
+      prefaceReceived_(false),
+      settingsSent_(false),
+      settingsReceived_(false),
+      goingAway_(false),
+      lastStreamId_(0),
+      continuationStream_(0),
+      continuationEndStream_(false),
+      peerInitialWindowSize_(http2::kDefaultWindowSize),
+      peerMaxFrameSize_(http2::kDefaultMaxFrameSize),
+      connSendWindow_(http2::kDefaultWindowSize),
+      connRecvWindow_(detail::kConnectionWindowSize),
+      connRecvConsumed_(0),
+      virtualTime_(0)
+{
+}
+
+Http2Connection::~Http2Connection() = default;
+
+void Http2Connection::sendSettings()
+{
+    if (settingsSent_)
+        return;
+    settingsSent_ = true;
+    Buffer buf;
+    http2::appendFrameHeader(&buf, 12, http2::kSettings, 0, 0);
+    buf.appendInt16(http2::kSettingsMaxConcurrentStreams);
+    buf.appendInt32(static_cast<int32_t>(detail::kMaxConcurrentStreams));
+    buf.appendInt16(http2::kSettingsMaxHeaderListSize);
+    buf.appendInt32(static_cast<int32_t>(detail::kMaxHeaderListSize));
+    // 连接级窗口不能通过 SETTINGS 调整，从默认的 64KB 扩大到 kConnectionWindowSize
+    http2::appendFrameHeader(&buf, 4, http2::kWindowUpdate, 0, 0);
+    buf.appendInt32(static_cast<int32_t>(detail::kConnectionWindowSize - http2::kDefaultWindowSize));
+    send(&buf);
+}
+
+bool Http2Connection::upgrade(const string &http2Settings, HttpRequest *req)
+{
+    string payload;
+    if (!detail::base64UrlDecode(http2Settings, &payload) || payload.size() % 6 != 0)
+    {
+        LOG_ERROR << "Http2Connection::upgrade invalid HTTP2-Settings";
+        return false;
+    }
+    sendSettings();
+    if (!applySettings(payload.data(), payload.size()))
+    {
+        return false;
+    }
+
+    // 升级前的请求成为流 1，处于 half-closed (remote) 状态
+    lastStreamId_ = 1;
+    Stream *stream = new Stream(1, peerInitialWindowSize_);
+    streams_[1].reset(stream);
+    stream->request.swap(*req);
+    stream->headersReceived = true;
+    stream->endStreamReceived = true;
+    dispatch(stream);
+    return true;
+}
+
+void Http2Connection::onMessage(Buffer *buf, Timestamp receiveTime)
+{
+    receiveTime_ = receiveTime;
+    if (goingAway_)
+    {
+        buf->retrieveAll();
+        return;
+    }
+
+    if (!prefaceReceived_)
+    {
+        size_t n = std::min(buf->readableBytes(), http2::kClientPrefaceLength);
+        if (memcmp(buf->peek(), http2::kClientPreface, n) != 0)
+        {
+            connectionError(http2::kProtocolError, "invalid connection preface");
+            buf->retrieveAll();
+            return;
+        }
+        if (n < http2::kClientPrefaceLength)
+        {
+            return;
+        }
+        buf->retrieve(n);
+        prefaceReceived_ = true;
+        sendSettings();
+    }
+
+    while (buf->readableBytes() >= http2::kFrameHeaderLength)
+    {
+        const uint8_t *p = reinterpret_cast<const uint8_t *>(buf->peek());
+        size_t length = static_cast<size_t>(p[0]) << 16 | static_cast<size_t>(p[1]) << 8 | p[2];
+        uint8_t type = p[3];
+        uint8_t flags = p[4];
+        uint32_t streamId = detail::readUint32(buf->peek() + 5) & 0x7fffffff;
+        if (length > http2::kDefaultMaxFrameSize)
+        {
+            // 本端没有调大 SETTINGS_MAX_FRAME_SIZE
+            connectionError(http2::kFrameSizeError, "frame too large");
+            buf->retrieveAll();
+            return;
+        }
+        if (buf->readableBytes() < http2::kFrameHeaderLength + length)
+        {
+            break;
+        }
+        bool ok = onFrame(type, flags, streamId, buf->peek() + http2::kFrameHeaderLength, length);
+        buf->retrieve(http2::kFrameHeaderLength + length);
+        if (!ok)
+        {
+            buf->retrieveAll();
+            return;
+        }
+    }
+}
+
+void Http2Connection::onWriteComplete()
+{
+    pumpData();
+}
+
+bool Http2Connection::onFrame(uint8_t type, uint8_t flags, uint32_t streamId, const char *payload, size_t length)
+{
+    if (!settingsReceived_ && type != http2::kSettings)
+    {
+        return connectionError(http2::kProtocolError, "expect SETTINGS");
+    }
+    if (continuationStream_ != 0 && type != http2::kContinuation)
+    {
+        return connectionError(http2::kProtocolError, "expect CONTINUATION");
+    }
+
+    switch (type)
+    {
+    case http2::kData:
+        return onData(flags, streamId, payload, length);
+    case http2::kHeaders:
+        return onHeaders(flags, streamId, payload, length);
+    case http2::kPriority:
+        return onPriority(streamId, payload, length);
+    case http2::kRstStream:
+        if (streamId == 0)
+            return connectionError(http2::kProtocolError, "RST_STREAM on stream 0");
+        if (length != 4)
+            return connectionError(http2::kFrameSizeError, "RST_STREAM size");
+        closeStream(streamId);
+        return true;
+    case http2::kSettings:
+        return onSettings(flags, streamId, payload, length);
+    case http2::kPushPromise:
+        return connectionError(http2::kProtocolError, "PUSH_PROMISE from client");
+    case http2::kPing:
+        if (streamId != 0)
+            return connectionError(http2::kProtocolError, "PING on stream");
+        if (length != 8)
+            return connectionError(http2::kFrameSizeError, "PING size");
+        if (!(flags & http2::kFlagAck))
+        {
+            Buffer buf;
+            http2::appendFrameHeader(&buf, 8, http2::kPing, http2::kFlagAck, 0);
+            buf.append(payload, length);
+            send(&buf);
+        }
+        return true;
+    case http2::kGoAway:
+        if (streamId != 0)
+            return connectionError(http2::kProtocolError, "GOAWAY on stream");
+        LOG_DEBUG << "GOAWAY received";
+        return true;
+    case http2::kWindowUpdate:
+        return onWindowUpdate(streamId, payload, length);
+    case http2::kContinuation:
+        return onContinuation(flags, streamId, payload, length);
+    default:
+        // 未知类型的帧必须忽略
+        return true;
+    }
+}
+
+bool Http2Connection::onHeaders(uint8_t flags, uint32_t streamId, const char *payload, size_t length)
+{
+    if (streamId == 0 || (streamId & 1) == 0)
+    {
+        return connectionError(http2::kProtocolError, "HEADERS on invalid stream");
+    }
+    const char *p = payload;
+    const char *end = payload + length;
+    size_t padding = 0;
+    if (flags & http2::kFlagPadded)
+    {
+        if (p == end)
+            return connectionError(http2::kFrameSizeError, "HEADERS padding");
+        padding = static_cast<uint8_t>(*p++);
+    }
+    bool hasPriority = (flags & http2::kFlagPriority) != 0;
+    uint32_t dependency = 0;
+    int weight = http2::kDefaultWeight;
+    if (hasPriority)
+    {
+        if (end - p < 5)
+            return connectionError(http2::kFrameSizeError, "HEADERS priority");
+        dependency = detail::readUint32(p) & 0x7fffffff;
+        weight = static_cast<uint8_t>(p[4]) + 1;
+        p += 5;
+    }
+    if (padding > static_cast<size_t>(end - p))
+    {
+        return connectionError(http2::kProtocolError, "HEADERS padding too large");
+    }
+    end -= padding;
+
+    StreamMap::iterator it = streams_.find(streamId);
+    if (it == streams_.end())
+    {
+        if (streamId <= lastStreamId_)
+        {
+            return connectionError(http2::kStreamClosed, "HEADERS on closed stream");
+        }
+        lastStreamId_ = streamId;
+        Stream *stream = new Stream(streamId, peerInitialWindowSize_);
+        streams_[streamId].reset(stream);
+        if (hasPriority)
+        {
+            setPriority(stream, dependency, weight);
+        }
+    }
+    else if (it->second->endStreamReceived)
+    {
+        return connectionError(http2::kStreamClosed, "HEADERS on half-closed stream");
+    }
+
+    headerBlock_.assign(p, end);
+    continuationEndStream_ = (flags & http2::kFlagEndStream) != 0;
+    if (flags & http2::kFlagEndHeaders)
+    {
+        return onHeaderBlock(streamId, continuationEndStream_);
+    }
+    continuationStream_ = streamId;
+    return true;
+}
+
+bool Http2Connection::onContinuation(uint8_t flags, uint32_t streamId, const char *payload, size_t length)
+{
+    if (streamId == 0 || streamId != continuationStream_)
+    {
+        return connectionError(http2::kProtocolError, "unexpected CONTINUATION");
+    }
+    headerBlock_.append(payload, length);
+    if (headerBlock_.size() > detail::kMaxHeaderBlockSize)
+    {
+        return connectionError(http2::kEnhanceYourCalm, "header block too large");
+    }
+    if (flags & http2::kFlagEndHeaders)
+    {
+        continuationStream_ = 0;
+        return onHeaderBlock(streamId, continuationEndStream_);
+    }
+    return true;
+}
+
+bool Http2Connection::onHeaderBlock(uint32_t streamId, bool endStream)
+{
+    // 即使流会被拒绝也必须解码，保持 HPACK 动态表与对端同步
+    hpack::HeaderList headers;
+    bool ok = decoder_.decode(headerBlock_.data(), headerBlock_.size(), &headers);
+    headerBlock_.clear();
+    if (!ok)
+    {
+        return connectionError(http2::kCompressionError, "HPACK decoding failed");
+    }
+
+    StreamMap::iterator it = streams_.find(streamId);
+    if (it == streams_.end())
+    {
+        return true;
+    }
+    Stream *stream = it->second.get();
+    if (stream->headersReceived)
+    {
+        // trailers，内容忽略
+        if (!endStream)
+        {
+            resetStream(streamId, http2::kProtocolError);
+            return true;
+        }
+        stream->endStreamReceived = true;
+        dispatch(stream);
+        return true;
+    }
+
+    if (streams_.size() > detail::kMaxConcurrentStreams)
+    {
+        resetStream(streamId, http2::kRefusedStream);
+        return true;
+    }
+    if (!buildRequest(stream, headers))
+    {
+        resetStream(streamId, http2::kProtocolError);
+        return true;
+    }
+    stream->headersReceived = true;
+    stream->endStreamReceived = endStream;
+
+    if (stream->request.method() == HttpRequest::kInvalid)
+    {
+        // 与 HTTP/1.x 的处理一致，不支持的方法返回 400
+        stream->dispatched = true;
+        HttpResponse response(false);
+        response.setStatusCode(HttpResponse::k400BadRequest);
+        sendResponse(streamId, response);
+        return true;
+    }
+    if (endStream)
+    {
+        dispatch(stream);
+    }
+    return true;
+}
+
+bool Http2Connection::buildRequest(Stream *stream, const hpack::HeaderList &headers)
+{
+    HttpRequest &req = stream->request;
+    bool regularSeen = false;
+    bool hasMethod = false;
+    bool hasPath = false;
+    for (const hpack::Header &h : headers)
+    {
+        const string &name = h.first;
+        const string &value = h.second;
+        if (!name.empty() && name[0] == ':')
+        {
+            // 伪首部必须在普通首部之前，且不能重复
+            if (regularSeen)
+                return false;
+            if (name == ":method")
+            {
+                if (hasMethod)
+                    return false;
+                hasMethod = true;
+                req.setMethod(value.data(), value.data() + value.size());
+            }
+            else if (name == ":path")
+            {
+                if (hasPath || value.empty())
+                    return false;
+                hasPath = true;
+                size_t question = value.find('?');
+                if (question != string::npos)
+                {
+                    req.setPath(value.data(), value.data() + question);
+                    // 与 HTTP/1.x 一致，query 带有开头的 '?'
+                    req.setQuery(value.data() + question, value.data() + value.size());
+                }
+                else
+                {
+                    req.setPath(value.data(), value.data() + value.size());
+                }
+            }
+            else if (name == ":authority")
+            {
+                string line = "Host:" + value;
+                req.addHeader(line.data(), line.data() + 4, line.data() + line.size());
+            }
+            else if (name != ":scheme")
+            {
+                return false;
+            }
+            continue;
+        }
+
+        regularSeen = true;
+        if (detail::isConnectionHeader(name))
+        {
+            return false;
+        }
+        string field = detail::canonicalHeaderName(name);
+        string combined = value;
+        if (field == "Cookie")
+        {
+            // HTTP/2 允许把 cookie 拆成多个字段，合并回一个
+            string existing = req.getHeader(field);
+            if (!existing.empty())
+                combined = existing + "; " + value;
+        }
+        string line = field + ":" + combined;
+        req.addHeader(line.data(), line.data() + field.size(), line.data() + line.size());
+    }
+    req.setVersion(HttpRequest::kHttp20);
+    req.setReceiveTime(receiveTime_);
+    return hasMethod && hasPath;
+}
+
+void Http2Connection::dispatch(Stream *stream)
+{
+    stream->dispatched = true;
+    stream->method = stream->request.method();
+    // 实体交给了处理方，它占用的连接级窗口可以归还
+    releaseConnectionWindow(stream->bodyReceived);
+    stream->bodyReceived = 0;
+    // 回调中可能同步发送完响应并删除流，之后不能再访问 stream
+    requestCallback_(shared_from_this(), stream->id, &stream->request);
+}
+
+bool Http2Connection::onData(uint8_t flags, uint32_t streamId, const char *payload, size_t length)
+{
+    if (streamId == 0)
+    {
+        return connectionError(http2::kProtocolError, "DATA on stream 0");
+    }
+    const char *p = payload;
+    const char *end = payload + length;
+    if (flags & http2::kFlagPadded)
+    {
+        if (p == end)
+            return connectionError(http2::kFrameSizeError, "DATA padding");
+        size_t padding = static_cast<uint8_t>(*p++);
+        if (padding > static_cast<size_t>(end - p))
+            return connectionError(http2::kProtocolError, "DATA padding too large");
+        end -= padding;
+    }
+
+    // 流量控制按整个帧长度计算（含填充）
+    if (static_cast<int64_t>(length) > connRecvWindow_)
+    {
+        return connectionError(http2::kFlowControlError, "DATA exceeds connection window");
+    }
+    connRecvWindow_ -= static_cast<int64_t>(length);
+
+    StreamMap::iterator it = streams_.find(streamId);
+    if (it == streams_.end())
+    {
+        if (streamId > lastStreamId_)
+            return connectionError(http2::kProtocolError, "DATA on idle stream");
+        // 已经关闭的流，丢弃
+        releaseConnectionWindow(length);
+        return true;
+    }
+    Stream *stream = it->second.get();
+    if (!stream->headersReceived || stream->endStreamReceived)
+    {
+        releaseConnectionWindow(length);
+        resetStream(streamId, http2::kStreamClosed);
+        return true;
+    }
+    if (static_cast<int64_t>(length) > stream->recvWindow)
+    {
+        releaseConnectionWindow(length);
+        resetStream(streamId, http2::kFlowControlError);
+        return true;
+    }
+    stream->recvWindow -= static_cast<int64_t>(length);
+    if (stream->dispatched)
+    {
+        // 已经以 400 响应，剩余实体丢弃
+        releaseConnectionWindow(length);
+        return true;
+    }
+
+    size_t dataLength = static_cast<size_t>(end - p);
+    if (stream->request.getBody().size() + dataLength > detail::kMaxRequestBodySize)
+    {
+        LOG_WARN << "Http2Connection stream " << streamId << " body too large";
+        releaseConnectionWindow(length);
+        resetStream(streamId, http2::kRefusedStream);
+        return true;
+    }
+    stream->request.appendBody(p, end);
+    // 填充立即归还，实体要等交给处理方之后
+    stream->bodyReceived += dataLength;
+    releaseConnectionWindow(length - dataLength);
+
+    if (flags & http2::kFlagEndStream)
+    {
+        stream->endStreamReceived = true;
+        dispatch(stream);
+    }
+    else
+    {
+        // 流级窗口攒够一半再归还，实体的总量由 kMaxRequestBodySize 限制
+        stream->recvConsumed += length;
+        if (stream->recvConsumed >= static_cast<size_t>(http2::kDefaultWindowSize / 2))
+        {
+            sendWindowUpdate(streamId, stream->recvConsumed);
+            stream->recvWindow += static_cast<int64_t>(stream->recvConsumed);
+            stream->recvConsumed = 0;
+        }
+    }
+    return true;
+}
+
+bool Http2Connection::onSettings(uint8_t flags, uint32_t streamId, const char *payload, size_t length)
+{
+    if (streamId != 0)
+    {
+        return connectionError(http2::kProtocolError, "SETTINGS on stream");
+    }
+    if (flags & http2::kFlagAck)
+    {
+        if (length != 0)
+            return connectionError(http2::kFrameSizeError, "SETTINGS ack with payload");
+        return true;
+    }
+    if (length % 6 != 0)
+    {
+        return connectionError(http2::kFrameSizeError, "SETTINGS size");
+    }
+    if (!applySettings(payload, length))
+    {
+        return false;
+    }
+    settingsReceived_ = true;
+
+    Buffer buf;
+    http2::appendFrameHeader(&buf, 0, http2::kSettings, http2::kFlagAck, 0);
+    send(&buf);
+    // 初始窗口可能变大
+    pumpData();
+    return true;
+}
+
+bool Http2Connection::applySettings(const char *payload, size_t length)
+{
+    for (size_t i = 0; i + 6 <= length; i += 6)
+    {
+        const uint8_t *p = reinterpret_cast<const uint8_t *>(payload + i);
+        int id = p[0] << 8 | p[1];
+        uint32_t value = detail::readUint32(payload + i + 2);
+        switch (id)
+        {
+        case http2::kSettingsHeaderTableSize:
+            encoder_.setMaxTableSize(value);
+            break;
+        case http2::kSettingsEnablePush:
+            if (value > 1)
+                return connectionError(http2::kProtocolError, "SETTINGS_ENABLE_PUSH");
+            break;
+        case http2::kSettingsInitialWindowSize:
+        {
+            if (value > http2::kMaxWindowSize)
+                return connectionError(http2::kFlowControlError, "SETTINGS_INITIAL_WINDOW_SIZE");
+            // 已经打开的流按差值调整发送窗口
+            int64_t delta = static_cast<int64_t>(value) - peerInitialWindowSize_;
+            for (auto &entry : streams_)
+            {
+                entry.second->sendWindow += delta;
+                if (entry.second->sendWindow > http2::kMaxWindowSize)
+                    return connectionError(http2::kFlowControlError, "stream window overflow");
+            }
+            peerInitialWindowSize_ = value;
+            break;
+        }
+        case http2::kSettingsMaxFrameSize:
+            if (value < http2::kDefaultMaxFrameSize || value > 0xffffff)
+                return connectionError(http2::kProtocolError, "SETTINGS_MAX_FRAME_SIZE");
+            peerMaxFrameSize_ = value;
+            break;
+        default:
+            break;
+        }
+    }
+    return true;
+}
+
+bool Http2Connection::onWindowUpdate(uint32_t streamId, const char *payload, size_t length)
+{
+    if (length != 4)
+    {
+        return connectionError(http2::kFrameSizeError, "WINDOW_UPDATE size");
+    }
+    int64_t increment = detail::readUint32(payload) & 0x7fffffff;
+    if (streamId == 0)
+    {
+        if (increment == 0)
+            return connectionError(http2::kProtocolError, "WINDOW_UPDATE increment 0");
+        connSendWindow_ += increment;
+        if (connSendWindow_ > http2::kMaxWindowSize)
+            return connectionError(http2::kFlowControlError, "connection window overflow");
+    }
+    else
+    {
+        StreamMap::iterator it = streams_.find(streamId);
+        if (it == streams_.end())
+            return true;
+        if (increment == 0)
+        {
+            resetStream(streamId, http2::kProtocolError);
+            return true;
+        }
+        it->second->sendWindow += increment;
+        if (it->second->sendWindow > http2::kMaxWindowSize)
+        {
+            resetStream(streamId, http2::kFlowControlError);
+            return true;
+        }
+    }
+    pumpData();
+    return true;
+}
+
+bool Http2Connection::onPriority(uint32_t streamId, const char *payload, size_t length)
+{
+    if (streamId == 0)
+    {
+        return connectionError(http2::kProtocolError, "PRIORITY on stream 0");
+    }
+    if (length != 5)
+    {
+        resetStream(streamId, http2::kFrameSizeError);
+        return true;
+    }
+    uint32_t dependency = detail::readUint32(payload) & 0x7fffffff;
+    int weight = static_cast<uint8_t>(payload[4]) + 1;
+    StreamMap::iterator it = streams_.find(streamId);
+    if (it != streams_.end())
+    {
+        setPriority(it->second.get(), dependency, weight);
+    }
+    return true;
+}
+
+void Http2Connection::setPriority(Stream *stream, uint32_t dependency, int weight)
+{
+    // 不实现独占标志（exclusive），只记录父流和权重
+    stream->dependency = dependency == stream->id ? 0 : dependency;
+    stream->weight = weight;
+}
+
+Http2Connection::Stream *Http2Connection::pickStream()
+{
+    Stream *best = NULL;
+    for (auto &entry : streams_)
+    {
+        Stream *stream = entry.second.get();
+        if (!stream->sendable())
+        {
+            continue;
+        }
+        // 父流（及更上层）还能发送时让路
+        bool blocked = false;
+        uint32_t dependency = stream->dependency;
+        for (int depth = 0; dependency != 0 && depth < 32; ++depth)
+        {
+            StreamMap::iterator parent = streams_.find(dependency);
+            if (parent == streams_.end())
+                break;
+            if (parent->second->sendable())
+            {
+                blocked = true;
+                break;
+            }
+            dependency = parent->second->dependency;
+        }
+        if (!blocked && (!best || stream->pass < best->pass))
+        {
+            best = stream;
+        }
+    }
+    return best;
+}
+
+void Http2Connection::pumpData()
+{
+    TcpConnectionPtr conn(conn_.lock());
+    if (!conn || !conn->connected() || goingAway_)
+    {
+        return;
+    }
+
+    Buffer out;
+    while (connSendWindow_ > 0 &&
+           conn->queuedBytes() + out.readableBytes() < detail::kOutputHighWaterMark)
+    {
+        Stream *stream = pickStream();
+        if (!stream)
+        {
+            break;
+        }
+        virtualTime_ = stream->pass;
+
+        int64_t remaining = stream->remaining();
+        size_t n = static_cast<size_t>(std::min(std::min(remaining, stream->sendWindow),
+                                                std::min(connSendWindow_, static_cast<int64_t>(peerMaxFrameSize_))));
+        out.ensureWritableBytes(http2::kFrameHeaderLength + n);
+        char *frame = out.beginWrite();
+        char *data = frame + http2::kFrameHeaderLength;
+        size_t filled = 0;
+        bool failed = false;
+        while (filled < n)
+        {
+            if (stream->bodyOffset < stream->body.size())
+            {
+                size_t chunk = std::min(n - filled, stream->body.size() - stream->bodyOffset);
+                memcpy(data + filled, stream->body.data() + stream->bodyOffset, chunk);
+                stream->bodyOffset += chunk;
+                filled += chunk;
+            }
+            else if (stream->fileRemaining > 0)
+            {
+                // 显式偏移读取，文件可能同时被其他连接共享
+                size_t chunk = static_cast<size_t>(std::min(static_cast<int64_t>(n - filled), stream->fileRemaining));
+                if (!fileResident(conn, stream, chunk))
+                {
+                    // 等待预读，已经填好的部分照常发出
+                    break;
+                }
+                ssize_t nr = ::pread(stream->file->fd(), data + filled, chunk, stream->fileOffset);
+                if (nr <= 0)
+                {
+                    failed = true;
+                    break;
+                }
+                stream->fileOffset += nr;
+                stream->fileRemaining -= nr;
+                filled += static_cast<size_t>(nr);
+            }
+            else if (!stream->parts.empty())
+            {
+                HttpResponse::FilePart &part = stream->parts.front();
+                stream->body.swap(part.header);
+                stream->bodyOffset = 0;
+                stream->fileOffset = part.offset;
+                stream->fileRemaining = part.length;
+                stream->residentEnd = part.offset;
+                stream->parts.pop_front();
+            }
+            else
+            {
+                failed = true;
+                break;
+            }
+        }
+        if (failed)
+        {
+            LOG_SYSERR << "Http2Connection read file for stream " << stream->id;
+            detail::appendRstStream(&out, stream->id, http2::kInternalError);
+            closeStream(stream->id);
+            continue;
+        }
+        n = filled;
+        if (n == 0)
+        {
+            // 流在等待预读，由 filePrefetched() 重新开始
+            continue;
+        }
+        stream->dataRemaining -= static_cast<int64_t>(n);
+
+        bool last = stream->remaining() == 0;
+        detail::encodeFrameHeader(frame, n, http2::kData, last ? http2::kFlagEndStream : 0, stream->id);
+        out.hasWritten(http2::kFrameHeaderLength + n);
+        stream->sendWindow -= static_cast<int64_t>(n);
+        connSendWindow_ -= static_cast<int64_t>(n);
+        // 步长与权重成反比，权重越大获得的带宽越多
+        stream->pass += (n * 256) / static_cast<size_t>(stream->weight) + 1;
+
+        if (last)
+        {
+            stream->dataPending = false;
+            finishStream(stream, &out);
+        }
+    }
+
+    if (out.readableBytes() > 0)
+    {
+        conn->send(&out);
+    }
+}
+
+/**
+ * 文件接下来的 want 字节不在页缓存中时交给 TcpConnection 的预读线程池读入，流暂停发送，
+ * 冷文件的磁盘读取不会阻塞 IO 线程上的其他连接。没有设置线程池时直接 pread
+ */
+bool Http2Connection::fileResident(const TcpConnectionPtr &conn, Stream *stream, size_t want)
+{
+    ThreadPool *pool = conn->fileReadPool();
+    if (!pool || stream->fileOffset + static_cast<off64_t>(want) <= stream->residentEnd)
+    {
+        return true;
+    }
+    size_t len = static_cast<size_t>(std::min(stream->fileRemaining, static_cast<int64_t>(std::max(want, detail::kResidencyWindow))));
+    off64_t end = stream->fileOffset + static_cast<off64_t>(len);
+    if (stream->file->isResident(stream->fileOffset, len))
+    {
+        stream->residentEnd = end;
+        return true;
+    }
+
+    conn->getLoop()->countColdFileRead();
+    stream->prefetching = true;
+    std::weak_ptr<Http2Connection> weakSelf(shared_from_this());
+    FileHandlePtr file = stream->file;
+    off64_t offset = stream->fileOffset;
+    uint32_t streamId = stream->id;
+    EventLoop *loop = conn->getLoop();
+    pool->run([weakSelf, file, offset, len, end, streamId, loop] {
+        file->readIntoPageCache(offset, len);
+        loop->queueInLoop([weakSelf, streamId, end] {
+            Http2ConnectionPtr self(weakSelf.lock());
+            if (self)
+                self->filePrefetched(streamId, end);
+        });
+    });
+    return false;
+}
+
+void Http2Connection::filePrefetched(uint32_t streamId, off64_t end)
+{
+    StreamMap::iterator it = streams_.find(streamId);
+    if (it == streams_.end())
+    {
+        return;
+    }
+    // 即使没有读满也不再检查这一段，由 pread 报告错误，避免反复预读
+    Stream *stream = it->second.get();
+    stream->prefetching = false;
+    stream->residentEnd = std::max(stream->residentEnd, end);
+    pumpData();
+}
+
+void Http2Connection::sendResponse(uint32_t streamId, const HttpResponse &response)
+{
+    StreamMap::iterator it = streams_.find(streamId);
+    if (it == streams_.end() || goingAway_)
+    {
+        return;
+    }
+    Stream *stream = it->second.get();
+
+    HttpResponse::HttpStatusCode status = response.statusCode();
+    bool hasFile = response.needSendFile();
+    int64_t length = !response.fileParts().empty() ? response.contentLength()
+                     : hasFile                     ? response.getSendLen()
+                                                   : static_cast<int64_t>(response.body().size());
+    bool bodyless = status == HttpResponse::k204NoContent || status == HttpResponse::k304NotModified;
+    bool noData = bodyless || stream->method == HttpRequest::kHead || length == 0;
+
+    string block;
+    encoder_.encode(":status", std::to_string(status == HttpResponse::kUnknown ? 500 : static_cast<int>(status)), &block);
+    if (response.sendDate())
+    {
+        // 去掉 "Date: " 和 "\r\n"
+        StringPiece date = HttpResponse::dateHeader();
+        encoder_.encode("date", StringPiece(date.data() + 6, date.size() - 8), &block);
+    }
+    if (!bodyless)
+    {
+        int64_t contentLength = response.contentLength() >= 0 ? response.contentLength() : length;
+        encoder_.encode("content-length", std::to_string(contentLength), &block, false);
+    }
+    int64_t begin, end, total;
+    if (response.contentRange(&begin, &end, &total))
+    {
+        string range = begin >= 0 ? "bytes " + std::to_string(begin) + "-" + std::to_string(end) + "/" + std::to_string(total)
+                                  : "bytes */" + std::to_string(total);
+        encoder_.encode("content-range", range, &block, false);
+    }
+    for (int i = 0; i < HttpResponse::kNumHeaderNames; ++i)
+    {
+        const string &value = response.header(static_cast<HttpResponse::HeaderName>(i));
+        if (!value.empty() && i != HttpResponse::kTransferEncoding)
+        {
+            encoder_.encode(detail::kResponseHeaderNames[i], value, &block);
+        }
+    }
+    for (const HttpResponse::Header &h : response.headers())
+    {
+        if (detail::isConnectionHeader(h.first))
+            continue;
+        string name(h.first);
+        for (char &c : name)
+        {
+            c = static_cast<char>(::tolower(c));
+        }
+        encoder_.encode(name, h.second, &block);
+    }
+
+    // 首部块超过帧大小时拆成 HEADERS + CONTINUATION
+    Buffer out;
+    size_t offset = 0;
+    do
+    {
+        size_t n = std::min(block.size() - offset, peerMaxFrameSize_);
+        bool lastFrame = offset + n == block.size();
+        uint8_t flags = lastFrame ? http2::kFlagEndHeaders : 0;
+        if (offset == 0 && noData)
+        {
+            flags = static_cast<uint8_t>(flags | http2::kFlagEndStream);
+        }
+        http2::appendFrameHeader(&out, n, offset == 0 ? http2::kHeaders : http2::kContinuation, flags, streamId);
+        out.append(block.data() + offset, n);
+        offset += n;
+    } while (offset < block.size());
+
+    if (noData)
+    {
+        finishStream(stream, &out);
+        send(&out);
+        return;
+    }
+
+    stream->body.clear();
+    stream->bodyOffset = 0;
+    stream->fileRemaining = 0;
+    stream->dataRemaining = length;
+    if (!response.fileParts().empty())
+    {
+        stream->file = response.file();
+        stream->parts.assign(response.fileParts().begin(), response.fileParts().end());
+    }
+    else if (hasFile)
+    {
+        stream->file = response.file();
+        stream->fileOffset = response.fileOffset();
+        stream->fileRemaining = length;
+        stream->residentEnd = stream->fileOffset;
+    }
+    else
+    {
+        stream->body = response.body();
+    }
+    stream->dataPending = true;
+    stream->pass = std::max(stream->pass, virtualTime_);
+    send(&out);
+    pumpData();
+}
+
+void Http2Connection::finishStream(Stream *stream, Buffer *out)
+{
+    // 响应已经发完，对端还没有结束请求时用 NO_ERROR 重置，让它停止发送
+    if (!stream->endStreamReceived)
+    {
+        detail::appendRstStream(out, stream->id, http2::kNoError);
+    }
+    closeStream(stream->id);
+}
+
+void Http2Connection::closeStream(uint32_t streamId)
+{
+    StreamMap::iterator it = streams_.find(streamId);
+    if (it != streams_.end())
+    {
+        // 没有交给处理方的实体随流一起丢弃
+        releaseConnectionWindow(it->second->bodyReceived);
+        streams_.erase(it);
+    }
+}
+
+void Http2Connection::resetStream(uint32_t streamId, http2::ErrorCode error)
+{
+    LOG_DEBUG << "Http2Connection reset stream " << streamId << " error " << error;
+    Buffer buf;
+    detail::appendRstStream(&buf, streamId, error);
+    send(&buf);
+    closeStream(streamId);
+}
+
+void Http2Connection::sendWindowUpdate(uint32_t streamId, size_t increment)
+{
+    Buffer buf;
+    http2::appendFrameHeader(&buf, 4, http2::kWindowUpdate, 0, streamId);
+    buf.appendInt32(static_cast<int32_t>(increment));
+    send(&buf);
+}
+
+/**
+ * 已经收下的 DATA 被处理（实体交给处理方，或者丢弃）之后归还连接级窗口，攒够半个窗口才发送一次 WINDOW_UPDATE。
+ * 处理方跟不上时窗口逐渐耗尽，对端只能等待，积压的请求实体不超过 kConnectionWindowSize
+ */
+void Http2Connection::releaseConnectionWindow(size_t n)
+{
+    connRecvConsumed_ += n;
+    if (connRecvConsumed_ >= static_cast<size_t>(detail::kConnectionWindowSize / 2) && !goingAway_)
+    {
+        sendWindowUpdate(0, connRecvConsumed_);
+        connRecvWindow_ += static_cast<int64_t>(connRecvConsumed_);
+        connRecvConsumed_ = 0;
+    }
+}
+
+bool Http2Connection::connectionError(http2::ErrorCode error, const char *reason)
+{
+    LOG_ERROR << "Http2Connection error " << error << ": " << reason;
+    if (!goingAway_)
+    {
+        goingAway_ = true;
+        Buffer buf;
+        http2::appendFrameHeader(&buf, 8, http2::kGoAway, 0, 0);
+        buf.appendInt32(static_cast<int32_t>(lastStreamId_));
+        buf.appendInt32(static_cast<int32_t>(error));
+        send(&buf);
+        TcpConnectionPtr conn(conn_.lock());
+        if (conn)
+        {
+            conn->shutdown();
+        }
+    }
+    return false;
+}
+
+void Http2Connection::send(Buffer *buf)
+{
+    TcpConnectionPtr conn(conn_.lock());
+    if (conn)
+    {
+        conn->send(buf);
+    }
+}
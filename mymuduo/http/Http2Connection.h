@@ -0,0 +1,190 @@
+#ifndef MYMUDUO_HTTP_HTTP2CONNECTION_H
+#define MYMUDUO_HTTP_HTTP2CONNECTION_H
+
+#include "mymuduo/base/noncopyable.h"
+#include "mymuduo/http/Hpack.h"
+#include "mymuduo/http/HttpRequest.h"
+#include "mymuduo/net/Callbacks.h"
+
+#include <functional>
+#include <map>
+#include <memory>
+
+namespace mymuduo
+{
+    namespace net
+    {
+        class Buffer;
+        class HttpResponse;
+
+        /**
+         * HTTP/2（RFC 7540）的帧格式与常量
+         */
+        namespace http2
+        {
+            enum FrameType
+            {
+                kData = 0x0,
+                kHeaders = 0x1,
+                kPriority = 0x2,
+                kRstStream = 0x3,
+                kSettings = 0x4,
+                kPushPromise = 0x5,
+                kPing = 0x6,
+                kGoAway = 0x7,
+                kWindowUpdate = 0x8,
+                kContinuation = 0x9,
+            };
+
+            enum FrameFlag
+            {
+                kFlagEndStream = 0x1,
+                kFlagAck = 0x1,
+                kFlagEndHeaders = 0x4,
+                kFlagPadded = 0x8,
+                kFlagPriority = 0x20,
+            };
+
+            enum ErrorCode
+            {
+                kNoError = 0x0,
+                kProtocolError = 0x1,
+                kInternalError = 0x2,
+                kFlowControlError = 0x3,
+                kSettingsTimeout = 0x4,
+                kStreamClosed = 0x5,
+                kFrameSizeError = 0x6,
+                kRefusedStream = 0x7,
+                kCancel = 0x8,
+                kCompressionError = 0x9,
+                kConnectError = 0xa,
+                kEnhanceYourCalm = 0xb,
+            };
+
+            enum SettingsId
+            {
+                kSettingsHeaderTableSize = 0x1,
+                kSettingsEnablePush = 0x2,
+                kSettingsMaxConcurrentStreams = 0x3,
+                kSettingsInitialWindowSize = 0x4,
+                kSettingsMaxFrameSize = 0x5,
+                kSettingsMaxHeaderListSize = 0x6,
+            };
+
+            /// 客户端连接前言，prior knowledge 方式下连接上的第一段数据
+            const char kClientPreface[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+            const size_t kClientPrefaceLength = sizeof kClientPreface - 1;
+            const size_t kFrameHeaderLength = 9;
+            const int64_t kDefaultWindowSize = 65535;
+            const int64_t kMaxWindowSize = 0x7fffffff;
+            const size_t kDefaultMaxFrameSize = 16384;
+            const int kDefaultWeight = 16;
+
+            /// 写入 9 字节的帧头
+            void appendFrameHeader(Buffer *buf, size_t length, FrameType type, uint8_t flags, uint32_t streamId);
+        }
+
+        class Http2Connection;
+        typedef std::shared_ptr<Http2Connection> Http2ConnectionPtr;
+
+        /**
+         * 一条 TcpConnection 上的 HTTP/2 会话，保存在 HttpContext 中，只在 IO 线程中使用
+         *
+         * 请求的 HEADERS/DATA 在各自的流上交错到达，某个流接收完毕后通过 RequestCallback
+         * 交给 HttpServer，处理完成后（可以是异步的）调用 sendResponse()。
+         * 响应实体（内存或文件）按流排队，只在对端流量控制窗口允许时发送 DATA 帧：
+         * 依赖的父流还有数据时子流等待，同级的流按权重分配带宽。
+         * 输出缓冲区积压超过高水位后停止组帧，等 WriteComplete 再继续，
+         * 大文件不会被一次读进内存，TcpConnection 设置了预读线程池时冷文件先在线程池中读入页缓存。
+         * 请求实体收齐后才交给处理方，连接级接收窗口在实体交出之后才归还，
+         * 所有流积压的请求实体合计不超过 16MB
+         */
+        class Http2Connection : noncopyable,
+                                public std::enable_shared_from_this<Http2Connection>
+        {
+        public:
+            typedef std::function<void(const Http2ConnectionPtr &, uint32_t streamId, HttpRequest *)> RequestCallback;
+
+            Http2Connection(const TcpConnectionPtr &conn, const RequestCallback &cb);
+            ~Http2Connection();
+
+            TcpConnectionPtr connection() const { return conn_.lock(); }
+
+            /**
+             * h2c Upgrade：101 已经发出，http2Settings 为请求中 HTTP2-Settings 首部的值，
+             * 原请求作为流 1 处理。格式错误返回 false
+             */
+            bool upgrade(const string &http2Settings, HttpRequest *req);
+
+            /// 处理输入缓冲区中的数据，协议错误时发送 GOAWAY 并关闭连接
+            void onMessage(Buffer *buf, Timestamp receiveTime);
+            /// 输出缓冲区写空后继续发送排队的 DATA 帧
+            void onWriteComplete();
+
+            /**
+             * 发送流 streamId 的响应，必须在 IO 线程调用。
+             * 流已经被对端重置时丢弃响应
+             */
+            void sendResponse(uint32_t streamId, const HttpResponse &response);
+
+            size_t numStreams() const { return streams_.size(); }
+
+        private:
+            struct Stream;
+            typedef std::map<uint32_t, std::unique_ptr<Stream>> StreamMap;
+
+            void sendSettings();
+            bool onFrame(uint8_t type, uint8_t flags, uint32_t streamId, const char *payload, size_t length);
+            bool onHeaders(uint8_t flags, uint32_t streamId, const char *payload, size_t length);
+            bool onContinuation(uint8_t flags, uint32_t streamId, const char *payload, size_t length);
+            bool onHeaderBlock(uint32_t streamId, bool endStream);
+            bool onData(uint8_t flags, uint32_t streamId, const char *payload, size_t length);
+            bool onSettings(uint8_t flags, uint32_t streamId, const char *payload, size_t length);
+            bool applySettings(const char *payload, size_t length);
+            bool onWindowUpdate(uint32_t streamId, const char *payload, size_t length);
+            bool onPriority(uint32_t streamId, const char *payload, size_t length);
+
+            bool buildRequest(Stream *stream, const hpack::HeaderList &headers);
+            void dispatch(Stream *stream);
+            void setPriority(Stream *stream, uint32_t dependency, int weight);
+            Stream *pickStream();
+            void pumpData();
+            // 流的文件接下来的 want 字节是否在页缓存中，不在时开始预读并返回 false
+            bool fileResident(const TcpConnectionPtr &conn, Stream *stream, size_t want);
+            void filePrefetched(uint32_t streamId, off64_t end);
+            void finishStream(Stream *stream, Buffer *out);
+            void closeStream(uint32_t streamId);
+            void resetStream(uint32_t streamId, http2::ErrorCode error);
+            void sendWindowUpdate(uint32_t streamId, size_t increment);
+            // n 字节的 DATA 处理完毕，按批归还连接级接收窗口
+            void releaseConnectionWindow(size_t n);
+            bool connectionError(http2::ErrorCode error, const char *reason);
+            void send(Buffer *buf);
+
+            std::weak_ptr<TcpConnection> conn_;
+            RequestCallback requestCallback_;
+            HpackDecoder decoder_;
+            HpackEncoder encoder_;
+            StreamMap streams_;
+
+            bool prefaceReceived_;
+            bool settingsSent_;
+            bool settingsReceived_;
+            bool goingAway_;
+            uint32_t lastStreamId_;       // 已经接受的最大的客户端流 ID
+            uint32_t continuationStream_; // 非 0 表示首部块未结束，只能接收该流的 CONTINUATION
+            bool continuationEndStream_;
+            string headerBlock_;          // 拼接中的首部块
+
+            int64_t peerInitialWindowSize_; // 对端 SETTINGS_INITIAL_WINDOW_SIZE
+            size_t peerMaxFrameSize_;       // 对端 SETTINGS_MAX_FRAME_SIZE
+            int64_t connSendWindow_;        // 连接级发送窗口
+            int64_t connRecvWindow_;        // 连接级接收窗口：对端还可以发送的 DATA 字节数
+            size_t connRecvConsumed_;       // 已经处理但还没有归还的连接级接收窗口
+            uint64_t virtualTime_;          // 加权调度的全局虚拟时间
+            Timestamp receiveTime_;
+        };
+    }
+}
+
+#endif
@@ -0,0 +1,189 @@
+#include "mymuduo/http/HttpAsyncResponse.h"
+
+#include "mymuduo/base/Logging.h"
+#include "mymuduo/http/HttpCompress.h"
+#include "mymuduo/net/EventLoop.h"
+#include "mymuduo/net/TcpConnection.h"
+
+#include <stdio.h>
+
+using namespace mymuduo;
+using namespace mymuduo::net;
+
+HttpAsyncResponse::HttpAsyncResponse(EventLoop *loop,
+                                     const TcpConnectionPtr &conn,
+                                     bool close,
+                                     const CompleteCallback &cb)
+    : loop_(loop),
+      conn_(conn),
+      response_(close),
+      completeCallback_(cb),
+      finished_(false),
+      streamable_(false),
+      streamState_(kNoStream),
+      streamChunked_(false),
+      streamBodyless_(false),
+      streamFlushed_(false)
+{
+}
+
+HttpAsyncResponse::~HttpAsyncResponse()
+{
+    if (done_.get() == 0)
+    {
+        // 处理方没有调用 done()，同一连接上后续的响应都会被阻塞
+        LOG_ERROR << "HttpAsyncResponse for " << request_.methodString() << " "
+                  << request_.path() << " destroyed without done()";
+    }
+    else if (streamState_ == kStreaming)
+    {
+        LOG_ERROR << "HttpAsyncResponse for " << request_.methodString() << " "
+                  << request_.path() << " destroyed without endStream()";
+    }
+}
+
+void HttpAsyncResponse::done()
+{
+    if (done_.getAndSet(1) == 0)
+    {
+        // 压缩在调用 done() 的线程中完成，不占用 IO 线程
+        compress::compressResponse(request_, &response_);
+        // 同一线程时直接执行，否则排队并唤醒 IO 线程
+        loop_->runInLoop(std::bind(&HttpAsyncResponse::finishInLoop, shared_from_this()));
+    }
+}
+
+void HttpAsyncResponse::finishInLoop()
+{
+    loop_->assertInLoopThread();
+    finished_ = true;
+    if (completeCallback_)
+    {
+        completeCallback_(shared_from_this());
+    }
+}
+
+void HttpAsyncResponse::startStream()
+{
+    loop_->assertInLoopThread();
+    if (!streamable_)
+    {
+        // 退化为普通响应，write() 的数据进入实体
+        return;
+    }
+    if (done_.getAndSet(1) != 0)
+    {
+        LOG_ERROR << "HttpAsyncResponse::startStream after done()";
+        return;
+    }
+    int code = response_.statusCode();
+    streamBodyless_ = request_.method() == HttpRequest::kHead || code < HttpResponse::k200Ok ||
+                      code == HttpResponse::k204NoContent || code == HttpResponse::k304NotModified;
+    if (!streamBodyless_ && response_.contentLength() < 0)
+    {
+        response_.addHeader(HttpResponse::kTransferEncoding, "chunked");
+        streamChunked_ = true;
+    }
+    streamState_ = kStreaming;
+    // 放到下一轮，首部可以和紧接着写入的实体合并成一次发送
+    loop_->queueInLoop(std::bind(&HttpAsyncResponse::finishInLoop, shared_from_this()));
+}
+
+void HttpAsyncResponse::appendStreamData(Buffer *buf, const char *data, size_t len) const
+{
+    if (streamChunked_)
+    {
+        char size[32];
+        int n = snprintf(size, sizeof size, "%zx\r\n", len);
+        buf->append(size, static_cast<size_t>(n));
+        buf->append(data, len);
+        buf->append("\r\n", 2);
+    }
+    else
+    {
+        buf->append(data, len);
+    }
+}
+
+bool HttpAsyncResponse::write(const char *data, size_t len)
+{
+    loop_->assertInLoopThread();
+    if (streamState_ == kNoStream)
+    {
+        string body;
+        response_.swapBody(body);
+        body.append(data, len);
+        response_.swapBody(body);
+        return true;
+    }
+    if (streamState_ == kStreamEnded)
+    {
+        LOG_ERROR << "HttpAsyncResponse::write after endStream()";
+        return false;
+    }
+    if (len == 0 || streamBodyless_)
+    {
+        return true;
+    }
+    if (!streamFlushed_)
+    {
+        appendStreamData(&streamPending_, data, len);
+        return streamPending_.readableBytes() < kStreamHighWaterMark;
+    }
+    TcpConnectionPtr conn(conn_.lock());
+    if (!conn || !conn->connected())
+    {
+        return false;
+    }
+    Buffer buf;
+    appendStreamData(&buf, data, len);
+    conn->send(&buf);
+    return conn->queuedBytes() < kStreamHighWaterMark;
+}
+
+void HttpAsyncResponse::endStream()
+{
+    loop_->assertInLoopThread();
+    if (streamState_ == kNoStream)
+    {
+        done();
+        return;
+    }
+    if (streamState_ == kStreamEnded)
+    {
+        return;
+    }
+    streamState_ = kStreamEnded;
+    writableCallback_ = WritableCallback();
+    if (!streamFlushed_)
+    {
+        if (streamChunked_)
+            streamPending_.append("0\r\n\r\n", 5);
+        // 轮到它时由 HttpServer 一起发出
+        return;
+    }
+    TcpConnectionPtr conn(conn_.lock());
+    if (conn && streamChunked_)
+    {
+        conn->send("0\r\n\r\n");
+    }
+    // 让 HttpServer 继续发送后面排队的响应
+    finishInLoop();
+}
+
+void HttpAsyncResponse::flushStream(const TcpConnectionPtr &conn, Buffer *buf)
+{
+    loop_->assertInLoopThread();
+    streamFlushed_ = true;
+    buf->append(streamPending_.peek(), streamPending_.readableBytes());
+    streamPending_.retrieveAll();
+    conn->send(buf);
+}
+
+void HttpAsyncResponse::onWritable()
+{
+    if (streamState_ == kStreaming && writableCallback_)
+    {
+        writableCallback_();
+    }
+}
@@ -0,0 +1,111 @@
+#ifndef MYMUDUO_HTTP_HTTPASYNCRESPONSE_H
+#define MYMUDUO_HTTP_HTTPASYNCRESPONSE_H
+
+#include "mymuduo/base/Atomic.h"
+#include "mymuduo/base/noncopyable.h"
+#include "mymuduo/http/HttpRequest.h"
+#include "mymuduo/http/HttpResponse.h"
+#include "mymuduo/net/Buffer.h"
+#include "mymuduo/net/Callbacks.h"
+
+namespace mymuduo
+{
+    namespace net
+    {
+        class EventLoop;
+        class HttpAsyncResponse;
+        typedef std::shared_ptr<HttpAsyncResponse> HttpAsyncResponsePtr;
+
+        /**
+         * 异步处理一个 Http 请求时的“完成对象”
+         *
+         * HttpServer 在 IO 线程中创建它，并把解析好的请求转移进来，之后处理方可以在任意线程
+         * （比如 ThreadPool 的工作线程）中填写 response()，最后调用 done()。
+         * done() 会把完成事件转交回连接所属的 IO 线程，由 HttpServer 按请求到达的顺序发送，
+         * 保证流水线（pipelining）请求的响应不会乱序
+         *
+         * 在 done() 之前，request() 和 response() 只能由一个线程访问
+         *
+         * 实体事先不能全部得到时（比如转发上游的响应）可以改用流式发送：填好状态码和首部后调用
+         * startStream()，之后用 write() 逐段发送实体，最后调用 endStream() 代替 done()。
+         * response() 设置了 Content-Length 时实体原样发送，否则使用分块编码。
+         * 排在前面的响应发出之前写入的数据先缓存起来。HTTP/2 和 HTTP/1.0 的连接不做流式发送，
+         * write() 的数据累积到实体中，endStream() 时一次发出。流式发送的函数只能在 IO 线程中调用
+         */
+        class HttpAsyncResponse : noncopyable,
+                                  public std::enable_shared_from_this<HttpAsyncResponse>
+        {
+        public:
+            typedef std::function<void(const HttpAsyncResponsePtr &)> CompleteCallback;
+            typedef std::function<void()> WritableCallback;
+
+            // 客户端的发送队列超过该值时 write() 返回 false
+            static const size_t kStreamHighWaterMark = 256 * 1024;
+
+            HttpAsyncResponse(EventLoop *loop,
+                              const TcpConnectionPtr &conn,
+                              bool close,
+                              const CompleteCallback &cb);
+            ~HttpAsyncResponse();
+
+            const HttpRequest &request() const { return request_; }
+            HttpRequest &request() { return request_; }
+            HttpResponse *response() { return &response_; }
+
+            /// 响应填写完毕，线程安全，只有第一次调用有效
+            void done();
+            /// 完成事件已经回到 IO 线程，只能在 IO 线程中调用
+            bool finished() const { return finished_; }
+
+            /// 首部填写完毕，开始流式发送
+            void startStream();
+            /// 返回 false 表示客户端积压过多，应当暂停产生数据，直到 WritableCallback 被调用
+            bool write(const char *data, size_t len);
+            void endStream();
+            /// 客户端可以继续写入，或者连接已经断开（connection() 为空）时调用
+            void setWritableCallback(const WritableCallback &cb) { writableCallback_ = cb; }
+
+            /// 以下由 HttpServer 调用
+            void setStreamable(bool on) { streamable_ = on; }
+            bool streaming() const { return streamState_ != kNoStream; }
+            bool streamEnded() const { return streamState_ == kStreamEnded; }
+            bool streamFlushed() const { return streamFlushed_; }
+            // buf 中是编码好的首部，与之前缓存的实体一起发出，之后 write() 直接发送
+            void flushStream(const TcpConnectionPtr &conn, Buffer *buf);
+            void onWritable();
+
+            EventLoop *getLoop() const { return loop_; }
+            // 连接已经断开时返回空指针
+            TcpConnectionPtr connection() const { return conn_.lock(); }
+
+        private:
+            enum StreamState
+            {
+                kNoStream,
+                kStreaming,
+                kStreamEnded,
+            };
+
+            void finishInLoop();
+            // 按分块编码（如果使用）把 data 追加到 buf
+            void appendStreamData(Buffer *buf, const char *data, size_t len) const;
+
+            EventLoop *loop_;
+            std::weak_ptr<TcpConnection> conn_; // 不延长连接的生命期
+            HttpRequest request_;
+            HttpResponse response_;
+            CompleteCallback completeCallback_;
+            AtomicInt32 done_;
+            bool finished_;
+            bool streamable_;     // 连接支持流式发送（HTTP/1.1）
+            StreamState streamState_;
+            bool streamChunked_;  // 使用分块编码
+            bool streamBodyless_; // 响应没有实体（HEAD、204、304）
+            bool streamFlushed_;  // 首部已经发出
+            Buffer streamPending_; // 首部发出之前写入的数据
+            WritableCallback writableCallback_;
+        };
+    }
+}
+
+#endif
@@ -0,0 +1,543 @@
+#include "mymuduo/http/HttpClient.h"
+
+#include "mymuduo/base/Logging.h"
+#include "mymuduo/http/HttpClientConnection.h"
+#include "mymuduo/net/EventLoop.h"
+#include "mymuduo/net/TcpConnection.h"
+
+#include <algorithm>
+#include <deque>
+#include <strings.h>
+
+using namespace mymuduo;
+using namespace mymuduo::net;
+
+namespace mymuduo
+{
+    namespace net
+    {
+        namespace detail
+        {
+            const double kDefaultRequestTimeout = 30.0;
+
+            const char *methodName(HttpRequest::Method method)
+            {
+                switch (method)
+                {
+                case HttpRequest::kGet:
+                    return "GET";
+                case HttpRequest::kPost:
+                    return "POST";
+                case HttpRequest::kHead:
+                    return "HEAD";
+                case HttpRequest::kPut:
+                    return "PUT";
+                case HttpRequest::kDelete:
+                    return "DELETE";
+                default:
+                    return "GET";
+                }
+            }
+
+            // 请求行、首部和实体拼成一段，Host 和 Content-Length 没有给出时自动补上
+            string serializeRequest(const HttpClient::Request &req, const string &host)
+            {
+                string wire;
+                wire.reserve(128 + req.body.size());
+                wire += methodName(req.method);
+                wire += ' ';
+                wire += req.target.empty() ? "/" : req.target;
+                wire += " HTTP/1.1\r\n";
+                bool hasHost = false;
+                bool hasLength = false;
+                for (const std::pair<string, string> &header : req.headers)
+                {
+                    if (::strcasecmp(header.first.c_str(), "Host") == 0)
+                        hasHost = true;
+                    else if (::strcasecmp(header.first.c_str(), "Content-Length") == 0)
+                        hasLength = true;
+                    wire += header.first;
+                    wire += ": ";
+                    wire += header.second;
+                    wire += "\r\n";
+                }
+                if (!hasHost)
+                {
+                    wire += "Host: ";
+                    wire += host;
+                    wire += "\r\n";
+                }
+                if (!hasLength && (!req.body.empty() || req.method == HttpRequest::kPost ||
+                                   req.method == HttpRequest::kPut))
+                {
+                    wire += "Content-Length: ";
+                    wire += std::to_string(req.body.size());
+                    wire += "\r\n";
+                }
+                wire += "\r\n";
+                wire += req.body;
+                return wire;
+            }
+        }
+    }
+}
+
+/**
+ * 一个请求，从发起到回调只在所属的 EventLoop 中访问。
+ * 排队时位于 HostPool::waiting，发出后位于某个连接的 inflight 中
+ */
+struct HttpClient::Call
+{
+    Call(EventLoop *l, const InetAddress &addr, const Request &req, const ResponseCallback &callback)
+        : loop(l),
+          server(addr),
+          method(req.method),
+          wire(detail::serializeRequest(req, addr.toIpPort())),
+          timeout(req.timeout),
+          cb(callback),
+          idempotent(req.method != HttpRequest::kPost),
+          sent(false),
+          retried(false),
+          done(false),
+          timerActive(false)
+    {
+    }
+
+    void cancelTimer()
+    {
+        if (timerActive)
+        {
+            loop->cancel(timer);
+            timerActive = false;
+        }
+    }
+
+    EventLoop *loop;
+    InetAddress server;
+    HttpRequest::Method method;
+    string wire;
+    double timeout;
+    ResponseCallback cb;
+    bool idempotent;
+    bool sent;
+    bool retried; // 已经因为连接断开重发过一次
+    bool done;
+    bool timerActive;
+    TimerId timer;
+    ConnectionPtr conn;
+};
+
+struct HttpClient::HostPool
+{
+    explicit HostPool(const InetAddress &address) : addr(address) {}
+
+    InetAddress addr;
+    std::vector<ConnectionPtr> conns;
+    std::deque<CallPtr> waiting;
+};
+
+struct HttpClient::LoopPool
+{
+    // 以 "ip:port" 为键
+    std::map<string, std::unique_ptr<HostPool>> hosts;
+};
+
+/**
+ * 到一个 host:port 的连接。
+ * inflight 中是按发送顺序等待响应的请求，响应按同样的顺序到达
+ */
+class HttpClient::Connection : public HttpClientConnection
+{
+public:
+    Connection(HttpClient *owner, EventLoop *loop, HostPool *host)
+        : HttpClientConnection(loop, host->addr, owner->name_ + "-" + host->addr.toIpPort()),
+          owner_(owner),
+          host_(host),
+          responseStarted_(false)
+    {
+    }
+
+    // 分配一个请求，已连接时立即发出，否则等连接建立后发出
+    void send(const CallPtr &call);
+    // 关闭连接并通知 HttpClient 处理 inflight 中的请求
+    void abort(Result result);
+
+    // 已发出的请求都是幂等的，可以继续在后面流水线发送
+    bool pipelinable() const;
+    // 队首请求的响应已经开始到达
+    bool responseStarted() const { return responseStarted_; }
+    HostPool *host() const { return host_; }
+
+    std::deque<CallPtr> inflight;
+
+private:
+    void onConnected() override;
+    void onMessage(Buffer *buf) override;
+    void onClosed(bool connectFailed) override;
+    ConnectionPtr self() { return std::static_pointer_cast<Connection>(shared_from_this()); }
+
+    HttpClient *owner_;
+    HostPool *host_;
+    bool responseStarted_;
+};
+
+void HttpClient::Connection::send(const CallPtr &call)
+{
+    inflight.push_back(call);
+    call->conn = self();
+    if (connected())
+    {
+        call->sent = true;
+        connection()->send(call->wire);
+    }
+}
+
+bool HttpClient::Connection::pipelinable() const
+{
+    for (const CallPtr &call : inflight)
+    {
+        if (!call->idempotent)
+            return false;
+    }
+    return true;
+}
+
+void HttpClient::Connection::onConnected()
+{
+    for (const CallPtr &call : inflight)
+    {
+        if (!call->sent)
+        {
+            call->sent = true;
+            connection()->send(call->wire);
+        }
+    }
+    owner_->onConnectionIdle(self());
+}
+
+void HttpClient::Connection::onClosed(bool connectFailed)
+{
+    ConnectionPtr guard(self());
+    if (!connectFailed && !inflight.empty() && responseStarted_ && parser().parseEof())
+    {
+        // 没有 Content-Length 的响应以连接关闭结束
+        CallPtr call(inflight.front());
+        inflight.pop_front();
+        responseStarted_ = false;
+        HttpResponseParser response(std::move(parser()));
+        parser().reset();
+        owner_->onConnectionClosed(guard, kConnectionClosed);
+        owner_->finishCall(call, kOk, response);
+        return;
+    }
+    owner_->onConnectionClosed(guard, connectFailed ? kConnectFailed : kConnectionClosed);
+}
+
+void HttpClient::Connection::onMessage(Buffer *buf)
+{
+    ConnectionPtr guard(self());
+    HttpResponseParser &response = parser();
+    std::vector<std::pair<CallPtr, HttpResponseParser>> finished;
+    bool bad = false;
+    bool reusable = true;
+    while (!inflight.empty() && buf->readableBytes() > 0)
+    {
+        if (!responseStarted_)
+        {
+            response.reset(inflight.front()->method == HttpRequest::kHead);
+            responseStarted_ = true;
+        }
+        if (!response.parse(buf))
+        {
+            bad = true;
+            break;
+        }
+        if (!response.gotAll())
+        {
+            break;
+        }
+        reusable = response.keepAlive();
+        finished.push_back(std::make_pair(inflight.front(), std::move(response)));
+        inflight.pop_front();
+        response.reset();
+        responseStarted_ = false;
+        if (!reusable)
+        {
+            break;
+        }
+    }
+
+    if (bad)
+    {
+        LOG_ERROR << "HttpClient bad response from " << host_->addr.toIpPort();
+        abort(kBadResponse);
+    }
+    else if (!reusable || (inflight.empty() && buf->readableBytes() > 0))
+    {
+        if (reusable)
+        {
+            LOG_WARN << "HttpClient unexpected " << buf->readableBytes() << " bytes from "
+                     << host_->addr.toIpPort();
+        }
+        buf->retrieveAll();
+        // 后面流水线发出的请求重新排队
+        abort(kConnectionClosed);
+    }
+
+    for (const std::pair<CallPtr, HttpResponseParser> &entry : finished)
+    {
+        owner_->finishCall(entry.first, kOk, entry.second);
+    }
+    if (!finished.empty() && !closed())
+    {
+        owner_->onConnectionIdle(guard);
+    }
+}
+
+void HttpClient::Connection::abort(Result result)
+{
+    if (closed())
+    {
+        return;
+    }
+    ConnectionPtr guard(self());
+    close();
+    owner_->onConnectionClosed(guard, result);
+}
+
+HttpClient::HttpClient(const string &name)
+    : name_(name),
+      maxConnections_(8),
+      pipelineDepth_(1),
+      defaultTimeout_(detail::kDefaultRequestTimeout)
+{
+}
+
+HttpClient::~HttpClient()
+{
+    // 在各自的 IO 线程中关闭连接并等待完成，未完成的请求不再回调
+    MutexLockGuard lock(mutex_);
+    for (auto &entry : pools_)
+    {
+        LoopPool *pool = entry.second.get();
+        detail::runInLoopAndWait(entry.first, [pool]() {
+            for (auto &hostEntry : pool->hosts)
+            {
+                HostPool *host = hostEntry.second.get();
+                for (const CallPtr &call : host->waiting)
+                    call->cancelTimer();
+                for (const ConnectionPtr &conn : host->conns)
+                {
+                    for (const CallPtr &call : conn->inflight)
+                    {
+                        call->cancelTimer();
+                        call->conn.reset();
+                    }
+                    conn->inflight.clear();
+                    conn->close();
+                }
+            }
+            pool->hosts.clear();
+        });
+    }
+}
+
+void HttpClient::request(const InetAddress &server, const Request &req, const ResponseCallback &cb)
+{
+    EventLoop *loop = EventLoop::getEventLoopOfCurrentThread();
+    if (loop == NULL)
+    {
+        LOG_FATAL << "HttpClient::request called outside of an IO thread";
+    }
+    requestInLoop(loop, server, std::make_shared<Call>(loop, server, req, cb));
+}
+
+void HttpClient::request(EventLoop *loop, const InetAddress &server, const Request &req, const ResponseCallback &cb)
+{
+    CallPtr call(std::make_shared<Call>(loop, server, req, cb));
+    loop->runInLoop(std::bind(&HttpClient::requestInLoop, this, loop, server, call));
+}
+
+HttpClient::LoopPool *HttpClient::poolOf(EventLoop *loop)
+{
+    MutexLockGuard lock(mutex_);
+    std::unique_ptr<LoopPool> &pool = pools_[loop];
+    if (!pool)
+    {
+        pool.reset(new LoopPool);
+    }
+    return pool.get();
+}
+
+void HttpClient::requestInLoop(EventLoop *loop, const InetAddress &server, const CallPtr &call)
+{
+    loop->assertInLoopThread();
+    std::unique_ptr<HostPool> &host = poolOf(loop)->hosts[server.toIpPort()];
+    if (!host)
+    {
+        host.reset(new HostPool(server));
+    }
+    double timeout = call->timeout > 0 ? call->timeout : defaultTimeout_;
+    if (timeout > 0)
+    {
+        std::weak_ptr<Call> weakCall(call);
+        call->timer = loop->runAfter(timeout, [this, weakCall]() { onCallTimeout(weakCall); });
+        call->timerActive = true;
+    }
+    host->waiting.push_back(call);
+    dispatch(loop, host.get());
+}
+
+/**
+ * 依次为排队的请求选择连接：先用空闲的连接，没有时在连接数上限之内新建，
+ * 再没有时（开启了流水线的幂等请求）排在 inflight 最少的连接后面，否则继续排队
+ */
+void HttpClient::dispatch(EventLoop *loop, HostPool *host)
+{
+    while (!host->waiting.empty())
+    {
+        CallPtr call(host->waiting.front());
+        if (call->done)
+        {
+            host->waiting.pop_front();
+            continue;
+        }
+
+        ConnectionPtr target;
+        ConnectionPtr pipelined;
+        size_t best = pipelineDepth_;
+        for (const ConnectionPtr &conn : host->conns)
+        {
+            if (!conn->connected())
+                continue;
+            size_t n = conn->inflight.size();
+            if (n == 0)
+            {
+                target = conn;
+                break;
+            }
+            if (call->idempotent && n < best && conn->pipelinable())
+            {
+                pipelined = conn;
+                best = n;
+            }
+        }
+        if (!target && host->conns.size() < maxConnections_)
+        {
+            target = std::make_shared<Connection>(this, loop, host);
+            host->conns.push_back(target);
+            connections_.increment();
+            target->connect();
+        }
+        if (!target)
+        {
+            target = pipelined;
+        }
+        if (!target)
+        {
+            break;
+        }
+        host->waiting.pop_front();
+        target->send(call);
+    }
+}
+
+void HttpClient::finishCall(const CallPtr &call, Result result, const HttpResponseParser &response)
+{
+    if (call->done)
+    {
+        return;
+    }
+    call->done = true;
+    call->cancelTimer();
+    call->conn.reset();
+    ResponseCallback cb;
+    cb.swap(call->cb);
+    if (cb)
+    {
+        cb(result, response);
+    }
+}
+
+void HttpClient::onCallTimeout(const std::weak_ptr<Call> &weakCall)
+{
+    CallPtr call(weakCall.lock());
+    if (!call || call->done)
+    {
+        return;
+    }
+    call->timerActive = false;
+    ConnectionPtr conn(call->conn);
+    if (!conn)
+    {
+        std::unique_ptr<HostPool> &host = poolOf(call->loop)->hosts[call->server.toIpPort()];
+        std::deque<CallPtr> &waiting = host->waiting;
+        waiting.erase(std::remove(waiting.begin(), waiting.end(), call), waiting.end());
+    }
+    LOG_WARN << "HttpClient request to " << call->server.toIpPort() << " timed out";
+    finishCall(call, kTimeout, HttpResponseParser());
+    if (conn)
+    {
+        // 同一连接上的其他请求重新排队或重发
+        conn->abort(kConnectionClosed);
+    }
+}
+
+void HttpClient::onConnectionIdle(const ConnectionPtr &conn)
+{
+    dispatch(conn->getLoop(), conn->host());
+}
+
+void HttpClient::onConnectionClosed(const ConnectionPtr &conn, Result result)
+{
+    HostPool *host = conn->host();
+    std::vector<ConnectionPtr>::iterator it = std::find(host->conns.begin(), host->conns.end(), conn);
+    if (it != host->conns.end())
+    {
+        host->conns.erase(it);
+        connections_.decrement();
+    }
+
+    std::deque<CallPtr> calls;
+    calls.swap(conn->inflight);
+    std::vector<CallPtr> requeue;
+    std::vector<std::pair<CallPtr, Result>> failed;
+    for (size_t i = 0; i < calls.size(); ++i)
+    {
+        const CallPtr &call = calls[i];
+        if (call->done)
+            continue;
+        call->conn.reset();
+        bool front = i == 0;
+        if (result == kConnectFailed)
+        {
+            failed.push_back(std::make_pair(call, kConnectFailed));
+        }
+        else if (!call->sent)
+        {
+            requeue.push_back(call);
+        }
+        else if (front && (result == kBadResponse || conn->responseStarted()))
+        {
+            failed.push_back(std::make_pair(call, result == kBadResponse ? kBadResponse : kConnectionClosed));
+        }
+        else if (call->idempotent && !call->retried)
+        {
+            // keep-alive 连接可能恰好被服务端关闭，幂等的请求重发一次
+            call->retried = true;
+            call->sent = false;
+            requeue.push_back(call);
+        }
+        else
+        {
+            failed.push_back(std::make_pair(call, kConnectionClosed));
+        }
+    }
+    host->waiting.insert(host->waiting.begin(), requeue.begin(), requeue.end());
+
+    for (const std::pair<CallPtr, Result> &entry : failed)
+    {
+        finishCall(entry.first, entry.second, HttpResponseParser());
+    }
+    dispatch(conn->getLoop(), host);
+}
@@ -0,0 +1,107 @@
+#ifndef MYMUDUO_HTTP_HTTPCLIENT_H
+#define MYMUDUO_HTTP_HTTPCLIENT_H
+
+#include "mymuduo/base/Atomic.h"
+#include "mymuduo/base/Mutex.h"
+#include "mymuduo/http/HttpRequest.h"
+#include "mymuduo/http/HttpResponseParser.h"
+#include "mymuduo/net/InetAddress.h"
+
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace mymuduo
+{
+    namespace net
+    {
+        class EventLoop;
+
+        /**
+         * 异步 HTTP/1.1 客户端，用于在 HttpServer 的处理函数中调用其他服务
+         *
+         * 请求在发起方所属的 EventLoop 上发出，完成回调也在这个 EventLoop 上执行，
+         * 每个 EventLoop 对每个 host:port 各自维护 keep-alive 连接池，不需要跨线程交接。
+         * 连接数达到上限时请求排队，等待有连接空闲；开启流水线后幂等的请求可以不等上一个响应
+         * 就在同一连接上发出。每个请求有自己的期限，超时后回调 kTimeout 并关闭承载它的连接
+         *
+         * 与 HttpServer 一样，HttpClient 的生命期要长于各个 EventLoop 的运行，
+         * 析构时这些 EventLoop 必须仍在运行，连接在各自的线程中关闭，析构函数等到全部关闭后才返回
+         */
+        class HttpClient : noncopyable
+        {
+        public:
+            struct Request
+            {
+                Request(HttpRequest::Method m, const string &t) : method(m), target(t), timeout(0) {}
+
+                HttpRequest::Method method;
+                string target; // 路径和查询串，如 "/users?id=1"
+                std::vector<std::pair<string, string>> headers;
+                string body;
+                double timeout; // 秒，0 表示使用 setDefaultTimeout 的值
+            };
+
+            enum Result
+            {
+                kOk,
+                kConnectFailed,
+                kTimeout,
+                kConnectionClosed, // 收到完整的响应之前连接断开
+                kBadResponse,
+            };
+
+            /// result 不为 kOk 时 response 为空
+            typedef std::function<void(Result result, const HttpResponseParser &response)> ResponseCallback;
+
+            explicit HttpClient(const string &name);
+            ~HttpClient();
+
+            /// 以下设置在发出第一个请求之前调用
+            /// 每个 EventLoop 到每个 host:port 的最大连接数，默认 8
+            void setMaxConnectionsPerHost(size_t n) { maxConnections_ = n > 0 ? n : 1; }
+            /// 同一连接上最多同时等待响应的请求数，默认 1（不使用流水线）
+            void setPipelineDepth(size_t depth) { pipelineDepth_ = depth > 0 ? depth : 1; }
+            void setDefaultTimeout(double seconds) { defaultTimeout_ = seconds; }
+
+            /// 在当前线程的 EventLoop 上发出请求，回调也在这里执行。只能在 IO 线程中调用
+            void request(const InetAddress &server, const Request &req, const ResponseCallback &cb);
+            /// 在 loop 上发出请求并执行回调，线程安全
+            void request(EventLoop *loop, const InetAddress &server, const Request &req, const ResponseCallback &cb);
+
+            /// 当前所有 EventLoop 上的连接数
+            int connectionCount() const { return connections_.get(); }
+
+        private:
+            struct Call;
+            struct HostPool;
+            struct LoopPool;
+            class Connection;
+            typedef std::shared_ptr<Call> CallPtr;
+            typedef std::shared_ptr<Connection> ConnectionPtr;
+
+            void requestInLoop(EventLoop *loop, const InetAddress &server, const CallPtr &call);
+            // 结束请求并执行回调，重复调用时什么也不做
+            void finishCall(const CallPtr &call, Result result, const HttpResponseParser &response);
+            // 为排队的请求寻找或新建连接
+            void dispatch(EventLoop *loop, HostPool *host);
+            void onCallTimeout(const std::weak_ptr<Call> &weakCall);
+            // 连接断开（或连接失败），处理其上未完成的请求
+            void onConnectionClosed(const ConnectionPtr &conn, Result result);
+            void onConnectionIdle(const ConnectionPtr &conn);
+            LoopPool *poolOf(EventLoop *loop);
+
+            const string name_;
+            size_t maxConnections_;
+            size_t pipelineDepth_;
+            double defaultTimeout_;
+            mutable AtomicInt32 connections_;
+
+            mutable MutexLock mutex_;
+            // 连接池按 EventLoop 分开，池内的对象只在所属的 IO 线程中访问
+            std::map<EventLoop *, std::unique_ptr<LoopPool>> pools_ GUARDED_BY(mutex_);
+        };
+    }
+}
+
+#endif
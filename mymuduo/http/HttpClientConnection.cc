@@ -0,0 +1,141 @@
+#include "mymuduo/http/HttpClientConnection.h"
+
+#include "mymuduo/base/CountDownLatch.h"
+#include "mymuduo/net/EventLoop.h"
+#include "mymuduo/net/TcpClient.h"
+
+using namespace mymuduo;
+using namespace mymuduo::net;
+
+namespace mymuduo
+{
+    namespace net
+    {
+        namespace detail
+        {
+            void runInLoopAndWait(EventLoop *loop, const std::function<void()> &cb)
+            {
+                if (loop->isInLoopThread())
+                {
+                    cb();
+                    return;
+                }
+                CountDownLatch latch(1);
+                loop->runInLoop([&cb, &latch]() {
+                    cb();
+                    latch.countDown();
+                });
+                latch.wait();
+            }
+        }
+    }
+}
+
+HttpClientConnection::HttpClientConnection(EventLoop *loop, const InetAddress &addr, const string &name)
+    : loop_(loop),
+      addr_(addr),
+      client_(new TcpClient(loop, addr, name)),
+      closed_(false)
+{
+}
+
+HttpClientConnection::~HttpClientConnection()
+{
+    close();
+}
+
+void HttpClientConnection::connect()
+{
+    std::weak_ptr<HttpClientConnection> weakSelf(shared_from_this());
+    client_->setConnectionCallback([weakSelf](const TcpConnectionPtr &conn) {
+        std::shared_ptr<HttpClientConnection> self(weakSelf.lock());
+        if (self)
+            self->onConnection(conn);
+        else if (conn->connected())
+            conn->forceClose();
+    });
+    client_->setMessageCallback([weakSelf](const TcpConnectionPtr &, Buffer *buf, Timestamp) {
+        std::shared_ptr<HttpClientConnection> self(weakSelf.lock());
+        if (self && !self->closed_)
+            self->onMessage(buf);
+        else
+            buf->retrieveAll();
+    });
+    client_->setWriteCompleteCallback([weakSelf](const TcpConnectionPtr &) {
+        std::shared_ptr<HttpClientConnection> self(weakSelf.lock());
+        if (self && !self->closed_)
+            self->onWriteComplete();
+    });
+    EventLoop *loop = loop_;
+    client_->setConnectFailedCallback([weakSelf, loop]() {
+        // 可能发生在 connect() 之中，推迟到下一轮处理
+        loop->queueInLoop([weakSelf]() {
+            std::shared_ptr<HttpClientConnection> self(weakSelf.lock());
+            if (self)
+                self->handleClose(true);
+        });
+    });
+    client_->connect();
+}
+
+bool HttpClientConnection::connected() const
+{
+    return !closed_ && conn_ && conn_->connected();
+}
+
+void HttpClientConnection::onConnection(const TcpConnectionPtr &conn)
+{
+    if (conn->connected())
+    {
+        if (closed_)
+        {
+            conn->forceClose();
+            return;
+        }
+        conn_ = conn;
+        conn->setTcpNoDelay(true);
+        std::shared_ptr<HttpClientConnection> guard(shared_from_this());
+        onConnected();
+    }
+    else
+    {
+        conn_.reset();
+        handleClose(false);
+    }
+}
+
+void HttpClientConnection::handleClose(bool connectFailed)
+{
+    if (closed_)
+    {
+        return;
+    }
+    closed_ = true;
+    std::shared_ptr<HttpClientConnection> guard(shared_from_this());
+    releaseClient();
+    onClosed(connectFailed);
+}
+
+void HttpClientConnection::close()
+{
+    if (closed_)
+    {
+        return;
+    }
+    closed_ = true;
+    if (conn_)
+    {
+        conn_->forceClose();
+        conn_.reset();
+    }
+    releaseClient();
+}
+
+/**
+ * 即使在 TcpClient 自己的回调中也可以析构它：~TcpClient 把 Connector 交给 EventLoop 延后释放，
+ * 正在执行的 Connector 回调和已经排队的 Connector 工作不会访问已经释放的对象
+ */
+void HttpClientConnection::releaseClient()
+{
+    client_.reset();
+}
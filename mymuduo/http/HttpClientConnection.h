@@ -0,0 +1,75 @@
+#ifndef MYMUDUO_HTTP_HTTPCLIENTCONNECTION_H
+#define MYMUDUO_HTTP_HTTPCLIENTCONNECTION_H
+
+#include "mymuduo/base/noncopyable.h"
+#include "mymuduo/http/HttpResponseParser.h"
+#include "mymuduo/net/Callbacks.h"
+#include "mymuduo/net/InetAddress.h"
+
+#include <functional>
+#include <memory>
+
+namespace mymuduo
+{
+    namespace net
+    {
+        class Buffer;
+        class EventLoop;
+        class TcpClient;
+
+        /**
+         * 到一个 HTTP 服务器的一条连接，包装了一个不自动重连的 TcpClient 和响应解析器，
+         * 是 HttpClient 和 HttpProxy 连接池中的元素，派生类实现各自的请求处理。
+         * 只在所属的 EventLoop 中使用，由 shared_ptr 管理
+         *
+         * 连接断开或连接失败时调用一次 onClosed()；主动 close() 之后不再调用任何回调。
+         * close() 当场析构 TcpClient，不需要 EventLoop 再运行几轮，
+         * 之后留在 EventLoop 中的工作只涉及 TcpConnection 本身
+         */
+        class HttpClientConnection : noncopyable,
+                                     public std::enable_shared_from_this<HttpClientConnection>
+        {
+        public:
+            HttpClientConnection(EventLoop *loop, const InetAddress &addr, const string &name);
+            virtual ~HttpClientConnection();
+
+            void connect();
+            /// 主动关闭，之后不再回调，重复调用时什么也不做
+            void close();
+
+            bool connected() const;
+            bool closed() const { return closed_; }
+            EventLoop *getLoop() const { return loop_; }
+            const InetAddress &serverAddress() const { return addr_; }
+            const TcpConnectionPtr &connection() const { return conn_; }
+            HttpResponseParser &parser() { return parser_; }
+
+        protected:
+            virtual void onConnected() = 0;
+            virtual void onMessage(Buffer *buf) = 0;
+            virtual void onWriteComplete() {}
+            /// connectFailed 为 true 表示没有连上，否则是已建立的连接断开
+            virtual void onClosed(bool connectFailed) = 0;
+
+        private:
+            void onConnection(const TcpConnectionPtr &conn);
+            void handleClose(bool connectFailed);
+            void releaseClient();
+
+            EventLoop *loop_;
+            const InetAddress addr_;
+            std::unique_ptr<TcpClient> client_;
+            TcpConnectionPtr conn_;
+            HttpResponseParser parser_;
+            bool closed_;
+        };
+
+        namespace detail
+        {
+            /// 在 loop 中执行 cb 并等待完成，用于析构时同步关闭各个 IO 线程中的连接，loop 必须在运行
+            void runInLoopAndWait(EventLoop *loop, const std::function<void()> &cb);
+        }
+    }
+}
+
+#endif // MYMUDUO_HTTP_HTTPCLIENTCONNECTION_H
@@ -0,0 +1,268 @@
+#include "mymuduo/http/HttpCompress.h"
+
+#include "mymuduo/base/Logging.h"
+#include "mymuduo/http/HttpRequest.h"
+#include "mymuduo/http/HttpResponse.h"
+
+#include <algorithm>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <zlib.h>
+
+using namespace mymuduo;
+using namespace mymuduo::net;
+
+namespace mymuduo
+{
+    namespace net
+    {
+        namespace detail
+        {
+            bool isSpace(char c) { return c == ' ' || c == '\t'; }
+
+            StringPiece trim(const char *begin, const char *end)
+            {
+                while (begin < end && isSpace(*begin))
+                    ++begin;
+                while (end > begin && isSpace(end[-1]))
+                    --end;
+                return StringPiece(begin, static_cast<int>(end - begin));
+            }
+
+            bool equalsIgnoreCase(const StringPiece &a, const char *b)
+            {
+                size_t len = strlen(b);
+                return static_cast<size_t>(a.size()) == len && ::strncasecmp(a.data(), b, len) == 0;
+            }
+
+            // 解析 "gzip;q=0.8" 中的 q 值，缺省为 1
+            double qvalue(const char *begin, const char *end)
+            {
+                const char *semi = std::find(begin, end, ';');
+                while (semi != end)
+                {
+                    const char *next = std::find(semi + 1, end, ';');
+                    StringPiece param = trim(semi + 1, next);
+                    if (param.size() > 2 && (param[0] == 'q' || param[0] == 'Q') && param[1] == '=')
+                    {
+                        return ::strtod(param.as_string().c_str() + 2, NULL);
+                    }
+                    semi = next;
+                }
+                return 1.0;
+            }
+        }
+    }
+}
+
+compress::Encoding compress::negotiate(const string &acceptEncoding)
+{
+    double gzip = -1, deflate = -1, any = -1;
+    const char *p = acceptEncoding.data();
+    const char *end = p + acceptEncoding.size();
+    while (p < end)
+    {
+        const char *comma = std::find(p, end, ',');
+        const char *semi = std::find(p, comma, ';');
+        StringPiece coding = detail::trim(p, semi);
+        double q = detail::qvalue(semi, comma);
+        if (detail::equalsIgnoreCase(coding, "gzip") || detail::equalsIgnoreCase(coding, "x-gzip"))
+            gzip = q;
+        else if (detail::equalsIgnoreCase(coding, "deflate"))
+            deflate = q;
+        else if (coding == "*")
+            any = q;
+        p = comma + (comma < end ? 1 : 0);
+    }
+    // 没有单独列出的编码取 * 的 q 值
+    if (gzip < 0)
+        gzip = any;
+    if (deflate < 0)
+        deflate = any;
+    if (gzip > 0 && gzip >= deflate)
+        return kGzip;
+    if (deflate > 0)
+        return kDeflate;
+    return kIdentity;
+}
+
+const char *compress::encodingName(Encoding encoding)
+{
+    switch (encoding)
+    {
+    case kGzip:
+        return "gzip";
+    case kDeflate:
+        return "deflate";
+    default:
+        return "";
+    }
+}
+
+bool compress::isCompressibleType(const StringPiece &contentType)
+{
+    if (contentType.starts_with("text/"))
+        return true;
+    static const char *const kTypes[] = {
+        "application/json",
+        "application/javascript",
+        "application/xml",
+        "image/svg+xml",
+    };
+    for (const char *type : kTypes)
+    {
+        if (contentType.starts_with(type))
+            return true;
+    }
+    return false;
+}
+
+bool compress::compress(Encoding encoding, const char *data, size_t len, string *out, int level)
+{
+    if (encoding == kIdentity)
+    {
+        out->assign(data, len);
+        return true;
+    }
+
+    z_stream zs;
+    memZero(&zs, sizeof zs);
+    // windowBits 加 16 输出 gzip 头尾，否则为 zlib 格式（即 HTTP 的 deflate）
+    int windowBits = encoding == kGzip ? 15 + 16 : 15;
+    if (::deflateInit2(&zs, level, Z_DEFLATED, windowBits, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+    {
+        LOG_ERROR << "deflateInit2 failed";
+        return false;
+    }
+    out->resize(::deflateBound(&zs, static_cast<uLong>(len)));
+    zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+    zs.avail_in = static_cast<uInt>(len);
+    zs.next_out = reinterpret_cast<Bytef *>(&*out->begin());
+    zs.avail_out = static_cast<uInt>(out->size());
+    int ret = ::deflate(&zs, Z_FINISH);
+    out->resize(zs.total_out);
+    ::deflateEnd(&zs);
+    if (ret != Z_STREAM_END)
+    {
+        LOG_ERROR << "deflate failed " << ret;
+        return false;
+    }
+    return true;
+}
+
+bool compress::compressResponse(const HttpRequest &req, HttpResponse *resp)
+{
+    if (!resp->compress() || resp->needSendFile() ||
+        resp->body().size() < kMinCompressSize ||
+        !resp->header(HttpResponse::kContentEncoding).empty() ||
+        resp->statusCode() == HttpResponse::k206Partitial)
+    {
+        return false;
+    }
+
+    // 无论是否压缩，缓存都需要按 Accept-Encoding 区分
+    string vary = resp->header(HttpResponse::kVary);
+    if (vary.find("Accept-Encoding") == string::npos)
+    {
+        resp->addHeader(HttpResponse::kVary, vary.empty() ? "Accept-Encoding" : vary + ", Accept-Encoding");
+    }
+
+    Encoding encoding = negotiate(req.getHeader("Accept-Encoding"));
+    string out;
+    if (encoding == kIdentity ||
+        !compress(encoding, resp->body().data(), resp->body().size(), &out))
+    {
+        return false;
+    }
+    resp->swapBody(out);
+    resp->addHeader(HttpResponse::kContentEncoding, encodingName(encoding));
+    return true;
+}
+
+CompressCache::CompressCache(size_t maxBytes)
+    : maxBytes_(maxBytes),
+      bytes_(0)
+{
+}
+
+CompressCache::DataPtr CompressCache::get(const string &path, compress::Encoding encoding,
+                                          int64_t mtime, int64_t size)
+{
+    string key(path);
+    key.push_back(static_cast<char>('0' + encoding));
+    MutexLockGuard lock(mutex_);
+    auto it = index_.find(key);
+    if (it == index_.end())
+    {
+        misses_.increment();
+        return DataPtr();
+    }
+    EntryList::iterator entry = it->second;
+    if (entry->mtime != mtime || entry->size != size)
+    {
+        // 文件已经改变
+        bytes_ -= entry->data->size();
+        lru_.erase(entry);
+        index_.erase(it);
+        misses_.increment();
+        return DataPtr();
+    }
+    lru_.splice(lru_.begin(), lru_, entry);
+    hits_.increment();
+    return entry->data;
+}
+
+void CompressCache::put(const string &path, compress::Encoding encoding,
+                        int64_t mtime, int64_t size, const DataPtr &data)
+{
+    string key(path);
+    key.push_back(static_cast<char>('0' + encoding));
+    MutexLockGuard lock(mutex_);
+    if (data->size() > maxBytes_)
+    {
+        return;
+    }
+    auto it = index_.find(key);
+    if (it != index_.end())
+    {
+        // 多个线程同时压缩了同一个文件
+        bytes_ -= it->second->data->size();
+        lru_.erase(it->second);
+        index_.erase(it);
+    }
+    lru_.push_front(Entry{key, mtime, size, data});
+    index_[key] = lru_.begin();
+    bytes_ += data->size();
+    evict();
+}
+
+void CompressCache::setMaxBytes(size_t maxBytes)
+{
+    MutexLockGuard lock(mutex_);
+    maxBytes_ = maxBytes;
+    evict();
+}
+
+size_t CompressCache::bytes() const
+{
+    MutexLockGuard lock(mutex_);
+    return bytes_;
+}
+
+size_t CompressCache::size() const
+{
+    MutexLockGuard lock(mutex_);
+    return lru_.size();
+}
+
+void CompressCache::evict()
+{
+    while (bytes_ > maxBytes_ && !lru_.empty())
+    {
+        const Entry &last = lru_.back();
+        bytes_ -= last.data->size();
+        index_.erase(last.key);
+        lru_.pop_back();
+    }
+}
@@ -0,0 +1,97 @@
+#ifndef MYMUDUO_HTTP_HTTPCOMPRESS_H
+#define MYMUDUO_HTTP_HTTPCOMPRESS_H
+
+#include "mymuduo/base/Atomic.h"
+#include "mymuduo/base/Mutex.h"
+#include "mymuduo/base/noncopyable.h"
+#include "mymuduo/base/StringPiece.h"
+#include "mymuduo/base/Types.h"
+
+#include <list>
+#include <memory>
+#include <unordered_map>
+
+namespace mymuduo
+{
+    namespace net
+    {
+        class HttpRequest;
+        class HttpResponse;
+
+        /**
+         * 基于 zlib 的 Content-Encoding 支持：gzip 与 deflate（zlib 格式）
+         */
+        namespace compress
+        {
+            enum Encoding
+            {
+                kIdentity,
+                kGzip,
+                kDeflate,
+            };
+
+            // 小于该值的实体压缩收益不大，不做压缩
+            const size_t kMinCompressSize = 256;
+
+            /// 按 Accept-Encoding（含 q 值）选择编码，gzip 优先，都不接受时返回 kIdentity
+            Encoding negotiate(const string &acceptEncoding);
+            /// Content-Encoding 首部的值，kIdentity 返回空串
+            const char *encodingName(Encoding encoding);
+            /// text/*、json、javascript、xml 等文本类型才值得压缩
+            bool isCompressibleType(const StringPiece &contentType);
+
+            /// 把 [data, data+len) 整体压缩后写入 *out，失败返回 false
+            bool compress(Encoding encoding, const char *data, size_t len, string *out, int level = 6);
+
+            /**
+             * HttpServer 对设置了 HttpResponse::setCompress(true) 的响应调用，
+             * 客户端接受时压缩实体并设置 Content-Encoding 和 Vary，返回是否压缩
+             */
+            bool compressResponse(const HttpRequest &req, HttpResponse *resp);
+        }
+
+        /**
+         * 压缩结果的 LRU 缓存，键为 路径 + 编码，同时记录原文件的 mtime 和大小，
+         * 两者任一变化都视为失效。按压缩后的字节数限制总大小，线程安全
+         */
+        class CompressCache : noncopyable
+        {
+        public:
+            typedef std::shared_ptr<const string> DataPtr;
+
+            explicit CompressCache(size_t maxBytes);
+
+            /// 未命中或已失效时返回空指针，mtime 以纳秒计
+            DataPtr get(const string &path, compress::Encoding encoding, int64_t mtime, int64_t size);
+            void put(const string &path, compress::Encoding encoding, int64_t mtime, int64_t size, const DataPtr &data);
+
+            void setMaxBytes(size_t maxBytes);
+            size_t bytes() const;
+            size_t size() const;
+            int64_t hits() const { return hits_.get(); }
+            int64_t misses() const { return misses_.get(); }
+
+        private:
+            struct Entry
+            {
+                string key;
+                int64_t mtime;
+                int64_t size;
+                DataPtr data;
+            };
+            typedef std::list<Entry> EntryList;
+
+            void evict() REQUIRES(mutex_);
+
+            mutable MutexLock mutex_;
+            EntryList lru_ GUARDED_BY(mutex_); // 队首为最近使用
+            std::unordered_map<string, EntryList::iterator> index_ GUARDED_BY(mutex_);
+            size_t maxBytes_ GUARDED_BY(mutex_);
+            size_t bytes_ GUARDED_BY(mutex_);
+            mutable AtomicInt64 hits_;
+            mutable AtomicInt64 misses_;
+        };
+    }
+}
+
+#endif
@@ -1,6 +1,6 @@
 #include "mymuduo/net/Buffer.h"
 #include "mymuduo/http/HttpContext.h"
-#include "mymuduo/base/Exception.h"
+#include "mymuduo/base/Logging.h"
 
 #include <string.h>
 #include <stdio.h>
@@ -113,6 +113,15 @@ bool HttpContext::parseRequest(Buffer *buf, Timestamp receiveTime)
                 {
                     // empty line, end of header
                     state_ = kExpectBody;
+                    if (pauseAtBody_ && request_.headers().count("Content-Length") > 0 && contentLength() >= 0)
+                    {
+                        // 暂停，由调用方决定实体的接收方式，Content-Length: 0 的空实体也一样（比如上传空文件）
+                        hasMore = false;
+                    }
+                    else
+                    {
+                        bodyDecided_ = true;
+                    }
                 }
                 buf->retrieveUntil(crlf + 2);
             }
@@ -124,36 +133,92 @@ bool HttpContext::parseRequest(Buffer *buf, Timestamp receiveTime)
         else if (state_ == kExpectBody)
         {
             // 通过 Content-Length 来定义主体大小，如果没有该字段则默认不存在主体
-            string lenstr = request_.getHeader("Content-Length");
-            if (!lenstr.empty()) // 请求定义了主体大小
+            int64_t len = contentLength();
+            if (len < 0)
             {
-                try
-                {
-                    size_t len = static_cast<size_t>(std::stoll(lenstr));
-                    if (len >= buf->readableBytes())
-                    {
-                        request_.setBody(buf->peek(), buf->peek() + len);
-                        buf->retrieve(len);
-                        state_ = kGotAll;
-                        hasMore = false;
-                    }
-                }
-                catch (Exception &ex)
-                {
-                    fprintf(stderr, "Http request analyze fail: Content-Length = %s", lenstr.c_str());
-                    fprintf(stderr, "reason: %s\n", ex.what());
-                    fprintf(stderr, "stack trace: %s\n", ex.stackTrace());
-                    buf->retrieveAll();
-                    ok = false;
-                    hasMore = false;
-                }
+                LOG_ERROR << "Http request analyze fail: Content-Length = "
+                          << request_.getHeader("Content-Length");
+                buf->retrieveAll();
+                ok = false;
             }
-            else
+            else if (len == 0)
             {
                 state_ = kGotAll;
-                hasMore = false;
             }
+            else if (buf->readableBytes() >= static_cast<size_t>(len))
+            {
+                // 实体已经全部到达
+                request_.setBody(buf->peek(), buf->peek() + len);
+                buf->retrieve(static_cast<size_t>(len));
+                state_ = kGotAll;
+            }
+            hasMore = false;
+        }
+        else
+        {
+            // kStreamBody 由 consumeBody() 处理，kGotAll 等待调用方 reset()
+            hasMore = false;
         }
     }
     return ok;
-}
\ No newline at end of file
+}
+int64_t HttpContext::contentLength() const
+{
+    const std::map<string, string> &headers = request_.headers();
+    std::map<string, string>::const_iterator it = headers.find("Content-Length");
+    if (it == headers.end())
+    {
+        return 0;
+    }
+    const string &value = it->second;
+    // 只接受十进制数字，且不超过 int64_t 的范围
+    if (value.empty() || value.size() > 18)
+    {
+        return -1;
+    }
+    int64_t len = 0;
+    for (char c : value)
+    {
+        if (c < '0' || c > '9')
+        {
+            return -1;
+        }
+        len = len * 10 + (c - '0');
+    }
+    return len;
+}
+
+void HttpContext::streamBody(const HttpBodyHandler &handler)
+{
+    assert(headersComplete());
+    assert(handler.onData);
+    int64_t len = contentLength();
+    assert(len >= 0);
+    bodyDecided_ = true;
+    bodyHandler_ = handler;
+    bodyRemaining_ = static_cast<size_t>(len);
+    // 空实体不调用 onData，直接完成
+    state_ = len > 0 ? kStreamBody : kGotAll;
+}
+
+void HttpContext::consumeBody(Buffer *buf)
+{
+    assert(state_ == kStreamBody);
+    while (bodyRemaining_ > 0 && buf->readableBytes() > 0)
+    {
+        size_t len = std::min(bodyRemaining_, buf->readableBytes());
+        size_t n = bodyHandler_.onData(buf->peek(), len);
+        assert(n <= len);
+        buf->retrieve(n);
+        bodyRemaining_ -= n;
+        if (n < len)
+        {
+            // 处理方暂时跟不上，剩余数据留在 buf 中
+            break;
+        }
+    }
+    if (bodyRemaining_ == 0)
+    {
+        state_ = kGotAll;
+    }
+}
@@ -4,11 +4,34 @@
 #include "mymuduo/base/copyable.h"
 #include "mymuduo/http/HttpRequest.h"
 
+#include <deque>
+#include <functional>
+#include <memory>
+
 namespace mymuduo
 {
     namespace net
     {
         class Buffer;
+        class HttpResponse;
+        class HttpAsyncResponse;
+        class Http2Connection;
+        class WebSocketConnection;
+
+        /**
+         * 流式接收请求实体时使用的处理器，由 HttpServer 的 HttpStreamCallback 按请求创建，
+         * 需要跨调用保存的状态（如正在写入的文件）可以由两个回调共同捕获
+         */
+        struct HttpBodyHandler
+        {
+            /// 处理一段新到达的实体数据，返回实际消费的字节数；
+            /// 返回值小于 len 时剩余数据保留在输入缓冲区中，表示处理方暂时跟不上（背压）
+            std::function<size_t(const char *data, size_t len)> onData;
+            /// 实体全部接收完毕后调用，用于填写响应；为空时使用 HttpServer 的 HttpCallback
+            std::function<void(const HttpRequest &, HttpResponse *)> onComplete;
+            /// 与 onComplete 相同，但以异步方式完成（见 HttpAsyncResponse），设置后优先使用
+            std::function<void(const std::shared_ptr<HttpAsyncResponse> &)> onAsyncComplete;
+        };
 
         class HttpContext : public mymuduo::copyable
         {
@@ -18,10 +41,17 @@ namespace mymuduo
                 kExpectRequestLine, // 正在解析请求行（初始状态）
                 kExpectHeaders,     // 正在解析首部
                 kExpectBody,        // 正在解析实体
+                kStreamBody,        // 正在流式接收实体，数据不进入 request_
                 kGotAll,            // 解析完毕
             };
 
-            HttpContext() : state_(kExpectRequestLine) {}
+            typedef std::deque<std::shared_ptr<HttpAsyncResponse>> ResponseQueue;
+
+            HttpContext() : state_(kExpectRequestLine),
+                            pauseAtBody_(false),
+                            bodyDecided_(false),
+                            bodyRemaining_(0),
+                            pipelinePaused_(false) {}
 
             // default copy-ctor, dtor and assignment are fine
 
@@ -29,6 +59,29 @@ namespace mymuduo
             bool parseRequest(Buffer *buf, Timestamp receiveTime);
 
             bool gotAll() const { return state_ == kGotAll; }
+            /// 处于两个请求之间，缓冲区中的数据（如果有）是新请求的开头
+            bool expectRequestLine() const { return state_ == kExpectRequestLine; }
+
+            /**
+             * 开启后，带 Content-Length（包括 0）的请求在首部解析完毕时暂停（headersComplete() 为真），
+             * 由调用方通过 streamBody() 或 bufferBody() 决定实体的接收方式
+             */
+            void setPauseAtBody(bool on) { pauseAtBody_ = on; }
+            bool headersComplete() const { return state_ == kExpectBody && !bodyDecided_; }
+
+            // 实体照旧缓存到 request_ 中，接着调用 parseRequest 即可
+            void bufferBody() { bodyDecided_ = true; }
+            // 切换到流式接收，之后由 consumeBody() 把数据交给 handler
+            void streamBody(const HttpBodyHandler &handler);
+            bool streamingBody() const { return state_ == kStreamBody; }
+
+            /**
+             * 把 buf 中属于当前实体的数据交给 bodyHandler_.onData，
+             * 实体接收完毕后状态变为 kGotAll
+             */
+            void consumeBody(Buffer *buf);
+            size_t bodyRemaining() const { return bodyRemaining_; }
+            const HttpBodyHandler &bodyHandler() const { return bodyHandler_; }
 
             void reset()
             {
@@ -36,18 +89,46 @@ namespace mymuduo
                 HttpRequest dummy;
                 // 利用 swap 机制清空 request 存储内容
                 request_.swap(dummy);
+                bodyDecided_ = false;
+                bodyRemaining_ = 0;
+                bodyHandler_ = HttpBodyHandler();
             }
 
             const HttpRequest &request() const { return request_; }
             HttpRequest &request() { return request_; }
 
+            /**
+             * 异步处理时按到达顺序排队、尚未发送的响应，属于连接级别的状态，reset() 不清空
+             * pipelinePaused 表示因排队过多暂停了读取
+             */
+            ResponseQueue &pendingResponses() { return pendingResponses_; }
+            bool pipelinePaused() const { return pipelinePaused_; }
+            void setPipelinePaused(bool on) { pipelinePaused_ = on; }
+
+            /// 协商为 HTTP/2 之后连接上的数据全部交给它处理，不再使用上面的解析状态
+            const std::shared_ptr<Http2Connection> &http2() const { return http2_; }
+            void setHttp2(const std::shared_ptr<Http2Connection> &h2) { http2_ = h2; }
+            /// 升级为 WebSocket 之后同理
+            const std::shared_ptr<WebSocketConnection> &webSocket() const { return webSocket_; }
+            void setWebSocket(const std::shared_ptr<WebSocketConnection> &ws) { webSocket_ = ws; }
+
         private:
             bool processRequestLine(const char *begin, const char *end);
+            // 解析 Content-Length，没有该字段时返回 0，格式错误返回 -1
+            int64_t contentLength() const;
 
             HttpRequestParseState state_; // 当前进度
             HttpRequest request_;         // 解析过程中的请求缓存
+            bool pauseAtBody_;            // 首部解析完毕后是否暂停
+            bool bodyDecided_;            // 本次请求的实体接收方式是否已经确定
+            size_t bodyRemaining_;        // 流式接收时尚未到达的实体字节数
+            HttpBodyHandler bodyHandler_; // 流式接收的处理器
+            ResponseQueue pendingResponses_;
+            bool pipelinePaused_;
+            std::shared_ptr<Http2Connection> http2_;
+            std::shared_ptr<WebSocketConnection> webSocket_;
         };
     }
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,315 @@
+#include "mymuduo/http/HttpMetrics.h"
+
+#include "mymuduo/base/AsyncLogging.h"
+#include "mymuduo/base/ProcessInfo.h"
+#include "mymuduo/http/HttpRequest.h"
+#include "mymuduo/http/HttpResponse.h"
+#include "mymuduo/http/HttpServer.h"
+#include "mymuduo/net/Buffer.h"
+
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+
+using namespace mymuduo;
+using namespace mymuduo::net;
+
+namespace mymuduo
+{
+    namespace net
+    {
+        namespace detail
+        {
+            const double kMicrosToSeconds = 1e-6;
+
+            // 直接格式化到 Buffer 的可写区域，不产生临时字符串
+            void appendf(Buffer *out, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+            void appendf(Buffer *out, const char *fmt, ...)
+            {
+                out->ensureWritableBytes(128);
+                va_list args;
+                va_start(args, fmt);
+                int n = vsnprintf(out->beginWrite(), out->writableBytes(), fmt, args);
+                va_end(args);
+                if (n > 0 && static_cast<size_t>(n) >= out->writableBytes())
+                {
+                    // 一行放不下，扩容后重新格式化
+                    out->ensureWritableBytes(static_cast<size_t>(n) + 1);
+                    va_start(args, fmt);
+                    n = vsnprintf(out->beginWrite(), out->writableBytes(), fmt, args);
+                    va_end(args);
+                }
+                if (n > 0)
+                {
+                    out->hasWritten(static_cast<size_t>(n));
+                }
+            }
+
+            void appendHeader(Buffer *out, const char *name, const char *type, const char *help)
+            {
+                appendf(out, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+            }
+
+            // 标签值中的 \、" 和换行需要转义
+            string labelValue(const string &value)
+            {
+                string result;
+                result.reserve(value.size());
+                for (char c : value)
+                {
+                    if (c == '\\' || c == '"')
+                    {
+                        result += '\\';
+                        result += c;
+                    }
+                    else if (c == '\n')
+                    {
+                        result += "\\n";
+                    }
+                    else
+                    {
+                        result += c;
+                    }
+                }
+                return result;
+            }
+
+            /**
+             * 桶的 le 标签为累计计数的上限，按 scale 换算单位。
+             * 快照中各个桶与 count 之间可能相差正在记录的值，_count 取桶的累计值，保持 +Inf 桶与 _count 相等
+             */
+            void appendHistogram(Buffer *out, const char *name, const string &labels,
+                                 const HistogramSnapshot &h, double scale)
+            {
+                int64_t cumulative = 0;
+                for (int i = 0; i < HistogramSnapshot::kBuckets; ++i)
+                {
+                    cumulative += h.buckets[i];
+                    int64_t bound = HistogramSnapshot::upperBound(i);
+                    if (bound < 0)
+                    {
+                        appendf(out, "%s_bucket{%s,le=\"+Inf\"} %" PRId64 "\n", name, labels.c_str(), cumulative);
+                    }
+                    else
+                    {
+                        appendf(out, "%s_bucket{%s,le=\"%.9g\"} %" PRId64 "\n", name, labels.c_str(),
+                                static_cast<double>(bound) * scale, cumulative);
+                    }
+                }
+                appendf(out, "%s_sum{%s} %.6f\n", name, labels.c_str(), static_cast<double>(h.sum) * scale);
+                appendf(out, "%s_count{%s} %" PRId64 "\n", name, labels.c_str(), cumulative);
+            }
+        }
+    }
+}
+
+HttpRequestStats::HttpRequestStats()
+    : latencyCount_(0),
+      latencySum_(0)
+{
+    for (int i = 0; i < kMaxStatus; ++i)
+    {
+        requests_[i].store(0, std::memory_order_relaxed);
+    }
+    for (int i = 0; i < HistogramSnapshot::kBuckets; ++i)
+    {
+        latencyBuckets_[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+void HttpRequestStats::addRequest(int status)
+{
+    if (status < 0 || status >= kMaxStatus)
+    {
+        status = 0;
+    }
+    requests_[status].fetch_add(1, std::memory_order_relaxed);
+}
+
+void HttpRequestStats::addLatency(int64_t micros)
+{
+    latencyBuckets_[HistogramSnapshot::bucketOf(micros)].fetch_add(1, std::memory_order_relaxed);
+    latencyCount_.fetch_add(1, std::memory_order_relaxed);
+    latencySum_.fetch_add(micros, std::memory_order_relaxed);
+}
+
+HistogramSnapshot HttpRequestStats::latencySnapshot() const
+{
+    HistogramSnapshot snap;
+    for (int i = 0; i < HistogramSnapshot::kBuckets; ++i)
+    {
+        snap.buckets[i] = latencyBuckets_[i].load(std::memory_order_relaxed);
+    }
+    snap.count = latencyCount_.load(std::memory_order_relaxed);
+    snap.sum = latencySum_.load(std::memory_order_relaxed);
+    return snap;
+}
+
+HttpMetrics::HttpMetrics()
+    : logging_(NULL),
+      sizeHint_(0)
+{
+}
+
+void HttpMetrics::addServer(HttpServer *server)
+{
+    MutexLockGuard lock(mutex_);
+    servers_.push_back(server);
+}
+
+std::vector<HttpServer *> HttpMetrics::servers() const
+{
+    MutexLockGuard lock(mutex_);
+    return servers_;
+}
+
+void HttpMetrics::render(Buffer *out) const
+{
+    out->ensureWritableBytes(sizeHint_.load(std::memory_order_relaxed));
+    size_t start = out->readableBytes();
+    std::vector<HttpServer *> servers = this->servers();
+    renderServers(servers, out);
+    renderLoops(servers, out);
+    renderProcess(out);
+    sizeHint_.store(out->readableBytes() - start, std::memory_order_relaxed);
+}
+
+void HttpMetrics::renderServers(const std::vector<HttpServer *> &servers, Buffer *out) const
+{
+    std::vector<string> labels;
+    for (HttpServer *server : servers)
+    {
+        labels.push_back("server=\"" + detail::labelValue(server->name()) + "\"");
+    }
+
+    detail::appendHeader(out, "mymuduo_connections", "gauge", "Currently open TCP connections.");
+    for (size_t i = 0; i < servers.size(); ++i)
+    {
+        detail::appendf(out, "mymuduo_connections{%s} %" PRId64 "\n", labels[i].c_str(), servers[i]->numConnections());
+    }
+    detail::appendHeader(out, "mymuduo_connections_accepted_total", "counter", "TCP connections accepted.");
+    for (size_t i = 0; i < servers.size(); ++i)
+    {
+        detail::appendf(out, "mymuduo_connections_accepted_total{%s} %" PRId64 "\n", labels[i].c_str(),
+                        servers[i]->acceptedConnections());
+    }
+
+    detail::appendHeader(out, "mymuduo_http_requests_total", "counter", "HTTP requests answered, by status code.");
+    for (size_t i = 0; i < servers.size(); ++i)
+    {
+        const HttpRequestStats &stats = servers[i]->requestStats();
+        for (int status = 0; status < HttpRequestStats::kMaxStatus; ++status)
+        {
+            int64_t n = stats.requests(status);
+            if (n > 0)
+            {
+                detail::appendf(out, "mymuduo_http_requests_total{%s,code=\"%d\"} %" PRId64 "\n", labels[i].c_str(), status, n);
+            }
+        }
+    }
+    detail::appendHeader(out, "mymuduo_http_request_duration_seconds", "histogram",
+                         "Time from receiving a request to queueing its response.");
+    for (size_t i = 0; i < servers.size(); ++i)
+    {
+        detail::appendHistogram(out, "mymuduo_http_request_duration_seconds", labels[i],
+                                servers[i]->requestStats().latencySnapshot(), detail::kMicrosToSeconds);
+    }
+}
+
+void HttpMetrics::renderLoops(const std::vector<HttpServer *> &servers, Buffer *out) const
+{
+    // 先取出所有快照，之后每个指标族按 (server, loop) 依次输出
+    std::vector<string> labels;
+    std::vector<LoopMetrics::Snapshot> snaps;
+    for (HttpServer *server : servers)
+    {
+        std::vector<LoopMetrics::Snapshot> loops = server->loopMetricsSnapshots();
+        for (size_t i = 0; i < loops.size(); ++i)
+        {
+            char loop[32];
+            snprintf(loop, sizeof loop, "\",loop=\"%zu\"", i);
+            labels.push_back("server=\"" + detail::labelValue(server->name()) + loop);
+            snaps.push_back(loops[i]);
+        }
+    }
+
+    detail::appendHeader(out, "mymuduo_loop_iterations_total", "counter", "Event loop iterations.");
+    for (size_t i = 0; i < snaps.size(); ++i)
+    {
+        detail::appendf(out, "mymuduo_loop_iterations_total{%s} %" PRId64 "\n", labels[i].c_str(), snaps[i].iterations);
+    }
+    detail::appendHeader(out, "mymuduo_loop_functors_total", "counter", "Functors run by the event loop.");
+    for (size_t i = 0; i < snaps.size(); ++i)
+    {
+        detail::appendf(out, "mymuduo_loop_functors_total{%s} %" PRId64 "\n", labels[i].c_str(), snaps[i].functorsRun);
+    }
+    detail::appendHeader(out, "mymuduo_loop_channels", "gauge", "Channels registered in the poller.");
+    for (size_t i = 0; i < snaps.size(); ++i)
+    {
+        detail::appendf(out, "mymuduo_loop_channels{%s} %" PRId64 "\n", labels[i].c_str(), snaps[i].channels);
+    }
+    detail::appendHeader(out, "mymuduo_loop_received_bytes_total", "counter", "Bytes read from sockets.");
+    for (size_t i = 0; i < snaps.size(); ++i)
+    {
+        detail::appendf(out, "mymuduo_loop_received_bytes_total{%s} %" PRId64 "\n", labels[i].c_str(), snaps[i].bytesRead);
+    }
+    detail::appendHeader(out, "mymuduo_loop_sent_bytes_total", "counter",
+                         "Bytes written to sockets, from user space buffers or by sendfile.");
+    for (size_t i = 0; i < snaps.size(); ++i)
+    {
+        detail::appendf(out, "mymuduo_loop_sent_bytes_total{%s,via=\"buffer\"} %" PRId64 "\n", labels[i].c_str(),
+                        snaps[i].bytesWritten - snaps[i].bytesSentFile);
+        detail::appendf(out, "mymuduo_loop_sent_bytes_total{%s,via=\"sendfile\"} %" PRId64 "\n", labels[i].c_str(),
+                        snaps[i].bytesSentFile);
+    }
+    detail::appendHeader(out, "mymuduo_loop_iteration_seconds", "histogram",
+                         "Time spent handling events and functors per iteration (loop lag).");
+    for (size_t i = 0; i < snaps.size(); ++i)
+    {
+        detail::appendHistogram(out, "mymuduo_loop_iteration_seconds", labels[i],
+                                snaps[i].iterationMicros, detail::kMicrosToSeconds);
+    }
+}
+
+void HttpMetrics::renderProcess(Buffer *out) const
+{
+    if (logging_)
+    {
+        detail::appendHeader(out, "mymuduo_log_dropped_buffers_total", "counter",
+                             "Log buffers dropped because the backend could not keep up.");
+        detail::appendf(out, "mymuduo_log_dropped_buffers_total %" PRId64 "\n", logging_->droppedBuffers());
+    }
+
+    ProcessInfo::CpuTime cpu = ProcessInfo::cpuTime();
+    detail::appendHeader(out, "process_cpu_seconds_total", "counter", "User and system CPU time spent in seconds.");
+    detail::appendf(out, "process_cpu_seconds_total %.3f\n", cpu.total());
+    detail::appendHeader(out, "process_resident_memory_bytes", "gauge", "Resident memory size in bytes.");
+    detail::appendf(out, "process_resident_memory_bytes %" PRId64 "\n", ProcessInfo::residentSetSize());
+    detail::appendHeader(out, "process_open_fds", "gauge", "Number of open file descriptors.");
+    detail::appendf(out, "process_open_fds %d\n", ProcessInfo::openedFiles());
+    detail::appendHeader(out, "process_max_fds", "gauge", "Maximum number of open file descriptors.");
+    detail::appendf(out, "process_max_fds %d\n", ProcessInfo::maxOpenFiles());
+    detail::appendHeader(out, "process_threads", "gauge", "Number of OS threads.");
+    detail::appendf(out, "process_threads %d\n", ProcessInfo::numThreads());
+    detail::appendHeader(out, "process_start_time_seconds", "gauge", "Start time of the process since unix epoch in seconds.");
+    detail::appendf(out, "process_start_time_seconds %.3f\n",
+                    static_cast<double>(ProcessInfo::startTime().microSecondsSinceEpoch()) * detail::kMicrosToSeconds);
+}
+
+void HttpMetrics::handle(const HttpRequest &, HttpResponse *resp) const
+{
+    Buffer buf;
+    render(&buf);
+    resp->setStatusCode(HttpResponse::k200Ok);
+    resp->setStatusMessage("OK");
+    resp->setContentType("text/plain; version=0.0.4; charset=utf-8");
+    // 页面只复制一次，作为共享的实体交给响应
+    resp->setBody(std::make_shared<const string>(buf.peek(), buf.readableBytes()));
+}
+
+HttpRouter::Handler HttpMetrics::handler() const
+{
+    return [this](const HttpRequest &req, const HttpRouter::Params &, HttpResponse *resp) {
+        handle(req, resp);
+    };
+}
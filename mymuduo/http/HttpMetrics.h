@@ -0,0 +1,95 @@
+#ifndef MYMUDUO_HTTP_HTTPMETRICS_H
+#define MYMUDUO_HTTP_HTTPMETRICS_H
+
+#include "mymuduo/base/Mutex.h"
+#include "mymuduo/base/noncopyable.h"
+#include "mymuduo/http/HttpRouter.h"
+#include "mymuduo/net/LoopMetrics.h"
+
+#include <atomic>
+#include <vector>
+
+namespace mymuduo
+{
+    class AsyncLogging;
+
+    namespace net
+    {
+        class Buffer;
+        class HttpRequest;
+        class HttpResponse;
+        class HttpServer;
+
+        /**
+         * HttpServer 的请求统计：按状态码计数，以及从收到请求到响应交给连接发送的耗时分布。
+         * 多个 IO 线程并发更新，每次记录只是几次 relaxed 的原子加法，不加锁；任意线程可以读取
+         */
+        class HttpRequestStats : noncopyable
+        {
+        public:
+            static const int kMaxStatus = 600; // 超出 [0, 600) 的状态码计入 0
+
+            HttpRequestStats();
+
+            void addRequest(int status);
+            void addLatency(int64_t micros);
+
+            int64_t requests(int status) const { return requests_[status].load(std::memory_order_relaxed); }
+            HistogramSnapshot latencySnapshot() const;
+
+        private:
+            std::atomic<int64_t> requests_[kMaxStatus];
+            std::atomic<int64_t> latencyBuckets_[HistogramSnapshot::kBuckets];
+            std::atomic<int64_t> latencyCount_;
+            std::atomic<int64_t> latencySum_;
+        };
+
+        /**
+         * 以 Prometheus 文本格式（version 0.0.4）导出运行统计，挂载到路由上供采集：
+         *   HttpMetrics metrics;
+         *   metrics.addServer(&server);
+         *   router.get("/metrics", metrics.handler());
+         * FileServer 使用 FileServer::setMetrics() 挂载。
+         *
+         * 导出的内容：
+         *  - 每个服务器的连接数、累计接受的连接、按状态码的请求数、请求耗时直方图
+         *  - 每个 EventLoop 的循环次数、读写字节数（发送分为经过缓冲区和 sendfile 两部分）、
+         *    Channel 数，以及开启 EventLoop::setMetricsEnabled 后每轮循环的耗时直方图（事件循环的延迟）
+         *  - AsyncLogging 丢弃的缓冲区数（setAsyncLogging 之后）
+         *  - 进程的常驻内存、打开的文件数、线程数和 CPU 时间
+         *
+         * 渲染时只读取各处的原子计数器，直接格式化追加到 Buffer 中，不在 IO 线程间加锁，也不打扰它们；
+         * 同一时刻读到的各项之间可能相差正在更新的几个值。
+         * 共用同一个 baseLoop 的多个服务器，各自导出的 loop="0" 统计来自同一个 EventLoop
+         */
+        class HttpMetrics : noncopyable
+        {
+        public:
+            HttpMetrics();
+
+            /// 线程安全，通常在 server.start() 之前调用；loop 统计在 start() 之后才会出现
+            void addServer(HttpServer *server);
+            void setAsyncLogging(const AsyncLogging *logging) { logging_ = logging; }
+
+            /// 把全部统计追加到 out，可以在任意线程调用
+            void render(Buffer *out) const;
+
+            void handle(const HttpRequest &req, HttpResponse *resp) const;
+            HttpRouter::Handler handler() const;
+
+        private:
+            std::vector<HttpServer *> servers() const;
+            void renderServers(const std::vector<HttpServer *> &servers, Buffer *out) const;
+            void renderLoops(const std::vector<HttpServer *> &servers, Buffer *out) const;
+            void renderProcess(Buffer *out) const;
+
+            mutable MutexLock mutex_;
+            std::vector<HttpServer *> servers_ GUARDED_BY(mutex_);
+            const AsyncLogging *logging_;
+            // 上一次渲染的长度，下一次按此预留缓冲区，避免逐步扩容
+            mutable std::atomic<size_t> sizeHint_;
+        };
+    }
+}
+
+#endif // MYMUDUO_HTTP_HTTPMETRICS_H
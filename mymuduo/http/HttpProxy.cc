@@ -0,0 +1,937 @@
+#include "mymuduo/http/HttpProxy.h"
+
+#include "mymuduo/base/Logging.h"
+#include "mymuduo/http/HttpClientConnection.h"
+#include "mymuduo/http/HttpResponseParser.h"
+#include "mymuduo/http/HttpServer.h"
+#include "mymuduo/net/EventLoop.h"
+#include "mymuduo/net/TcpConnection.h"
+
+#include <algorithm>
+#include <stdlib.h>
+#include <strings.h>
+
+using namespace mymuduo;
+using namespace mymuduo::net;
+
+namespace mymuduo
+{
+    namespace net
+    {
+        namespace detail
+        {
+            // 转发时上游的连接积压超过该值就暂停读取客户端的实体
+            const size_t kUpstreamHighWaterMark = 256 * 1024;
+
+            // 只对一跳有效的首部，不转发
+            bool isHopByHop(const string &field)
+            {
+                static const char *const kFields[] = {
+                    "Connection", "Keep-Alive", "Proxy-Connection", "TE",
+                    "Trailer", "Transfer-Encoding", "Upgrade"};
+                for (const char *name : kFields)
+                {
+                    if (::strcasecmp(field.c_str(), name) == 0)
+                        return true;
+                }
+                return false;
+            }
+
+            bool isField(const string &field, const char *name)
+            {
+                return ::strcasecmp(field.c_str(), name) == 0;
+            }
+        }
+    }
+}
+
+struct HttpProxy::Upstream
+{
+    Upstream(const InetAddress &address, size_t i) : addr(address), index(i)
+    {
+        healthy.getAndSet(1);
+    }
+
+    InetAddress addr;
+    size_t index;
+    AtomicInt32 outstanding; // 所有 IO 线程上正在处理的请求数
+    AtomicInt32 healthy;
+};
+
+struct HttpProxy::LoopPool
+{
+    // 下标为上游的序号，后放入的连接先取出
+    std::vector<std::vector<UpstreamConnectionPtr>> idle;
+};
+
+/**
+ * 到上游的一条连接，
+ * 正在处理请求时 session 不为空，否则位于所属 EventLoop 的连接池中
+ */
+class HttpProxy::UpstreamConnection : public HttpClientConnection
+{
+public:
+    UpstreamConnection(HttpProxy *proxy, EventLoop *loop, Upstream *upstream)
+        : HttpClientConnection(loop, upstream->addr, proxy->name_ + "-" + upstream->addr.toIpPort()),
+          proxy_(proxy),
+          upstream_(upstream)
+    {
+    }
+
+    Upstream *upstream() const { return upstream_; }
+
+    SessionPtr session;
+
+private:
+    void onConnected() override;
+    void onMessage(Buffer *buf) override;
+    void onWriteComplete() override;
+    void onClosed(bool connectFailed) override;
+
+    HttpProxy *proxy_;
+    Upstream *upstream_;
+};
+
+/**
+ * 转发一个请求的全过程，在客户端连接所属的 IO 线程中运行。
+ * 请求实体需要流式转发时，首部到达就开始连接上游，此时 HttpAsyncResponse 还不存在，
+ * 在它 attach() 之前收到的响应先暂存，并暂停读取上游
+ */
+class HttpProxy::Session : noncopyable,
+                           public std::enable_shared_from_this<Session>
+{
+public:
+    Session(HttpProxy *proxy, const TcpConnectionPtr &client, const HttpRequest &req, bool streamBody);
+
+    void start();
+    void attach(const HttpAsyncResponsePtr &resp);
+    size_t onData(const char *data, size_t len);
+
+    void onUpstreamConnected();
+    void onUpstreamMessage(Buffer *buf);
+    void onUpstreamWritable();
+    void onUpstreamClosed(bool connectFailed);
+
+private:
+    void sendRequest();
+    // 根据解析进度推进响应的转发
+    void pump();
+    void startResponse();
+    void onBody(const char *data, size_t len);
+    void complete();
+    // 请求在发送之前，或者可以安全重放时才重试
+    bool canRetry() const { return !responseStarted_ && (!requestSent_ || (idempotent_ && !streamBody_)); }
+    void fail(HttpResponse::HttpStatusCode code, bool retry);
+    // 客户端已经断开
+    void abort();
+    void respondError(HttpResponse::HttpStatusCode code);
+    void detachUpstream(bool reusable);
+    void pauseUpstream();
+    void resumeUpstream();
+    void onClientWritable();
+    void startTimer(double seconds);
+    void cancelTimer();
+    void onTimeout();
+
+    HttpProxy *proxy_;
+    EventLoop *loop_;
+    std::weak_ptr<TcpConnection> client_;
+    HttpRequest::Method method_;
+    string requestLine_;
+    string headers_; // 转发的首部行，不含 Host
+    string host_;    // 客户端的 Host，为空时使用上游地址
+    string body_;
+    bool idempotent_;
+    bool streamBody_;
+    size_t bodyRemaining_; // 流式转发的实体还有多少字节没有发给上游
+    bool bodyBlocked_;     // onData 因为上游跟不上返回过 0，需要 resumeBody
+
+    HttpAsyncResponsePtr resp_;
+    UpstreamConnectionPtr upstream_;
+    Upstream *target_;
+    Upstream *lastFailed_;
+    int tries_;
+    bool requestSent_;
+    bool responseStarted_;
+    bool upstreamPaused_;
+    bool finished_;
+    HttpResponse::HttpStatusCode error_; // attach() 之前已经失败时要返回的状态码
+    string early_;                       // attach() 之前收到的响应实体
+    TimerId timer_;
+    bool timerActive_;
+};
+
+/**
+ * 对一个上游的一次健康检查，运行在 baseLoop 上，由超时定时器持有，
+ * 连接超时时间之内没有得到正常的响应即视为不健康
+ */
+class HttpProxy::HealthCheck : public HttpClientConnection
+{
+public:
+    HealthCheck(HttpProxy *proxy, Upstream *upstream)
+        : HttpClientConnection(proxy->baseLoop_, upstream->addr, proxy->name_ + "-check"),
+          proxy_(proxy),
+          upstream_(upstream),
+          done_(false)
+    {
+    }
+
+    void start();
+    // HttpProxy 析构时调用，不再报告结果
+    void cancel();
+
+private:
+    void onConnected() override;
+    void onMessage(Buffer *buf) override;
+    void onClosed(bool connectFailed) override;
+    void finish(bool healthy);
+
+    HttpProxy *proxy_;
+    Upstream *upstream_;
+    bool done_;
+};
+
+void HttpProxy::UpstreamConnection::onConnected()
+{
+    if (session)
+    {
+        session->onUpstreamConnected();
+    }
+}
+
+void HttpProxy::UpstreamConnection::onMessage(Buffer *buf)
+{
+    if (session)
+    {
+        SessionPtr guard(session);
+        guard->onUpstreamMessage(buf);
+    }
+    else
+    {
+        // 空闲连接上不应该有数据
+        LOG_WARN << "HttpProxy unexpected " << buf->readableBytes() << " bytes from idle upstream "
+                 << upstream_->addr.toIpPort();
+        buf->retrieveAll();
+        close();
+        proxy_->removeIdle(this);
+    }
+}
+
+void HttpProxy::UpstreamConnection::onWriteComplete()
+{
+    if (session)
+    {
+        SessionPtr guard(session);
+        guard->onUpstreamWritable();
+    }
+}
+
+void HttpProxy::UpstreamConnection::onClosed(bool connectFailed)
+{
+    if (session)
+    {
+        SessionPtr s(session);
+        s->onUpstreamClosed(connectFailed);
+    }
+    else
+    {
+        proxy_->removeIdle(this);
+    }
+}
+
+HttpProxy::Session::Session(HttpProxy *proxy, const TcpConnectionPtr &client, const HttpRequest &req, bool streamBody)
+    : proxy_(proxy),
+      loop_(client->getLoop()),
+      client_(client),
+      method_(req.method()),
+      idempotent_(req.method() != HttpRequest::kPost),
+      streamBody_(streamBody),
+      bodyRemaining_(0),
+      bodyBlocked_(false),
+      target_(NULL),
+      lastFailed_(NULL),
+      tries_(0),
+      requestSent_(false),
+      responseStarted_(false),
+      upstreamPaused_(false),
+      finished_(false),
+      error_(HttpResponse::kUnknown),
+      timerActive_(false)
+{
+    requestLine_ = req.methodString();
+    requestLine_ += ' ';
+    requestLine_ += req.path();
+    requestLine_ += req.query();
+    requestLine_ += " HTTP/1.1\r\n";
+
+    string forwardedFor = client->peerAddr().toIp();
+    for (const auto &header : req.headers())
+    {
+        if (detail::isHopByHop(header.first) || detail::isField(header.first, "Content-Length"))
+        {
+            continue;
+        }
+        if (detail::isField(header.first, "Host"))
+        {
+            host_ = header.second;
+            continue;
+        }
+        if (detail::isField(header.first, "X-Forwarded-For"))
+        {
+            forwardedFor = header.second + ", " + forwardedFor;
+            continue;
+        }
+        headers_ += header.first;
+        headers_ += ": ";
+        headers_ += header.second;
+        headers_ += "\r\n";
+    }
+    headers_ += "X-Forwarded-For: " + forwardedFor + "\r\n";
+    if (streamBody_)
+    {
+        bodyRemaining_ = static_cast<size_t>(strtoull(req.getHeader("Content-Length").c_str(), NULL, 10));
+        headers_ += "Content-Length: " + std::to_string(bodyRemaining_) + "\r\n";
+    }
+    else
+    {
+        body_ = req.getBody();
+        if (!body_.empty() || method_ == HttpRequest::kPost || method_ == HttpRequest::kPut)
+        {
+            headers_ += "Content-Length: " + std::to_string(body_.size()) + "\r\n";
+        }
+    }
+}
+
+void HttpProxy::Session::start()
+{
+    target_ = proxy_->selectUpstream(lastFailed_);
+    if (!target_)
+    {
+        fail(HttpResponse::k503ServiceUnavailable, false);
+        return;
+    }
+    ++tries_;
+    target_->outstanding.increment();
+    upstream_ = proxy_->acquire(loop_, target_);
+    upstream_->session = shared_from_this();
+    if (upstream_->connected())
+    {
+        sendRequest();
+    }
+    else
+    {
+        startTimer(proxy_->connectTimeout_);
+    }
+}
+
+void HttpProxy::Session::attach(const HttpAsyncResponsePtr &resp)
+{
+    resp_ = resp;
+    std::weak_ptr<Session> weakSelf(shared_from_this());
+    resp_->setWritableCallback([weakSelf]() {
+        SessionPtr self(weakSelf.lock());
+        if (self)
+            self->onClientWritable();
+    });
+    if (error_ != HttpResponse::kUnknown)
+    {
+        respondError(error_);
+        return;
+    }
+    if (upstream_)
+    {
+        pump();
+    }
+}
+
+size_t HttpProxy::Session::onData(const char *data, size_t len)
+{
+    if (finished_)
+    {
+        // 已经失败，剩下的实体丢弃
+        return len;
+    }
+    if (!requestSent_ || !upstream_->connected() ||
+        upstream_->connection()->queuedBytes() >= detail::kUpstreamHighWaterMark)
+    {
+        bodyBlocked_ = true;
+        return 0;
+    }
+    Buffer buf;
+    buf.append(data, len);
+    upstream_->connection()->send(&buf);
+    bodyRemaining_ -= std::min(len, bodyRemaining_);
+    return len;
+}
+
+void HttpProxy::Session::onUpstreamConnected()
+{
+    cancelTimer();
+    sendRequest();
+}
+
+void HttpProxy::Session::sendRequest()
+{
+    requestSent_ = true;
+    HttpResponseParser &parser = upstream_->parser();
+    parser.reset(method_ == HttpRequest::kHead);
+    parser.setBodyCallback(std::bind(&Session::onBody, this, _1, _2));
+
+    Buffer buf;
+    buf.append(requestLine_);
+    buf.append("Host: ");
+    buf.append(host_.empty() ? upstream_->upstream()->addr.toIpPort() : host_);
+    buf.append("\r\n");
+    buf.append(headers_);
+    buf.append("\r\n");
+    buf.append(body_);
+    upstream_->connection()->send(&buf);
+    startTimer(proxy_->responseTimeout_);
+
+    if (bodyBlocked_)
+    {
+        bodyBlocked_ = false;
+        onUpstreamWritable();
+    }
+}
+
+void HttpProxy::Session::onUpstreamWritable()
+{
+    TcpConnectionPtr client(client_.lock());
+    if (client && requestSent_ && streamBody_)
+    {
+        // 放到下一轮，避免在上游的回调中重入 HttpServer::onMessage
+        HttpServer *server = proxy_->server_;
+        loop_->queueInLoop([server, client]() { server->resumeBody(client); });
+    }
+}
+
+void HttpProxy::Session::onUpstreamMessage(Buffer *buf)
+{
+    if (resp_ && !resp_->connection())
+    {
+        abort();
+        return;
+    }
+    if (!upstream_->parser().parse(buf))
+    {
+        fail(HttpResponse::k502BadGateway, false);
+        return;
+    }
+    pump();
+}
+
+void HttpProxy::Session::onUpstreamClosed(bool connectFailed)
+{
+    if (connectFailed)
+    {
+        LOG_WARN << "HttpProxy connect to " << target_->addr.toIpPort() << " failed";
+        if (proxy_->healthCheckInterval_ > 0)
+        {
+            // 由健康检查负责恢复
+            proxy_->markHealthy(target_, false);
+        }
+        fail(HttpResponse::k502BadGateway, true);
+    }
+    else if (requestSent_ && upstream_->parser().parseEof())
+    {
+        // 以关闭连接作为实体结束的响应
+        pump();
+    }
+    else
+    {
+        LOG_WARN << "HttpProxy upstream " << target_->addr.toIpPort() << " closed in state "
+                 << upstream_->parser().state();
+        fail(HttpResponse::k502BadGateway, canRetry());
+    }
+}
+
+void HttpProxy::Session::pump()
+{
+    HttpResponseParser &parser = upstream_->parser();
+    if (!parser.headersComplete())
+    {
+        return;
+    }
+    cancelTimer();
+    if (!resp_)
+    {
+        // 请求实体还没有收完，响应先留在上游
+        pauseUpstream();
+        return;
+    }
+    if (!responseStarted_)
+    {
+        startResponse();
+    }
+    if (parser.gotAll())
+    {
+        complete();
+    }
+}
+
+void HttpProxy::Session::startResponse()
+{
+    responseStarted_ = true;
+    HttpResponseParser &parser = upstream_->parser();
+    HttpResponse *response = resp_->response();
+    int code = parser.statusCode();
+    if (code < 200 || code > 511)
+    {
+        LOG_WARN << "HttpProxy unsupported upstream status " << code;
+        code = HttpResponse::k502BadGateway;
+    }
+    response->setStatusCode(static_cast<HttpResponse::HttpStatusCode>(code));
+    response->setStatusMessage(parser.statusMessage());
+    for (const auto &header : parser.headers())
+    {
+        if (!detail::isHopByHop(header.first) && !detail::isField(header.first, "Content-Length") &&
+            !detail::isField(header.first, "Date"))
+        {
+            response->addHeader(header.first, header.second);
+        }
+    }
+    if (parser.contentLength() >= 0)
+    {
+        response->setContentLength(parser.contentLength());
+    }
+    resp_->startStream();
+    if (!early_.empty())
+    {
+        string early;
+        early.swap(early_);
+        onBody(early.data(), early.size());
+    }
+    resumeUpstream();
+}
+
+void HttpProxy::Session::onBody(const char *data, size_t len)
+{
+    if (!responseStarted_)
+    {
+        early_.append(data, len);
+    }
+    else if (!resp_->write(data, len))
+    {
+        // 客户端跟不上，等 WritableCallback
+        pauseUpstream();
+    }
+}
+
+void HttpProxy::Session::complete()
+{
+    finished_ = true;
+    cancelTimer();
+    // 请求实体没有发完，或者上游在响应之后还有多余的数据时，连接的状态不确定，不复用
+    bool reusable = upstream_->parser().keepAlive() && bodyRemaining_ == 0 && upstream_->connected() &&
+                    upstream_->connection()->inputBuffer()->readableBytes() == 0;
+    detachUpstream(reusable);
+    resp_->endStream();
+}
+
+void HttpProxy::Session::fail(HttpResponse::HttpStatusCode code, bool retry)
+{
+    cancelTimer();
+    if (upstream_)
+    {
+        lastFailed_ = target_;
+        detachUpstream(false);
+    }
+    if (retry && tries_ < proxy_->maxTries_ && !finished_)
+    {
+        requestSent_ = false;
+        start();
+        return;
+    }
+    finished_ = true;
+    if (responseStarted_)
+    {
+        // 响应已经发出了一部分，只能断开客户端
+        TcpConnectionPtr client(client_.lock());
+        if (client)
+            client->forceClose();
+        return;
+    }
+    if (resp_)
+        respondError(code);
+    else
+        error_ = code;
+}
+
+void HttpProxy::Session::abort()
+{
+    LOG_DEBUG << "HttpProxy client gone, abort the request";
+    finished_ = true;
+    cancelTimer();
+    if (upstream_)
+    {
+        detachUpstream(false);
+    }
+}
+
+void HttpProxy::Session::respondError(HttpResponse::HttpStatusCode code)
+{
+    HttpResponse *response = resp_->response();
+    response->setStatusCode(code);
+    response->setContentType("text/plain");
+    response->setBody(code == HttpResponse::k504GatewayTimeout ? "upstream timed out\n" : "upstream unavailable\n");
+    resp_->done();
+}
+
+void HttpProxy::Session::detachUpstream(bool reusable)
+{
+    UpstreamConnectionPtr conn;
+    conn.swap(upstream_);
+    conn->session.reset();
+    conn->parser().setBodyCallback(HttpResponseParser::BodyCallback());
+    target_->outstanding.decrement();
+    if (upstreamPaused_)
+    {
+        upstreamPaused_ = false;
+        if (conn->connected())
+            conn->connection()->startRead();
+    }
+    proxy_->release(conn, reusable);
+}
+
+void HttpProxy::Session::pauseUpstream()
+{
+    if (!upstreamPaused_ && upstream_->connected())
+    {
+        upstreamPaused_ = true;
+        upstream_->connection()->stopRead();
+    }
+}
+
+void HttpProxy::Session::resumeUpstream()
+{
+    if (upstreamPaused_ && upstream_)
+    {
+        upstreamPaused_ = false;
+        if (upstream_->connected())
+            upstream_->connection()->startRead();
+    }
+}
+
+void HttpProxy::Session::onClientWritable()
+{
+    TcpConnectionPtr client(resp_->connection());
+    if (!client || !client->connected())
+    {
+        if (!finished_)
+            abort();
+        return;
+    }
+    resumeUpstream();
+}
+
+void HttpProxy::Session::startTimer(double seconds)
+{
+    cancelTimer();
+    if (seconds <= 0)
+    {
+        return;
+    }
+    std::weak_ptr<Session> weakSelf(shared_from_this());
+    timer_ = loop_->runAfter(seconds, [weakSelf]() {
+        SessionPtr self(weakSelf.lock());
+        if (self)
+            self->onTimeout();
+    });
+    timerActive_ = true;
+}
+
+void HttpProxy::Session::cancelTimer()
+{
+    if (timerActive_)
+    {
+        timerActive_ = false;
+        loop_->cancel(timer_);
+    }
+}
+
+void HttpProxy::Session::onTimeout()
+{
+    timerActive_ = false;
+    if (finished_ || !upstream_)
+    {
+        return;
+    }
+    LOG_WARN << "HttpProxy upstream " << target_->addr.toIpPort()
+             << (requestSent_ ? " response" : " connect") << " timeout";
+    // 连接超时可以换一个上游重试，请求发出之后的超时不重试
+    fail(HttpResponse::k504GatewayTimeout, !requestSent_);
+}
+
+void HttpProxy::HealthCheck::start()
+{
+    std::shared_ptr<HealthCheck> self(std::static_pointer_cast<HealthCheck>(shared_from_this()));
+    proxy_->baseLoop_->runAfter(proxy_->connectTimeout_, [self]() { self->finish(false); });
+    connect();
+}
+
+void HttpProxy::HealthCheck::cancel()
+{
+    done_ = true;
+    close();
+}
+
+void HttpProxy::HealthCheck::onConnected()
+{
+    if (done_)
+    {
+        close();
+        return;
+    }
+    connection()->send("GET " + proxy_->healthCheckPath_ + " HTTP/1.1\r\nHost: " + upstream_->addr.toIpPort() +
+                       "\r\nConnection: close\r\n\r\n");
+}
+
+void HttpProxy::HealthCheck::onClosed(bool connectFailed)
+{
+    finish(!connectFailed && parser().parseEof() && parser().statusCode() < 400);
+}
+
+void HttpProxy::HealthCheck::onMessage(Buffer *buf)
+{
+    if (!parser().parse(buf))
+    {
+        finish(false);
+    }
+    else if (parser().gotAll())
+    {
+        finish(parser().statusCode() < 400);
+    }
+}
+
+void HttpProxy::HealthCheck::finish(bool healthy)
+{
+    if (done_)
+    {
+        return;
+    }
+    done_ = true;
+    proxy_->markHealthy(upstream_, healthy);
+    close();
+}
+
+HttpProxy::HttpProxy(EventLoop *baseLoop, const string &name)
+    : baseLoop_(baseLoop),
+      name_(name),
+      server_(NULL),
+      balanceMode_(kRoundRobin),
+      maxIdle_(16),
+      connectTimeout_(3),
+      responseTimeout_(30),
+      maxTries_(2),
+      healthCheckInterval_(0)
+{
+}
+
+HttpProxy::~HttpProxy()
+{
+    // 健康检查和空闲连接在各自的 IO 线程中关闭，等待完成后才返回
+    detail::runInLoopAndWait(baseLoop_, [this]() {
+        if (healthCheckInterval_ > 0)
+        {
+            baseLoop_->cancel(healthCheckTimer_);
+        }
+        for (const std::weak_ptr<HealthCheck> &weakCheck : healthChecks_)
+        {
+            std::shared_ptr<HealthCheck> check(weakCheck.lock());
+            if (check)
+                check->cancel();
+        }
+        healthChecks_.clear();
+    });
+    MutexLockGuard lock(mutex_);
+    for (auto &entry : pools_)
+    {
+        LoopPool *pool = entry.second.get();
+        detail::runInLoopAndWait(entry.first, [pool]() {
+            for (const std::vector<UpstreamConnectionPtr> &idle : pool->idle)
+            {
+                for (const UpstreamConnectionPtr &conn : idle)
+                    conn->close();
+            }
+            pool->idle.clear();
+        });
+    }
+}
+
+void HttpProxy::addUpstream(const InetAddress &addr)
+{
+    upstreams_.push_back(std::unique_ptr<Upstream>(new Upstream(addr, upstreams_.size())));
+}
+
+void HttpProxy::setHealthCheck(const string &path, double interval)
+{
+    healthCheckPath_ = path;
+    healthCheckInterval_ = interval;
+}
+
+bool HttpProxy::upstreamHealthy(size_t index) const
+{
+    return upstreams_[index]->healthy.get() != 0;
+}
+
+int HttpProxy::outstanding(size_t index) const
+{
+    return upstreams_[index]->outstanding.get();
+}
+
+void HttpProxy::attach(HttpServer *server)
+{
+    assert(!upstreams_.empty());
+    server_ = server;
+    server->setHttpAsyncCallback(std::bind(&HttpProxy::onRequest, this, _1));
+    server->setHttpStreamCallback(std::bind(&HttpProxy::onRequestHeaders, this, _1, _2));
+    if (healthCheckInterval_ > 0)
+    {
+        healthCheckTimer_ = baseLoop_->runEvery(healthCheckInterval_, std::bind(&HttpProxy::runHealthChecks, this));
+    }
+}
+
+void HttpProxy::onRequest(const HttpAsyncResponsePtr &resp)
+{
+    TcpConnectionPtr conn(resp->connection());
+    if (!conn)
+    {
+        resp->done();
+        return;
+    }
+    SessionPtr session(std::make_shared<Session>(this, conn, resp->request(), false));
+    session->attach(resp);
+    session->start();
+}
+
+/**
+ * 实体较小时照常缓存，得到完整的请求后由 onRequest 转发，可以重试；
+ * 较大的实体在首部到达时就开始转发
+ */
+HttpBodyHandler HttpProxy::onRequestHeaders(const TcpConnectionPtr &conn, const HttpRequest &req)
+{
+    HttpBodyHandler handler;
+    const string &length = req.getHeader("Content-Length");
+    if (strtoull(length.c_str(), NULL, 10) <= kMaxReplayBody)
+    {
+        return handler;
+    }
+    SessionPtr session(std::make_shared<Session>(this, conn, req, true));
+    handler.onData = [session](const char *data, size_t len) { return session->onData(data, len); };
+    handler.onAsyncComplete = [session](const HttpAsyncResponsePtr &resp) { session->attach(resp); };
+    session->start();
+    return handler;
+}
+
+HttpProxy::Upstream *HttpProxy::selectUpstream(const Upstream *avoid)
+{
+    size_t n = upstreams_.size();
+    size_t first = static_cast<size_t>(nextUpstream_.getAndAdd(1));
+    Upstream *best = NULL;
+    Upstream *fallback = NULL;
+    for (size_t i = 0; i < n; ++i)
+    {
+        Upstream *upstream = upstreams_[(first + i) % n].get();
+        if (!upstream->healthy.get())
+        {
+            continue;
+        }
+        if (upstream == avoid)
+        {
+            // 只剩它可用时才再次选择
+            fallback = upstream;
+            continue;
+        }
+        if (balanceMode_ == kRoundRobin)
+        {
+            return upstream;
+        }
+        if (!best || upstream->outstanding.get() < best->outstanding.get())
+        {
+            best = upstream;
+        }
+    }
+    return best ? best : fallback;
+}
+
+HttpProxy::LoopPool *HttpProxy::poolOf(EventLoop *loop)
+{
+    MutexLockGuard lock(mutex_);
+    std::unique_ptr<LoopPool> &pool = pools_[loop];
+    if (!pool)
+    {
+        pool.reset(new LoopPool);
+        pool->idle.resize(upstreams_.size());
+    }
+    return pool.get();
+}
+
+HttpProxy::UpstreamConnectionPtr HttpProxy::acquire(EventLoop *loop, Upstream *upstream)
+{
+    std::vector<UpstreamConnectionPtr> &idle = poolOf(loop)->idle[upstream->index];
+    while (!idle.empty())
+    {
+        UpstreamConnectionPtr conn(idle.back());
+        idle.pop_back();
+        if (conn->connected())
+        {
+            return conn;
+        }
+        conn->close();
+    }
+    UpstreamConnectionPtr conn(std::make_shared<UpstreamConnection>(this, loop, upstream));
+    conn->connect();
+    return conn;
+}
+
+void HttpProxy::release(const UpstreamConnectionPtr &conn, bool reusable)
+{
+    if (reusable && conn->connected())
+    {
+        std::vector<UpstreamConnectionPtr> &idle = poolOf(conn->getLoop())->idle[conn->upstream()->index];
+        if (idle.size() < maxIdle_)
+        {
+            idle.push_back(conn);
+            return;
+        }
+    }
+    conn->close();
+}
+
+void HttpProxy::removeIdle(const UpstreamConnection *conn)
+{
+    std::vector<UpstreamConnectionPtr> &idle = poolOf(conn->getLoop())->idle[conn->upstream()->index];
+    for (auto it = idle.begin(); it != idle.end(); ++it)
+    {
+        if (it->get() == conn)
+        {
+            idle.erase(it);
+            break;
+        }
+    }
+}
+
+void HttpProxy::runHealthChecks()
+{
+    // 顺便清理已经结束的检查
+    healthChecks_.erase(std::remove_if(healthChecks_.begin(), healthChecks_.end(),
+                                       [](const std::weak_ptr<HealthCheck> &check) { return check.expired(); }),
+                        healthChecks_.end());
+    for (const std::unique_ptr<Upstream> &upstream : upstreams_)
+    {
+        std::shared_ptr<HealthCheck> check(std::make_shared<HealthCheck>(this, upstream.get()));
+        healthChecks_.push_back(check);
+        check->start();
+    }
+}
+
+void HttpProxy::markHealthy(Upstream *upstream, bool healthy)
+{
+    int was = upstream->healthy.getAndSet(healthy ? 1 : 0);
+    if (was != (healthy ? 1 : 0))
+    {
+        LOG_WARN << "HttpProxy[" << name_ << "] upstream " << upstream->addr.toIpPort()
+                 << (healthy ? " is up" : " is down");
+    }
+}
@@ -0,0 +1,120 @@
+#ifndef MYMUDUO_HTTP_HTTPPROXY_H
+#define MYMUDUO_HTTP_HTTPPROXY_H
+
+#include "mymuduo/base/Atomic.h"
+#include "mymuduo/base/Mutex.h"
+#include "mymuduo/http/HttpAsyncResponse.h"
+#include "mymuduo/http/HttpContext.h"
+#include "mymuduo/net/InetAddress.h"
+#include "mymuduo/net/TimerId.h"
+
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace mymuduo
+{
+    namespace net
+    {
+        class EventLoop;
+        class HttpServer;
+
+        /**
+         * 反向代理 / 负载均衡：把 HttpServer 收到的请求转发给一组上游服务器，
+         * 再把上游的响应转发回客户端
+         *
+         *  - 上游连接是 keep-alive 的 TcpClient，按 IO 线程分别建池，请求总在客户端连接所属的
+         *    EventLoop 上转发，不需要跨线程交接
+         *  - 按轮转（round-robin）或最少未完成请求选择上游
+         *  - 可选的健康检查在 baseLoop 的定时器上周期性发送 GET，不健康的上游暂不参与选择
+         *  - 请求实体（超过 kMaxReplayBody 时）和响应实体都是边收边转发，任一方向的对端跟不上时
+         *    暂停读取另一端，内存中积压的数据有上限
+         *  - 幂等请求（GET/HEAD/PUT/DELETE）在收到响应之前失败时换一个上游重试，
+         *    实体已经流式转发出去的请求不重试
+         *
+         * 与 HttpServer 一样，HttpProxy 的生命期要长于 EventLoop 的运行；
+         * 析构时 IO 线程必须仍在运行（先于 attach 的 HttpServer 析构），空闲连接在各自的线程中关闭，
+         * 析构函数等到全部关闭后才返回
+         */
+        class HttpProxy : noncopyable
+        {
+        public:
+            enum BalanceMode
+            {
+                kRoundRobin,
+                kLeastOutstanding,
+            };
+
+            // 不超过该长度的请求实体完整缓存后再转发，可以用于重试
+            static const size_t kMaxReplayBody = 64 * 1024;
+
+            HttpProxy(EventLoop *baseLoop, const string &name);
+            ~HttpProxy();
+
+            /// 以下设置都在 attach() 之前调用
+            void addUpstream(const InetAddress &addr);
+            void setBalanceMode(BalanceMode mode) { balanceMode_ = mode; }
+            /// 每隔 interval 秒对每个上游 GET path，2xx/3xx 视为健康。interval 为 0 时不检查（默认）
+            void setHealthCheck(const string &path, double interval);
+            /// 每个 IO 线程对每个上游最多保留的空闲连接数，默认 16
+            void setMaxIdleConnections(size_t n) { maxIdle_ = n; }
+            void setConnectTimeout(double seconds) { connectTimeout_ = seconds; }
+            /// 从请求发出到收到响应首部的超时，超时返回 504
+            void setResponseTimeout(double seconds) { responseTimeout_ = seconds; }
+            /// 每个请求最多尝试的次数（包括第一次），默认 2
+            void setMaxTries(int n) { maxTries_ = n; }
+
+            /// 接管 server 的全部请求，server 之后不再使用其他 Http 回调
+            void attach(HttpServer *server);
+
+            size_t upstreamCount() const { return upstreams_.size(); }
+            bool upstreamHealthy(size_t index) const;
+            /// 正在处理的请求数
+            int outstanding(size_t index) const;
+
+        private:
+            struct Upstream;
+            struct LoopPool;
+            class UpstreamConnection;
+            class Session;
+            class HealthCheck;
+            typedef std::shared_ptr<UpstreamConnection> UpstreamConnectionPtr;
+            typedef std::shared_ptr<Session> SessionPtr;
+
+            void onRequest(const HttpAsyncResponsePtr &resp);
+            HttpBodyHandler onRequestHeaders(const TcpConnectionPtr &conn, const HttpRequest &req);
+
+            // 选择一个健康的上游，尽量避开 avoid，没有时返回空指针
+            Upstream *selectUpstream(const Upstream *avoid);
+            // 取出一个空闲连接，没有时新建
+            UpstreamConnectionPtr acquire(EventLoop *loop, Upstream *upstream);
+            // 请求完成后放回连接池，连接不可复用或池已满时关闭
+            void release(const UpstreamConnectionPtr &conn, bool reusable);
+            void removeIdle(const UpstreamConnection *conn);
+            LoopPool *poolOf(EventLoop *loop);
+            void runHealthChecks();
+            void markHealthy(Upstream *upstream, bool healthy);
+
+            EventLoop *baseLoop_;
+            const string name_;
+            HttpServer *server_;
+            std::vector<std::unique_ptr<Upstream>> upstreams_;
+            BalanceMode balanceMode_;
+            AtomicInt64 nextUpstream_;
+            size_t maxIdle_;
+            double connectTimeout_;
+            double responseTimeout_;
+            int maxTries_;
+            string healthCheckPath_;
+            double healthCheckInterval_;
+            TimerId healthCheckTimer_;
+            std::vector<std::weak_ptr<HealthCheck>> healthChecks_; // 进行中的健康检查，只在 baseLoop 中访问
+
+            MutexLock mutex_;
+            // 连接池按 EventLoop 分开，池内的连接只在所属的 IO 线程中访问
+            std::map<EventLoop *, std::unique_ptr<LoopPool>> pools_ GUARDED_BY(mutex_);
+        };
+    }
+}
+
+#endif
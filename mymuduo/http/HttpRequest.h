@@ -59,12 +59,13 @@ namespace mymuduo
                 // kPatch
             };
 
-            // 只实现了 /1.0 /1.1，Http/2 是基于 HTTPS 实现的
+            // HTTP/2 只支持明文的 h2c，由 Http2Connection 从 HEADERS 帧构造请求
             enum Version
             {
                 kUnknown,
                 kHttp10,
-                kHttp11
+                kHttp11,
+                kHttp20
             };
 
             HttpRequest() : method_(kInvalid),
@@ -169,6 +170,7 @@ namespace mymuduo
             const std::map<string, string> &headers() const { return headers_; }
 
             void setBody(const char *start, const char *end) { body_.assign(start, end); }
+            void appendBody(const char *start, const char *end) { body_.append(start, end); }
             const string &getBody() const { return body_; }
 
             void swap(HttpRequest &that)
@@ -179,6 +181,7 @@ namespace mymuduo
                 query_.swap(that.query_);
                 receiveTime_.swap(that.receiveTime_);
                 headers_.swap(that.headers_);
+                body_.swap(that.body_);
             }
 
         private:
@@ -4,43 +4,276 @@
 #include "mymuduo/net/Buffer.h"
 
 #include <stdio.h>
+#include <strings.h>
+#include <time.h>
 
 using namespace mymuduo;
 using namespace mymuduo::net;
 
+namespace mymuduo
+{
+    namespace net
+    {
+        namespace detail
+        {
+            // 预先编码好的状态行，常见状态码直接整行拷贝
+            struct StatusLine
+            {
+                StatusLine(const char *s, const char *p) : line(s), phrase(p) {}
+                StringPiece line;
+                StringPiece phrase;
+            };
+
+#define STATUS_LINE(code, phrase) StatusLine("HTTP/1.1 " #code " " phrase "\r\n", phrase)
+
+            const StatusLine *statusLine(HttpResponse::HttpStatusCode code)
+            {
+                static const StatusLine k101 = STATUS_LINE(101, "Switching Protocols");
+                static const StatusLine k200 = STATUS_LINE(200, "OK");
+                static const StatusLine k201 = STATUS_LINE(201, "Created");
+                static const StatusLine k204 = STATUS_LINE(204, "No Content");
+                static const StatusLine k206 = STATUS_LINE(206, "Partial Content");
+                static const StatusLine k301 = STATUS_LINE(301, "Moved Permanently");
+                static const StatusLine k302 = STATUS_LINE(302, "Found");
+                static const StatusLine k304 = STATUS_LINE(304, "Not Modified");
+                static const StatusLine k400 = STATUS_LINE(400, "Bad Request");
+                static const StatusLine k403 = STATUS_LINE(403, "Forbidden");
+                static const StatusLine k404 = STATUS_LINE(404, "Not Found");
+                static const StatusLine k405 = STATUS_LINE(405, "Method Not Allowed");
+                static const StatusLine k412 = STATUS_LINE(412, "Precondition Failed");
+                static const StatusLine k413 = STATUS_LINE(413, "Payload Too Large");
+                static const StatusLine k416 = STATUS_LINE(416, "Range Not Satisfiable");
+                static const StatusLine k500 = STATUS_LINE(500, "Internal Server Error");
+                static const StatusLine k502 = STATUS_LINE(502, "Bad Gateway");
+                static const StatusLine k503 = STATUS_LINE(503, "Service Unavailable");
+                static const StatusLine k504 = STATUS_LINE(504, "Gateway Timeout");
+                switch (code)
+                {
+                case HttpResponse::k101SwitchingProtocols: return &k101;
+                case HttpResponse::k200Ok: return &k200;
+                case HttpResponse::k201Created: return &k201;
+                case HttpResponse::k204NoContent: return &k204;
+                case HttpResponse::k206Partitial: return &k206;
+                case HttpResponse::k301MovedPermanently: return &k301;
+                case HttpResponse::k302Found: return &k302;
+                case HttpResponse::k304NotModified: return &k304;
+                case HttpResponse::k400BadRequest: return &k400;
+                case HttpResponse::k403Forbidden: return &k403;
+                case HttpResponse::k404NotFound: return &k404;
+                case HttpResponse::k405MethodNotAllowed: return &k405;
+                case HttpResponse::k412PreconditionFailed: return &k412;
+                case HttpResponse::k413PayloadTooLarge: return &k413;
+                case HttpResponse::k416RangeNotSatisfiable: return &k416;
+                case HttpResponse::k500InternalError: return &k500;
+                case HttpResponse::k502BadGateway: return &k502;
+                case HttpResponse::k503ServiceUnavailable: return &k503;
+                case HttpResponse::k504GatewayTimeout: return &k504;
+                default: return NULL;
+                }
+            }
+
+#undef STATUS_LINE
+
+            // 与 HttpResponse::HeaderName 一一对应，包含 ": "
+            const StringPiece kHeaderNames[HttpResponse::kNumHeaderNames] = {
+                "Content-Type: ",
+                "Content-Encoding: ",
+                "Transfer-Encoding: ",
+                "Accept-Ranges: ",
+                "Cache-Control: ",
+                "ETag: ",
+                "Last-Modified: ",
+                "Expires: ",
+                "Location: ",
+                "Allow: ",
+                "Vary: ",
+                "Server: ",
+            };
+
+            const char kDayNames[][4] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+            const char kMonthNames[][4] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                           "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+
+            // 与 Logging.cc 中 t_time 的做法相同，每个线程缓存当前秒的 Date 首部
+            __thread char t_date[64];
+            __thread int t_dateLength;
+            __thread time_t t_dateSecond;
+
+            inline void appendTwoDigits(char *p, int v)
+            {
+                p[0] = static_cast<char>('0' + v / 10);
+                p[1] = static_cast<char>('0' + v % 10);
+            }
+        }
+    }
+}
+
+StringPiece HttpResponse::dateHeader()
+{
+    time_t now = ::time(NULL);
+    if (now != detail::t_dateSecond || detail::t_dateLength == 0)
+    {
+        // IMF-fixdate: Sun, 06 Nov 1994 08:49:37 GMT
+        struct tm tm_time;
+        ::gmtime_r(&now, &tm_time);
+        char *p = detail::t_date;
+        memcpy(p, "Date: ", 6);
+        p += 6;
+        memcpy(p, detail::kDayNames[tm_time.tm_wday], 3);
+        p += 3;
+        *p++ = ',';
+        *p++ = ' ';
+        detail::appendTwoDigits(p, tm_time.tm_mday);
+        p += 2;
+        *p++ = ' ';
+        memcpy(p, detail::kMonthNames[tm_time.tm_mon], 3);
+        p += 3;
+        *p++ = ' ';
+        int year = tm_time.tm_year + 1900;
+        detail::appendTwoDigits(p, year / 100);
+        detail::appendTwoDigits(p + 2, year % 100);
+        p += 4;
+        *p++ = ' ';
+        detail::appendTwoDigits(p, tm_time.tm_hour);
+        p[2] = ':';
+        detail::appendTwoDigits(p + 3, tm_time.tm_min);
+        p[5] = ':';
+        detail::appendTwoDigits(p + 6, tm_time.tm_sec);
+        p += 8;
+        memcpy(p, " GMT\r\n", 6);
+        p += 6;
+        detail::t_dateLength = static_cast<int>(p - detail::t_date);
+        detail::t_dateSecond = now;
+    }
+    return StringPiece(detail::t_date, detail::t_dateLength);
+}
+
+void HttpResponse::addHeader(const string &key, const string &value)
+{
+    for (int i = 0; i < kNumHeaderNames; ++i)
+    {
+        // 去掉 ": " 后比较，首部字段名不区分大小写
+        const StringPiece &name = detail::kHeaderNames[i];
+        if (key.size() + 2 == static_cast<size_t>(name.size()) &&
+            ::strncasecmp(key.data(), name.data(), key.size()) == 0)
+        {
+            knownHeaders_[i] = value;
+            return;
+        }
+    }
+    headers_.push_back(Header(key, value));
+}
+
+string HttpResponse::encodeHeaders() const
+{
+    Buffer buf;
+    appendHeaderLines(&buf);
+    return buf.retrieveAllAsString();
+}
+
+void HttpResponse::appendHeaderLines(Buffer *output) const
+{
+    for (int i = 0; i < kNumHeaderNames; ++i)
+    {
+        if (!knownHeaders_[i].empty())
+        {
+            output->append(detail::kHeaderNames[i]);
+            output->append(knownHeaders_[i]);
+            output->append("\r\n", 2);
+        }
+    }
+
+    for (const Header &header : headers_)
+    {
+        output->append(header.first);
+        output->append(": ", 2);
+        output->append(header.second);
+        output->append("\r\n", 2);
+    }
+
+    if (encodedHeaders_)
+    {
+        output->append(*encodedHeaders_);
+    }
+}
+
 void HttpResponse::appendToBuffer(Buffer *output) const
 {
-    char buf[32];
-    snprintf(buf, sizeof buf, "HTTP/1.1 %d ", statusCode_);
-    output->append(buf);
-    output->append(statusMessage_);
-    output->append("\r\n");
+    appendHeadersToBuffer(output);
+    output->append(body());
+}
 
-    if (closeConnection_)
+void HttpResponse::appendHeadersToBuffer(Buffer *output) const
+{
+    const detail::StatusLine *status = detail::statusLine(statusCode_);
+    if (status && (statusMessage_.empty() || status->phrase == statusMessage_))
     {
-        // HTTP1.1中，建立的HTTP请求默认是持久连接的。当Client确定不再需要向Server发送数据时，
-        // 它可以关闭连接，即在发送首部中添加Connection:Closed字段。
-        output->append("Connection: close\r\n");
+        output->append(status->line);
     }
     else
     {
-        // 格式符z和整数转换说明符一起使用，表示对应数字是一个size_t值。属于C99。
-        if (!needSendFile())
-            snprintf(buf, sizeof buf, "Content-Length: %zd\r\n", body_.size());
-        output->append(buf);
+        output->append("HTTP/1.1 ", 9);
+        output->appendDecimal(statusCode_);
+        output->append(" ", 1);
+        output->append(statusMessage_);
+        output->append("\r\n", 2);
+    }
+
+    if (sendDate_)
+    {
+        output->append(dateHeader());
+    }
+
+    // 101 由调用方自行设置 Connection: Upgrade
+    if (statusCode_ != k101SwitchingProtocols)
+    {
+        // HTTP1.1中，建立的HTTP请求默认是持久连接的。当Client确定不再需要向Server发送数据时，
+        // 它可以关闭连接，即在发送首部中添加Connection:Closed字段。
         // HTTP/1.1 之前的 HTTP 版本的默认连接都是非持久连接。为了兼容老版本，
         // 则需要指定 Connection 首部字段的值为 Keep-Alive
-        output->append("Connection: Keep-Alive\r\n");
+        if (closeConnection_)
+        {
+            output->append("Connection: close\r\n", 19);
+        }
+        else
+        {
+            output->append("Connection: Keep-Alive\r\n", 24);
+        }
     }
 
-    for (const auto &header : headers_)
+    // 1xx/204/304 不带 Content-Length，分块传输时也不带
+    if (statusCode_ >= k200Ok && statusCode_ != k204NoContent && statusCode_ != k304NotModified &&
+        knownHeaders_[kTransferEncoding].empty())
     {
-        output->append(header.first);
-        output->append(": ");
-        output->append(header.second);
-        output->append("\r\n");
+        int64_t length = contentLength_;
+        if (length < 0)
+        {
+            length = needSendFile() ? len_ : static_cast<int64_t>(body().size());
+        }
+        output->append("Content-Length: ", 16);
+        output->appendDecimal(length);
+        output->append("\r\n", 2);
+    }
+
+    if (rangeTotal_ >= 0)
+    {
+        output->append("Content-Range: bytes ", 21);
+        if (rangeBegin_ >= 0)
+        {
+            output->appendDecimal(rangeBegin_);
+            output->append("-", 1);
+            output->appendDecimal(rangeEnd_);
+        }
+        else
+        {
+            // 416 时为 bytes */total
+            output->append("*", 1);
+        }
+        output->append("/", 1);
+        output->appendDecimal(rangeTotal_);
+        output->append("\r\n", 2);
     }
 
-    output->append("\r\n");
-    output->append(body_);
-}
\ No newline at end of file
+    appendHeaderLines(output);
+    output->append("\r\n", 2);
+}
@@ -2,9 +2,12 @@
 #define MYMUDUO_HTTP_HTTPRESPONSE_H
 
 #include "mymuduo/base/copyable.h"
+#include "mymuduo/base/StringPiece.h"
 #include "mymuduo/base/Types.h"
+#include "mymuduo/net/FileHandle.h"
 
-#include <map>
+#include <utility>
+#include <vector>
 
 namespace mymuduo
 {
@@ -18,44 +21,203 @@ namespace mymuduo
          * CRLF
          * 实体主体（有些响应报文不用）
          *
-         * 封装了构造响应报文的格式化过程
+         * 封装了构造响应报文的格式化过程：
+         *  - 常见状态码的状态行是预先编码好的常量，直接拷贝
+         *  - 常用首部以枚举 HeaderName 作下标存放，不需要查找和拼接字段名
+         *  - Content-Length / Content-Range 以整数保存，序列化时直接格式化进 Buffer
+         *  - Date 首部每个 IO 线程每秒只生成一次
          */
         class HttpResponse : public mymuduo::copyable
         {
         public:
+            typedef std::pair<string, string> Header;
+            typedef std::shared_ptr<const string> BodyPtr;
+
+            // 多段实体中的一段：先发送内存中的 header，再发送文件中 [offset, offset + length) 的内容
+            struct FilePart
+            {
+                string header;
+                off64_t offset;
+                off64_t length;
+            };
+
             enum HttpStatusCode
             {
                 kUnknown,
+                k101SwitchingProtocols = 101,
                 k200Ok = 200,
+                k201Created = 201,
                 k204NoContent = 204,
                 k206Partitial = 206,
                 k301MovedPermanently = 301,
+                k302Found = 302,
+                k304NotModified = 304,
                 k400BadRequest = 400,
+                k403Forbidden = 403,
                 k404NotFound = 404,
-                k500InternalError = 500
+                k405MethodNotAllowed = 405,
+                k412PreconditionFailed = 412,
+                k413PayloadTooLarge = 413,
+                k416RangeNotSatisfiable = 416,
+                k500InternalError = 500,
+                k502BadGateway = 502,
+                k503ServiceUnavailable = 503,
+                k504GatewayTimeout = 504
+            };
+
+            // 常用首部，顺序即序列化顺序
+            enum HeaderName
+            {
+                kContentType,
+                kContentEncoding,
+                kTransferEncoding,
+                kAcceptRanges,
+                kCacheControl,
+                kETag,
+                kLastModified,
+                kExpires,
+                kLocation,
+                kAllow,
+                kVary,
+                kServer,
+                kNumHeaderNames
             };
 
             explicit HttpResponse(bool close) : statusCode_(kUnknown),
                                                 closeConnection_(close),
-                                                fd_(-1), len_(0) {}
+                                                sendDate_(true),
+                                                compress_(false),
+                                                contentLength_(-1),
+                                                rangeBegin_(-1),
+                                                rangeEnd_(-1),
+                                                rangeTotal_(-1),
+                                                fileOffset_(-1), len_(0),
+                                                rateLimit_(0), rateBurst_(0) {}
 
             void setStatusCode(HttpStatusCode code) { statusCode_ = code; }
+            HttpStatusCode statusCode() const { return statusCode_; }
+            // 常见状态码不需要设置，会使用标准短语
             void setStatusMessage(const string &message) { statusMessage_ = message; }
             void setCloseConnection(bool on) { closeConnection_ = on; }
             bool closeConnection() const { return closeConnection_; }
-            void setContentType(const string &contentType) { addHeader("Content-Type", contentType); }
-            // FIXME: replace string with StringPiece
-            void addHeader(const string &key, const string &value) { headers_[key] = value; }
-            void setBody(const string &body) { body_ = body; }
+            void setContentType(const StringPiece &contentType) { addHeader(kContentType, contentType); }
+
+            void addHeader(HeaderName name, const StringPiece &value) { knownHeaders_[name].assign(value.data(), value.size()); }
+            // 字段名为常用首部时转为对应的 HeaderName
+            void addHeader(const string &key, const string &value);
+            const string &header(HeaderName name) const { return knownHeaders_[name]; }
+            /// 不属于 HeaderName 的其他首部
+            const std::vector<Header> &headers() const { return headers_; }
+
+            /// 不设置时取 body 的长度，发送文件时必须设置
+            void setContentLength(int64_t len) { contentLength_ = len; }
+            int64_t contentLength() const { return contentLength_; }
+            /// Content-Range: bytes begin-end/total
+            void setContentRange(int64_t begin, int64_t end, int64_t total)
+            {
+                rangeBegin_ = begin;
+                rangeEnd_ = end;
+                rangeTotal_ = total;
+            }
+            /// 没有设置 Content-Range 时返回 false
+            bool contentRange(int64_t *begin, int64_t *end, int64_t *total) const
+            {
+                *begin = rangeBegin_;
+                *end = rangeEnd_;
+                *total = rangeTotal_;
+                return rangeTotal_ >= 0;
+            }
+            /// 是否发送 Date 首部，默认发送
+            void setSendDate(bool on) { sendDate_ = on; }
+            bool sendDate() const { return sendDate_; }
+            /// 客户端接受 gzip/deflate 时由 HttpServer 压缩实体，默认关闭
+            void setCompress(bool on) { compress_ = on; }
+            bool compress() const { return compress_; }
+
+            void setBody(const string &body)
+            {
+                body_ = body;
+                sharedBody_.reset();
+            }
+            void setBody(string &&body)
+            {
+                body_ = std::move(body);
+                sharedBody_.reset();
+            }
+            /// 共享不可变的实体（比如缓存中的文件内容），HTTP/1.x 发送时与首部一起 writev，不拷贝
+            void setBody(const BodyPtr &body)
+            {
+                body_.clear();
+                sharedBody_ = body;
+            }
+            void swapBody(string &body)
+            {
+                if (sharedBody_)
+                {
+                    body_ = *sharedBody_;
+                    sharedBody_.reset();
+                }
+                body_.swap(body);
+            }
+            const string &body() const { return sharedBody_ ? *sharedBody_ : body_; }
+            /// 没有通过 setBody(BodyPtr) 设置时为空
+            const BodyPtr &sharedBody() const { return sharedBody_; }
+
+            /**
+             * 预先编码好的首部行（"Name: value\r\n"...），原样追加在其他首部之后，
+             * 只用于 HTTP/1.x，HTTP/2 需要逐个字段做 HPACK 编码
+             */
+            void setEncodedHeaders(const BodyPtr &headers) { encodedHeaders_ = headers; }
+            const BodyPtr &encodedHeaders() const { return encodedHeaders_; }
+            /// 把常用首部和其他首部编码为首部行，不含状态行、Date、Connection 和长度等逐次变化的字段
+            string encodeHeaders() const;
+
+            /// 状态行、首部和空行，不含实体
+            void appendHeadersToBuffer(Buffer *output) const;
             void appendToBuffer(Buffer *output) const;
 
-            bool needSendFile() const { return fd_ != -1; }
-            int getFd() const { return fd_; }
+            bool needSendFile() const { return static_cast<bool>(file_); }
+            int getFd() const { return file_ ? file_->fd() : -1; }
+            /// 取得 fd 的所有权，从 fd 当前的文件偏移开始发送
             void setFd(int fd)
             {
                 // assert(fd >= 0);
-                fd_ = fd;
+                file_ = std::make_shared<FileHandle>(fd);
+                fileOffset_ = -1;
             }
+            /// 共享已经打开的文件（比如缓存中的 fd），从 offset 开始发送，不改变文件偏移
+            void setFile(const FileHandlePtr &file, off64_t offset)
+            {
+                file_ = file;
+                fileOffset_ = offset;
+            }
+            const FileHandlePtr &file() const { return file_; }
+            /// 文件的发送起点，setFd 设置的文件取 fd 当前的偏移
+            off64_t fileOffset() const
+            {
+                if (fileOffset_ >= 0 || !file_)
+                    return fileOffset_;
+                off64_t offset = ::lseek64(file_->fd(), 0, SEEK_CUR);
+                return offset < 0 ? 0 : offset;
+            }
+            /**
+             * 由多段组成的实体（如 multipart/byteranges），各段的文件内容都来自 file()，
+             * 不读入用户态，设置后忽略 fileOffset()/getSendLen()，需要设置 Content-Length
+             */
+            void addFilePart(const string &header, off64_t offset, off64_t length) { fileParts_.push_back(FilePart{header, offset, length}); }
+            const std::vector<FilePart> &fileParts() const { return fileParts_; }
+            /**
+             * 按 bytesPerSecond 发送这个响应，开始的 initialBurst 字节不受限制，
+             * 用于视频等按码率播放的内容。只限制文件实体（setFile()/addFilePart()），
+             * 只对 HTTP/1.x 连接生效
+             */
+            void setRateLimit(double bytesPerSecond, size_t initialBurst)
+            {
+                rateLimit_ = bytesPerSecond;
+                rateBurst_ = initialBurst;
+            }
+            double rateLimit() const { return rateLimit_; }
+            size_t rateBurst() const { return rateBurst_; }
             off64_t getSendLen() const { return len_; }
             void setSendLen(off64_t len)
             {
@@ -63,16 +225,37 @@ namespace mymuduo
                 len_ = len;
             }
 
+            /**
+             * 返回 "Date: <IMF-fixdate>\r\n"，每个线程缓存一份，秒数变化时才重新生成，
+             * 因此同一个 IO 线程上的响应每秒只格式化一次时间
+             */
+            static StringPiece dateHeader();
+
         private:
-            std::map<string, string> headers_; // 首部字段
-            HttpStatusCode statusCode_;        // 状态码
-            string statusMessage_;             // 状态短语
-            bool closeConnection_;             // 是否关闭长连接
-            string body_;                      // 实体主体
-            int fd_;                           // 需要传输文件时使用
+            void appendHeaderLines(Buffer *output) const;
+
+            string knownHeaders_[kNumHeaderNames]; // 常用首部，空串表示未设置
+            std::vector<Header> headers_;          // 其他首部字段
+            HttpStatusCode statusCode_;            // 状态码
+            string statusMessage_;                 // 状态短语
+            bool closeConnection_;                 // 是否关闭长连接
+            bool sendDate_;                        // 是否发送 Date 首部
+            bool compress_;                        // 是否按 Accept-Encoding 压缩实体
+            int64_t contentLength_;                // -1 表示取 body_ 的长度
+            int64_t rangeBegin_;                   // Content-Range，-1 表示未设置
+            int64_t rangeEnd_;
+            int64_t rangeTotal_;
+            string body_;                          // 实体主体
+            BodyPtr sharedBody_;                   // 共享的实体，设置时代替 body_
+            BodyPtr encodedHeaders_;               // 预先编码的首部行
+            FileHandlePtr file_;                   // 需要传输文件时使用
+            off64_t fileOffset_;                   // -1 表示从 fd 当前的偏移开始
             off64_t len_;                          // 传输大小
+            std::vector<FilePart> fileParts_;      // 多段实体
+            double rateLimit_;                     // 发送速度，字节/秒，0 表示不限速
+            size_t rateBurst_;                     // 开始时不限速的字节数
         };
     }
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,299 @@
+#include "mymuduo/http/HttpResponseParser.h"
+
+#include "mymuduo/base/Logging.h"
+#include "mymuduo/net/Buffer.h"
+
+#include <algorithm>
+#include <ctype.h>
+#include <strings.h>
+
+using namespace mymuduo;
+using namespace mymuduo::net;
+
+namespace mymuduo
+{
+    namespace net
+    {
+        namespace detail
+        {
+            // 只接受十进制数字，出错返回 -1
+            int64_t parseDecimal(const string &value)
+            {
+                if (value.empty() || value.size() > 18)
+                    return -1;
+                int64_t n = 0;
+                for (char c : value)
+                {
+                    if (c < '0' || c > '9')
+                        return -1;
+                    n = n * 10 + (c - '0');
+                }
+                return n;
+            }
+
+            // 块大小行："1a3f[;ext]"，出错返回 -1
+            int64_t parseChunkSize(const char *begin, const char *end)
+            {
+                int64_t n = 0;
+                const char *p = begin;
+                for (; p < end && isxdigit(static_cast<unsigned char>(*p)); ++p)
+                {
+                    if (p - begin >= 15)
+                        return -1;
+                    int digit = isdigit(static_cast<unsigned char>(*p)) ? *p - '0' : (tolower(*p) - 'a' + 10);
+                    n = n * 16 + digit;
+                }
+                if (p == begin)
+                    return -1;
+                while (p < end && (*p == ' ' || *p == '\t'))
+                    ++p;
+                return (p == end || *p == ';') ? n : -1;
+            }
+
+            bool containsToken(const string &value, const char *token)
+            {
+                string lower(value);
+                std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+                return lower.find(token) != string::npos;
+            }
+        }
+    }
+}
+
+bool HttpResponseParser::CaseInsensitiveLess::operator()(const string &a, const string &b) const
+{
+    return ::strcasecmp(a.c_str(), b.c_str()) < 0;
+}
+
+HttpResponseParser::HttpResponseParser()
+{
+    reset();
+}
+
+void HttpResponseParser::reset(bool headRequest)
+{
+    state_ = kExpectStatusLine;
+    headRequest_ = headRequest;
+    statusCode_ = 0;
+    statusMessage_.clear();
+    version_ = HttpRequest::kUnknown;
+    headers_.clear();
+    body_.clear();
+    contentLength_ = -1;
+    chunked_ = false;
+    remaining_ = 0;
+}
+
+string HttpResponseParser::getHeader(const string &field) const
+{
+    HeaderMap::const_iterator it = headers_.find(field);
+    return it != headers_.end() ? it->second : string();
+}
+
+bool HttpResponseParser::keepAlive() const
+{
+    if (state_ == kExpectClose)
+        return false;
+    const string &connection = getHeader("Connection");
+    if (version_ == HttpRequest::kHttp10)
+        return detail::containsToken(connection, "keep-alive");
+    return !detail::containsToken(connection, "close");
+}
+
+/**
+ *  @brief  解析状态行 [ 版本 <space> 状态码 <space> 短语 CRLF ]
+ */
+bool HttpResponseParser::processStatusLine(const char *begin, const char *end)
+{
+    if (end - begin < 12 || !std::equal(begin, begin + 7, "HTTP/1.") || begin[8] != ' ')
+        return false;
+    if (begin[7] == '1')
+        version_ = HttpRequest::kHttp11;
+    else if (begin[7] == '0')
+        version_ = HttpRequest::kHttp10;
+    else
+        return false;
+    const char *code = begin + 9;
+    if (!isdigit(static_cast<unsigned char>(code[0])) || !isdigit(static_cast<unsigned char>(code[1])) ||
+        !isdigit(static_cast<unsigned char>(code[2])))
+        return false;
+    statusCode_ = (code[0] - '0') * 100 + (code[1] - '0') * 10 + (code[2] - '0');
+    const char *message = code + 3;
+    if (message < end && *message == ' ')
+        ++message;
+    statusMessage_.assign(message, end);
+    return true;
+}
+
+bool HttpResponseParser::headersDone()
+{
+    if (statusCode_ >= 100 && statusCode_ < 200 && statusCode_ != 101)
+    {
+        // 100 Continue 等临时响应之后才是真正的响应
+        bool head = headRequest_;
+        reset(head);
+        return true;
+    }
+    if (headRequest_ || statusCode_ == 204 || statusCode_ == 304 || statusCode_ < 200)
+    {
+        state_ = kGotAll;
+        return true;
+    }
+    if (detail::containsToken(getHeader("Transfer-Encoding"), "chunked"))
+    {
+        chunked_ = true;
+        state_ = kExpectChunkSize;
+        return true;
+    }
+    HeaderMap::const_iterator it = headers_.find("Content-Length");
+    if (it != headers_.end())
+    {
+        contentLength_ = detail::parseDecimal(it->second);
+        if (contentLength_ < 0)
+        {
+            LOG_ERROR << "HttpResponseParser bad Content-Length " << it->second;
+            return false;
+        }
+        remaining_ = static_cast<size_t>(contentLength_);
+        state_ = remaining_ > 0 ? kExpectBody : kGotAll;
+        return true;
+    }
+    state_ = kExpectClose;
+    return true;
+}
+
+void HttpResponseParser::appendBody(const char *data, size_t len)
+{
+    if (len == 0)
+        return;
+    if (bodyCallback_)
+        bodyCallback_(data, len);
+    else
+        body_.append(data, len);
+}
+
+bool HttpResponseParser::parse(Buffer *buf)
+{
+    bool ok = true;
+    bool hasMore = true;
+    while (ok && hasMore)
+    {
+        if (state_ == kExpectStatusLine || state_ == kExpectHeaders || state_ == kExpectChunkSize ||
+            state_ == kExpectChunkEnd || state_ == kExpectTrailers)
+        {
+            const char *crlf = buf->findCRLF();
+            if (!crlf)
+            {
+                hasMore = false;
+                continue;
+            }
+            const char *begin = buf->peek();
+            switch (state_)
+            {
+            case kExpectStatusLine:
+                ok = processStatusLine(begin, crlf);
+                state_ = kExpectHeaders;
+                break;
+            case kExpectHeaders:
+                if (begin == crlf)
+                {
+                    buf->retrieveUntil(crlf + 2);
+                    ok = headersDone();
+                    continue;
+                }
+                else
+                {
+                    const char *colon = std::find(begin, crlf, ':');
+                    if (colon == crlf)
+                    {
+                        ok = false;
+                        break;
+                    }
+                    const char *value = colon + 1;
+                    while (value < crlf && isspace(static_cast<unsigned char>(*value)))
+                        ++value;
+                    const char *valueEnd = crlf;
+                    while (valueEnd > value && isspace(static_cast<unsigned char>(valueEnd[-1])))
+                        --valueEnd;
+                    string field(begin, colon);
+                    HeaderMap::iterator it = headers_.find(field);
+                    if (it != headers_.end())
+                    {
+                        // 重复的字段按逗号合并
+                        it->second.append(", ");
+                        it->second.append(value, valueEnd);
+                    }
+                    else
+                    {
+                        headers_[field] = string(value, valueEnd);
+                    }
+                }
+                break;
+            case kExpectChunkSize:
+            {
+                int64_t size = detail::parseChunkSize(begin, crlf);
+                if (size < 0)
+                {
+                    ok = false;
+                    break;
+                }
+                remaining_ = static_cast<size_t>(size);
+                state_ = remaining_ > 0 ? kExpectChunkData : kExpectTrailers;
+                break;
+            }
+            case kExpectChunkEnd:
+                ok = begin == crlf;
+                state_ = kExpectChunkSize;
+                break;
+            case kExpectTrailers:
+                // trailer 首部直接丢弃
+                if (begin == crlf)
+                    state_ = kGotAll;
+                break;
+            default:
+                break;
+            }
+            if (ok)
+                buf->retrieveUntil(crlf + 2);
+        }
+        else if (state_ == kExpectBody || state_ == kExpectChunkData)
+        {
+            size_t n = std::min(remaining_, buf->readableBytes());
+            if (n == 0)
+            {
+                hasMore = false;
+                continue;
+            }
+            appendBody(buf->peek(), n);
+            buf->retrieve(n);
+            remaining_ -= n;
+            if (remaining_ == 0)
+                state_ = state_ == kExpectBody ? kGotAll : kExpectChunkEnd;
+        }
+        else if (state_ == kExpectClose)
+        {
+            appendBody(buf->peek(), buf->readableBytes());
+            buf->retrieveAll();
+            hasMore = false;
+        }
+        else
+        {
+            // kGotAll 等待调用方 reset()，之后的数据属于下一个响应
+            hasMore = false;
+        }
+    }
+    if (!ok)
+    {
+        LOG_ERROR << "HttpResponseParser parse error in state " << state_;
+    }
+    return ok;
+}
+
+bool HttpResponseParser::parseEof()
+{
+    if (state_ == kExpectClose)
+    {
+        state_ = kGotAll;
+    }
+    return state_ == kGotAll;
+}
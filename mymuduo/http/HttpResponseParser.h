@@ -0,0 +1,100 @@
+#ifndef MYMUDUO_HTTP_HTTPRESPONSEPARSER_H
+#define MYMUDUO_HTTP_HTTPRESPONSEPARSER_H
+
+#include "mymuduo/base/copyable.h"
+#include "mymuduo/base/Types.h"
+#include "mymuduo/http/HttpRequest.h"
+
+#include <functional>
+#include <map>
+
+namespace mymuduo
+{
+    namespace net
+    {
+        class Buffer;
+
+        /**
+         * 增量解析 HTTP/1.x 响应，与解析请求的 HttpContext 相对应，供客户端和反向代理使用。
+         * 每次收到数据后调用 parse()，数据不足时保留在缓冲区中等待下一次。
+         *
+         * 实体的长度依次由 Content-Length、Transfer-Encoding: chunked 或连接关闭确定，
+         * 分块编码在解析时去掉，交给调用方的总是原始实体。
+         * 设置了 BodyCallback 时实体边到达边交出，不在内存中积攒
+         */
+        class HttpResponseParser : public mymuduo::copyable
+        {
+        public:
+            enum ParseState
+            {
+                kExpectStatusLine, // 正在解析状态行（初始状态）
+                kExpectHeaders,    // 正在解析首部
+                kExpectBody,       // 按 Content-Length 接收实体
+                kExpectChunkSize,  // 分块编码：块大小行
+                kExpectChunkData,  // 分块编码：块数据
+                kExpectChunkEnd,   // 分块编码：块数据之后的 CRLF
+                kExpectTrailers,   // 分块编码：最后的 trailer 首部
+                kExpectClose,      // 实体直到连接关闭为止
+                kGotAll,           // 解析完毕
+            };
+
+            // 首部字段名不区分大小写
+            struct CaseInsensitiveLess
+            {
+                bool operator()(const string &a, const string &b) const;
+            };
+            typedef std::map<string, string, CaseInsensitiveLess> HeaderMap;
+            typedef std::function<void(const char *data, size_t len)> BodyCallback;
+
+            HttpResponseParser();
+
+            /// 开始解析下一个响应，headRequest 为 true 时（HEAD 请求的响应）没有实体
+            void reset(bool headRequest = false);
+            /// 设置后实体数据交给 cb，不保存到 body() 中，reset() 不清除
+            void setBodyCallback(const BodyCallback &cb) { bodyCallback_ = cb; }
+
+            /// 解析 buf 中的数据，格式错误返回 false
+            bool parse(Buffer *buf);
+            /// 对端关闭了连接，以关闭作为实体结束的响应此时完整，返回响应是否完整
+            bool parseEof();
+
+            ParseState state() const { return state_; }
+            bool headersComplete() const { return state_ > kExpectHeaders; }
+            bool gotAll() const { return state_ == kGotAll; }
+
+            int statusCode() const { return statusCode_; }
+            const string &statusMessage() const { return statusMessage_; }
+            HttpRequest::Version version() const { return version_; }
+            const HeaderMap &headers() const { return headers_; }
+            string getHeader(const string &field) const;
+            const string &body() const { return body_; }
+            string &body() { return body_; }
+
+            /// Content-Length 的值，没有该字段（或使用分块编码）时为 -1
+            int64_t contentLength() const { return contentLength_; }
+            bool chunked() const { return chunked_; }
+            /// 响应之后连接是否可以继续使用
+            bool keepAlive() const;
+
+        private:
+            bool processStatusLine(const char *begin, const char *end);
+            // 首部解析完毕，确定实体的长度
+            bool headersDone();
+            void appendBody(const char *data, size_t len);
+
+            ParseState state_;
+            bool headRequest_;
+            int statusCode_;
+            string statusMessage_;
+            HttpRequest::Version version_;
+            HeaderMap headers_;
+            string body_;
+            int64_t contentLength_;
+            bool chunked_;
+            size_t remaining_; // 当前实体或块中尚未到达的字节数
+            BodyCallback bodyCallback_;
+        };
+    }
+}
+
+#endif
@@ -0,0 +1,307 @@
+#include "mymuduo/http/HttpRouter.h"
+
+#include "mymuduo/base/Logging.h"
+#include "mymuduo/http/HttpResponse.h"
+
+#include <string.h>
+
+using namespace mymuduo;
+using namespace mymuduo::net;
+
+namespace mymuduo
+{
+    namespace net
+    {
+        namespace detail
+        {
+            const char *kMethodNames[] = {"", "GET", "POST", "HEAD", "PUT", "DELETE"};
+
+            void defaultNotFoundCallback(const HttpRequest &, HttpResponse *resp)
+            {
+                resp->setStatusCode(HttpResponse::k404NotFound);
+                resp->setStatusMessage("Not Found");
+                resp->setCloseConnection(true);
+            }
+        }
+    }
+}
+
+/**
+ * 树中的节点分三类：
+ *  - 静态节点：prefix 为压缩后的一段静态路径，子节点通过首字符 indices 索引
+ *  - 参数节点：匹配一个分段，匹配结束后继续在其子节点中查找
+ *  - 通配节点：匹配剩余全部路径，一定是叶子
+ * 任一节点都可以同时拥有静态子节点、一个参数子节点和一个通配子节点
+ */
+struct HttpRouter::Node
+{
+    enum Type
+    {
+        kStatic,
+        kParam,
+        kWildcard,
+    };
+
+    explicit Node(Type t) : type(t), hasHandler(false) {}
+
+    Type type;
+    string prefix;  // 静态节点的压缩前缀
+    string name;    // 参数/通配节点的参数名
+    string indices; // 静态子节点的首字符，与 children 一一对应
+    std::vector<std::unique_ptr<Node>> children;
+    std::unique_ptr<Node> paramChild;
+    std::unique_ptr<Node> wildcardChild;
+    Handler handlers[kNumMethods]; // 按 HttpRequest::Method 索引
+    bool hasHandler;
+};
+
+HttpRouter::HttpRouter()
+    : root_(new Node(Node::kStatic)),
+      notFoundCallback_(detail::defaultNotFoundCallback)
+{
+}
+
+HttpRouter::~HttpRouter() = default;
+
+bool HttpRouter::addRoute(HttpRequest::Method method, const string &pattern, const Handler &handler)
+{
+    if (method <= HttpRequest::kInvalid || method >= kNumMethods ||
+        pattern.empty() || pattern[0] != '/' || !handler)
+    {
+        LOG_ERROR << "HttpRouter::addRoute invalid route " << pattern;
+        return false;
+    }
+
+    Node *node = root_.get();
+    size_t i = 0;
+    while (i < pattern.size())
+    {
+        char c = pattern[i];
+        if (c == ':' || c == '*')
+        {
+            // 参数必须占据一个完整的分段
+            size_t end = pattern.find('/', i);
+            if (end == string::npos)
+            {
+                end = pattern.size();
+            }
+            string name = pattern.substr(i + 1, end - i - 1);
+            if (pattern[i - 1] != '/' || name.empty() || (c == '*' && end != pattern.size()))
+            {
+                LOG_ERROR << "HttpRouter::addRoute invalid wildcard in " << pattern;
+                return false;
+            }
+
+            std::unique_ptr<Node> &child = c == ':' ? node->paramChild : node->wildcardChild;
+            if (!child)
+            {
+                child.reset(new Node(c == ':' ? Node::kParam : Node::kWildcard));
+                child->name = name;
+            }
+            else if (child->name != name)
+            {
+                // 同一位置的参数名必须一致，否则无法确定捕获到哪个名字下
+                LOG_ERROR << "HttpRouter::addRoute " << pattern << " conflicts with parameter "
+                          << child->name;
+                return false;
+            }
+            node = child.get();
+            i = end;
+        }
+        else
+        {
+            size_t end = pattern.find_first_of(":*", i);
+            if (end == string::npos)
+            {
+                end = pattern.size();
+            }
+            node = insertStatic(node, StringPiece(pattern.data() + i, static_cast<int>(end - i)));
+            i = end;
+        }
+    }
+
+    if (node->handlers[method])
+    {
+        LOG_ERROR << "HttpRouter::addRoute duplicate route " << detail::kMethodNames[method]
+                  << " " << pattern;
+        return false;
+    }
+    node->handlers[method] = handler;
+    node->hasHandler = true;
+    return true;
+}
+
+HttpRouter::Node *HttpRouter::insertStatic(Node *node, const StringPiece &str)
+{
+    StringPiece rest(str);
+    while (!rest.empty())
+    {
+        size_t idx = node->indices.find(rest[0]);
+        if (idx == string::npos)
+        {
+            Node *child = new Node(Node::kStatic);
+            child->prefix = rest.as_string();
+            node->indices.push_back(rest[0]);
+            node->children.emplace_back(child);
+            return child;
+        }
+
+        Node *child = node->children[idx].get();
+        size_t common = 0;
+        size_t maxLen = std::min(child->prefix.size(), static_cast<size_t>(rest.size()));
+        while (common < maxLen && child->prefix[common] == rest[static_cast<int>(common)])
+        {
+            ++common;
+        }
+        if (common < child->prefix.size())
+        {
+            // 公共前缀比已有节点短，拆分成 公共部分 -> 剩余部分 两个节点
+            std::unique_ptr<Node> mid(new Node(Node::kStatic));
+            mid->prefix = child->prefix.substr(0, common);
+            child->prefix.erase(0, common);
+            mid->indices.push_back(child->prefix[0]);
+            mid->children.push_back(std::move(node->children[idx]));
+            node->children[idx] = std::move(mid);
+            child = node->children[idx].get();
+        }
+        rest.remove_prefix(static_cast<int>(common));
+        node = child;
+    }
+    return node;
+}
+
+const HttpRouter::Node *HttpRouter::match(const Node *node, const char *pos, const char *end,
+                                          Params *params) const
+{
+    // node 本身已经匹配完毕，继续匹配 [pos, end)
+    if (pos == end)
+    {
+        if (node->hasHandler)
+        {
+            return node;
+        }
+        if (node->wildcardChild)
+        {
+            // 通配可以匹配空串，如 /static/ 匹配 /static/*filepath
+            params->push(node->wildcardChild->name, StringPiece(pos, 0));
+            return node->wildcardChild.get();
+        }
+        return NULL;
+    }
+
+    size_t idx = node->indices.find(*pos);
+    if (idx != string::npos)
+    {
+        const Node *child = node->children[idx].get();
+        size_t len = child->prefix.size();
+        if (static_cast<size_t>(end - pos) >= len && memcmp(pos, child->prefix.data(), len) == 0)
+        {
+            const Node *found = match(child, pos + len, end, params);
+            if (found)
+            {
+                return found;
+            }
+        }
+    }
+
+    if (node->paramChild)
+    {
+        const char *segEnd = static_cast<const char *>(memchr(pos, '/', end - pos));
+        if (!segEnd)
+        {
+            segEnd = end;
+        }
+        if (segEnd != pos)
+        {
+            params->push(node->paramChild->name, StringPiece(pos, static_cast<int>(segEnd - pos)));
+            const Node *found = match(node->paramChild.get(), segEnd, end, params);
+            if (found)
+            {
+                return found;
+            }
+            // 回溯，尝试通配
+            params->pop();
+        }
+    }
+
+    if (node->wildcardChild)
+    {
+        params->push(node->wildcardChild->name, StringPiece(pos, static_cast<int>(end - pos)));
+        return node->wildcardChild.get();
+    }
+    return NULL;
+}
+
+const HttpRouter::Handler *HttpRouter::find(HttpRequest::Method method, const StringPiece &path,
+                                            Params *params, bool *pathMatched) const
+{
+    const Node *node = match(root_.get(), path.begin(), path.end(), params);
+    if (pathMatched)
+    {
+        *pathMatched = node != NULL;
+    }
+    if (!node || method <= HttpRequest::kInvalid || method >= kNumMethods)
+    {
+        return NULL;
+    }
+    if (node->handlers[method])
+    {
+        return &node->handlers[method];
+    }
+    if (method == HttpRequest::kHead && node->handlers[HttpRequest::kGet])
+    {
+        return &node->handlers[HttpRequest::kGet];
+    }
+    return NULL;
+}
+
+void HttpRouter::allowedMethods(const Node *node, string *allow) const
+{
+    for (int m = HttpRequest::kGet; m < kNumMethods; ++m)
+    {
+        if (node->handlers[m])
+        {
+            if (!allow->empty())
+            {
+                allow->append(", ");
+            }
+            allow->append(detail::kMethodNames[m]);
+        }
+    }
+}
+
+void HttpRouter::dispatch(const HttpRequest &req, HttpResponse *resp) const
+{
+    Params params;
+    const string &path = req.path();
+    const Node *node = match(root_.get(), path.data(), path.data() + path.size(), &params);
+    if (!node)
+    {
+        notFoundCallback_(req, resp);
+        return;
+    }
+
+    HttpRequest::Method method = req.method();
+    const Handler *handler = NULL;
+    if (node->handlers[method])
+    {
+        handler = &node->handlers[method];
+    }
+    else if (method == HttpRequest::kHead && node->handlers[HttpRequest::kGet])
+    {
+        handler = &node->handlers[HttpRequest::kGet];
+    }
+
+    if (handler)
+    {
+        (*handler)(req, params, resp);
+    }
+    else
+    {
+        string allow;
+        allowedMethods(node, &allow);
+        resp->setStatusCode(HttpResponse::k405MethodNotAllowed);
+        resp->setStatusMessage("Method Not Allowed");
+        resp->addHeader(HttpResponse::kAllow, allow);
+    }
+}
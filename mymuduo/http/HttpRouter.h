@@ -0,0 +1,110 @@
+#ifndef MYMUDUO_HTTP_HTTPROUTER_H
+#define MYMUDUO_HTTP_HTTPROUTER_H
+
+#include "mymuduo/base/noncopyable.h"
+#include "mymuduo/base/StringPiece.h"
+#include "mymuduo/http/HttpRequest.h"
+
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace mymuduo
+{
+    namespace net
+    {
+        class HttpResponse;
+
+        // 基于压缩前缀树（radix tree）的路由表，替代在 HttpCallback 中逐个比较 req.path() 的写法
+        //
+        // 路由模式以 '/' 分段，每段可以是：
+        //  - 静态字符串，如 /api/users，相同前缀的静态部分在树中共享节点
+        //  - 参数 :name，匹配一个完整分段（不含 '/'），如 /users/:id
+        //  - 通配 *name，只能出现在模式末尾，匹配剩余的全部路径（可以为空），如 /static/*filepath
+        //
+        // 匹配优先级为 静态 > 参数 > 通配，查找只沿路径前进一次，代价与路径长度成正比，
+        // 与路由数量无关。捕获的参数以 StringPiece 返回，指向 req.path() 内部，不做拷贝
+        class HttpRouter : noncopyable
+        {
+        public:
+            /// 路由匹配捕获的参数，在 Handler 调用期间有效
+            class Params
+            {
+            public:
+                typedef std::pair<StringPiece, StringPiece> Param; // name -> value
+
+                // 找不到时返回空的 StringPiece
+                StringPiece get(const StringPiece &name) const
+                {
+                    for (const Param &p : params_)
+                    {
+                        if (p.first == name)
+                        {
+                            return p.second;
+                        }
+                    }
+                    return StringPiece();
+                }
+
+                size_t size() const { return params_.size(); }
+                bool empty() const { return params_.empty(); }
+                const Param &operator[](size_t i) const { return params_[i]; }
+
+                void push(const StringPiece &name, const StringPiece &value) { params_.push_back(Param(name, value)); }
+                void pop() { params_.pop_back(); }
+                void clear() { params_.clear(); }
+
+            private:
+                std::vector<Param> params_;
+            };
+
+            typedef std::function<void(const HttpRequest &, const Params &, HttpResponse *)> Handler;
+            typedef std::function<void(const HttpRequest &, HttpResponse *)> NotFoundCallback;
+
+            HttpRouter();
+            ~HttpRouter();
+
+            /**
+             * 注册路由，模式非法或与已有路由冲突时返回 false
+             * Not thread safe, routes be registered before calling HttpServer::start().
+             */
+            bool addRoute(HttpRequest::Method method, const string &pattern, const Handler &handler);
+            bool get(const string &pattern, const Handler &handler) { return addRoute(HttpRequest::kGet, pattern, handler); }
+            bool post(const string &pattern, const Handler &handler) { return addRoute(HttpRequest::kPost, pattern, handler); }
+            bool put(const string &pattern, const Handler &handler) { return addRoute(HttpRequest::kPut, pattern, handler); }
+            bool del(const string &pattern, const Handler &handler) { return addRoute(HttpRequest::kDelete, pattern, handler); }
+
+            /// 没有任何路由匹配时调用，默认返回 404
+            void setNotFoundCallback(const NotFoundCallback &cb) { notFoundCallback_ = cb; }
+
+            /**
+             * 查找 path 对应的处理函数，params 返回捕获的参数
+             * 路径存在但方法不匹配时返回 NULL 并把 *pathMatched 置为 true
+             */
+            const Handler *find(HttpRequest::Method method, const StringPiece &path,
+                                Params *params, bool *pathMatched = NULL) const;
+
+            /**
+             * 按请求分发，签名与 HttpServer::HttpCallback 一致：
+             * server.setHttpCallback(std::bind(&HttpRouter::dispatch, &router, _1, _2));
+             * 方法不匹配返回 405，HEAD 请求没有单独注册时使用 GET 的处理函数
+             */
+            void dispatch(const HttpRequest &req, HttpResponse *resp) const;
+
+        private:
+            struct Node;
+
+            static const int kNumMethods = HttpRequest::kDelete + 1;
+
+            Node *insertStatic(Node *node, const StringPiece &str);
+            const Node *match(const Node *node, const char *pos, const char *end, Params *params) const;
+            void allowedMethods(const Node *node, string *allow) const;
+
+            std::unique_ptr<Node> root_;
+            NotFoundCallback notFoundCallback_;
+        };
+    }
+}
+
+#endif
@@ -1,9 +1,16 @@
 #include "mymuduo/http/HttpServer.h"
 
 #include "mymuduo/base/Logging.h"
+#include "mymuduo/base/ThreadPool.h"
+#include "mymuduo/http/Http2Connection.h"
+#include "mymuduo/http/HttpCompress.h"
 #include "mymuduo/http/HttpContext.h"
 #include "mymuduo/http/HttpRequest.h"
 #include "mymuduo/http/HttpResponse.h"
+#include "mymuduo/net/EventLoop.h"
+#include "mymuduo/net/EventLoopThreadPool.h"
+
+#include <string.h>
 
 using namespace mymuduo;
 using namespace mymuduo::net;
@@ -14,6 +21,9 @@ namespace mymuduo
     {
         namespace detail
         {
+            // 不小于该长度的实体不拷贝到首部之后，与首部分段 writev
+            const size_t kGatherBodySize = 4096;
+
             void defaultHttpCallback(const HttpRequest &, HttpResponse *resp)
             {
                 // 404 表示请求的资源在服务器上不存在或未找到
@@ -21,6 +31,39 @@ namespace mymuduo
                 resp->setStatusMessage("Not Found");
                 resp->setCloseConnection(true);
             }
+
+            bool shouldClose(const HttpRequest &req)
+            {
+                const string &connection = req.getHeader("Connection");
+                return connection == "close" ||
+                       (req.getVersion() == HttpRequest::kHttp10 && connection != "Keep-Alive");
+            }
+
+            // 缓冲区以连接前言（或其前缀）开头
+            bool startsWithPreface(const Buffer *buf)
+            {
+                size_t n = std::min(buf->readableBytes(), http2::kClientPrefaceLength);
+                return n > 0 && memcmp(buf->peek(), http2::kClientPreface, n) == 0;
+            }
+
+            bool wantsWebSocket(const HttpRequest &req)
+            {
+                return req.method() == HttpRequest::kGet &&
+                       ::strcasecmp(req.getHeader("Upgrade").c_str(), "websocket") == 0 &&
+                       !req.getHeader("Sec-WebSocket-Key").empty();
+            }
+
+            bool wantsH2cUpgrade(const HttpRequest &req)
+            {
+                const string &upgrade = req.getHeader("Upgrade");
+                return upgrade.find("h2c") != string::npos && req.headers().count("HTTP2-Settings") > 0;
+            }
+
+            void runOffloaded(const HttpServer::HttpCallback &cb, const HttpAsyncResponsePtr &resp)
+            {
+                cb(resp->request(), resp->response());
+                resp->done();
+            }
         }
     }
 }
@@ -30,10 +73,25 @@ HttpServer::HttpServer(EventLoop *loop,
                        const string &name,
                        TcpServer::Option option)
     : server_(loop, listenAddr, name, option),
-      httpCallback_(detail::defaultHttpCallback)
+      httpCallback_(detail::defaultHttpCallback),
+      bodyHighWaterMark_(1024 * 1024),
+      maxPipelineDepth_(16),
+      http2Enabled_(true),
+      webSocketDeflate_(true),
+      connectionRateLimit_{0, 0},
+      clientRateLimit_{0, 0},
+      clientLimitersSweep_(1024)
 {
     server_.setConnectionCallback(std::bind(&HttpServer::onConnection, this, _1));
     server_.setMessageCallback(std::bind(&HttpServer::onMessage, this, _1, _2, _3));
+    server_.setWriteCompleteCallback(std::bind(&HttpServer::onWriteComplete, this, _1));
+}
+
+void HttpServer::setHttpCallback(const HttpCallback &cb, ThreadPool *pool)
+{
+    asyncCallback_ = [cb, pool](const HttpAsyncResponsePtr &resp) {
+        pool->run(std::bind(&detail::runOffloaded, cb, resp));
+    };
 }
 
 void HttpServer::start()
@@ -43,11 +101,92 @@ void HttpServer::start()
     server_.start();
 }
 
+std::vector<LoopMetrics::Snapshot> HttpServer::loopMetricsSnapshots() const
+{
+    return server_.threadPool()->loopMetricsSnapshots();
+}
+
+void HttpServer::setConnectionRateLimit(double bytesPerSecond, size_t burst)
+{
+    connectionRateLimit_ = RateLimit{bytesPerSecond, burst};
+}
+
+void HttpServer::setClientRateLimit(double bytesPerSecond, size_t burst)
+{
+    clientRateLimit_ = RateLimit{bytesPerSecond, burst};
+}
+
+void HttpServer::setGlobalRateLimit(double bytesPerSecond, size_t burst)
+{
+    if (bytesPerSecond > 0)
+        globalRateLimiter_ = std::make_shared<TokenBucket>(bytesPerSecond, burst);
+    else
+        globalRateLimiter_.reset();
+}
+
+void HttpServer::setRateLimiters(const TcpConnectionPtr &conn)
+{
+    std::vector<TokenBucketPtr> buckets;
+    if (connectionRateLimit_.rate > 0)
+        buckets.push_back(std::make_shared<TokenBucket>(connectionRateLimit_.rate, connectionRateLimit_.burst));
+    if (clientRateLimit_.rate > 0)
+        buckets.push_back(clientRateLimiter(conn->peerAddr().toIp()));
+    if (globalRateLimiter_)
+        buckets.push_back(globalRateLimiter_);
+    if (!buckets.empty())
+        conn->setRateLimiters(buckets);
+}
+
+TokenBucketPtr HttpServer::clientRateLimiter(const string &ip)
+{
+    MutexLockGuard lock(clientLimitersMutex_);
+    std::weak_ptr<TokenBucket> &weak = clientLimiters_[ip];
+    TokenBucketPtr bucket(weak.lock());
+    if (!bucket)
+    {
+        bucket = std::make_shared<TokenBucket>(clientRateLimit_.rate, clientRateLimit_.burst);
+        weak = bucket;
+    }
+    if (clientLimiters_.size() > clientLimitersSweep_)
+    {
+        for (auto it = clientLimiters_.begin(); it != clientLimiters_.end();)
+        {
+            if (it->second.expired())
+                it = clientLimiters_.erase(it);
+            else
+                ++it;
+        }
+        clientLimitersSweep_ = std::max(clientLimiters_.size() * 2, static_cast<size_t>(1024));
+    }
+    return bucket;
+}
+
 void HttpServer::onConnection(const TcpConnectionPtr &conn)
 {
     if (conn->connected())
     {
-        conn->setContext(HttpContext());
+        HttpContext context;
+        context.setPauseAtBody(static_cast<bool>(streamCallback_));
+        conn->setContext(context);
+        setRateLimiters(conn);
+    }
+    else
+    {
+        HttpContext *context = boost::any_cast<HttpContext>(conn->getMutableContext());
+        if (context && context->webSocket())
+        {
+            context->webSocket()->onDisconnected();
+        }
+        else if (context)
+        {
+            // 让正在流式产生响应的处理方尽早停止
+            HttpContext::ResponseQueue pending;
+            pending.swap(context->pendingResponses());
+            for (const HttpAsyncResponsePtr &resp : pending)
+            {
+                resp->onWritable();
+            }
+        }
     }
 }
 
@@ -58,32 +197,446 @@ void HttpServer::onMessage(const TcpConnectionPtr &conn,
     LOG_TRACE << "HTTP message\n"
               << buf->toStringPiece();
     HttpContext *context = boost::any_cast<HttpContext>(conn->getMutableContext());
+    if (context->http2())
+    {
+        context->http2()->onMessage(buf, receiveTime);
+        return;
+    }
+    if (context->webSocket())
+    {
+        context->webSocket()->onMessage(buf, receiveTime);
+        return;
+    }
 
-    if (!context->parseRequest(buf, receiveTime))
+    // 一次读取可能包含多个流水线请求，逐个处理直到数据不足
+    while (conn->connected())
     {
-        conn->send("HTTP/1.1 400 Bad Request\r\n\r\n");
-        conn->shutdown();
+        if (http2Enabled_ && context->expectRequestLine() && context->pendingResponses().empty() &&
+            detail::startsWithPreface(buf))
+        {
+            // prior knowledge：前言收全后切换到 HTTP/2，否则等待更多数据
+            if (buf->readableBytes() >= http2::kClientPrefaceLength)
+            {
+                startHttp2(conn, context)->onMessage(buf, receiveTime);
+            }
+            break;
+        }
+
+        if (context->pendingResponses().size() >= maxPipelineDepth_)
+        {
+            // 积压的异步请求太多，等待完成后再继续解析
+            if (!context->pipelinePaused())
+            {
+                context->setPipelinePaused(true);
+                conn->stopRead();
+            }
+            break;
+        }
+
+        if (!context->parseRequest(buf, receiveTime))
+        {
+            requestStats_.addRequest(HttpResponse::k400BadRequest);
+            conn->send("HTTP/1.1 400 Bad Request\r\n\r\n");
+            conn->shutdown();
+            break;
+        }
+
+        if (context->headersComplete())
+        {
+            HttpBodyHandler handler = streamCallback_(conn, context->request());
+            if (handler.onData)
+            {
+                context->streamBody(handler);
+            }
+            else
+            {
+                context->bufferBody();
+            }
+            continue;
+        }
+
+        if (context->streamingBody())
+        {
+            context->consumeBody(buf);
+            if (!context->gotAll())
+            {
+                // 数据不足，或者处理方跟不上；后者需要暂停读取避免输入缓冲区无限增长
+                if (buf->readableBytes() >= bodyHighWaterMark_ && conn->isReading())
+                {
+                    LOG_DEBUG << conn->name() << " body backlog " << buf->readableBytes()
+                              << " bytes, stop reading";
+                    conn->stopRead();
+                }
+                break;
+            }
+        }
+
+        if (context->gotAll())
+        {
+            if (upgradeWebSocket(conn, context, buf, receiveTime) ||
+                upgradeHttp2(conn, context, buf, receiveTime))
+            {
+                break;
+            }
+            const HttpBodyHandler &handler = context->bodyHandler();
+            // 前面还有未发送的异步响应时也要排队，保证顺序
+            if (asyncCallback_ || handler.onAsyncComplete || !context->pendingResponses().empty())
+            {
+                onAsyncRequest(conn, context, handler);
+            }
+            else
+            {
+                onRequest(conn, context->request(), handler.onComplete ? handler.onComplete : httpCallback_);
+            }
+            context->reset();
+        }
+        else
+        {
+            break;
+        }
     }
+}
+
+void HttpServer::resumeBody(const TcpConnectionPtr &conn)
+{
+    conn->getLoop()->runInLoop(std::bind(&HttpServer::resumeInLoop, this, conn));
+}
 
-    if (context->gotAll())
+void HttpServer::resumeInLoop(const TcpConnectionPtr &conn)
+{
+    conn->getLoop()->assertInLoopThread();
+    if (!conn->connected())
     {
-        onRequest(conn, context->request());
-        context->reset();
+        return;
+    }
+    onMessage(conn, conn->inputBuffer(), Timestamp::now());
+    HttpContext *context = boost::any_cast<HttpContext>(conn->getMutableContext());
+    if (!conn->isReading() && !context->pipelinePaused() &&
+        !(context->streamingBody() && conn->inputBuffer()->readableBytes() >= bodyHighWaterMark_))
+    {
+        conn->startRead();
+    }
+}
+
+void HttpServer::onRequest(const TcpConnectionPtr &conn, const HttpRequest &req, const HttpCallback &cb)
+{
+    HttpResponse response(detail::shouldClose(req));
+    cb(req, &response);
+    compress::compressResponse(req, &response);
+    sendResponse(conn, req, response);
+}
+
+/**
+ * 响应自己的限速跟随文件分段排队，流水线中前后的响应不受影响，
+ * 后面的响应也不会替换掉它
+ */
+TokenBucketPtr HttpServer::streamRateLimiter(const HttpResponse &response)
+{
+    if (response.rateLimit() <= 0)
+    {
+        return TokenBucketPtr();
+    }
+    // 突发额度用完后令牌最多积攒 1/4 秒，保持匀速
+    size_t capacity = std::max(static_cast<size_t>(response.rateLimit() / 4), static_cast<size_t>(16 * 1024));
+    return std::make_shared<TokenBucket>(response.rateLimit(), capacity, response.rateBurst());
+}
+
+void HttpServer::recordRequest(const HttpRequest &req, const HttpResponse &response)
+{
+    requestStats_.addRequest(response.statusCode());
+    if (req.receiveTime().valid())
+    {
+        requestStats_.addLatency(Timestamp::now().microSecondsSinceEpoch() - req.receiveTime().microSecondsSinceEpoch());
     }
 }
 
-void HttpServer::onRequest(const TcpConnectionPtr &conn, const HttpRequest &req)
+void HttpServer::sendResponse(const TcpConnectionPtr &conn, const HttpRequest &req, const HttpResponse &response)
 {
-    const string &connection = req.getHeader("Connection");
-    bool close = connection == "close" ||
-                 (req.getVersion() == HttpRequest::kHttp10 && connection != "Keep-Alive");
-    HttpResponse response(close);
-    httpCallback_(req, &response);
+    recordRequest(req, response);
     Buffer buf;
-    response.appendToBuffer(&buf);
-    conn->send(&buf);
+    // HEAD 的响应只有状态行和首部，Content-Length 与 GET 相同，实体、文件分段和 sendfile 都不发送
+    const bool headersOnly = req.method() == HttpRequest::kHead;
+    if (headersOnly)
+    {
+        response.appendHeadersToBuffer(&buf);
+        conn->send(&buf);
+    }
+    else if (!response.fileParts().empty())
+    {
+        // 每段的头部经过缓冲区，文件内容按显式偏移 sendfile，发送顺序由 TcpConnection 保证
+        response.appendHeadersToBuffer(&buf);
+        TokenBucketPtr limiter(streamRateLimiter(response));
+        for (const HttpResponse::FilePart &part : response.fileParts())
+        {
+            buf.append(part.header);
+            if (part.length > 0)
+            {
+                conn->send(&buf);
+                conn->sendFile(response.file(), part.offset, static_cast<size_t>(part.length), limiter);
+            }
+        }
+        conn->send(&buf);
+    }
+    else if (response.sharedBody() && !response.sharedBody()->empty())
+    {
+        // 共享的实体不拷贝进缓冲区，与首部一起 writev
+        response.appendHeadersToBuffer(&buf);
+        conn->send(&buf, response.sharedBody());
+    }
+    else if (response.body().size() >= detail::kGatherBodySize)
+    {
+        // 实体留在 HttpResponse 中，只有没写完的部分才会拷贝到发送队列
+        response.appendHeadersToBuffer(&buf);
+        std::vector<SendSegment> segments;
+        segments.push_back(SendSegment(buf.peek(), buf.readableBytes()));
+        segments.push_back(SendSegment(response.body().data(), response.body().size()));
+        conn->send(segments);
+    }
+    else
+    {
+        response.appendToBuffer(&buf);
+        conn->send(&buf);
+    }
+    if (!headersOnly && response.needSendFile() && response.fileParts().empty())
+    {
+        // 文件内容不经过用户态缓冲区，直接 sendfile
+        conn->sendFile(response.file(), response.fileOffset(), static_cast<size_t>(response.getSendLen()),
+                       streamRateLimiter(response));
+    }
     if (response.closeConnection())
     {
         conn->shutdown();
     }
 }
+
+void HttpServer::sendStreamHeaders(const TcpConnectionPtr &conn, const HttpAsyncResponsePtr &resp)
+{
+    recordRequest(resp->request(), *resp->response());
+    Buffer buf;
+    resp->response()->appendHeadersToBuffer(&buf);
+    resp->flushStream(conn, &buf);
+}
+
+/**
+ * 把解析好的请求转移到 HttpAsyncResponse 中并加入连接的响应队列，
+ * handler 的 onAsyncComplete 优先，其次是 HttpAsyncCallback，
+ * 同步的回调（流式实体的 onComplete 或 HttpCallback）直接在 IO 线程中完成
+ */
+void HttpServer::onAsyncRequest(const TcpConnectionPtr &conn, HttpContext *context, const HttpBodyHandler &handler)
+{
+    HttpAsyncResponsePtr resp(new HttpAsyncResponse(conn->getLoop(),
+                                                    conn,
+                                                    detail::shouldClose(context->request()),
+                                                    std::bind(&HttpServer::onAsyncComplete, this, _1)));
+    resp->request().swap(context->request());
+    resp->setStreamable(resp->request().getVersion() == HttpRequest::kHttp11);
+    context->pendingResponses().push_back(resp);
+    if (handler.onAsyncComplete)
+    {
+        handler.onAsyncComplete(resp);
+    }
+    else if (asyncCallback_ && !handler.onComplete)
+    {
+        asyncCallback_(resp);
+    }
+    else
+    {
+        const HttpCallback &cb = handler.onComplete ? handler.onComplete : httpCallback_;
+        cb(resp->request(), resp->response());
+        resp->done();
+    }
+}
+
+/**
+ * 某个响应完成后回到 IO 线程，从队首开始依次发送已经完成的响应，
+ * 队首未完成时后面完成的响应只能等待，保证与请求顺序一致
+ */
+void HttpServer::onAsyncComplete(const HttpAsyncResponsePtr &resp)
+{
+    TcpConnectionPtr conn = resp->connection();
+    if (!conn || !conn->connected())
+    {
+        return;
+    }
+    HttpContext *context = boost::any_cast<HttpContext>(conn->getMutableContext());
+    HttpContext::ResponseQueue &pending = context->pendingResponses();
+    while (!pending.empty() && pending.front()->finished())
+    {
+        HttpAsyncResponsePtr front = pending.front();
+        if (front->streaming())
+        {
+            if (!front->streamFlushed())
+            {
+                sendStreamHeaders(conn, front);
+            }
+            if (!front->streamEnded())
+            {
+                // 实体发送完之前，后面的响应继续排队
+                break;
+            }
+            pending.pop_front();
+            if (front->response()->closeConnection())
+            {
+                conn->shutdown();
+            }
+        }
+        else
+        {
+            pending.pop_front();
+            sendResponse(conn, front->request(), *front->response());
+        }
+        if (front->response()->closeConnection())
+        {
+            // 之后的请求不再响应
+            pending.clear();
+            return;
+        }
+    }
+
+    if (context->pipelinePaused() && pending.size() < maxPipelineDepth_)
+    {
+        context->setPipelinePaused(false);
+        conn->startRead();
+        // 继续解析已经在输入缓冲区中的请求，放到下一轮避免重入 onMessage
+        conn->getLoop()->queueInLoop(std::bind(&HttpServer::resumeInLoop, this, conn));
+    }
+}
+
+void HttpServer::onWriteComplete(const TcpConnectionPtr &conn)
+{
+    HttpContext *context = boost::any_cast<HttpContext>(conn->getMutableContext());
+    if (context && context->http2())
+    {
+        context->http2()->onWriteComplete();
+    }
+    else if (context && !context->pendingResponses().empty())
+    {
+        // 正在流式发送的响应可以继续产生数据
+        HttpAsyncResponsePtr front = context->pendingResponses().front();
+        if (front->streamFlushed())
+        {
+            front->onWritable();
+        }
+    }
+}
+
+Http2ConnectionPtr HttpServer::startHttp2(const TcpConnectionPtr &conn, HttpContext *context)
+{
+    LOG_DEBUG << conn->name() << " switching to HTTP/2";
+    Http2ConnectionPtr h2(new Http2Connection(conn, std::bind(&HttpServer::onHttp2Request, this, _1, _2, _3)));
+    context->setHttp2(h2);
+    return h2;
+}
+
+bool HttpServer::upgradeHttp2(const TcpConnectionPtr &conn, HttpContext *context, Buffer *buf, Timestamp receiveTime)
+{
+    HttpRequest &req = context->request();
+    // 带实体或流式接收的请求不做升级，照常以 HTTP/1.1 响应
+    if (!http2Enabled_ || !detail::wantsH2cUpgrade(req) || !req.getBody().empty() ||
+        context->bodyHandler().onData || !context->pendingResponses().empty())
+    {
+        return false;
+    }
+
+    HttpResponse response(false);
+    response.setStatusCode(HttpResponse::k101SwitchingProtocols);
+    response.addHeader("Connection", "Upgrade");
+    response.addHeader("Upgrade", "h2c");
+    Buffer out;
+    response.appendToBuffer(&out);
+    conn->send(&out);
+
+    HttpRequest upgraded;
+    upgraded.swap(req);
+    string settings = upgraded.getHeader("HTTP2-Settings");
+    context->reset();
+    Http2ConnectionPtr h2 = startHttp2(conn, context);
+    if (!h2->upgrade(settings, &upgraded))
+    {
+        conn->shutdown();
+        return true;
+    }
+    // 客户端收到 101 之后才发送前言，通常此时缓冲区为空
+    h2->onMessage(buf, receiveTime);
+    return true;
+}
+
+bool HttpServer::upgradeWebSocket(const TcpConnectionPtr &conn, HttpContext *context, Buffer *buf, Timestamp receiveTime)
+{
+    const HttpRequest &req = context->request();
+    if (!webSocketCallback_ || !detail::wantsWebSocket(req) || !context->pendingResponses().empty())
+    {
+        return false;
+    }
+
+    HttpResponse response(false);
+    if (req.getHeader("Sec-WebSocket-Version") != "13")
+    {
+        response.setStatusCode(HttpResponse::k400BadRequest);
+        response.addHeader("Sec-WebSocket-Version", "13");
+        sendResponse(conn, req, response);
+        context->reset();
+        return true;
+    }
+
+    string extensions = webSocketDeflate_ ? WebSocketConnection::negotiateDeflate(req) : string();
+    WebSocketConnectionPtr ws(new WebSocketConnection(conn, !extensions.empty()));
+    if (!webSocketCallback_(req, ws))
+    {
+        response.setStatusCode(HttpResponse::k403Forbidden);
+        response.setCloseConnection(true);
+        sendResponse(conn, req, response);
+        context->reset();
+        return true;
+    }
+
+    response.setStatusCode(HttpResponse::k101SwitchingProtocols);
+    response.addHeader("Upgrade", "websocket");
+    response.addHeader("Connection", "Upgrade");
+    response.addHeader("Sec-WebSocket-Accept", websocket::acceptKey(req.getHeader("Sec-WebSocket-Key")));
+    if (!extensions.empty())
+    {
+        response.addHeader("Sec-WebSocket-Extensions", extensions);
+    }
+    sendResponse(conn, req, response);
+    context->reset();
+    context->setWebSocket(ws);
+    ws->open();
+    // 客户端可能紧跟着握手发送了帧
+    ws->onMessage(buf, receiveTime);
+    return true;
+}
+
+void HttpServer::onHttp2Request(const Http2ConnectionPtr &h2, uint32_t streamId, HttpRequest *req)
+{
+    TcpConnectionPtr conn = h2->connection();
+    if (!conn)
+    {
+        return;
+    }
+    if (asyncCallback_)
+    {
+        // 流之间互不阻塞，完成后直接发送，不需要 HTTP/1.1 那样按顺序排队
+        std::weak_ptr<Http2Connection> weakH2(h2);
+        HttpAsyncResponsePtr resp(new HttpAsyncResponse(
+            conn->getLoop(), conn, false,
+            [this, weakH2, streamId](const HttpAsyncResponsePtr &done) {
+                Http2ConnectionPtr session(weakH2.lock());
+                if (session)
+                {
+                    recordRequest(done->request(), *done->response());
+                    session->sendResponse(streamId, *done->response());
+                }
+            }));
+        resp->request().swap(*req);
+        asyncCallback_(resp);
+    }
+    else
+    {
+        HttpResponse response(false);
+        httpCallback_(*req, &response);
+        compress::compressResponse(*req, &response);
+        recordRequest(*req, response);
+        h2->sendResponse(streamId, response);
+    }
+}
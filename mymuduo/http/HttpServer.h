@@ -2,18 +2,45 @@
 #define MYMUDUO_HTTP_HTTPSERVER_H
 
 #include "mymuduo/net/TcpServer.h"
+#include "mymuduo/http/HttpContext.h"
+#include "mymuduo/http/HttpAsyncResponse.h"
+#include "mymuduo/http/HttpMetrics.h"
+#include "mymuduo/http/WebSocket.h"
+#include "mymuduo/base/Mutex.h"
+
+#include <map>
 
 namespace mymuduo
 {
+    class ThreadPool;
+
     namespace net
     {
         class HttpRequest;
         class HttpResponse;
+        class Http2Connection;
 
         class HttpServer : noncopyable
         {
         public:
             typedef std::function<void(const HttpRequest &, HttpResponse *)> HttpCallback;
+            /**
+             * 首部解析完毕后调用，返回的 handler.onData 不为空时该请求的实体改为流式接收，
+             * 否则照旧缓存到 HttpRequest 中。只对带 Content-Length 的 HTTP/1.x 请求调用，
+             * Content-Length 为 0 时 onData 不会被调用，接着直接调用 onComplete
+             */
+            typedef std::function<HttpBodyHandler(const TcpConnectionPtr &, const HttpRequest &)> HttpStreamCallback;
+            /**
+             * 异步处理：回调返回后请求不必立即完成，处理方可以在任意线程填写
+             * resp->response() 后调用 resp->done()
+             */
+            typedef std::function<void(const HttpAsyncResponsePtr &)> HttpAsyncCallback;
+            /**
+             * 收到 WebSocket 升级请求时调用，返回 false 拒绝升级（响应 403）。
+             * 接受时在回调中设置 conn 的 MessageCallback / CloseCallback，
+             * 此时发送的消息会在握手响应之后发出
+             */
+            typedef std::function<bool(const HttpRequest &, const WebSocketConnectionPtr &)> WebSocketCallback;
 
             /**
              * Http 协议本质上还是建立 Tcp 之后按照特定的格式收发数据
@@ -25,11 +52,73 @@ namespace mymuduo
                        TcpServer::Option option = TcpServer::kNoReusePort);
 
             EventLoop *getLoop() const { return server_.getLoop(); }
+            const string &name() const { return server_.name(); }
+            const string &ipPort() const { return server_.ipPort(); }
 
             /// Not thread safe, callback be registered before calling start().
             void setHttpCallback(const HttpCallback &cb) { httpCallback_ = cb; }
+            /// Not thread safe, callback be registered before calling start().
+            /// 设置后取代 HttpCallback，流式接收实体的请求仍然使用 HttpBodyHandler::onComplete
+            void setHttpAsyncCallback(const HttpAsyncCallback &cb) { asyncCallback_ = cb; }
+            /**
+             * 把 cb 放到 pool 的工作线程中执行，执行完毕后自动完成响应，
+             * 适合做 CPU 计算或者慢速本地 IO 的处理函数，不会阻塞 IO 线程上的其他连接。
+             * pool 队列已满时 ThreadPool::run 会阻塞 IO 线程，应当配合 setMaxPipelineDepth 限制积压
+             */
+            void setHttpCallback(const HttpCallback &cb, ThreadPool *pool);
+            /// 每个连接上最多同时处理的异步请求数，超过后暂停读取，默认 16
+            void setMaxPipelineDepth(size_t depth) { maxPipelineDepth_ = depth; }
+            /// Not thread safe, callback be registered before calling start().
+            void setHttpStreamCallback(const HttpStreamCallback &cb) { streamCallback_ = cb; }
+            /**
+             * 流式接收时，输入缓冲区中积压的实体数据超过该值就暂停读取 socket，
+             * 直到处理方调用 resumeBody()
+             */
+            void setBodyHighWaterMark(size_t bytes) { bodyHighWaterMark_ = bytes; }
+
+            /**
+             * 流式处理方恢复消费能力后调用，把积压的数据重新交给 onData 并恢复读取，
+             * 线程安全
+             */
+            void resumeBody(const TcpConnectionPtr &conn);
 
             void setThreadNum(int numThreads) { server_.setThreadNum(numThreads); }
+            /**
+             * 发送文件（sendFile）前检查数据是否在页缓存中，不在时由 pool 读盘，
+             * 避免冷文件的 sendfile 阻塞 IO 线程。Not thread safe, 在 start() 之前调用
+             */
+            void setFileReadPool(ThreadPool *pool) { server_.setFileReadPool(pool); }
+            /**
+             * 回调中的多次 send 和 sendFile 留到本轮事件循环末尾一起写出，
+             * 减少系统调用和小报文段，见 TcpConnection::setWriteCoalescing。Not thread safe, 在 start() 之前调用
+             */
+            void setWriteCoalescing(bool on) { server_.setWriteCoalescing(on); }
+            /**
+             * 发送限速，单位字节/秒，burst 为允许的突发量，bytesPerSecond 为 0 时不限速（默认）。
+             * 三种限制同时生效：每个连接、同一客户端 IP 的所有连接、整个服务器的所有连接。
+             * Not thread safe, 在 start() 之前调用
+             */
+            void setConnectionRateLimit(double bytesPerSecond, size_t burst);
+            void setClientRateLimit(double bytesPerSecond, size_t burst);
+            void setGlobalRateLimit(double bytesPerSecond, size_t burst);
+
+            /**
+             * 是否接受 HTTP/2 明文连接（prior knowledge 或 Upgrade: h2c），默认开启。
+             * HTTP/2 上的请求同样交给 HttpCallback / HttpAsyncCallback 处理，
+             * 但实体总是完整缓存后才回调，不经过 HttpStreamCallback
+             */
+            void setHttp2Enabled(bool on) { http2Enabled_ = on; }
+            /// Not thread safe, callback be registered before calling start().
+            void setWebSocketCallback(const WebSocketCallback &cb) { webSocketCallback_ = cb; }
+            /// 是否接受客户端提出的 permessage-deflate，默认开启
+            void setWebSocketDeflate(bool on) { webSocketDeflate_ = on; }
+
+            /// 请求与连接统计，可以在任意线程读取，见 HttpMetrics
+            const HttpRequestStats &requestStats() const { return requestStats_; }
+            int64_t acceptedConnections() const { return server_.acceptedConnections(); }
+            int64_t numConnections() const { return server_.numConnections(); }
+            /// 各个 IO 线程的统计，见 EventLoopThreadPool::loopMetricsSnapshots，start() 之后可以在任意线程调用
+            std::vector<LoopMetrics::Snapshot> loopMetricsSnapshots() const;
 
             /**
              * 核心函数，开启 Tcp listen
@@ -43,13 +132,54 @@ namespace mymuduo
             void onMessage(const TcpConnectionPtr &conn,
                            Buffer *buf,
                            Timestamp receiveTime);
-            void onRequest(const TcpConnectionPtr &, const HttpRequest &);
+            void onRequest(const TcpConnectionPtr &, const HttpRequest &, const HttpCallback &);
+            void onAsyncRequest(const TcpConnectionPtr &, HttpContext *, const HttpBodyHandler &);
+            void onAsyncComplete(const HttpAsyncResponsePtr &resp);
+            void sendResponse(const TcpConnectionPtr &, const HttpRequest &, const HttpResponse &);
+            // 按状态码计数，并记录从收到请求到此刻的耗时
+            void recordRequest(const HttpRequest &, const HttpResponse &);
+            // 流式响应轮到发送时先发出首部
+            void sendStreamHeaders(const TcpConnectionPtr &, const HttpAsyncResponsePtr &);
+            // 响应自己的限速（HttpResponse::setRateLimit），没有设置时返回空
+            static TokenBucketPtr streamRateLimiter(const HttpResponse &response);
             void onConnection(const TcpConnectionPtr &conn);
+            void resumeInLoop(const TcpConnectionPtr &conn);
+            void onWriteComplete(const TcpConnectionPtr &conn);
+            void setRateLimiters(const TcpConnectionPtr &conn);
+            TokenBucketPtr clientRateLimiter(const string &ip);
+
+            std::shared_ptr<Http2Connection> startHttp2(const TcpConnectionPtr &conn, HttpContext *context);
+            // 请求带有 Upgrade: h2c 时切换协议，返回是否已经切换
+            bool upgradeHttp2(const TcpConnectionPtr &conn, HttpContext *context, Buffer *buf, Timestamp receiveTime);
+            // 请求为 WebSocket 握手时完成升级，返回是否已经处理
+            bool upgradeWebSocket(const TcpConnectionPtr &conn, HttpContext *context, Buffer *buf, Timestamp receiveTime);
+            void onHttp2Request(const std::shared_ptr<Http2Connection> &h2, uint32_t streamId, HttpRequest *req);
 
             TcpServer server_;
             HttpCallback httpCallback_;
+            HttpStreamCallback streamCallback_;
+            HttpAsyncCallback asyncCallback_;
+            WebSocketCallback webSocketCallback_;
+            size_t bodyHighWaterMark_;
+            size_t maxPipelineDepth_;
+            bool http2Enabled_;
+            bool webSocketDeflate_;
+            HttpRequestStats requestStats_;
+
+            struct RateLimit
+            {
+                double rate;
+                size_t burst;
+            };
+            RateLimit connectionRateLimit_;
+            RateLimit clientRateLimit_;
+            TokenBucketPtr globalRateLimiter_;
+            // 同一 IP 的连接共享令牌桶，连接都断开后令牌桶随之释放，条目在下次清理时删除
+            MutexLock clientLimitersMutex_;
+            std::map<string, std::weak_ptr<TokenBucket>> clientLimiters_ GUARDED_BY(clientLimitersMutex_);
+            size_t clientLimitersSweep_ GUARDED_BY(clientLimitersMutex_); // 条目数超过该值时清理
         };
     }
 }
 
-#endif
\ No newline at end of file
+#endif
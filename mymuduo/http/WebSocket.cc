@@ -0,0 +1,741 @@
+#include "mymuduo/http/WebSocket.h"
+
+#include "mymuduo/base/Logging.h"
+#include "mymuduo/http/HttpRequest.h"
+#include "mymuduo/net/EventLoop.h"
+#include "mymuduo/net/TcpConnection.h"
+
+#include <string.h>
+#include <zlib.h>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+using namespace mymuduo;
+using namespace mymuduo::net;
+
+namespace mymuduo
+{
+    namespace net
+    {
+        namespace detail
+        {
+            const char kWebSocketGuid[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+            const size_t kMaxControlPayload = 125;
+
+            uint32_t rotl(uint32_t x, int n) { return (x << n) | (x >> (32 - n)); }
+
+            // 握手只需要对 60 字节左右的数据做一次 SHA-1，不值得引入 OpenSSL
+            void sha1(const string &message, unsigned char digest[20])
+            {
+                uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+                string data(message);
+                uint64_t bits = static_cast<uint64_t>(message.size()) * 8;
+                data.push_back(static_cast<char>(0x80));
+                while (data.size() % 64 != 56)
+                {
+                    data.push_back('\0');
+                }
+                for (int i = 7; i >= 0; --i)
+                {
+                    data.push_back(static_cast<char>(bits >> (i * 8)));
+                }
+
+                for (size_t chunk = 0; chunk < data.size(); chunk += 64)
+                {
+                    const unsigned char *p = reinterpret_cast<const unsigned char *>(data.data() + chunk);
+                    uint32_t w[80];
+                    for (int i = 0; i < 16; ++i)
+                    {
+                        w[i] = static_cast<uint32_t>(p[i * 4]) << 24 | static_cast<uint32_t>(p[i * 4 + 1]) << 16 |
+                               static_cast<uint32_t>(p[i * 4 + 2]) << 8 | p[i * 4 + 3];
+                    }
+                    for (int i = 16; i < 80; ++i)
+                    {
+                        w[i] = rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+                    }
+                    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+                    for (int i = 0; i < 80; ++i)
+                    {
+                        uint32_t f, k;
+                        if (i < 20)
+                        {
+                            f = (b & c) | (~b & d);
+                            k = 0x5A827999;
+                        }
+                        else if (i < 40)
+                        {
+                            f = b ^ c ^ d;
+                            k = 0x6ED9EBA1;
+                        }
+                        else if (i < 60)
+                        {
+                            f = (b & c) | (b & d) | (c & d);
+                            k = 0x8F1BBCDC;
+                        }
+                        else
+                        {
+                            f = b ^ c ^ d;
+                            k = 0xCA62C1D6;
+                        }
+                        uint32_t temp = rotl(a, 5) + f + e + k + w[i];
+                        e = d;
+                        d = c;
+                        c = rotl(b, 30);
+                        b = a;
+                        a = temp;
+                    }
+                    h[0] += a;
+                    h[1] += b;
+                    h[2] += c;
+                    h[3] += d;
+                    h[4] += e;
+                }
+                for (int i = 0; i < 5; ++i)
+                {
+                    digest[i * 4] = static_cast<unsigned char>(h[i] >> 24);
+                    digest[i * 4 + 1] = static_cast<unsigned char>(h[i] >> 16);
+                    digest[i * 4 + 2] = static_cast<unsigned char>(h[i] >> 8);
+                    digest[i * 4 + 3] = static_cast<unsigned char>(h[i]);
+                }
+            }
+
+            string base64Encode(const unsigned char *data, size_t len)
+            {
+                static const char kTable[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+                string out;
+                size_t i = 0;
+                for (; i + 3 <= len; i += 3)
+                {
+                    uint32_t v = static_cast<uint32_t>(data[i]) << 16 | static_cast<uint32_t>(data[i + 1]) << 8 | data[i + 2];
+                    out.push_back(kTable[v >> 18]);
+                    out.push_back(kTable[(v >> 12) & 0x3f]);
+                    out.push_back(kTable[(v >> 6) & 0x3f]);
+                    out.push_back(kTable[v & 0x3f]);
+                }
+                if (i < len)
+                {
+                    uint32_t v = static_cast<uint32_t>(data[i]) << 16;
+                    if (i + 1 < len)
+                        v |= static_cast<uint32_t>(data[i + 1]) << 8;
+                    out.push_back(kTable[v >> 18]);
+                    out.push_back(kTable[(v >> 12) & 0x3f]);
+                    out.push_back(i + 1 < len ? kTable[(v >> 6) & 0x3f] : '=');
+                    out.push_back('=');
+                }
+                return out;
+            }
+
+            // permessage-deflate 的 raw deflate，双方都不保留上下文，每个消息独立压缩
+            z_stream *newDeflater()
+            {
+                z_stream *zs = new z_stream;
+                memZero(zs, sizeof *zs);
+                if (deflateInit2(zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+                {
+                    delete zs;
+                    return NULL;
+                }
+                return zs;
+            }
+
+            // 压缩后去掉 Z_SYNC_FLUSH 产生的 00 00 ff ff
+            bool deflatePayload(z_stream *zs, const StringPiece &message, string *out)
+            {
+                deflateReset(zs);
+                out->resize(deflateBound(zs, static_cast<uLong>(message.size())) + 16);
+                zs->next_in = reinterpret_cast<Bytef *>(const_cast<char *>(message.data()));
+                zs->avail_in = static_cast<uInt>(message.size());
+                zs->next_out = reinterpret_cast<Bytef *>(&(*out)[0]);
+                zs->avail_out = static_cast<uInt>(out->size());
+                if (deflate(zs, Z_SYNC_FLUSH) != Z_OK || zs->avail_in != 0)
+                {
+                    return false;
+                }
+                size_t n = out->size() - zs->avail_out;
+                if (n >= 4)
+                {
+                    n -= 4;
+                }
+                out->resize(n);
+                return true;
+            }
+
+            void appendCloseFrame(Buffer *buf, websocket::CloseCode code, const StringPiece &reason)
+            {
+                char payload[kMaxControlPayload];
+                payload[0] = static_cast<char>(code >> 8);
+                payload[1] = static_cast<char>(code);
+                size_t n = std::min(static_cast<size_t>(reason.size()), kMaxControlPayload - 2);
+                memcpy(payload + 2, reason.data(), n);
+                websocket::appendFrame(buf, websocket::kClose, payload, n + 2);
+            }
+        }
+    }
+}
+
+string websocket::acceptKey(const string &key)
+{
+    unsigned char digest[20];
+    detail::sha1(key + detail::kWebSocketGuid, digest);
+    return detail::base64Encode(digest, sizeof digest);
+}
+
+void websocket::unmask(char *data, size_t len, const char mask[4], size_t offset)
+{
+    // 把掩码按 offset 旋转，使 key[i % 4] 对应 data[i]
+    unsigned char key[4];
+    for (int i = 0; i < 4; ++i)
+    {
+        key[i] = static_cast<unsigned char>(mask[(offset + static_cast<size_t>(i)) & 3]);
+    }
+    uint32_t key32;
+    memcpy(&key32, key, 4);
+    size_t i = 0;
+
+#if defined(__AVX2__)
+    const __m256i key256 = _mm256_set1_epi32(static_cast<int>(key32));
+    for (; i + 32 <= len; i += 32)
+    {
+        __m256i *p = reinterpret_cast<__m256i *>(data + i);
+        _mm256_storeu_si256(p, _mm256_xor_si256(_mm256_loadu_si256(p), key256));
+    }
+#endif
+#if defined(__SSE2__)
+    const __m128i key128 = _mm_set1_epi32(static_cast<int>(key32));
+    for (; i + 16 <= len; i += 16)
+    {
+        __m128i *p = reinterpret_cast<__m128i *>(data + i);
+        _mm_storeu_si128(p, _mm_xor_si128(_mm_loadu_si128(p), key128));
+    }
+#endif
+    uint64_t key64 = static_cast<uint64_t>(key32) << 32 | key32;
+    for (; i + 8 <= len; i += 8)
+    {
+        uint64_t v;
+        memcpy(&v, data + i, 8);
+        v ^= key64;
+        memcpy(data + i, &v, 8);
+    }
+    for (; i < len; ++i)
+    {
+        data[i] = static_cast<char>(data[i] ^ key[i & 3]);
+    }
+}
+
+void websocket::appendFrame(Buffer *buf, Opcode opcode, const char *data, size_t len, bool fin, bool rsv1)
+{
+    char header[10];
+    size_t n = 2;
+    header[0] = static_cast<char>((fin ? 0x80 : 0) | (rsv1 ? 0x40 : 0) | opcode);
+    if (len < 126)
+    {
+        header[1] = static_cast<char>(len);
+    }
+    else if (len <= 0xffff)
+    {
+        header[1] = 126;
+        header[2] = static_cast<char>(len >> 8);
+        header[3] = static_cast<char>(len);
+        n = 4;
+    }
+    else
+    {
+        header[1] = 127;
+        for (int i = 0; i < 8; ++i)
+        {
+            header[2 + i] = static_cast<char>(static_cast<uint64_t>(len) >> ((7 - i) * 8));
+        }
+        n = 10;
+    }
+    buf->ensureWritableBytes(n + len);
+    buf->append(header, n);
+    buf->append(data, len);
+}
+
+WebSocketConnection::WebSocketConnection(const TcpConnectionPtr &conn, bool deflate)
+    : conn_(conn),
+      deflate_(deflate),
+      maxMessageSize_(16 * 1024 * 1024),
+      closeReceived_(false),
+      closeCallbackCalled_(false),
+      messageOpcode_(websocket::kContinuation),
+      messageCompressed_(false),
+      inflater_(NULL),
+      opened_(false),
+      closeSent_(false),
+      deflater_(NULL)
+{
+}
+
+WebSocketConnection::~WebSocketConnection()
+{
+    if (inflater_)
+    {
+        inflateEnd(inflater_);
+        delete inflater_;
+    }
+    if (deflater_)
+    {
+        deflateEnd(deflater_);
+        delete deflater_;
+    }
+}
+
+string WebSocketConnection::negotiateDeflate(const HttpRequest &req)
+{
+    const string &extensions = req.getHeader("Sec-WebSocket-Extensions");
+    if (extensions.find("permessage-deflate") == string::npos)
+    {
+        return string();
+    }
+    // 两个方向都不保留滑动窗口，每个消息独立压缩，广播时压缩结果可以共享
+    return "permessage-deflate; server_no_context_takeover; client_no_context_takeover";
+}
+
+void WebSocketConnection::open()
+{
+    std::vector<std::shared_ptr<const string>> pending;
+    {
+        MutexLockGuard lock(mutex_);
+        opened_ = true;
+        pending.swap(pending_);
+    }
+    if (!pending.empty())
+    {
+        TcpConnectionPtr conn(conn_.lock());
+        if (conn)
+        {
+            // 积压的帧按引用一次发出，广播的帧不再拷贝
+            std::vector<SendSegment> segments;
+            segments.reserve(pending.size());
+            for (const std::shared_ptr<const string> &frame : pending)
+            {
+                segments.push_back(SendSegment(frame->data(), frame->size(), frame));
+            }
+            conn->send(segments);
+        }
+    }
+}
+
+void WebSocketConnection::sendRaw(Buffer *buf)
+{
+    {
+        MutexLockGuard lock(mutex_);
+        if (closeSent_)
+        {
+            return;
+        }
+        if (!opened_)
+        {
+            pending_.push_back(std::make_shared<const string>(buf->retrieveAllAsString()));
+            return;
+        }
+    }
+    TcpConnectionPtr conn(conn_.lock());
+    if (conn)
+    {
+        conn->send(buf);
+    }
+}
+
+void WebSocketConnection::sendFrame(const std::shared_ptr<const string> &frame)
+{
+    {
+        MutexLockGuard lock(mutex_);
+        if (closeSent_)
+        {
+            return;
+        }
+        if (!opened_)
+        {
+            pending_.push_back(frame);
+            return;
+        }
+    }
+    TcpConnectionPtr conn(conn_.lock());
+    if (conn)
+    {
+        conn->send(frame);
+    }
+}
+
+void WebSocketConnection::send(const StringPiece &message, bool binary)
+{
+    websocket::Opcode opcode = binary ? websocket::kBinary : websocket::kText;
+    Buffer buf;
+    string compressed;
+    if (deflate_ && deflateMessage(message, &compressed))
+    {
+        websocket::appendFrame(&buf, opcode, compressed.data(), compressed.size(), true, true);
+    }
+    else
+    {
+        websocket::appendFrame(&buf, opcode, message.data(), message.size());
+    }
+    sendRaw(&buf);
+}
+
+bool WebSocketConnection::deflateMessage(const StringPiece &message, string *out)
+{
+    MutexLockGuard lock(mutex_);
+    if (!deflater_)
+    {
+        deflater_ = detail::newDeflater();
+        if (!deflater_)
+            return false;
+    }
+    return detail::deflatePayload(deflater_, message, out);
+}
+
+bool WebSocketConnection::inflateMessage(string *message)
+{
+    if (!inflater_)
+    {
+        inflater_ = new z_stream;
+        memZero(inflater_, sizeof *inflater_);
+        if (inflateInit2(inflater_, -15) != Z_OK)
+        {
+            delete inflater_;
+            inflater_ = NULL;
+            return false;
+        }
+    }
+    inflateReset(inflater_);
+    message->append("\x00\x00\xff\xff", 4);
+    inflater_->next_in = reinterpret_cast<Bytef *>(&(*message)[0]);
+    inflater_->avail_in = static_cast<uInt>(message->size());
+
+    string out;
+    char buf[16384];
+    int ret = Z_OK;
+    while (inflater_->avail_in > 0 && ret == Z_OK)
+    {
+        inflater_->next_out = reinterpret_cast<Bytef *>(buf);
+        inflater_->avail_out = sizeof buf;
+        ret = inflate(inflater_, Z_SYNC_FLUSH);
+        if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR)
+        {
+            return false;
+        }
+        out.append(buf, sizeof buf - inflater_->avail_out);
+        if (out.size() > maxMessageSize_)
+        {
+            return false;
+        }
+        if (ret == Z_BUF_ERROR)
+        {
+            break;
+        }
+    }
+    message->swap(out);
+    return true;
+}
+
+void WebSocketConnection::ping(const StringPiece &payload)
+{
+    Buffer buf;
+    websocket::appendFrame(&buf, websocket::kPing, payload.data(),
+                           std::min(static_cast<size_t>(payload.size()), detail::kMaxControlPayload));
+    sendRaw(&buf);
+}
+
+void WebSocketConnection::close(websocket::CloseCode code, const StringPiece &reason)
+{
+    Buffer buf;
+    detail::appendCloseFrame(&buf, code, reason);
+    sendRaw(&buf);
+    {
+        MutexLockGuard lock(mutex_);
+        closeSent_ = true;
+    }
+    // 对端回复 Close 后由它关闭连接，这里只关闭写端
+    TcpConnectionPtr conn(conn_.lock());
+    if (conn)
+    {
+        conn->shutdown();
+    }
+}
+
+void WebSocketConnection::onMessage(Buffer *buf, Timestamp)
+{
+    while (buf->readableBytes() > 0)
+    {
+        int64_t n = onFrame(buf->peek(), buf->readableBytes());
+        if (n < 0)
+        {
+            buf->retrieveAll();
+            return;
+        }
+        if (n == 0)
+        {
+            break;
+        }
+        buf->retrieve(static_cast<size_t>(n));
+    }
+}
+
+int64_t WebSocketConnection::onFrame(const char *data, size_t len)
+{
+    if (closeReceived_)
+    {
+        return static_cast<int64_t>(len);
+    }
+    if (len < 2)
+    {
+        return 0;
+    }
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(data);
+    bool fin = (p[0] & 0x80) != 0;
+    bool rsv1 = (p[0] & 0x40) != 0;
+    websocket::Opcode opcode = static_cast<websocket::Opcode>(p[0] & 0x0f);
+    bool masked = (p[1] & 0x80) != 0;
+    uint64_t payloadLen = p[1] & 0x7f;
+    size_t headerLen = 2;
+    if (payloadLen == 126)
+    {
+        if (len < 4)
+            return 0;
+        payloadLen = static_cast<uint64_t>(p[2]) << 8 | p[3];
+        headerLen = 4;
+    }
+    else if (payloadLen == 127)
+    {
+        if (len < 10)
+            return 0;
+        payloadLen = 0;
+        for (int i = 0; i < 8; ++i)
+        {
+            payloadLen = payloadLen << 8 | p[2 + i];
+        }
+        headerLen = 10;
+    }
+
+    if (!masked)
+    {
+        failConnection(websocket::kProtocolError, "unmasked client frame");
+        return -1;
+    }
+    if ((p[0] & 0x30) != 0 || (rsv1 && (!deflate_ || opcode == websocket::kContinuation || opcode >= websocket::kClose)))
+    {
+        failConnection(websocket::kProtocolError, "unexpected RSV bits");
+        return -1;
+    }
+    bool control = opcode >= websocket::kClose;
+    if (control && (!fin || payloadLen > detail::kMaxControlPayload))
+    {
+        failConnection(websocket::kProtocolError, "invalid control frame");
+        return -1;
+    }
+    if (payloadLen > maxMessageSize_ || message_.size() + payloadLen > maxMessageSize_)
+    {
+        failConnection(websocket::kMessageTooBig, "message too big");
+        return -1;
+    }
+    if (len < headerLen + 4 + payloadLen)
+    {
+        return 0;
+    }
+
+    const char *mask = data + headerLen;
+    const char *payload = mask + 4;
+    size_t size = static_cast<size_t>(payloadLen);
+    if (control)
+    {
+        string body(payload, size);
+        websocket::unmask(&body[0], size, mask);
+        onControlFrame(opcode, body);
+    }
+    else
+    {
+        if (opcode == websocket::kContinuation)
+        {
+            if (messageOpcode_ == websocket::kContinuation)
+            {
+                failConnection(websocket::kProtocolError, "unexpected continuation");
+                return -1;
+            }
+        }
+        else if (opcode == websocket::kText || opcode == websocket::kBinary)
+        {
+            if (messageOpcode_ != websocket::kContinuation)
+            {
+                failConnection(websocket::kProtocolError, "expect continuation");
+                return -1;
+            }
+            messageOpcode_ = opcode;
+            messageCompressed_ = rsv1;
+        }
+        else
+        {
+            failConnection(websocket::kProtocolError, "unknown opcode");
+            return -1;
+        }
+        // 直接拼到消息末尾再原地去掩码，每个字节只拷贝一次
+        size_t start = message_.size();
+        message_.append(payload, size);
+        websocket::unmask(&message_[0] + start, size, mask);
+        if (fin)
+        {
+            deliverMessage();
+        }
+    }
+    return static_cast<int64_t>(headerLen + 4 + size);
+}
+
+void WebSocketConnection::deliverMessage()
+{
+    bool binary = messageOpcode_ == websocket::kBinary;
+    messageOpcode_ = websocket::kContinuation;
+    string message;
+    message.swap(message_);
+    if (messageCompressed_ && !inflateMessage(&message))
+    {
+        failConnection(websocket::kInvalidPayload, "inflate failed");
+        return;
+    }
+    if (messageCallback_)
+    {
+        messageCallback_(shared_from_this(), message, binary);
+    }
+}
+
+void WebSocketConnection::onControlFrame(websocket::Opcode opcode, const string &payload)
+{
+    if (opcode == websocket::kPing)
+    {
+        Buffer buf;
+        websocket::appendFrame(&buf, websocket::kPong, payload.data(), payload.size());
+        sendRaw(&buf);
+    }
+    else if (opcode == websocket::kClose)
+    {
+        closeReceived_ = true;
+        bool closeSent;
+        {
+            MutexLockGuard lock(mutex_);
+            closeSent = closeSent_;
+        }
+        if (closeSent)
+        {
+            // 我们发起的关闭已经得到回应
+            TcpConnectionPtr conn(conn_.lock());
+            if (conn)
+                conn->shutdown();
+            return;
+        }
+        websocket::CloseCode code = websocket::kNormalClosure;
+        if (payload.size() >= 2)
+        {
+            code = static_cast<websocket::CloseCode>(static_cast<unsigned char>(payload[0]) << 8 |
+                                                     static_cast<unsigned char>(payload[1]));
+        }
+        close(code == websocket::kNoStatus ? websocket::kNormalClosure : code);
+    }
+    // Pong 不需要处理
+}
+
+void WebSocketConnection::failConnection(websocket::CloseCode code, const char *reason)
+{
+    LOG_ERROR << "WebSocketConnection error " << code << ": " << reason;
+    closeReceived_ = true;
+    close(code, reason);
+}
+
+void WebSocketConnection::onDisconnected()
+{
+    if (!closeCallbackCalled_)
+    {
+        closeCallbackCalled_ = true;
+        if (closeCallback_)
+        {
+            closeCallback_(shared_from_this());
+        }
+    }
+}
+
+void WebSocketGroup::add(const WebSocketConnectionPtr &conn)
+{
+    MutexLockGuard lock(mutex_);
+    conns_.push_back(conn);
+}
+
+void WebSocketGroup::remove(const WebSocketConnectionPtr &conn)
+{
+    MutexLockGuard lock(mutex_);
+    for (size_t i = 0; i < conns_.size(); ++i)
+    {
+        if (conns_[i].lock() == conn)
+        {
+            conns_[i] = conns_.back();
+            conns_.pop_back();
+            break;
+        }
+    }
+}
+
+size_t WebSocketGroup::size() const
+{
+    MutexLockGuard lock(mutex_);
+    return conns_.size();
+}
+
+size_t WebSocketGroup::broadcast(const StringPiece &message, bool binary)
+{
+    std::vector<WebSocketConnectionPtr> targets;
+    {
+        MutexLockGuard lock(mutex_);
+        size_t alive = 0;
+        for (size_t i = 0; i < conns_.size(); ++i)
+        {
+            WebSocketConnectionPtr conn(conns_[i].lock());
+            if (conn)
+            {
+                targets.push_back(conn);
+                conns_[alive++] = conns_[i];
+            }
+        }
+        conns_.resize(alive);
+    }
+
+    // 普通帧和压缩帧各序列化一次，按连接的协商结果选择
+    websocket::Opcode opcode = binary ? websocket::kBinary : websocket::kText;
+    std::shared_ptr<const string> plain, compressed;
+    for (const WebSocketConnectionPtr &conn : targets)
+    {
+        std::shared_ptr<const string> *frame = &plain;
+        if (conn->deflate())
+        {
+            if (!compressed)
+            {
+                z_stream *zs = detail::newDeflater();
+                string payload;
+                Buffer buf;
+                if (zs && detail::deflatePayload(zs, message, &payload))
+                {
+                    websocket::appendFrame(&buf, opcode, payload.data(), payload.size(), true, true);
+                }
+                else
+                {
+                    websocket::appendFrame(&buf, opcode, message.data(), message.size());
+                }
+                if (zs)
+                {
+                    deflateEnd(zs);
+                    delete zs;
+                }
+                compressed = std::make_shared<const string>(buf.retrieveAllAsString());
+            }
+            frame = &compressed;
+        }
+        else if (!plain)
+        {
+            Buffer buf;
+            websocket::appendFrame(&buf, opcode, message.data(), message.size());
+            plain = std::make_shared<const string>(buf.retrieveAllAsString());
+        }
+        conn->sendFrame(*frame);
+    }
+    return targets.size();
+}
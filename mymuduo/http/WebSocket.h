@@ -0,0 +1,160 @@
+#ifndef MYMUDUO_HTTP_WEBSOCKET_H
+#define MYMUDUO_HTTP_WEBSOCKET_H
+
+#include "mymuduo/base/Mutex.h"
+#include "mymuduo/base/noncopyable.h"
+#include "mymuduo/base/StringPiece.h"
+#include "mymuduo/base/Types.h"
+#include "mymuduo/net/Buffer.h"
+#include "mymuduo/net/Callbacks.h"
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+typedef struct z_stream_s z_stream;
+
+namespace mymuduo
+{
+    namespace net
+    {
+        class HttpRequest;
+
+        /**
+         * WebSocket（RFC 6455）的帧格式与工具函数
+         */
+        namespace websocket
+        {
+            enum Opcode
+            {
+                kContinuation = 0x0,
+                kText = 0x1,
+                kBinary = 0x2,
+                kClose = 0x8,
+                kPing = 0x9,
+                kPong = 0xa,
+            };
+
+            enum CloseCode
+            {
+                kNormalClosure = 1000,
+                kGoingAway = 1001,
+                kProtocolError = 1002,
+                kUnsupportedData = 1003,
+                kNoStatus = 1005,
+                kInvalidPayload = 1007,
+                kMessageTooBig = 1009,
+                kInternalError = 1011,
+            };
+
+            /// Sec-WebSocket-Accept = base64(sha1(key + GUID))
+            string acceptKey(const string &key);
+
+            /**
+             * 用 4 字节掩码异或 [data, data+len)，offset 为这段数据在整个负载中的起始位置。
+             * 按 CPU 支持使用 AVX2 / SSE2，每次处理 32 / 16 字节
+             */
+            void unmask(char *data, size_t len, const char mask[4], size_t offset = 0);
+
+            /// 写入一个服务端帧（不带掩码），rsv1 表示负载经过 permessage-deflate 压缩
+            void appendFrame(Buffer *buf, Opcode opcode, const char *data, size_t len, bool fin = true, bool rsv1 = false);
+        }
+
+        class WebSocketConnection;
+        typedef std::shared_ptr<WebSocketConnection> WebSocketConnectionPtr;
+
+        /**
+         * 升级后的一条 WebSocket 连接，保存在 HttpContext 中。
+         * 收到的帧在 IO 线程中解码，分片的消息拼接完整后回调 MessageCallback，
+         * Ping 自动回复 Pong，Close 按握手流程回复后关闭连接。
+         * send()/close() 线程安全
+         */
+        class WebSocketConnection : noncopyable,
+                                    public std::enable_shared_from_this<WebSocketConnection>
+        {
+        public:
+            typedef std::function<void(const WebSocketConnectionPtr &, const string &message, bool binary)> MessageCallback;
+            typedef std::function<void(const WebSocketConnectionPtr &)> CloseCallback;
+
+            WebSocketConnection(const TcpConnectionPtr &conn, bool deflate);
+            ~WebSocketConnection();
+
+            TcpConnectionPtr connection() const { return conn_.lock(); }
+            /// 是否协商了 permessage-deflate
+            bool deflate() const { return deflate_; }
+
+            void setMessageCallback(const MessageCallback &cb) { messageCallback_ = cb; }
+            /// 连接断开（无论哪一方发起）时调用一次
+            void setCloseCallback(const CloseCallback &cb) { closeCallback_ = cb; }
+            /// 单个消息（拼接后）的上限，超过时以 1009 关闭，默认 16MB
+            void setMaxMessageSize(size_t bytes) { maxMessageSize_ = bytes; }
+
+            void send(const StringPiece &message, bool binary = false);
+            void ping(const StringPiece &payload = StringPiece());
+            void close(websocket::CloseCode code = websocket::kNormalClosure, const StringPiece &reason = StringPiece());
+
+            /// 广播时使用：发送一个已经序列化好的帧，各连接共享同一份内存
+            void sendFrame(const std::shared_ptr<const string> &frame);
+
+            /// 以下由 HttpServer 调用
+            void open();
+            void onMessage(Buffer *buf, Timestamp receiveTime);
+            void onDisconnected();
+
+            /// permessage-deflate 协商：返回响应中的 Sec-WebSocket-Extensions，不接受时为空串
+            static string negotiateDeflate(const HttpRequest &req);
+
+        private:
+            // 解码一个帧，数据不足返回 0，出错返回 -1，否则返回帧的总长度
+            int64_t onFrame(const char *data, size_t len);
+            void onControlFrame(websocket::Opcode opcode, const string &payload);
+            void deliverMessage();
+            void failConnection(websocket::CloseCode code, const char *reason);
+            void sendRaw(Buffer *buf);
+            bool deflateMessage(const StringPiece &message, string *out);
+            bool inflateMessage(string *message);
+
+            std::weak_ptr<TcpConnection> conn_;
+            const bool deflate_;
+            MessageCallback messageCallback_;
+            CloseCallback closeCallback_;
+            size_t maxMessageSize_;
+
+            // 以下只在 IO 线程使用
+            bool closeReceived_;
+            bool closeCallbackCalled_;
+            websocket::Opcode messageOpcode_; // 正在拼接的消息类型，kContinuation 表示没有
+            bool messageCompressed_;
+            string message_;
+            z_stream *inflater_;
+
+            // send() 可以在任意线程调用，打开之前的输出和压缩上下文由 mutex_ 保护
+            MutexLock mutex_;
+            bool opened_ GUARDED_BY(mutex_);
+            bool closeSent_ GUARDED_BY(mutex_);
+            std::vector<std::shared_ptr<const string>> pending_ GUARDED_BY(mutex_); // 握手完成前（回调中）发送的帧
+            z_stream *deflater_ GUARDED_BY(mutex_);
+        };
+
+        /**
+         * 一组 WebSocket 连接，广播时帧只序列化（和压缩）一次，再发给每个连接。
+         * 保存 weak_ptr，断开的连接在下次广播时移除，线程安全
+         */
+        class WebSocketGroup : noncopyable
+        {
+        public:
+            void add(const WebSocketConnectionPtr &conn);
+            void remove(const WebSocketConnectionPtr &conn);
+            size_t size() const;
+
+            /// 返回实际发送的连接数
+            size_t broadcast(const StringPiece &message, bool binary = false);
+
+        private:
+            mutable MutexLock mutex_;
+            std::vector<std::weak_ptr<WebSocketConnection>> conns_ GUARDED_BY(mutex_);
+        };
+    }
+}
+
+#endif
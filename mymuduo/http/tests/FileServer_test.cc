@@ -2,21 +2,47 @@
 #include "mymuduo/http/HttpRequest.h"
 #include "mymuduo/net/EventLoop.h"
 #include "mymuduo/base/Logging.h"
+#include "mymuduo/base/ThreadPool.h"
+
+#include <string.h>
 
 using namespace mymuduo;
 using namespace mymuduo::net;
 
+// 用法：FileServer_test [numThreads [readThreads]] [--upload]
+// 服务的是当前目录，只有显式给出 --upload 才接受 PUT 上传
 int main(int argc, char *argv[])
 {
     int numThreads = 0;
-    if (argc > 1)
+    int readThreads = 0;
+    bool upload = false;
+    int positional = 0;
+    for (int i = 1; i < argc; ++i)
     {
-        Logger::setLogLevel(Logger::WARN);
-        numThreads = atoi(argv[1]);
+        if (::strcmp(argv[i], "--upload") == 0)
+        {
+            upload = true;
+        }
+        else if (positional++ == 0)
+        {
+            Logger::setLogLevel(Logger::WARN);
+            numThreads = atoi(argv[i]);
+        }
+        else
+        {
+            readThreads = atoi(argv[i]);
+        }
     }
     EventLoop loop;
     FileServer server(".", &loop, InetAddress(8888), "FileServer");
     server.setThreadNum(numThreads);
+    ThreadPool readPool("FileRead");
+    if (readThreads > 0)
+    {
+        readPool.start(readThreads);
+        server.setFileReadPool(&readPool);
+    }
+    server.setUploadEnabled(upload);
     server.start();
     loop.loop();
 }
\ No newline at end of file
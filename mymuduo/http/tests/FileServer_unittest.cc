@@ -0,0 +1,491 @@
+#include "mymuduo/http/FileServer.h"
+#include "mymuduo/http/HttpRequest.h"
+#include "mymuduo/http/HttpResponse.h"
+#include "mymuduo/net/Buffer.h"
+#include "mymuduo/base/Logging.h"
+#include "mymuduo/base/ThreadPool.h"
+#include "mymuduo/base/tests/TestCheck.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <atomic>
+#include <thread>
+
+using namespace mymuduo;
+using namespace mymuduo::net;
+
+string g_dir;
+
+void writeFile(const string &name, const string &content)
+{
+    FILE *fp = ::fopen((g_dir + name).c_str(), "w");
+    ::fwrite(content.data(), 1, content.size(), fp);
+    ::fclose(fp);
+}
+
+HttpRequest makeRequest(const char *method, const string &path)
+{
+    HttpRequest req;
+    req.setMethod(method, method + strlen(method));
+    req.setPath(path.data(), path.data() + path.size());
+    req.setVersion(HttpRequest::kHttp11);
+    return req;
+}
+
+void addHeader(HttpRequest *req, const string &field, const string &value)
+{
+    string line = field + ": " + value;
+    req->addHeader(line.data(), line.data() + field.size(), line.data() + line.size());
+}
+
+HttpResponse serve(FileServer &files, const HttpRequest &req)
+{
+    HttpResponse resp(false);
+    files.serve(req.path(), req, &resp);
+    return resp;
+}
+
+void testConditional(FileServer &files)
+{
+    HttpResponse first = serve(files, makeRequest("GET", "/a.txt"));
+    CHECK(first.statusCode() == HttpResponse::k200Ok);
+    const string etag = first.header(HttpResponse::kETag);
+    const string lastModified = first.header(HttpResponse::kLastModified);
+    CHECK(etag.size() > 2 && etag[0] == '"');
+    CHECK(lastModified.find(" GMT") != string::npos);
+    CHECK(first.header(HttpResponse::kCacheControl) == "max-age=60");
+
+    HttpRequest req = makeRequest("GET", "/a.txt");
+    addHeader(&req, "If-None-Match", "\"other\", " + etag);
+    HttpResponse resp = serve(files, req);
+    CHECK(resp.statusCode() == HttpResponse::k304NotModified);
+    CHECK(!resp.needSendFile() && resp.body().empty());
+    CHECK(resp.header(HttpResponse::kETag) == etag);
+
+    // 弱比较
+    req = makeRequest("HEAD", "/a.txt");
+    addHeader(&req, "If-None-Match", "W/" + etag);
+    CHECK(serve(files, req).statusCode() == HttpResponse::k304NotModified);
+
+    req = makeRequest("GET", "/a.txt");
+    addHeader(&req, "If-None-Match", "*");
+    CHECK(serve(files, req).statusCode() == HttpResponse::k304NotModified);
+
+    req = makeRequest("GET", "/a.txt");
+    addHeader(&req, "If-Modified-Since", lastModified);
+    CHECK(serve(files, req).statusCode() == HttpResponse::k304NotModified);
+
+    req = makeRequest("GET", "/a.txt");
+    addHeader(&req, "If-Modified-Since", "Sun, 06 Nov 1994 08:49:37 GMT");
+    CHECK(serve(files, req).statusCode() == HttpResponse::k200Ok);
+
+    // If-None-Match 优先于 If-Modified-Since
+    req = makeRequest("GET", "/a.txt");
+    addHeader(&req, "If-None-Match", "\"other\"");
+    addHeader(&req, "If-Modified-Since", lastModified);
+    CHECK(serve(files, req).statusCode() == HttpResponse::k200Ok);
+
+    // 压缩后的表示有自己的 ETag，再次验证时同样返回 304
+    req = makeRequest("GET", "/a.txt");
+    addHeader(&req, "Accept-Encoding", "gzip");
+    resp = serve(files, req);
+    CHECK(resp.header(HttpResponse::kContentEncoding) == "gzip");
+    string gzipETag = resp.header(HttpResponse::kETag);
+    CHECK(gzipETag != etag && gzipETag.find("-gzip\"") != string::npos);
+    addHeader(&req, "If-None-Match", gzipETag);
+    CHECK(serve(files, req).statusCode() == HttpResponse::k304NotModified);
+}
+
+void testIfRange(FileServer &files)
+{
+    const string etag = serve(files, makeRequest("GET", "/a.txt")).header(HttpResponse::kETag);
+    const string lastModified = serve(files, makeRequest("GET", "/a.txt")).header(HttpResponse::kLastModified);
+
+    HttpRequest req = makeRequest("GET", "/a.txt");
+    addHeader(&req, "Range", "bytes=0-9");
+    addHeader(&req, "If-Range", etag);
+    HttpResponse resp = serve(files, req);
+    CHECK(resp.statusCode() == HttpResponse::k206Partitial);
+    CHECK(resp.getSendLen() == 10);
+
+    req = makeRequest("GET", "/a.txt");
+    addHeader(&req, "Range", "bytes=0-9");
+    addHeader(&req, "If-Range", lastModified);
+    CHECK(serve(files, req).statusCode() == HttpResponse::k206Partitial);
+
+    // 过期的验证器：忽略 Range，发送完整文件
+    req = makeRequest("GET", "/a.txt");
+    addHeader(&req, "Range", "bytes=0-9");
+    addHeader(&req, "If-Range", "\"stale\"");
+    resp = serve(files, req);
+    CHECK(resp.statusCode() == HttpResponse::k200Ok);
+    CHECK(resp.contentLength() == 1000);
+
+    // 弱 ETag 不能用于 If-Range
+    req = makeRequest("GET", "/a.txt");
+    addHeader(&req, "Range", "bytes=0-9");
+    addHeader(&req, "If-Range", "W/" + etag);
+    CHECK(serve(files, req).statusCode() == HttpResponse::k200Ok);
+}
+
+void testMultiRange(FileServer &files)
+{
+    HttpRequest req = makeRequest("GET", "/a.txt");
+    addHeader(&req, "Range", "bytes=0-9, 100-109,-5");
+    HttpResponse resp = serve(files, req);
+    CHECK(resp.statusCode() == HttpResponse::k206Partitial);
+    const string &type = resp.header(HttpResponse::kContentType);
+    CHECK(type.compare(0, 31, "multipart/byteranges; boundary=") == 0);
+    const string boundary = type.substr(31);
+    const std::vector<HttpResponse::FilePart> &parts = resp.fileParts();
+    CHECK(parts.size() == 4);
+    CHECK(parts[0].header == "\r\n--" + boundary + "\r\nContent-Type: text/plain;charset=utf-8\r\n"
+                             "Content-Range: bytes 0-9/1000\r\n\r\n");
+    CHECK(parts[1].offset == 100 && parts[1].length == 10);
+    CHECK(parts[2].offset == 995 && parts[2].length == 5);
+    CHECK(parts[2].header.find("Content-Range: bytes 995-999/1000") != string::npos);
+    CHECK(parts[3].header == "\r\n--" + boundary + "--\r\n" && parts[3].length == 0);
+    int64_t total = 0;
+    for (const HttpResponse::FilePart &part : parts)
+        total += static_cast<int64_t>(part.header.size()) + part.length;
+    CHECK(resp.contentLength() == total);
+
+    // 超过 2GB 的偏移不会溢出，无法满足时返回 416
+    req = makeRequest("GET", "/a.txt");
+    addHeader(&req, "Range", "bytes=3000000000-");
+    resp = serve(files, req);
+    CHECK(resp.statusCode() == HttpResponse::k416RangeNotSatisfiable);
+    int64_t begin, end, size;
+    CHECK(resp.contentRange(&begin, &end, &size) && begin == -1 && size == 1000);
+    CHECK(!resp.needSendFile());
+
+    // 超出文件的部分被截断
+    req = makeRequest("GET", "/a.txt");
+    addHeader(&req, "Range", "bytes=990-99999999999");
+    resp = serve(files, req);
+    CHECK(resp.statusCode() == HttpResponse::k206Partitial && resp.getSendLen() == 10 && resp.fileOffset() == 990);
+
+    // 语法错误或者重叠造成的放大：忽略 Range
+    const char *ignored[] = {"bytes=9-0", "bytes=a-b", "items=0-9", "bytes=0-999,0-999", "bytes=-"};
+    for (const char *value : ignored)
+    {
+        req = makeRequest("GET", "/a.txt");
+        addHeader(&req, "Range", value);
+        CHECK(serve(files, req).statusCode() == HttpResponse::k200Ok);
+    }
+}
+
+void testCacheControl(FileServer &files)
+{
+    CHECK(serve(files, makeRequest("GET", "/b.png")).header(HttpResponse::kCacheControl) == "max-age=86400");
+    CHECK(serve(files, makeRequest("GET", "/c.mp3")).header(HttpResponse::kCacheControl) == "no-cache");
+
+    files.setWeakETag(true);
+    CHECK(serve(files, makeRequest("GET", "/b.png")).header(HttpResponse::kETag).compare(0, 3, "W/\"") == 0);
+    files.setWeakETag(false);
+}
+
+void testFileCache()
+{
+    FileServer files(g_dir);
+    files.setFileCacheTtl(60);
+    files.setSmallFileCache(0, 0);
+    HttpResponse first = serve(files, makeRequest("GET", "/a.txt"));
+    HttpResponse second = serve(files, makeRequest("GET", "/a.txt"));
+    CHECK(files.fileCache().misses() == 1);
+    CHECK(files.fileCache().hits() == 1);
+    // 并发的传输共享同一个 fd，偏移量各自独立
+    CHECK(first.file() && first.file() == second.file());
+    CHECK(first.fileOffset() == 0);
+
+    HttpRequest req = makeRequest("GET", "/a.txt");
+    addHeader(&req, "Range", "bytes=5-9");
+    HttpResponse range = serve(files, req);
+    CHECK(range.file() == first.file());
+    CHECK(range.fileOffset() == 5 && range.getSendLen() == 5);
+    CHECK(first.fileOffset() == 0);
+
+    // ttl 为 0 时每次重新 stat，文件未变则沿用原 fd
+    files.setFileCacheTtl(0);
+    HttpResponse third = serve(files, makeRequest("GET", "/a.txt"));
+    CHECK(third.file() == first.file());
+    CHECK(files.fileCache().revalidations() == 1);
+
+    // 文件被替换后重新打开，旧的传输仍然持有旧 fd
+    writeFile("/a.txt.new", string(500, 'b'));
+    ::rename((g_dir + "/a.txt.new").c_str(), (g_dir + "/a.txt").c_str());
+    HttpResponse replaced = serve(files, makeRequest("GET", "/a.txt"));
+    CHECK(replaced.file() && replaced.file() != first.file());
+    CHECK(replaced.getSendLen() == 500);
+    CHECK(files.fileCache().misses() == 2);
+    char c = 0;
+    CHECK(::pread(first.file()->fd(), &c, 1, 0) == 1 && c == 'a');
+
+    CHECK(serve(files, makeRequest("GET", "/missing")).statusCode() == HttpResponse::k404NotFound);
+}
+
+// 写法不同的同一路径共用一个缓存项，".." 段一律拒绝
+void testPathNormalization()
+{
+    FileServer files(g_dir);
+    files.setSmallFileCache(0, 0);
+    HttpResponse first = serve(files, makeRequest("GET", "/a.txt"));
+    CHECK(first.statusCode() == HttpResponse::k200Ok);
+    const char *aliases[] = {"//a.txt", "/./a.txt", "/.//./a.txt"};
+    for (const char *alias : aliases)
+    {
+        HttpResponse resp = serve(files, makeRequest("GET", alias));
+        CHECK(resp.statusCode() == HttpResponse::k200Ok);
+        CHECK(resp.file() == first.file());
+    }
+    CHECK(files.fileCache().size() == 1);
+    CHECK(files.fileCache().misses() == 1);
+
+    const char *escapes[] = {"/../a.txt", "/x/../a.txt", "/../../../etc/hostname", "/..", "/a.txt/.."};
+    for (const char *escape : escapes)
+    {
+        CHECK(serve(files, makeRequest("GET", escape)).statusCode() == HttpResponse::k403Forbidden);
+    }
+    CHECK(files.fileCache().size() == 1);
+    // 只有完整的 ".." 段才算越界
+    CHECK(serve(files, makeRequest("GET", "/a..txt")).statusCode() == HttpResponse::k404NotFound);
+}
+
+void testSmallFileCache()
+{
+    writeFile("/small.txt", string(100, 's'));
+    writeFile("/large.txt", string(5000, 'l'));
+    FileServer files(g_dir);
+    files.setSmallFileCache(1024, 4096);
+
+    // 第一次从文件读入，之后命中时直接使用编码好的首部
+    HttpResponse first = serve(files, makeRequest("GET", "/small.txt"));
+    CHECK(first.statusCode() == HttpResponse::k200Ok);
+    CHECK(!first.needSendFile() && first.sharedBody() && first.body() == string(100, 's'));
+    HttpResponse hit = serve(files, makeRequest("GET", "/small.txt"));
+    CHECK(files.smallFileCache().hits() == 1);
+    CHECK(hit.sharedBody() == first.sharedBody());
+    CHECK(hit.header(HttpResponse::kETag).empty() && hit.encodedHeaders());
+
+    Buffer expected, actual;
+    first.appendToBuffer(&expected);
+    hit.appendToBuffer(&actual);
+    CHECK(expected.retrieveAllAsString() == actual.retrieveAllAsString());
+
+    // 条件请求和范围请求照常处理
+    HttpRequest req = makeRequest("GET", "/small.txt");
+    addHeader(&req, "If-None-Match", first.header(HttpResponse::kETag));
+    CHECK(serve(files, req).statusCode() == HttpResponse::k304NotModified);
+    req = makeRequest("GET", "/small.txt");
+    addHeader(&req, "Range", "bytes=0-9");
+    CHECK(serve(files, req).statusCode() == HttpResponse::k206Partitial);
+
+    // 超过阈值的文件照常 sendfile
+    HttpResponse large = serve(files, makeRequest("GET", "/large.txt"));
+    CHECK(large.needSendFile() && !large.sharedBody());
+    CHECK(files.smallFileCache().size() == 1);
+
+    // 接受压缩的客户端命中压缩后的表示，与原样的表示分别缓存
+    HttpRequest gzipReq = makeRequest("GET", "/small.txt");
+    addHeader(&gzipReq, "Accept-Encoding", "gzip");
+    writeFile("/page.txt", string(800, 'p'));
+    HttpResponse gzipFirst = serve(files, gzipReq);
+    CHECK(gzipFirst.header(HttpResponse::kContentEncoding).empty());
+    gzipReq = makeRequest("GET", "/page.txt");
+    addHeader(&gzipReq, "Accept-Encoding", "gzip");
+    gzipFirst = serve(files, gzipReq);
+    CHECK(gzipFirst.header(HttpResponse::kContentEncoding) == "gzip" && gzipFirst.sharedBody());
+    int64_t hits = files.smallFileCache().hits();
+    HttpResponse gzipHit = serve(files, gzipReq);
+    CHECK(files.smallFileCache().hits() == hits + 1);
+    CHECK(gzipHit.sharedBody() == gzipFirst.sharedBody() && gzipHit.encodedHeaders());
+    expected.retrieveAll();
+    actual.retrieveAll();
+    gzipFirst.appendToBuffer(&expected);
+    gzipHit.appendToBuffer(&actual);
+    string gzipOutput = actual.retrieveAllAsString();
+    CHECK(expected.retrieveAllAsString() == gzipOutput);
+    CHECK(gzipOutput.find("Content-Encoding: gzip\r\n") != string::npos);
+    CHECK(gzipOutput.find("Vary: Accept-Encoding\r\n") != string::npos);
+    addHeader(&gzipReq, "If-None-Match", gzipFirst.header(HttpResponse::kETag));
+    CHECK(serve(files, gzipReq).statusCode() == HttpResponse::k304NotModified);
+    HttpResponse plain = serve(files, makeRequest("GET", "/page.txt"));
+    CHECK(plain.header(HttpResponse::kContentEncoding).empty() && plain.body() == string(800, 'p'));
+    CHECK(files.smallFileCache().size() == 4);
+
+    // mtime 变化后重新读入
+    files.setFileCacheTtl(0);
+    ::usleep(10 * 1000);
+    writeFile("/small.txt", string(100, 't'));
+    HttpResponse changed = serve(files, makeRequest("GET", "/small.txt"));
+    CHECK(changed.body() == string(100, 't'));
+    CHECK(changed.header(HttpResponse::kETag) != first.header(HttpResponse::kETag));
+
+    ::unlink((g_dir + "/small.txt").c_str());
+    ::unlink((g_dir + "/large.txt").c_str());
+    ::unlink((g_dir + "/page.txt").c_str());
+}
+
+// 超过 1MB 的文件不在 IO 线程中压缩：未命中时先发送原文件，由 pool 在后台压缩，之后命中缓存
+void testBackgroundCompression()
+{
+    writeFile("/big.txt", string(2 * 1024 * 1024, 'z'));
+    HttpRequest req = makeRequest("GET", "/big.txt");
+    addHeader(&req, "Accept-Encoding", "gzip");
+
+    // 没有 pool 时不压缩
+    FileServer plain(g_dir);
+    HttpResponse resp = serve(plain, req);
+    CHECK(resp.statusCode() == HttpResponse::k200Ok);
+    CHECK(resp.header(HttpResponse::kContentEncoding).empty() && resp.needSendFile());
+    CHECK(plain.compressCache().size() == 0);
+
+    ThreadPool pool("Compress");
+    pool.start(1);
+    {
+        FileServer files(g_dir);
+        files.setFileReadPool(&pool);
+        resp = serve(files, req);
+        CHECK(resp.header(HttpResponse::kContentEncoding).empty() && resp.needSendFile());
+        // 压缩完成之前的请求同样发送原文件，不重复提交
+        CHECK(serve(files, req).header(HttpResponse::kContentEncoding).empty());
+        for (int i = 0; i < 200 && files.compressCache().size() == 0; ++i)
+            ::usleep(10 * 1000);
+        CHECK(files.compressCache().size() == 1);
+        resp = serve(files, req);
+        CHECK(resp.header(HttpResponse::kContentEncoding) == "gzip");
+        CHECK(!resp.needSendFile() && resp.body().size() < 64 * 1024);
+        CHECK(files.compressCache().misses() == 2 && files.compressCache().hits() == 1);
+
+        // FileServer 析构时后台任务可以仍在进行
+        writeFile("/big.txt", string(2 * 1024 * 1024 + 1, 'y'));
+        files.setFileCacheTtl(0);
+        serve(files, req);
+    }
+    pool.stop();
+    ::unlink((g_dir + "/big.txt").c_str());
+}
+
+void testDirectoryListing()
+{
+    // 超过 100 字节的路径
+    string deep = "/" + string(120, 'd');
+    CHECK(::mkdir((g_dir + deep).c_str(), 0755) == 0);
+    CHECK(::mkdir((g_dir + deep + "/sub").c_str(), 0755) == 0);
+    writeFile(deep + "/a<b>.txt", "x");
+    writeFile(deep + "/c.txt", "x");
+
+    FileServer files(g_dir);
+    HttpResponse resp = serve(files, makeRequest("GET", deep));
+    CHECK(resp.statusCode() == HttpResponse::k200Ok);
+    CHECK(resp.body().find("<li><a href=\"a%3Cb%3E.txt\">a&lt;b&gt;.txt</a></li>") != string::npos);
+    CHECK(resp.body().find("<li><a href=\"sub/\">sub/</a></li>") != string::npos);
+    CHECK(resp.body().find("Page 1") == string::npos);
+    serve(files, makeRequest("GET", deep));
+    CHECK(files.dirCache().misses() == 1 && files.dirCache().hits() == 1);
+
+    // 目录内容变化后由 inotify 失效
+    writeFile(deep + "/e.txt", "x");
+    resp = serve(files, makeRequest("GET", deep));
+    CHECK(resp.body().find("e.txt") != string::npos);
+    CHECK(files.dirCache().misses() == 2);
+
+    HttpRequest req = makeRequest("GET", deep);
+    req.setQuery("?format=json", "?format=json" + 12);
+    resp = serve(files, req);
+    CHECK(resp.header(HttpResponse::kContentType) == "application/json");
+    CHECK(resp.body() == "{\"path\":\"" + g_dir + deep + "\",\"total\":4,\"page\":0,\"pages\":1,\"entries\":["
+                         "{\"name\":\"a<b>.txt\",\"type\":\"file\"},{\"name\":\"c.txt\",\"type\":\"file\"},"
+                         "{\"name\":\"e.txt\",\"type\":\"file\"},{\"name\":\"sub\",\"type\":\"directory\"}]}");
+
+    // 分页
+    files.setDirListingPageSize(3);
+    req = makeRequest("GET", deep);
+    req.setQuery("?page=1&format=json", "?page=1&format=json" + 19);
+    resp = serve(files, req);
+    CHECK(resp.body().find("\"page\":1,\"pages\":2,\"entries\":[{\"name\":\"sub\"") != string::npos);
+    resp = serve(files, makeRequest("GET", deep));
+    CHECK(resp.body().find("Page 1 of 2 <a href=\"?page=1\">Next</a>") != string::npos);
+    CHECK(resp.body().find("sub/") == string::npos);
+
+    ::unlink((g_dir + deep + "/a<b>.txt").c_str());
+    ::unlink((g_dir + deep + "/c.txt").c_str());
+    ::unlink((g_dir + deep + "/e.txt").c_str());
+    ::rmdir((g_dir + deep + "/sub").c_str());
+    ::rmdir((g_dir + deep).c_str());
+}
+
+// 其他目录上不断发生的事件不影响正在扫描的目录的结果
+void testDirCacheWatches()
+{
+    CHECK(::mkdir((g_dir + "/busy").c_str(), 0755) == 0);
+    CHECK(::mkdir((g_dir + "/quiet").c_str(), 0755) == 0);
+    for (int i = 0; i < 2000; ++i)
+        writeFile("/quiet/" + std::to_string(i), "");
+
+    DirCache cache;
+    std::atomic<bool> stop(false);
+    // 每次事件都使 busy 失效，重新缓存后才有下一次事件
+    std::thread writer([&stop, &cache] {
+        while (!stop)
+        {
+            cache.get(g_dir + "/busy", "/busy");
+            writeFile("/busy/x", "x");
+            ::unlink((g_dir + "/busy/x").c_str());
+        }
+    });
+    for (int i = 0; i < 20; ++i)
+    {
+        int64_t hits = cache.hits();
+        CHECK(cache.get(g_dir + "/quiet", "/quiet")->entries.size() == 2000);
+        CHECK(cache.get(g_dir + "/quiet", "/quiet") && cache.hits() == hits + 1);
+        cache.invalidate(g_dir + "/quiet");
+    }
+    stop = true;
+    writer.join();
+
+    for (int i = 0; i < 2000; ++i)
+        ::unlink((g_dir + "/quiet/" + std::to_string(i)).c_str());
+    ::unlink((g_dir + "/busy/x").c_str());
+    ::rmdir((g_dir + "/busy").c_str());
+    ::rmdir((g_dir + "/quiet").c_str());
+}
+
+int main()
+{
+    Logger::setLogLevel(Logger::WARN);
+    char dir[] = "/tmp/fileserver_unittest_XXXXXX";
+    if (!::mkdtemp(dir))
+    {
+        perror("mkdtemp");
+        return 1;
+    }
+    g_dir = dir;
+    writeFile("/a.txt", string(1000, 'a'));
+    writeFile("/b.png", "png");
+    writeFile("/c.mp3", "mp3");
+
+    FileServer files(g_dir);
+    files.setCacheControl("text/*", "max-age=60");
+    files.setCacheControl("image/png", "max-age=86400");
+    files.setCacheControl("", "no-cache");
+
+    testConditional(files);
+    testIfRange(files);
+    testMultiRange(files);
+    testCacheControl(files);
+    testFileCache();
+    testPathNormalization();
+    testSmallFileCache();
+    testBackgroundCompression();
+    testDirectoryListing();
+    testDirCacheWatches();
+
+    ::unlink((g_dir + "/a.txt").c_str());
+    ::unlink((g_dir + "/b.png").c_str());
+    ::unlink((g_dir + "/c.mp3").c_str());
+    ::rmdir(dir);
+    return testResult();
+}
@@ -0,0 +1,135 @@
+#include "mymuduo/http/FileServer.h"
+#include "mymuduo/net/EventLoop.h"
+#include "mymuduo/base/FileUtil.h"
+#include "mymuduo/base/Logging.h"
+#include "mymuduo/base/tests/TestCheck.h"
+
+#include <arpa/inet.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <thread>
+
+using namespace mymuduo;
+using namespace mymuduo::net;
+
+const uint16_t kPort = 18036;
+
+int connectServer()
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memZero(&addr, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(kPort);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof addr) < 0)
+    {
+        perror("connect");
+        ++g_failures;
+    }
+    return fd;
+}
+
+bool writeAll(int fd, const string &data)
+{
+    return ::write(fd, data.data(), data.size()) == static_cast<ssize_t>(data.size());
+}
+
+// 请求都带 Connection: close，读到 EOF 即为完整的响应，返回状态码
+int readStatus(int fd)
+{
+    string data;
+    char buf[4096];
+    ssize_t n;
+    while ((n = ::read(fd, buf, sizeof buf)) > 0)
+    {
+        data.append(buf, static_cast<size_t>(n));
+    }
+    ::close(fd);
+    return data.size() > 12 ? atoi(data.c_str() + 9) : 0;
+}
+
+string putHeaders(const string &path, size_t length)
+{
+    return "PUT " + path + " HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\nContent-Length: " +
+           std::to_string(length) + "\r\n\r\n";
+}
+
+string readFile(const string &path)
+{
+    string content;
+    FileUtil::readFile(path, 1024 * 1024, &content);
+    return content;
+}
+
+int countEntries(const string &dir)
+{
+    int n = 0;
+    DIR *d = ::opendir(dir.c_str());
+    while (struct dirent *entry = ::readdir(d))
+    {
+        if (entry->d_name[0] != '.')
+            ++n;
+    }
+    ::closedir(d);
+    return n;
+}
+
+// 两个上传交错写同一个目标：各自的临时文件互不干扰，都成功，最后完成的内容生效
+void testConcurrentUploads(const string &dir)
+{
+    const string first(256 * 1024, 'A');
+    const string second(128 * 1024, 'B');
+    int a = connectServer();
+    CHECK(writeAll(a, putHeaders("/target.txt", first.size()) + first.substr(0, first.size() / 2)));
+    ::usleep(50 * 1000);
+    int b = connectServer();
+    CHECK(writeAll(b, putHeaders("/target.txt", second.size()) + second));
+    CHECK(readStatus(b) == 201);
+    CHECK(readFile(dir + "/target.txt") == second);
+    CHECK(writeAll(a, first.substr(first.size() / 2)));
+    int status = readStatus(a);
+    CHECK(status == 201 || status == 204);
+    CHECK(readFile(dir + "/target.txt") == first);
+    // 没有遗留的临时文件
+    CHECK(countEntries(dir) == 1);
+}
+
+// 空实体同样是一次上传，创建空文件
+void testEmptyUpload(const string &dir)
+{
+    int fd = connectServer();
+    CHECK(writeAll(fd, putHeaders("/empty.txt", 0)));
+    CHECK(readStatus(fd) == 201);
+    CHECK(::access((dir + "/empty.txt").c_str(), F_OK) == 0);
+    CHECK(readFile(dir + "/empty.txt").empty());
+}
+
+int main()
+{
+    Logger::setLogLevel(Logger::ERROR);
+    char dir[] = "/tmp/fileupload_testXXXXXX";
+    CHECK(::mkdtemp(dir) != NULL);
+
+    EventLoop loop;
+    FileServer files(dir, &loop, InetAddress(kPort, true), "UploadTest");
+    files.setUploadEnabled(true);
+    files.start();
+
+    std::thread client([&loop, &dir] {
+        ::usleep(100 * 1000);
+        testConcurrentUploads(dir);
+        testEmptyUpload(dir);
+        loop.queueInLoop([&loop] { loop.quit(); });
+    });
+    loop.loop();
+    client.join();
+
+    ::unlink((string(dir) + "/target.txt").c_str());
+    ::unlink((string(dir) + "/empty.txt").c_str());
+    ::rmdir(dir);
+    return testResult();
+}
@@ -0,0 +1,337 @@
+#include "mymuduo/http/Hpack.h"
+#include "mymuduo/http/Http2Connection.h"
+#include "mymuduo/http/HttpServer.h"
+#include "mymuduo/http/HttpRequest.h"
+#include "mymuduo/http/HttpResponse.h"
+#include "mymuduo/net/Buffer.h"
+#include "mymuduo/net/EventLoop.h"
+#include "mymuduo/base/Logging.h"
+#include "mymuduo/base/Thread.h"
+#include "mymuduo/base/ThreadPool.h"
+#include "mymuduo/base/tests/TestCheck.h"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <map>
+
+using namespace mymuduo;
+using namespace mymuduo::net;
+
+const uint16_t kPort = 18031;
+const size_t kBigSize = 200 * 1000;
+const size_t kUploadSize = 60 * 1000;
+const size_t kFileSize = 300 * 1000;
+
+string g_fileContent;
+FileHandlePtr g_file;
+
+string fromHex(const char *hex)
+{
+    string out;
+    for (const char *p = hex; p[0] && p[1]; p += 2)
+    {
+        out.push_back(static_cast<char>(std::stoi(string(p, 2), NULL, 16)));
+    }
+    return out;
+}
+
+// RFC 7541 附录 C.4：带 Huffman 编码的三个连续请求，共用一个动态表
+void testHpackDecoder()
+{
+    string encoded;
+    hpack::huffmanEncode("www.example.com", &encoded);
+    CHECK(encoded == fromHex("f1e3c2e5f23a6ba0ab90f4ff"));
+    string decoded;
+    CHECK(hpack::huffmanDecode(encoded.data(), encoded.size(), &decoded));
+    CHECK(decoded == "www.example.com");
+
+    HpackDecoder decoder;
+    hpack::HeaderList headers;
+    string block = fromHex("828684418cf1e3c2e5f23a6ba0ab90f4ff");
+    CHECK(decoder.decode(block.data(), block.size(), &headers));
+    CHECK(headers.size() == 4);
+    CHECK(headers.size() == 4 && headers[3] == hpack::Header(":authority", "www.example.com"));
+
+    headers.clear();
+    block = fromHex("828684be5886a8eb10649cbf");
+    CHECK(decoder.decode(block.data(), block.size(), &headers));
+    CHECK(headers.size() == 5);
+    CHECK(headers.size() == 5 && headers[3].second == "www.example.com");
+    CHECK(headers.size() == 5 && headers[4] == hpack::Header("cache-control", "no-cache"));
+
+    headers.clear();
+    block = fromHex("828785bf408825a849e95ba97d7f8925a849e95bb8e8b4bf");
+    CHECK(decoder.decode(block.data(), block.size(), &headers));
+    CHECK(headers.size() == 5);
+    CHECK(headers.size() == 5 && headers[2] == hpack::Header(":path", "/index.html"));
+    CHECK(headers.size() == 5 && headers[4] == hpack::Header("custom-key", "custom-value"));
+
+    // 截断的首部块
+    headers.clear();
+    CHECK(!decoder.decode(block.data(), block.size() - 3, &headers));
+}
+
+// 编码后再解码，动态表在多个首部块之间保持同步
+void testHpackRoundTrip()
+{
+    HpackEncoder encoder;
+    HpackDecoder decoder;
+    for (int round = 0; round < 3; ++round)
+    {
+        if (round == 2)
+        {
+            encoder.setMaxTableSize(64);
+        }
+        hpack::HeaderList expected;
+        expected.push_back(hpack::Header(":status", "200"));
+        expected.push_back(hpack::Header("content-type", "text/html;charset=utf-8"));
+        expected.push_back(hpack::Header("content-length", std::to_string(1000 + round)));
+        expected.push_back(hpack::Header("x-round", "value-" + std::to_string(round % 2)));
+        string block;
+        for (size_t i = 0; i < expected.size(); ++i)
+        {
+            encoder.encode(expected[i].first, expected[i].second, &block, expected[i].first != "content-length");
+        }
+        hpack::HeaderList headers;
+        CHECK(decoder.decode(block.data(), block.size(), &headers));
+        CHECK(headers == expected);
+    }
+}
+
+void onRequest(const HttpRequest &req, HttpResponse *resp)
+{
+    resp->setStatusCode(HttpResponse::k200Ok);
+    resp->setContentType("text/plain");
+    if (req.path() == "/big")
+    {
+        resp->setBody(string(kBigSize, 'b'));
+    }
+    else if (req.path() == "/file")
+    {
+        resp->setFile(g_file, 0);
+        resp->setSendLen(static_cast<off64_t>(kFileSize));
+    }
+    else if (req.path() == "/echo")
+    {
+        resp->setBody(req.getHeader("Cookie") + "|" + req.query() + "|" + req.getBody());
+    }
+    else
+    {
+        resp->setStatusCode(HttpResponse::k404NotFound);
+        resp->setBody("not found");
+    }
+}
+
+struct StreamResult
+{
+    StreamResult() : status(0), ended(false) {}
+    int status;
+    string body;
+    bool ended;
+};
+
+void appendRequest(HpackEncoder *encoder, Buffer *out, uint32_t streamId,
+                   const char *method, const char *path, const string &body)
+{
+    string block;
+    encoder->encode(":method", method, &block);
+    encoder->encode(":scheme", "http", &block);
+    encoder->encode(":path", path, &block);
+    encoder->encode(":authority", "localhost", &block);
+    encoder->encode("cookie", "a=1", &block);
+    encoder->encode("cookie", "b=2", &block);
+    http2::appendFrameHeader(out, block.size(), http2::kHeaders,
+                             static_cast<uint8_t>(http2::kFlagEndHeaders | (body.empty() ? http2::kFlagEndStream : 0)),
+                             streamId);
+    out->append(block);
+    // 实体按默认的最大帧长度拆成多个 DATA 帧
+    for (size_t offset = 0; offset < body.size(); offset += http2::kDefaultMaxFrameSize)
+    {
+        size_t n = std::min(body.size() - offset, http2::kDefaultMaxFrameSize);
+        bool last = offset + n == body.size();
+        http2::appendFrameHeader(out, n, http2::kData, last ? http2::kFlagEndStream : 0, streamId);
+        out->append(body.data() + offset, n);
+    }
+}
+
+void appendWindowUpdate(Buffer *out, uint32_t streamId, size_t increment)
+{
+    http2::appendFrameHeader(out, 4, http2::kWindowUpdate, 0, streamId);
+    out->appendInt32(static_cast<int32_t>(increment));
+}
+
+// prior knowledge 方式连接，同时发出五个请求，边收边归还流量控制窗口。
+// 请求实体在默认的流级窗口之内，服务端攒够半个窗口才归还，不会每个 DATA 帧都回 WINDOW_UPDATE
+void client(EventLoop *loop)
+{
+    ::usleep(200 * 1000);
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memZero(&addr, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(kPort);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof addr) < 0)
+    {
+        perror("connect");
+        ++g_failures;
+        loop->quit();
+        return;
+    }
+
+    HpackEncoder encoder;
+    HpackDecoder decoder;
+    Buffer out;
+    out.append(http2::kClientPreface, http2::kClientPrefaceLength);
+    http2::appendFrameHeader(&out, 0, http2::kSettings, 0, 0);
+    appendRequest(&encoder, &out, 1, "GET", "/big", "");
+    appendRequest(&encoder, &out, 3, "POST", "/echo?x=1", "hello");
+    appendRequest(&encoder, &out, 5, "GET", "/missing", "");
+    const string upload(kUploadSize, 'u');
+    appendRequest(&encoder, &out, 7, "POST", "/echo", upload);
+    appendRequest(&encoder, &out, 9, "GET", "/file", "");
+    ssize_t n = ::write(fd, out.peek(), out.readableBytes());
+    (void)n;
+
+    std::map<uint32_t, StreamResult> results;
+    std::vector<uint32_t> endOrder;
+    bool settingsAcked = false;
+    int connWindowUpdates = 0;
+    int uploadWindowUpdates = 0;
+    Buffer in;
+    while (endOrder.size() < 5)
+    {
+        char buf[16384];
+        ssize_t nr = ::read(fd, buf, sizeof buf);
+        if (nr <= 0)
+            break;
+        in.append(buf, static_cast<size_t>(nr));
+        Buffer reply;
+        while (in.readableBytes() >= http2::kFrameHeaderLength)
+        {
+            const uint8_t *p = reinterpret_cast<const uint8_t *>(in.peek());
+            size_t length = static_cast<size_t>(p[0]) << 16 | static_cast<size_t>(p[1]) << 8 | p[2];
+            if (in.readableBytes() < http2::kFrameHeaderLength + length)
+                break;
+            uint8_t type = p[3];
+            uint8_t flags = p[4];
+            uint32_t streamId = static_cast<uint32_t>(p[5] & 0x7f) << 24 | static_cast<uint32_t>(p[6]) << 16 |
+                                static_cast<uint32_t>(p[7]) << 8 | p[8];
+            const char *payload = in.peek() + http2::kFrameHeaderLength;
+            if (type == http2::kSettings && !(flags & http2::kFlagAck))
+            {
+                http2::appendFrameHeader(&reply, 0, http2::kSettings, http2::kFlagAck, 0);
+            }
+            else if (type == http2::kSettings)
+            {
+                settingsAcked = true;
+            }
+            else if (type == http2::kHeaders)
+            {
+                hpack::HeaderList headers;
+                CHECK(decoder.decode(payload, length, &headers));
+                CHECK(!headers.empty() && headers[0].first == ":status");
+                if (!headers.empty())
+                    results[streamId].status = atoi(headers[0].second.c_str());
+            }
+            else if (type == http2::kData)
+            {
+                results[streamId].body.append(payload, length);
+                if (length > 0)
+                {
+                    appendWindowUpdate(&reply, 0, length);
+                    appendWindowUpdate(&reply, streamId, length);
+                }
+            }
+            else if (type == http2::kWindowUpdate)
+            {
+                if (streamId == 0)
+                    ++connWindowUpdates;
+                else if (streamId == 7)
+                    ++uploadWindowUpdates;
+            }
+            else if (type == http2::kGoAway || type == http2::kRstStream)
+            {
+                printf("unexpected frame type %d on stream %u\n", type, streamId);
+                ++g_failures;
+            }
+            if ((type == http2::kHeaders || type == http2::kData) && (flags & http2::kFlagEndStream))
+            {
+                results[streamId].ended = true;
+                endOrder.push_back(streamId);
+            }
+            in.retrieve(http2::kFrameHeaderLength + length);
+        }
+        if (reply.readableBytes() > 0)
+        {
+            n = ::write(fd, reply.peek(), reply.readableBytes());
+        }
+    }
+    ::close(fd);
+
+    CHECK(settingsAcked);
+    CHECK(results[1].status == 200 && results[1].ended);
+    CHECK(results[1].body.size() == kBigSize);
+    CHECK(results[3].status == 200 && results[3].body == "a=1; b=2|?x=1|hello");
+    CHECK(results[5].status == 404 && results[5].body == "not found");
+    CHECK(results[7].status == 200 && results[7].body == "a=1; b=2||" + upload);
+    CHECK(results[9].status == 200 && results[9].body == g_fileContent);
+    // 小响应不会被前面的大响应阻塞
+    std::vector<uint32_t>::iterator bigEnd = std::find(endOrder.begin(), endOrder.end(), 1u);
+    CHECK(endOrder.size() == 5);
+    CHECK(bigEnd > std::find(endOrder.begin(), endOrder.end(), 3u));
+    CHECK(bigEnd > std::find(endOrder.begin(), endOrder.end(), 5u));
+    // 连接级窗口只在开始时扩大一次，60KB 的实体只归还一次流级窗口
+    CHECK(connWindowUpdates == 1);
+    CHECK(uploadWindowUpdates == 1);
+    loop->quit();
+}
+
+// 文件响应不在页缓存中时先由线程池预读，DATA 帧的 pread 不会阻塞 IO 线程
+void testServer()
+{
+    char path[] = "/tmp/http2_testXXXXXX";
+    int fd = ::mkstemp(path);
+    ::unlink(path);
+    g_fileContent.resize(kFileSize);
+    for (size_t i = 0; i < kFileSize; ++i)
+    {
+        g_fileContent[i] = static_cast<char>('a' + i % 26);
+    }
+    CHECK(::write(fd, g_fileContent.data(), kFileSize) == static_cast<ssize_t>(kFileSize));
+    ::fdatasync(fd);
+    ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    g_file = std::make_shared<FileHandle>(fd);
+    ThreadPool readPool("FileRead");
+    readPool.start(1);
+
+    EventLoop loop;
+    HttpServer server(&loop, InetAddress(kPort, true), "Http2Server");
+    server.setHttpCallback(onRequest);
+    server.setFileReadPool(&readPool);
+    server.start();
+
+    Thread thread(std::bind(client, &loop), "client");
+    thread.start();
+    loop.loop();
+    thread.join();
+    // tmpfs 上的文件不会被清出页缓存，此时没有预读
+    printf("cold file reads: %" PRId64 "\n", loop.coldFileReads());
+    readPool.stop();
+    g_file.reset();
+}
+
+int main()
+{
+    Logger::setLogLevel(Logger::WARN);
+    testHpackDecoder();
+    testHpackRoundTrip();
+    testServer();
+    return testResult();
+}
@@ -0,0 +1,110 @@
+#include "mymuduo/http/HttpServer.h"
+#include "mymuduo/http/HttpRequest.h"
+#include "mymuduo/http/HttpResponse.h"
+#include "mymuduo/http/HttpRouter.h"
+#include "mymuduo/net/EventLoop.h"
+#include "mymuduo/base/Logging.h"
+#include "mymuduo/base/Thread.h"
+#include "mymuduo/base/ThreadPool.h"
+
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace mymuduo;
+using namespace mymuduo::net;
+
+// 流水线发送多个请求，越早到达的请求处理越慢，检查响应仍然按请求顺序返回
+const int kRequests = 8;
+const uint16_t kPort = 18028;
+bool g_ok = false;
+
+void onSleep(const HttpRequest &req, const HttpRouter::Params &params, HttpResponse *resp)
+{
+    int ms = atoi(params.get("ms").as_string().c_str());
+    ::usleep(ms * 1000);
+    resp->setStatusCode(HttpResponse::k200Ok);
+    resp->setStatusMessage("OK");
+    resp->setContentType("text/plain");
+    resp->setBody(req.path());
+}
+
+void client(EventLoop *loop)
+{
+    ::usleep(200 * 1000);
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memZero(&addr, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(kPort);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof addr) < 0)
+    {
+        perror("connect");
+        loop->quit();
+        return;
+    }
+
+    string requests, expected;
+    for (int i = 0; i < kRequests; ++i)
+    {
+        string path = "/sleep/" + std::to_string((kRequests - i) * 20);
+        requests += "GET " + path + " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+        expected += path;
+    }
+    ssize_t n = ::write(fd, requests.data(), requests.size());
+    (void)n;
+
+    // 只取出每个响应的实体
+    string received, bodies;
+    char buf[4096];
+    while (bodies.size() < expected.size())
+    {
+        ssize_t nr = ::read(fd, buf, sizeof buf);
+        if (nr <= 0)
+            break;
+        received.append(buf, nr);
+        size_t pos;
+        while ((pos = received.find("\r\n\r\n")) != string::npos)
+        {
+            size_t lenPos = received.find("Content-Length: ");
+            size_t len = static_cast<size_t>(atoi(received.c_str() + lenPos + 16));
+            if (received.size() < pos + 4 + len)
+                break;
+            bodies += received.substr(pos + 4, len);
+            received.erase(0, pos + 4 + len);
+        }
+    }
+    ::close(fd);
+
+    g_ok = bodies == expected;
+    printf("expected: %s\nreceived: %s\n", expected.c_str(), bodies.c_str());
+    loop->quit();
+}
+
+int main()
+{
+    Logger::setLogLevel(Logger::WARN);
+    ThreadPool pool("HttpWorker");
+    pool.start(4);
+
+    HttpRouter router;
+    router.get("/sleep/:ms", onSleep);
+
+    EventLoop loop;
+    HttpServer server(&loop, InetAddress(kPort, true), "AsyncServer");
+    server.setHttpCallback(std::bind(&HttpRouter::dispatch, &router, _1, _2), &pool);
+    server.setMaxPipelineDepth(3); // 让流水线暂停/恢复读取的路径也被覆盖
+    server.start();
+
+    Thread thread(std::bind(client, &loop), "client");
+    thread.start();
+    loop.loop();
+    thread.join();
+    pool.stop();
+
+    printf("%s\n", g_ok ? "PASS" : "FAIL");
+    return g_ok ? 0 : 1;
+}
@@ -0,0 +1,178 @@
+#include "mymuduo/http/HttpClient.h"
+#include "mymuduo/http/HttpServer.h"
+#include "mymuduo/net/EventLoop.h"
+#include "mymuduo/net/EventLoopThread.h"
+#include "mymuduo/base/CountDownLatch.h"
+#include "mymuduo/base/Logging.h"
+#include "mymuduo/base/Thread.h"
+#include "mymuduo/base/tests/TestCheck.h"
+
+#include <stdio.h>
+#include <unistd.h>
+
+using namespace mymuduo;
+using namespace mymuduo::net;
+
+// 本地 HttpServer 作为服务端，客户端运行在另一个 IO 线程上
+const uint16_t kServerPort = 18050;
+const uint16_t kDeadPort = 18051;
+const int kRequests = 20;
+// /echo 返回查询串和请求实体，/slow 0.3 秒后响应，/stream 分块发送，/close 响应后关闭连接
+void onRequest(const HttpAsyncResponsePtr &resp)
+{
+    const HttpRequest &req = resp->request();
+    HttpResponse *response = resp->response();
+    response->setStatusCode(HttpResponse::k200Ok);
+    response->setContentType("text/plain");
+    if (req.path() == "/echo")
+    {
+        response->setBody(req.query() + req.getBody());
+        resp->done();
+    }
+    else if (req.path() == "/slow")
+    {
+        response->setBody("slow");
+        resp->getLoop()->runAfter(0.3, [resp]() { resp->done(); });
+    }
+    else if (req.path() == "/stream")
+    {
+        resp->startStream();
+        resp->write("part1-", 6);
+        resp->getLoop()->runAfter(0.02, [resp]() {
+            resp->write("part2", 5);
+            resp->endStream();
+        });
+    }
+    else if (req.path() == "/close")
+    {
+        response->setCloseConnection(true);
+        response->setBody("bye");
+        resp->done();
+    }
+    else
+    {
+        response->setStatusCode(HttpResponse::k404NotFound);
+        resp->done();
+    }
+}
+
+struct Reply
+{
+    Reply() : result(HttpClient::kOk), status(0), chunked(false), inLoop(false) {}
+
+    HttpClient::Result result;
+    int status;
+    string body;
+    bool chunked;
+    bool inLoop;
+};
+
+// 发出一个请求并等待回调
+Reply fetch(HttpClient *client, EventLoop *loop, uint16_t port, const HttpClient::Request &req)
+{
+    Reply reply;
+    CountDownLatch latch(1);
+    client->request(loop, InetAddress(port, true), req,
+                    [&reply, &latch, loop](HttpClient::Result result, const HttpResponseParser &response) {
+                        reply.result = result;
+                        reply.status = response.statusCode();
+                        reply.body = response.body();
+                        reply.chunked = response.chunked();
+                        reply.inLoop = loop->isInLoopThread();
+                        latch.countDown();
+                    });
+    latch.wait();
+    return reply;
+}
+
+void testClient(EventLoop *serverLoop)
+{
+    ::usleep(100 * 1000);
+    EventLoopThread ioThread(EventLoopThread::ThreadInitCallback(), "client-io");
+    EventLoop *loop = ioThread.startLoop();
+    {
+        HttpClient client("client");
+        client.setMaxConnectionsPerHost(2);
+        client.setPipelineDepth(4);
+
+        // 同时发出的请求最多使用两条连接，每个请求得到自己的响应
+        {
+            std::vector<Reply> replies(kRequests);
+            CountDownLatch latch(kRequests);
+            for (int i = 0; i < kRequests; ++i)
+            {
+                HttpClient::Request req(HttpRequest::kGet, "/echo?i=" + std::to_string(i));
+                Reply *reply = &replies[static_cast<size_t>(i)];
+                client.request(loop, InetAddress(kServerPort, true), req,
+                               [reply, &latch, &client, loop](HttpClient::Result result, const HttpResponseParser &response) {
+                                   reply->result = result;
+                                   reply->body = response.body();
+                                   reply->inLoop = loop->isInLoopThread() && client.connectionCount() <= 2;
+                                   latch.countDown();
+                               });
+            }
+            latch.wait();
+            for (int i = 0; i < kRequests; ++i)
+            {
+                const Reply &reply = replies[static_cast<size_t>(i)];
+                CHECK(reply.result == HttpClient::kOk);
+                CHECK(reply.body == "?i=" + std::to_string(i));
+                CHECK(reply.inLoop);
+            }
+            CHECK(client.connectionCount() == 2);
+        }
+
+        HttpClient::Request post(HttpRequest::kPost, "/echo");
+        post.body = "hello";
+        Reply reply = fetch(&client, loop, kServerPort, post);
+        CHECK(reply.result == HttpClient::kOk && reply.body == "hello");
+
+        HttpClient::Request head(HttpRequest::kHead, "/echo?head");
+        reply = fetch(&client, loop, kServerPort, head);
+        CHECK(reply.result == HttpClient::kOk && reply.status == 200 && reply.body.empty());
+
+        reply = fetch(&client, loop, kServerPort, HttpClient::Request(HttpRequest::kGet, "/stream"));
+        CHECK(reply.result == HttpClient::kOk && reply.chunked && reply.body == "part1-part2");
+
+        reply = fetch(&client, loop, kServerPort, HttpClient::Request(HttpRequest::kGet, "/missing"));
+        CHECK(reply.result == HttpClient::kOk && reply.status == 404);
+
+        // 超时的请求关闭它的连接，之后的请求不受影响
+        HttpClient::Request slow(HttpRequest::kGet, "/slow");
+        slow.timeout = 0.1;
+        reply = fetch(&client, loop, kServerPort, slow);
+        CHECK(reply.result == HttpClient::kTimeout);
+        slow.timeout = 0;
+        reply = fetch(&client, loop, kServerPort, slow);
+        CHECK(reply.result == HttpClient::kOk && reply.body == "slow");
+
+        // 服务端关闭连接后连接从池中移除
+        int before = client.connectionCount();
+        reply = fetch(&client, loop, kServerPort, HttpClient::Request(HttpRequest::kGet, "/close"));
+        CHECK(reply.result == HttpClient::kOk && reply.body == "bye");
+        CHECK(client.connectionCount() == before - 1);
+        reply = fetch(&client, loop, kServerPort, HttpClient::Request(HttpRequest::kGet, "/echo?again"));
+        CHECK(reply.result == HttpClient::kOk && reply.body == "?again");
+
+        reply = fetch(&client, loop, kDeadPort, HttpClient::Request(HttpRequest::kGet, "/"));
+        CHECK(reply.result == HttpClient::kConnectFailed);
+        CHECK(reply.inLoop);
+    }
+    serverLoop->quit();
+}
+
+int main()
+{
+    Logger::setLogLevel(Logger::ERROR);
+    EventLoop loop;
+    HttpServer server(&loop, InetAddress(kServerPort, true), "HttpClientTest");
+    server.setHttpAsyncCallback(onRequest);
+    server.start();
+
+    Thread thread(std::bind(testClient, &loop), "test");
+    thread.start();
+    loop.loop();
+    thread.join();
+
+    return testResult();
+}
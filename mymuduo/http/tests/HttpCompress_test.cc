@@ -0,0 +1,113 @@
+#include "mymuduo/http/HttpCompress.h"
+#include "mymuduo/http/HttpRequest.h"
+#include "mymuduo/http/HttpResponse.h"
+#include "mymuduo/base/tests/TestCheck.h"
+
+#include <stdio.h>
+#include <zlib.h>
+
+using namespace mymuduo;
+using namespace mymuduo::net;
+
+// 用 zlib 解压，windowBits 取 15 + 32 自动识别 gzip 和 zlib 格式
+string inflateAll(const string &data)
+{
+    z_stream zs;
+    memZero(&zs, sizeof zs);
+    inflateInit2(&zs, 15 + 32);
+    string out;
+    char buf[4096];
+    zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.data()));
+    zs.avail_in = static_cast<uInt>(data.size());
+    int ret;
+    do
+    {
+        zs.next_out = reinterpret_cast<Bytef *>(buf);
+        zs.avail_out = sizeof buf;
+        ret = inflate(&zs, Z_NO_FLUSH);
+        out.append(buf, sizeof buf - zs.avail_out);
+    } while (ret == Z_OK);
+    inflateEnd(&zs);
+    return ret == Z_STREAM_END ? out : string();
+}
+
+void testNegotiate()
+{
+    CHECK(compress::negotiate("") == compress::kIdentity);
+    CHECK(compress::negotiate("gzip, deflate, br") == compress::kGzip);
+    CHECK(compress::negotiate("deflate") == compress::kDeflate);
+    CHECK(compress::negotiate("gzip;q=0.5, deflate") == compress::kDeflate);
+    CHECK(compress::negotiate("gzip;q=0, deflate;q=0") == compress::kIdentity);
+    CHECK(compress::negotiate("*") == compress::kGzip);
+    CHECK(compress::negotiate("*;q=0.1, gzip;q=0") == compress::kDeflate);
+    CHECK(compress::negotiate(" GZIP ; q=1.0") == compress::kGzip);
+    CHECK(compress::negotiate("br") == compress::kIdentity);
+}
+
+void testCompress()
+{
+    string text;
+    for (int i = 0; i < 1000; ++i)
+    {
+        text += "the quick brown fox jumps over the lazy dog\n";
+    }
+    string gz, zlib;
+    CHECK(compress::compress(compress::kGzip, text.data(), text.size(), &gz));
+    CHECK(compress::compress(compress::kDeflate, text.data(), text.size(), &zlib));
+    CHECK(gz.size() > 2 && static_cast<unsigned char>(gz[0]) == 0x1f && static_cast<unsigned char>(gz[1]) == 0x8b);
+    CHECK(gz.size() < text.size() / 5);
+    CHECK(inflateAll(gz) == text);
+    CHECK(inflateAll(zlib) == text);
+
+    CHECK(compress::isCompressibleType("text/plain;charset=utf-8"));
+    CHECK(compress::isCompressibleType("application/json"));
+    CHECK(!compress::isCompressibleType("image/png"));
+
+    HttpRequest req;
+    const char header[] = "Accept-Encoding: gzip";
+    req.addHeader(header, header + 15, header + sizeof header - 1);
+
+    HttpResponse resp(false);
+    resp.setBody(text);
+    CHECK(!compress::compressResponse(req, &resp)); // 没有 setCompress
+    resp.setCompress(true);
+    CHECK(compress::compressResponse(req, &resp));
+    CHECK(resp.header(HttpResponse::kContentEncoding) == "gzip");
+    CHECK(resp.header(HttpResponse::kVary) == "Accept-Encoding");
+    CHECK(inflateAll(resp.body()) == text);
+
+    HttpResponse small(false);
+    small.setCompress(true);
+    small.setBody("hello");
+    CHECK(!compress::compressResponse(req, &small));
+    CHECK(small.body() == "hello");
+}
+
+void testCache()
+{
+    CompressCache cache(250);
+    CompressCache::DataPtr data(new string(100, 'x'));
+    CHECK(!cache.get("/a", compress::kGzip, 1, 1000));
+    cache.put("/a", compress::kGzip, 1, 1000, data);
+    cache.put("/b", compress::kGzip, 1, 1000, data);
+    CHECK(cache.get("/a", compress::kGzip, 1, 1000) == data);
+    CHECK(!cache.get("/a", compress::kDeflate, 1, 1000));
+    // 超过 250 字节，淘汰最久未使用的 /b
+    cache.put("/c", compress::kGzip, 1, 1000, data);
+    CHECK(cache.size() == 2 && cache.bytes() == 200);
+    CHECK(!cache.get("/b", compress::kGzip, 1, 1000));
+    CHECK(cache.get("/c", compress::kGzip, 1, 1000) == data);
+    // mtime 变化后失效
+    CHECK(!cache.get("/a", compress::kGzip, 2, 1000));
+    CHECK(cache.size() == 1);
+    CHECK(cache.hits() == 2);
+    CHECK(cache.misses() == 4);
+}
+
+int main()
+{
+    testNegotiate();
+    testCompress();
+    testCache();
+    return testResult();
+}
@@ -0,0 +1,141 @@
+#include "mymuduo/http/HttpServer.h"
+#include "mymuduo/http/HttpRequest.h"
+#include "mymuduo/http/HttpResponse.h"
+#include "mymuduo/http/HttpRouter.h"
+#include "mymuduo/net/EventLoop.h"
+#include "mymuduo/base/Logging.h"
+#include "mymuduo/base/tests/TestCheck.h"
+
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <thread>
+
+using namespace mymuduo;
+using namespace mymuduo::net;
+
+// 同一个长连接上先 HEAD 后 GET，HEAD 的响应不能带实体，否则后面的响应就错位了
+const uint16_t kPort = 18035;
+const size_t kFileSize = 256 * 1024;
+
+string g_large;
+FileHandlePtr g_file;
+
+void onSmall(const HttpRequest &, const HttpRouter::Params &, HttpResponse *resp)
+{
+    resp->setStatusCode(HttpResponse::k200Ok);
+    resp->setBody("hello");
+}
+
+// 不小于 kGatherBodySize 的实体与首部分段发送
+void onLarge(const HttpRequest &, const HttpRouter::Params &, HttpResponse *resp)
+{
+    resp->setStatusCode(HttpResponse::k200Ok);
+    resp->setBody(g_large);
+}
+
+void onFile(const HttpRequest &, const HttpRouter::Params &, HttpResponse *resp)
+{
+    resp->setStatusCode(HttpResponse::k200Ok);
+    resp->setFile(g_file, 0);
+    resp->setSendLen(static_cast<off64_t>(kFileSize));
+}
+
+// 读出一个响应，返回实体；HEAD 的响应按 Content-Length 之外没有实体处理
+string readResponse(int fd, string *pending, bool head, size_t *contentLength)
+{
+    char buf[65536];
+    size_t end;
+    while ((end = pending->find("\r\n\r\n")) == string::npos)
+    {
+        ssize_t n = ::read(fd, buf, sizeof buf);
+        if (n <= 0)
+            return string();
+        pending->append(buf, static_cast<size_t>(n));
+    }
+    CHECK(pending->compare(0, 12, "HTTP/1.1 200") == 0);
+    size_t lenPos = pending->find("Content-Length: ");
+    CHECK(lenPos != string::npos && lenPos < end);
+    *contentLength = static_cast<size_t>(atol(pending->c_str() + lenPos + 16));
+    pending->erase(0, end + 4);
+    size_t bodyLength = head ? 0 : *contentLength;
+    while (pending->size() < bodyLength)
+    {
+        ssize_t n = ::read(fd, buf, sizeof buf);
+        if (n <= 0)
+            break;
+        pending->append(buf, static_cast<size_t>(n));
+    }
+    string body = pending->substr(0, bodyLength);
+    pending->erase(0, body.size());
+    return body;
+}
+
+void client()
+{
+    ::usleep(100 * 1000);
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memZero(&addr, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(kPort);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof addr) < 0)
+    {
+        perror("connect");
+        ++g_failures;
+        return;
+    }
+
+    const char *paths[] = {"/small", "/large", "/file"};
+    const size_t sizes[] = {5, g_large.size(), kFileSize};
+    string pending;
+    for (int i = 0; i < 3; ++i)
+    {
+        string path(paths[i]);
+        string requests = "HEAD " + path + " HTTP/1.1\r\nHost: localhost\r\n\r\n" +
+                          "GET " + path + " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+        CHECK(::write(fd, requests.data(), requests.size()) == static_cast<ssize_t>(requests.size()));
+        size_t headLength = 0, getLength = 0;
+        readResponse(fd, &pending, true, &headLength);
+        string body = readResponse(fd, &pending, false, &getLength);
+        CHECK(headLength == sizes[i]);
+        CHECK(getLength == sizes[i]);
+        CHECK(body.size() == sizes[i]);
+    }
+    CHECK(pending.empty());
+    ::close(fd);
+}
+
+int main()
+{
+    Logger::setLogLevel(Logger::WARN);
+    g_large.assign(64 * 1024, 'L');
+    char path[] = "/tmp/httphead_testXXXXXX";
+    int fd = ::mkstemp(path);
+    ::unlink(path);
+    string content(kFileSize, 'F');
+    CHECK(::write(fd, content.data(), content.size()) == static_cast<ssize_t>(content.size()));
+    g_file = std::make_shared<FileHandle>(fd);
+
+    HttpRouter router;
+    router.get("/small", onSmall);
+    router.get("/large", onLarge);
+    router.get("/file", onFile);
+
+    EventLoop loop;
+    HttpServer server(&loop, InetAddress(kPort, true), "HeadServer");
+    server.setHttpCallback(std::bind(&HttpRouter::dispatch, &router, _1, _2));
+    server.start();
+
+    std::thread thread([&loop] {
+        client();
+        loop.queueInLoop([&loop] { loop.quit(); });
+    });
+    loop.loop();
+    thread.join();
+
+    return testResult();
+}
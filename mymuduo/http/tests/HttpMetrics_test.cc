@@ -0,0 +1,161 @@
+#include "mymuduo/http/FileServer.h"
+#include "mymuduo/http/HttpMetrics.h"
+#include "mymuduo/http/HttpServer.h"
+#include "mymuduo/net/Buffer.h"
+#include "mymuduo/net/EventLoop.h"
+#include "mymuduo/base/AsyncLogging.h"
+#include "mymuduo/base/Logging.h"
+#include "mymuduo/base/tests/TestCheck.h"
+
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <thread>
+
+using namespace mymuduo;
+using namespace mymuduo::net;
+
+const uint16_t kPort = 18033;
+const size_t kFileSize = 1024 * 1024;
+
+// HTTP/1.0 请求，服务器响应后关闭连接，返回完整的响应
+string fetch(const string &path)
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memZero(&addr, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(kPort);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    string data;
+    if (::connect(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof addr) == 0)
+    {
+        string request = "GET " + path + " HTTP/1.0\r\n\r\n";
+        if (::write(fd, request.data(), request.size()) == static_cast<ssize_t>(request.size()))
+        {
+            char buf[65536];
+            ssize_t n;
+            while ((n = ::read(fd, buf, sizeof buf)) > 0)
+            {
+                data.append(buf, static_cast<size_t>(n));
+            }
+        }
+    }
+    ::close(fd);
+    return data;
+}
+
+bool contains(const string &text, const string &line)
+{
+    return text.find(line) != string::npos;
+}
+
+// 所有以 prefix 开头的样本值之和
+double sum(const string &text, const string &prefix, const string &filter)
+{
+    double total = 0;
+    size_t pos = 0;
+    while ((pos = text.find("\n" + prefix, pos)) != string::npos)
+    {
+        size_t eol = text.find('\n', pos + 1);
+        string line = text.substr(pos + 1, eol - pos - 1);
+        if (line.find(filter) != string::npos)
+        {
+            total += atof(line.c_str() + line.rfind(' ') + 1);
+        }
+        pos = eol;
+    }
+    return total;
+}
+
+// 每一行都是注释或者 "名字{标签} 数值"
+bool wellFormed(const string &text)
+{
+    size_t pos = 0;
+    while (pos < text.size())
+    {
+        size_t eol = text.find('\n', pos);
+        if (eol == string::npos)
+            return false;
+        string line = text.substr(pos, eol - pos);
+        pos = eol + 1;
+        if (line.empty() || line[0] == '#')
+            continue;
+        size_t space = line.rfind(' ');
+        if (space == string::npos || space == 0)
+            return false;
+        char *end = NULL;
+        ::strtod(line.c_str() + space + 1, &end);
+        if (*end != '\0' && !(line.compare(space + 1, string::npos, "+Inf") == 0))
+            return false;
+    }
+    return true;
+}
+
+int main()
+{
+    Logger::setLogLevel(Logger::WARN);
+    char dir[] = "/tmp/httpmetrics_testXXXXXX";
+    CHECK(::mkdtemp(dir) != NULL);
+    string file = string(dir) + "/big";
+    FILE *fp = ::fopen(file.c_str(), "w");
+    string content(kFileSize, 'x');
+    CHECK(::fwrite(content.data(), 1, content.size(), fp) == content.size());
+    ::fclose(fp);
+
+    EventLoop loop;
+    FileServer files(dir, &loop, InetAddress(kPort, true), "MetricsTest");
+    files.setThreadNum(1);
+    HttpMetrics metrics;
+    AsyncLogging logging("/tmp/httpmetrics_test", 1024 * 1024);
+    metrics.setAsyncLogging(&logging);
+    files.setMetrics(&metrics);
+    // 没有启动的服务器也可以导出，名字中的引号需要转义
+    HttpServer api(&loop, InetAddress(static_cast<uint16_t>(kPort + 1), true), "Api\"1");
+    metrics.addServer(&api);
+    files.start();
+
+    string page;
+    std::thread client([&page, &loop] {
+        ::usleep(100 * 1000);
+        string big = fetch("/big");
+        CHECK(big.size() > kFileSize);
+        CHECK(contains(fetch("/missing"), "404"));
+        page = fetch("/metrics");
+        loop.queueInLoop([&loop] { loop.quit(); });
+    });
+    loop.loop();
+    client.join();
+
+    size_t bodyPos = page.find("\r\n\r\n");
+    CHECK(contains(page.substr(0, bodyPos), "Content-Type: text/plain; version=0.0.4"));
+    string body = "\n" + page.substr(bodyPos + 4);
+    CHECK(wellFormed(body.substr(1)));
+
+    // 请求 /metrics 本身在渲染之后才计数
+    CHECK(contains(body, "\nmymuduo_http_requests_total{server=\"MetricsTest\",code=\"200\"} 1\n"));
+    CHECK(contains(body, "\nmymuduo_http_requests_total{server=\"MetricsTest\",code=\"404\"} 1\n"));
+    CHECK(contains(body, "\nmymuduo_http_request_duration_seconds_count{server=\"MetricsTest\"} 2\n"));
+    CHECK(contains(body, "\nmymuduo_http_request_duration_seconds_bucket{server=\"MetricsTest\",le=\"+Inf\"} 2\n"));
+    CHECK(contains(body, "\nmymuduo_connections_accepted_total{server=\"MetricsTest\"} 3\n"));
+    CHECK(contains(body, "\nmymuduo_connections_accepted_total{server=\"Api\\\"1\"} 0\n"));
+    CHECK(contains(body, "\nmymuduo_loop_iterations_total{server=\"MetricsTest\",loop=\"1\"} "));
+    // 文件内容经 sendfile 发出，首部和 404 页面经过缓冲区
+    CHECK(sum(body, "mymuduo_loop_sent_bytes_total{server=\"MetricsTest\"", "via=\"sendfile\"") >=
+          static_cast<double>(kFileSize));
+    CHECK(sum(body, "mymuduo_loop_sent_bytes_total{server=\"MetricsTest\"", "via=\"buffer\"") > 0);
+    CHECK(sum(body, "mymuduo_loop_received_bytes_total{server=\"MetricsTest\"", "") > 0);
+    CHECK(contains(body, "\nmymuduo_log_dropped_buffers_total 0\n"));
+    CHECK(sum(body, "process_resident_memory_bytes", "") > 0);
+    CHECK(sum(body, "process_open_fds", "") > 0);
+    CHECK(sum(body, "process_threads", "") >= 2);
+    // 每个指标族只声明一次
+    size_t first = body.find("# TYPE mymuduo_http_requests_total");
+    CHECK(first != string::npos && body.find("# TYPE mymuduo_http_requests_total", first + 1) == string::npos);
+
+    ::unlink(file.c_str());
+    ::rmdir(dir);
+    return testResult();
+}
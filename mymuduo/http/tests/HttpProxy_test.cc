@@ -0,0 +1,203 @@
+#include "mymuduo/http/HttpProxy.h"
+#include "mymuduo/http/HttpResponseParser.h"
+#include "mymuduo/http/HttpServer.h"
+#include "mymuduo/net/EventLoop.h"
+#include "mymuduo/base/Logging.h"
+#include "mymuduo/base/Thread.h"
+#include "mymuduo/base/tests/TestCheck.h"
+
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace mymuduo;
+using namespace mymuduo::net;
+
+// 两个正常的上游和一个没有监听的上游，经过代理发送各种请求
+const uint16_t kProxyPort = 18040;
+const uint16_t kUpstreamPorts[] = {18041, 18042, 18043};
+const size_t kBigSize = 1024 * 1024;
+const size_t kUploadSize = 200 * 1000;
+string bigBody()
+{
+    string body(kBigSize, '\0');
+    for (size_t i = 0; i < body.size(); ++i)
+        body[i] = static_cast<char>('a' + i % 23);
+    return body;
+}
+
+// 上游：/id 返回自己的名字，/big 返回 1MB，/stream 分两次流式发送，/echo 返回实体的长度
+void onUpstreamRequest(const string &name, const HttpAsyncResponsePtr &resp)
+{
+    const HttpRequest &req = resp->request();
+    HttpResponse *response = resp->response();
+    response->setStatusCode(HttpResponse::k200Ok);
+    response->setContentType("text/plain");
+    if (req.path() == "/id")
+    {
+        response->setBody(name);
+        resp->done();
+    }
+    else if (req.path() == "/big")
+    {
+        response->setBody(bigBody());
+        resp->done();
+    }
+    else if (req.path() == "/stream")
+    {
+        resp->startStream();
+        resp->write("part1-", 6);
+        resp->getLoop()->runAfter(0.05, [resp]() {
+            resp->write("part2", 5);
+            resp->endStream();
+        });
+    }
+    else if (req.path() == "/echo")
+    {
+        response->setBody(std::to_string(req.getBody().size()));
+        resp->done();
+    }
+    else
+    {
+        response->setStatusCode(HttpResponse::k404NotFound);
+        resp->done();
+    }
+}
+
+int connectProxy()
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memZero(&addr, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(kProxyPort);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof addr) < 0)
+    {
+        perror("connect");
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// 发送请求并读取一个完整的响应
+bool roundTrip(int fd, const string &request, HttpResponseParser *parser, bool head = false)
+{
+    size_t written = 0;
+    while (written < request.size())
+    {
+        ssize_t n = ::write(fd, request.data() + written, request.size() - written);
+        if (n <= 0)
+            return false;
+        written += static_cast<size_t>(n);
+    }
+    parser->reset(head);
+    Buffer buf;
+    while (!parser->gotAll())
+    {
+        int savedErrno = 0;
+        ssize_t n = buf.readFd(fd, &savedErrno);
+        if (n <= 0)
+            return parser->parseEof();
+        if (!parser->parse(&buf))
+            return false;
+    }
+    return true;
+}
+
+void client(EventLoop *loop, HttpProxy *proxy)
+{
+    ::usleep(200 * 1000);
+    int fd = connectProxy();
+    if (fd < 0)
+    {
+        ++g_failures;
+        loop->quit();
+        return;
+    }
+    HttpResponseParser parser;
+
+    // 轮转到没有监听的上游时换一个重试，请求仍然成功，两个正常的上游都会被用到
+    string seen;
+    for (int i = 0; i < 6; ++i)
+    {
+        CHECK(roundTrip(fd, "GET /id HTTP/1.1\r\nHost: proxy\r\n\r\n", &parser));
+        CHECK(parser.statusCode() == 200);
+        if (seen.find(parser.body()) == string::npos)
+            seen += parser.body();
+    }
+    printf("upstreams seen: %s\n", seen.c_str());
+    CHECK(seen.size() == 2);
+
+    CHECK(roundTrip(fd, "GET /big HTTP/1.1\r\nHost: proxy\r\n\r\n", &parser));
+    CHECK(parser.contentLength() == static_cast<int64_t>(kBigSize));
+    CHECK(parser.body() == bigBody());
+
+    CHECK(roundTrip(fd, "HEAD /big HTTP/1.1\r\nHost: proxy\r\n\r\n", &parser, true));
+    CHECK(parser.statusCode() == 200 && parser.body().empty());
+
+    // 上游没有 Content-Length，转发给客户端时使用分块编码
+    CHECK(roundTrip(fd, "GET /stream HTTP/1.1\r\nHost: proxy\r\n\r\n", &parser));
+    CHECK(parser.chunked());
+    CHECK(parser.body() == "part1-part2");
+
+    // 实体超过 kMaxReplayBody，边收边转发
+    string upload = "POST /echo HTTP/1.1\r\nHost: proxy\r\nContent-Length: " + std::to_string(kUploadSize) + "\r\n\r\n";
+    upload.append(kUploadSize, 'x');
+    CHECK(roundTrip(fd, upload, &parser));
+    CHECK(parser.body() == std::to_string(kUploadSize));
+
+    CHECK(roundTrip(fd, "GET /missing HTTP/1.1\r\nHost: proxy\r\n\r\n", &parser));
+    CHECK(parser.statusCode() == 404);
+    ::close(fd);
+
+    // HTTP/1.0 的客户端不能接收分块编码，整个响应缓存后带 Content-Length 发出
+    fd = connectProxy();
+    CHECK(roundTrip(fd, "GET /stream HTTP/1.0\r\n\r\n", &parser));
+    CHECK(!parser.chunked() && parser.contentLength() == 11);
+    CHECK(parser.body() == "part1-part2");
+    ::close(fd);
+
+    // 等健康检查发现没有监听的上游
+    ::usleep(500 * 1000);
+    CHECK(proxy->upstreamHealthy(0) && proxy->upstreamHealthy(1));
+    CHECK(!proxy->upstreamHealthy(2));
+    for (size_t i = 0; i < proxy->upstreamCount(); ++i)
+        CHECK(proxy->outstanding(i) == 0);
+    loop->quit();
+}
+
+int main()
+{
+    Logger::setLogLevel(Logger::ERROR);
+    EventLoop loop;
+
+    std::vector<std::unique_ptr<HttpServer>> upstreams;
+    const char *names[] = {"A", "B"};
+    for (int i = 0; i < 2; ++i)
+    {
+        upstreams.emplace_back(new HttpServer(&loop, InetAddress(kUpstreamPorts[i], true), names[i]));
+        upstreams.back()->setHttpAsyncCallback(std::bind(onUpstreamRequest, string(names[i]), _1));
+        upstreams.back()->start();
+    }
+
+    // proxy 先于 server 析构，此时 IO 线程还在运行
+    HttpServer server(&loop, InetAddress(kProxyPort, true), "ProxyServer");
+    server.setThreadNum(2);
+    HttpProxy proxy(&loop, "proxy");
+    for (uint16_t port : kUpstreamPorts)
+        proxy.addUpstream(InetAddress(port, true));
+    proxy.setHealthCheck("/id", 0.2);
+    proxy.setConnectTimeout(1);
+    proxy.attach(&server);
+    server.start();
+
+    Thread thread(std::bind(client, &loop, &proxy), "client");
+    thread.start();
+    loop.loop();
+    thread.join();
+
+    return testResult();
+}
@@ -0,0 +1,138 @@
+#include "mymuduo/http/HttpResponse.h"
+#include "mymuduo/net/Buffer.h"
+#include "mymuduo/base/Timestamp.h"
+
+#include <map>
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace mymuduo;
+using namespace mymuduo::net;
+
+// 对照组：改造前的编码方式，snprintf 格式化状态行和长度，首部存放在 std::map 中
+void legacyEncode(const std::map<string, string> &headers, const string &body, Buffer *output)
+{
+    char buf[32];
+    snprintf(buf, sizeof buf, "HTTP/1.1 %d ", 200);
+    output->append(buf);
+    output->append("OK");
+    output->append("\r\n");
+    snprintf(buf, sizeof buf, "Content-Length: %zd\r\n", body.size());
+    output->append(buf);
+    output->append("Connection: Keep-Alive\r\n");
+    for (const auto &header : headers)
+    {
+        output->append(header.first);
+        output->append(": ");
+        output->append(header.second);
+        output->append("\r\n");
+    }
+    output->append("\r\n");
+    output->append(body);
+}
+
+// 与 HttpServer::onRequest 相同，每个请求构造一个新的响应再编码
+void encode(const string &body, Buffer *output)
+{
+    HttpResponse resp(false);
+    resp.setStatusCode(HttpResponse::k200Ok);
+    resp.setStatusMessage("OK");
+    resp.setContentType("text/plain");
+    resp.addHeader(HttpResponse::kServer, "Muduo");
+    resp.setBody(body);
+    resp.appendToBuffer(output);
+}
+
+void encodeLegacy(const string &body, Buffer *output)
+{
+    std::map<string, string> headers;
+    headers["Content-Type"] = "text/plain";
+    headers["Server"] = "Muduo";
+    legacyEncode(headers, body, output);
+}
+
+bool check()
+{
+    Buffer buf;
+    HttpResponse resp(false);
+    resp.setStatusCode(HttpResponse::k206Partitial);
+    resp.setContentType("text/plain");
+    resp.addHeader("accept-ranges", "bytes");
+    resp.addHeader("X-Custom", "1");
+    resp.setContentLength(100);
+    resp.setContentRange(1024, 1123, 1234567890123LL);
+    resp.setSendDate(false);
+    resp.appendToBuffer(&buf);
+    string expected = "HTTP/1.1 206 Partial Content\r\n"
+                      "Connection: Keep-Alive\r\n"
+                      "Content-Length: 100\r\n"
+                      "Content-Range: bytes 1024-1123/1234567890123\r\n"
+                      "Content-Type: text/plain\r\n"
+                      "Accept-Ranges: bytes\r\n"
+                      "X-Custom: 1\r\n"
+                      "\r\n";
+    if (buf.retrieveAllAsString() != expected)
+    {
+        printf("unexpected encoding\n");
+        return false;
+    }
+
+    StringPiece date = HttpResponse::dateHeader();
+    // Date: Sun, 06 Nov 1994 08:49:37 GMT\r\n
+    if (date.size() != 37 || !date.starts_with("Date: ") || date[9] != ',')
+    {
+        printf("unexpected date header %s\n", date.as_string().c_str());
+        return false;
+    }
+
+    int64_t values[] = {0, 9, 10, 99, 100, 12345, -42, 9223372036854775807LL};
+    const char *texts[] = {"0", "9", "10", "99", "100", "12345", "-42", "9223372036854775807"};
+    for (size_t i = 0; i < sizeof values / sizeof values[0]; ++i)
+    {
+        buf.appendDecimal(values[i]);
+        if (buf.retrieveAllAsString() != texts[i])
+        {
+            printf("appendDecimal(%s) failed\n", texts[i]);
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : 1000000;
+    if (!check())
+    {
+        return 1;
+    }
+
+    const string body = "hello, world!\n";
+    Buffer output;
+    size_t bytes = 0;
+    Timestamp start(Timestamp::now());
+    for (int i = 0; i < iterations; ++i)
+    {
+        encode(body, &output);
+        bytes += output.readableBytes();
+        output.retrieveAll();
+    }
+    double fast = timeDifference(Timestamp::now(), start);
+    size_t fastBytes = bytes;
+
+    bytes = 0;
+    start = Timestamp::now();
+    for (int i = 0; i < iterations; ++i)
+    {
+        encodeLegacy(body, &output);
+        bytes += output.readableBytes();
+        output.retrieveAll();
+    }
+    double legacy = timeDifference(Timestamp::now(), start);
+
+    // 新编码多了一个 Date 首部，因此同时给出每个响应的耗时和吞吐
+    printf("keep-alive hello world, %d responses\n", iterations);
+    printf("encoder : %6.1f ns/response %6.3f bytes/ns\n", fast * 1e9 / iterations, static_cast<double>(fastBytes) / (fast * 1e9));
+    printf("legacy  : %6.1f ns/response %6.3f bytes/ns\n", legacy * 1e9 / iterations, static_cast<double>(bytes) / (legacy * 1e9));
+    return 0;
+}
@@ -0,0 +1,156 @@
+#include "mymuduo/http/HttpRouter.h"
+#include "mymuduo/http/HttpRequest.h"
+#include "mymuduo/http/HttpResponse.h"
+#include "mymuduo/base/Timestamp.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+using namespace mymuduo;
+using namespace mymuduo::net;
+
+// 1000 条路由：500 条静态、300 条单参数、200 条双参数
+const int kStatic = 500;
+const int kParam = 300;
+const int kParam2 = 200;
+
+struct Route
+{
+    string pattern;
+    string sample;   // 一条能匹配该路由的具体路径
+    string expected; // 期望捕获的第一个参数值
+};
+
+std::vector<Route> makeRoutes()
+{
+    std::vector<Route> routes;
+    char buf[128];
+    for (int i = 0; i < kStatic; ++i)
+    {
+        snprintf(buf, sizeof buf, "/api/v1/service%d/status", i);
+        routes.push_back(Route{buf, buf, ""});
+    }
+    for (int i = 0; i < kParam; ++i)
+    {
+        snprintf(buf, sizeof buf, "/api/v1/service%d/items/:id", i);
+        string pattern(buf);
+        snprintf(buf, sizeof buf, "/api/v1/service%d/items/%d", i, i * 7);
+        routes.push_back(Route{pattern, buf, std::to_string(i * 7)});
+    }
+    for (int i = 0; i < kParam2; ++i)
+    {
+        snprintf(buf, sizeof buf, "/api/v2/group%d/:name/posts/:post", i);
+        string pattern(buf);
+        snprintf(buf, sizeof buf, "/api/v2/group%d/user%d/posts/%d", i, i, i + 1);
+        snprintf(buf + 64, 64, "user%d", i);
+        routes.push_back(Route{pattern, buf, buf + 64});
+    }
+    return routes;
+}
+
+// 对照组：逐条比较的线性匹配，相当于一长串 if/else
+int linearMatch(const std::vector<Route> &routes, const string &path)
+{
+    for (size_t r = 0; r < routes.size(); ++r)
+    {
+        const string &pattern = routes[r].pattern;
+        size_t i = 0, j = 0;
+        bool ok = true;
+        while (ok && i < pattern.size() && j < path.size())
+        {
+            if (pattern[i] == ':')
+            {
+                while (i < pattern.size() && pattern[i] != '/')
+                    ++i;
+                while (j < path.size() && path[j] != '/')
+                    ++j;
+            }
+            else
+            {
+                ok = pattern[i++] == path[j++];
+            }
+        }
+        if (ok && i == pattern.size() && j == path.size())
+        {
+            return static_cast<int>(r);
+        }
+    }
+    return -1;
+}
+
+int main(int argc, char *argv[])
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : 200000;
+    std::vector<Route> routes = makeRoutes();
+
+    HttpRouter router;
+    std::vector<int> hits(routes.size(), 0);
+    for (size_t r = 0; r < routes.size(); ++r)
+    {
+        int *counter = &hits[r];
+        bool ok = router.get(routes[r].pattern, [counter](const HttpRequest &, const HttpRouter::Params &, HttpResponse *) {
+            ++*counter;
+        });
+        if (!ok)
+        {
+            printf("addRoute %s failed\n", routes[r].pattern.c_str());
+            return 1;
+        }
+    }
+
+    // 正确性检查
+    for (size_t r = 0; r < routes.size(); ++r)
+    {
+        HttpRouter::Params params;
+        const HttpRouter::Handler *h = router.find(HttpRequest::kGet, routes[r].sample, &params);
+        if (!h)
+        {
+            printf("no match for %s\n", routes[r].sample.c_str());
+            return 1;
+        }
+        (*h)(HttpRequest(), params, NULL);
+        if (hits[r] != 1 || (params.empty() ? "" : params[0].second.as_string()) != routes[r].expected)
+        {
+            printf("wrong match for %s\n", routes[r].sample.c_str());
+            return 1;
+        }
+    }
+    HttpRouter::Params params;
+    bool pathMatched = true;
+    if (router.find(HttpRequest::kGet, "/api/v1/unknown", &params, &pathMatched) || pathMatched ||
+        router.find(HttpRequest::kPost, routes[0].sample, &params, &pathMatched) || !pathMatched)
+    {
+        printf("negative lookup failed\n");
+        return 1;
+    }
+
+    std::vector<const string *> samples;
+    srand(42);
+    for (int i = 0; i < 4096; ++i)
+    {
+        samples.push_back(&routes[rand() % routes.size()].sample);
+    }
+
+    size_t found = 0;
+    Timestamp start(Timestamp::now());
+    for (int i = 0; i < iterations; ++i)
+    {
+        params.clear();
+        found += router.find(HttpRequest::kGet, *samples[i & 4095], &params) != NULL;
+    }
+    double radix = timeDifference(Timestamp::now(), start);
+
+    int linearIterations = iterations / 10;
+    start = Timestamp::now();
+    for (int i = 0; i < linearIterations; ++i)
+    {
+        found += linearMatch(routes, *samples[i & 4095]) >= 0;
+    }
+    double linear = timeDifference(Timestamp::now(), start);
+
+    printf("%zd routes, %zd lookups matched\n", routes.size(), found);
+    printf("radix  : %8.1f ns/lookup\n", radix * 1e9 / iterations);
+    printf("linear : %8.1f ns/lookup\n", linear * 1e9 / linearIterations);
+    return found == static_cast<size_t>(iterations + linearIterations) ? 0 : 1;
+}
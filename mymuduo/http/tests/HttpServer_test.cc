@@ -1,6 +1,7 @@
 #include "mymuduo/http/HttpServer.h"
 #include "mymuduo/http/HttpRequest.h"
 #include "mymuduo/http/HttpResponse.h"
+#include "mymuduo/http/HttpRouter.h"
 #include "mymuduo/net/EventLoop.h"
 #include "mymuduo/base/Logging.h"
 
@@ -13,7 +14,7 @@ using namespace mymuduo::net;
 extern char favicon[555];
 bool benchmark = false;
 
-void onRequest(const HttpRequest &req, HttpResponse *resp)
+void printHeaders(const HttpRequest &req)
 {
     std::cout << "Headers " << req.methodString() << " " << req.path() << std::endl;
     if (!benchmark)
@@ -24,40 +25,41 @@ void onRequest(const HttpRequest &req, HttpResponse *resp)
             std::cout << header.first << ": " << header.second << std::endl;
         }
     }
+}
 
-    if (req.path() == "/" || req.path() == "")
-    {
-        resp->setStatusCode(HttpResponse::k200Ok);
-        resp->setStatusMessage("OK");
-        resp->setContentType("text/html");
-        resp->addHeader("Server", "Muduo");
-        string now = Timestamp::now().toFormattedString();
-        resp->setBody("<html><head><title>This is title</title></head>"
-                      "<body><h1>Hello</h1>Now is " +
-                      now +
-                      "</body></html>");
-    }
-    else if (req.path() == "/favicon.ico")
-    {
-        resp->setStatusCode(HttpResponse::k200Ok);
-        resp->setStatusMessage("OK");
-        resp->setContentType("image/png");
-        resp->setBody(string(favicon, sizeof favicon));
-    }
-    else if (req.path() == "/hello")
-    {
-        resp->setStatusCode(HttpResponse::k200Ok);
-        resp->setStatusMessage("OK");
-        resp->setContentType("text/plain");
-        resp->addHeader("Server", "Muduo");
-        resp->setBody("hello, world!\n");
-    }
-    else
-    {
-        resp->setStatusCode(HttpResponse::k404NotFound);
-        resp->setStatusMessage("Not Found");
-        resp->setCloseConnection(true);
-    }
+void onIndex(const HttpRequest &req, const HttpRouter::Params &, HttpResponse *resp)
+{
+    printHeaders(req);
+    resp->setStatusCode(HttpResponse::k200Ok);
+    resp->setStatusMessage("OK");
+    resp->setContentType("text/html");
+    resp->addHeader(HttpResponse::kServer, "Muduo");
+    resp->setCompress(true); // 实体不足 256 字节时不会真正压缩
+    string now = Timestamp::now().toFormattedString();
+    resp->setBody("<html><head><title>This is title</title></head>"
+                  "<body><h1>Hello</h1>Now is " +
+                  now +
+                  "</body></html>");
+}
+
+void onFavicon(const HttpRequest &req, const HttpRouter::Params &, HttpResponse *resp)
+{
+    printHeaders(req);
+    resp->setStatusCode(HttpResponse::k200Ok);
+    resp->setStatusMessage("OK");
+    resp->setContentType("image/png");
+    resp->setBody(string(favicon, sizeof favicon));
+}
+
+void onHello(const HttpRequest &req, const HttpRouter::Params &params, HttpResponse *resp)
+{
+    printHeaders(req);
+    resp->setStatusCode(HttpResponse::k200Ok);
+    resp->setStatusMessage("OK");
+    resp->setContentType("text/plain");
+    resp->addHeader(HttpResponse::kServer, "Muduo");
+    StringPiece name = params.get("name");
+    resp->setBody("hello, " + (name.empty() ? string("world") : name.as_string()) + "!\n");
 }
 
 int main(int argc, char *argv[])
@@ -69,9 +71,15 @@ int main(int argc, char *argv[])
         Logger::setLogLevel(Logger::WARN);
         numThreads = atoi(argv[1]);
     }
+    HttpRouter router;
+    router.get("/", onIndex);
+    router.get("/favicon.ico", onFavicon);
+    router.get("/hello", onHello);
+    router.get("/hello/:name", onHello);
+
     EventLoop loop;
     HttpServer server(&loop, InetAddress(8000), "dummy");
-    server.setHttpCallback(onRequest);
+    server.setHttpCallback(std::bind(&HttpRouter::dispatch, &router, _1, _2));
     server.setThreadNum(numThreads);
     server.start();
     loop.loop();
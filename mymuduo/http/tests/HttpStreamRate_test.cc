@@ -0,0 +1,150 @@
+#include "mymuduo/http/HttpServer.h"
+#include "mymuduo/http/HttpRequest.h"
+#include "mymuduo/http/HttpResponse.h"
+#include "mymuduo/http/HttpRouter.h"
+#include "mymuduo/net/EventLoop.h"
+#include "mymuduo/base/Logging.h"
+#include "mymuduo/base/tests/TestCheck.h"
+
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <thread>
+
+using namespace mymuduo;
+using namespace mymuduo::net;
+
+// 同一个长连接上流水线发送限速的视频和不限速的大文件，两个响应的限速互不影响
+const uint16_t kPort = 18037;
+const size_t kVideoSize = 256 * 1024;
+const double kVideoRate = 512 * 1024;
+const size_t kBigSize = 4 * 1024 * 1024;
+
+FileHandlePtr g_video;
+FileHandlePtr g_big;
+
+// 按码率发送，没有开始的突发，约 0.5 秒
+void onVideo(const HttpRequest &, const HttpRouter::Params &, HttpResponse *resp)
+{
+    resp->setStatusCode(HttpResponse::k200Ok);
+    resp->setFile(g_video, 0);
+    resp->setSendLen(static_cast<off64_t>(kVideoSize));
+    resp->setRateLimit(kVideoRate, 0);
+}
+
+// 按视频的码率需要 8 秒
+void onBig(const HttpRequest &, const HttpRouter::Params &, HttpResponse *resp)
+{
+    resp->setStatusCode(HttpResponse::k200Ok);
+    resp->setFile(g_big, 0);
+    resp->setSendLen(static_cast<off64_t>(kBigSize));
+}
+
+FileHandlePtr makeFile(size_t size, char c)
+{
+    char path[] = "/tmp/httpstreamrate_testXXXXXX";
+    int fd = ::mkstemp(path);
+    ::unlink(path);
+    string content(size, c);
+    CHECK(::write(fd, content.data(), content.size()) == static_cast<ssize_t>(content.size()));
+    return std::make_shared<FileHandle>(fd);
+}
+
+// 读出一个响应，返回实体的长度
+size_t readResponse(int fd, string *pending)
+{
+    char buf[65536];
+    size_t end;
+    while ((end = pending->find("\r\n\r\n")) == string::npos)
+    {
+        ssize_t n = ::read(fd, buf, sizeof buf);
+        if (n <= 0)
+            return 0;
+        pending->append(buf, static_cast<size_t>(n));
+    }
+    CHECK(pending->compare(0, 12, "HTTP/1.1 200") == 0);
+    size_t lenPos = pending->find("Content-Length: ");
+    CHECK(lenPos != string::npos && lenPos < end);
+    size_t contentLength = static_cast<size_t>(atol(pending->c_str() + lenPos + 16));
+    pending->erase(0, end + 4);
+    size_t received = std::min(pending->size(), contentLength);
+    pending->erase(0, received);
+    while (received < contentLength)
+    {
+        ssize_t n = ::read(fd, buf, std::min(sizeof buf, contentLength - received));
+        if (n <= 0)
+            break;
+        received += static_cast<size_t>(n);
+    }
+    return received;
+}
+
+// 流水线发送两个请求，返回收齐两个响应所用的秒数
+double fetchPipelined(const string &first, const string &second, size_t firstSize, size_t secondSize)
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memZero(&addr, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(kPort);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof addr) < 0)
+    {
+        perror("connect");
+        ++g_failures;
+        ::close(fd);
+        return 0;
+    }
+    Timestamp start = Timestamp::now();
+    string requests = "GET " + first + " HTTP/1.1\r\nHost: localhost\r\n\r\n" +
+                      "GET " + second + " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    CHECK(::write(fd, requests.data(), requests.size()) == static_cast<ssize_t>(requests.size()));
+    string pending;
+    CHECK(readResponse(fd, &pending) == firstSize);
+    CHECK(readResponse(fd, &pending) == secondSize);
+    double elapsed = timeDifference(Timestamp::now(), start);
+    ::close(fd);
+    return elapsed;
+}
+
+void client()
+{
+    ::usleep(100 * 1000);
+    // 后面不限速的响应不能取消视频的限速
+    double elapsed = fetchPipelined("/video", "/big", kVideoSize, kBigSize);
+    printf("video then big: %.3f seconds\n", elapsed);
+    CHECK(elapsed > 0.4);
+    CHECK(elapsed < 2.0);
+    // 后面视频的限速不能拖慢前面还在发送的大文件
+    elapsed = fetchPipelined("/big", "/video", kBigSize, kVideoSize);
+    printf("big then video: %.3f seconds\n", elapsed);
+    CHECK(elapsed > 0.4);
+    CHECK(elapsed < 2.0);
+}
+
+int main()
+{
+    Logger::setLogLevel(Logger::WARN);
+    g_video = makeFile(kVideoSize, 'V');
+    g_big = makeFile(kBigSize, 'B');
+
+    HttpRouter router;
+    router.get("/video", onVideo);
+    router.get("/big", onBig);
+
+    EventLoop loop;
+    HttpServer server(&loop, InetAddress(kPort, true), "StreamRateServer");
+    server.setHttpCallback(std::bind(&HttpRouter::dispatch, &router, _1, _2));
+    server.start();
+
+    std::thread thread([&loop] {
+        client();
+        loop.queueInLoop([&loop] { loop.quit(); });
+    });
+    loop.loop();
+    thread.join();
+
+    return testResult();
+}
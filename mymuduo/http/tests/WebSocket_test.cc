@@ -0,0 +1,269 @@
+#include "mymuduo/http/WebSocket.h"
+#include "mymuduo/http/HttpServer.h"
+#include "mymuduo/http/HttpRequest.h"
+#include "mymuduo/net/Buffer.h"
+#include "mymuduo/net/EventLoop.h"
+#include "mymuduo/base/Logging.h"
+#include "mymuduo/base/Thread.h"
+#include "mymuduo/base/Timestamp.h"
+#include "mymuduo/base/tests/TestCheck.h"
+
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <zlib.h>
+
+using namespace mymuduo;
+using namespace mymuduo::net;
+
+const uint16_t kPort = 18032;
+WebSocketGroup g_group;
+
+void unmaskScalar(char *data, size_t len, const char mask[4], size_t offset)
+{
+    for (size_t i = 0; i < len; ++i)
+    {
+        data[i] = static_cast<char>(data[i] ^ mask[(offset + i) & 3]);
+    }
+}
+
+void testAcceptKey()
+{
+    // RFC 6455 1.3 中的例子
+    CHECK(websocket::acceptKey("dGhlIHNhbXBsZSBub25jZQ==") == "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=");
+}
+
+void testUnmask()
+{
+    const char mask[4] = {'\x12', '\x34', '\x56', '\x78'};
+    string data(4096 + 37, '\0');
+    for (size_t i = 0; i < data.size(); ++i)
+    {
+        data[i] = static_cast<char>(rand());
+    }
+    for (size_t len = 0; len < 100; ++len)
+    {
+        for (size_t offset = 0; offset < 4; ++offset)
+        {
+            string a = data.substr(3, len);
+            string b = a;
+            websocket::unmask(&a[0], len, mask, offset);
+            unmaskScalar(&b[0], len, mask, offset);
+            CHECK(a == b);
+        }
+    }
+
+    string a = data, b = data;
+    const int kRounds = 20000;
+    Timestamp start = Timestamp::now();
+    for (int i = 0; i < kRounds; ++i)
+        websocket::unmask(&a[0], a.size(), mask, static_cast<size_t>(i));
+    Timestamp middle = Timestamp::now();
+    for (int i = 0; i < kRounds; ++i)
+        unmaskScalar(&b[0], b.size(), mask, static_cast<size_t>(i));
+    Timestamp end = Timestamp::now();
+    CHECK(a == b);
+    printf("unmask %zu bytes: vectorized %.1f us, bytewise %.1f us\n", a.size(),
+           timeDifference(middle, start) * 1e6 / kRounds, timeDifference(end, middle) * 1e6 / kRounds);
+}
+
+bool onUpgrade(const HttpRequest &req, const WebSocketConnectionPtr &conn)
+{
+    if (req.path() != "/ws")
+    {
+        return false;
+    }
+    g_group.add(conn);
+    conn->setMessageCallback([](const WebSocketConnectionPtr &ws, const string &message, bool binary) {
+        if (message == "broadcast")
+            g_group.broadcast("hi all");
+        else
+            ws->send(message, binary);
+    });
+    conn->setCloseCallback([](const WebSocketConnectionPtr &ws) { g_group.remove(ws); });
+    return true;
+}
+
+// ---- 客户端 ----
+
+string rawDeflate(const string &in)
+{
+    z_stream zs;
+    memZero(&zs, sizeof zs);
+    deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+    string out(in.size() + 64, '\0');
+    zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(in.data()));
+    zs.avail_in = static_cast<uInt>(in.size());
+    zs.next_out = reinterpret_cast<Bytef *>(&out[0]);
+    zs.avail_out = static_cast<uInt>(out.size());
+    deflate(&zs, Z_SYNC_FLUSH);
+    out.resize(out.size() - zs.avail_out - 4);
+    deflateEnd(&zs);
+    return out;
+}
+
+string rawInflate(const string &in)
+{
+    z_stream zs;
+    memZero(&zs, sizeof zs);
+    inflateInit2(&zs, -15);
+    string data = in + string("\x00\x00\xff\xff", 4);
+    string out(4096, '\0');
+    zs.next_in = reinterpret_cast<Bytef *>(&data[0]);
+    zs.avail_in = static_cast<uInt>(data.size());
+    zs.next_out = reinterpret_cast<Bytef *>(&out[0]);
+    zs.avail_out = static_cast<uInt>(out.size());
+    inflate(&zs, Z_SYNC_FLUSH);
+    out.resize(out.size() - zs.avail_out);
+    inflateEnd(&zs);
+    return out;
+}
+
+int connectAndUpgrade(bool deflate)
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memZero(&addr, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(kPort);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof addr) < 0)
+    {
+        perror("connect");
+        ::close(fd);
+        return -1;
+    }
+    string request = "GET /ws HTTP/1.1\r\nHost: localhost\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                     "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n";
+    if (deflate)
+        request += "Sec-WebSocket-Extensions: permessage-deflate; client_max_window_bits\r\n";
+    request += "\r\n";
+    ssize_t n = ::write(fd, request.data(), request.size());
+    (void)n;
+
+    string response;
+    char c;
+    while (response.find("\r\n\r\n") == string::npos && ::read(fd, &c, 1) == 1)
+    {
+        response.push_back(c);
+    }
+    CHECK(response.find("HTTP/1.1 101") == 0);
+    CHECK(response.find("Sec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=\r\n") != string::npos);
+    CHECK((response.find("permessage-deflate") != string::npos) == deflate);
+    return fd;
+}
+
+void sendFrame(int fd, int opcode, const string &payload, bool fin = true, bool rsv1 = false)
+{
+    const char mask[4] = {'\x01', '\x02', '\x03', '\x04'};
+    string frame;
+    frame.push_back(static_cast<char>((fin ? 0x80 : 0) | (rsv1 ? 0x40 : 0) | opcode));
+    if (payload.size() < 126)
+    {
+        frame.push_back(static_cast<char>(0x80 | payload.size()));
+    }
+    else
+    {
+        frame.push_back(static_cast<char>(0x80 | 126));
+        frame.push_back(static_cast<char>(payload.size() >> 8));
+        frame.push_back(static_cast<char>(payload.size()));
+    }
+    frame.append(mask, 4);
+    string masked = payload;
+    unmaskScalar(&masked[0], masked.size(), mask, 0);
+    frame += masked;
+    ssize_t n = ::write(fd, frame.data(), frame.size());
+    (void)n;
+}
+
+// 读取一个服务端帧，返回 opcode，失败返回 -1
+int readFrame(int fd, string *payload, bool *rsv1)
+{
+    unsigned char header[4];
+    if (::read(fd, header, 2) != 2)
+        return -1;
+    CHECK((header[1] & 0x80) == 0); // 服务端帧不带掩码
+    size_t len = header[1] & 0x7f;
+    if (len == 126)
+    {
+        if (::read(fd, header + 2, 2) != 2)
+            return -1;
+        len = static_cast<size_t>(header[2]) << 8 | header[3];
+    }
+    payload->assign(len, '\0');
+    size_t got = 0;
+    while (got < len)
+    {
+        ssize_t nr = ::read(fd, &(*payload)[got], len - got);
+        if (nr <= 0)
+            return -1;
+        got += static_cast<size_t>(nr);
+    }
+    *rsv1 = (header[0] & 0x40) != 0;
+    return header[0] & 0x0f;
+}
+
+void client(EventLoop *loop)
+{
+    ::usleep(200 * 1000);
+    int plain = connectAndUpgrade(false);
+    int compressed = connectAndUpgrade(true);
+    if (plain < 0 || compressed < 0)
+    {
+        ++g_failures;
+        loop->quit();
+        return;
+    }
+    string payload;
+    bool rsv1 = false;
+
+    // 分片消息中间插入 Ping
+    sendFrame(plain, websocket::kText, "hel", false);
+    sendFrame(plain, websocket::kPing, "p1");
+    sendFrame(plain, websocket::kContinuation, "lo");
+    CHECK(readFrame(plain, &payload, &rsv1) == websocket::kPong && payload == "p1");
+    CHECK(readFrame(plain, &payload, &rsv1) == websocket::kText && payload == "hello" && !rsv1);
+
+    // permessage-deflate 双向
+    string text(1000, 'x');
+    sendFrame(compressed, websocket::kBinary, rawDeflate(text), true, true);
+    CHECK(readFrame(compressed, &payload, &rsv1) == websocket::kBinary && rsv1);
+    CHECK(rawInflate(payload) == text);
+
+    // 广播到两个连接
+    sendFrame(plain, websocket::kText, "broadcast");
+    CHECK(readFrame(plain, &payload, &rsv1) == websocket::kText && payload == "hi all");
+    CHECK(readFrame(compressed, &payload, &rsv1) == websocket::kText && rsv1 && rawInflate(payload) == "hi all");
+
+    // 关闭握手
+    sendFrame(plain, websocket::kClose, string("\x03\xe8", 2));
+    CHECK(readFrame(plain, &payload, &rsv1) == websocket::kClose && payload == string("\x03\xe8", 2));
+    CHECK(::read(plain, &rsv1, 1) == 0);
+    ::close(plain);
+    ::close(compressed);
+    loop->quit();
+}
+
+void testServer()
+{
+    EventLoop loop;
+    HttpServer server(&loop, InetAddress(kPort, true), "WebSocketServer");
+    server.setWebSocketCallback(onUpgrade);
+    server.start();
+
+    Thread thread(std::bind(client, &loop), "client");
+    thread.start();
+    loop.loop();
+    thread.join();
+}
+
+int main()
+{
+    Logger::setLogLevel(Logger::WARN);
+    testAcceptKey();
+    testUnmask();
+    testServer();
+    return testResult();
+}
@@ -26,6 +26,7 @@ Acceptor::Acceptor(EventLoop *loop, const InetAddress &listenAddr)
     assert(idleFd_ >= 0);
     acceptSocket_.setReuseAddr(true);
     acceptSocket_.bindAddress(listenAddr);
+    acceptChannel_.setType(Channel::kAcceptorChannel);
     acceptChannel_.setReadCallback(std::bind(&Acceptor::handleRead, this));
 }
 
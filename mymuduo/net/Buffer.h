@@ -242,6 +242,45 @@ namespace mymuduo
                 append(&x, sizeof x);
             }
 
+            ///
+            /// Append the decimal text of x, e.g. for Content-Length
+            /// 从低位向高位每次转换两位，不经过 snprintf
+            ///
+            void appendDecimal(int64_t x)
+            {
+                static const char kDigits2[] =
+                    "0001020304050607080910111213141516171819"
+                    "2021222324252627282930313233343536373839"
+                    "4041424344454647484950515253545556575859"
+                    "6061626364656667686970717273747576777879"
+                    "8081828384858687888990919293949596979899";
+                char buf[24];
+                char *p = buf + sizeof buf;
+                uint64_t v = x < 0 ? 0 - static_cast<uint64_t>(x) : static_cast<uint64_t>(x);
+                while (v >= 100)
+                {
+                    size_t i = static_cast<size_t>(v % 100) * 2;
+                    v /= 100;
+                    *--p = kDigits2[i + 1];
+                    *--p = kDigits2[i];
+                }
+                if (v >= 10)
+                {
+                    size_t i = static_cast<size_t>(v) * 2;
+                    *--p = kDigits2[i + 1];
+                    *--p = kDigits2[i];
+                }
+                else
+                {
+                    *--p = static_cast<char>('0' + v);
+                }
+                if (x < 0)
+                {
+                    *--p = '-';
+                }
+                append(p, static_cast<size_t>(buf + sizeof buf - p));
+            }
+
             ///
             /// Read int64_t from network endian
             ///
@@ -52,6 +52,7 @@ namespace mymuduo
         typedef std::function<void(const TcpConnectionPtr &)> CloseCallback;
         typedef std::function<void(const TcpConnectionPtr &)> WriteCompleteCallback;
         typedef std::function<void(const TcpConnectionPtr &, size_t)> HighWaterMarkCallback;
+        typedef std::function<void(const TcpConnectionPtr &)> ReadResumeCallback;
         typedef std::function<void(const TcpConnectionPtr &, Buffer *, Timestamp)> MessageCallback;
 
         void defaultConnectionCallback(const TcpConnectionPtr &conn);
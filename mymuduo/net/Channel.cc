@@ -20,6 +20,7 @@ Channel::Channel(EventLoop *loop, int fdArg)
       events_(0),
       revents_(0),
       index_(-1),
+      type_(kOtherChannel),
       tied_(false),
       addedToLoop_(false),
       eventHandling_(false)
@@ -36,6 +37,25 @@ Channel::~Channel()
     }
 }
 
+const char *Channel::typeName(Type type)
+{
+    switch (type)
+    {
+    case kWakeupChannel:
+        return "wakeup";
+    case kTimerChannel:
+        return "timer";
+    case kAcceptorChannel:
+        return "acceptor";
+    case kConnectorChannel:
+        return "connector";
+    case kConnectionChannel:
+        return "connection";
+    default:
+        return "other";
+    }
+}
+
 void Channel::update()
 {
     loop_->updateChannel(this);
@@ -30,6 +30,17 @@ namespace mymuduo
         public:
             typedef std::function<void()> EventCallback;
             typedef std::function<void(Timestamp)> ReadEventCallback;
+            // Channel 的用途，只用于按类型统计回调耗时（见 LoopMetrics）
+            enum Type
+            {
+                kOtherChannel,
+                kWakeupChannel,
+                kTimerChannel,
+                kAcceptorChannel,
+                kConnectorChannel,
+                kConnectionChannel,
+                kNumChannelTypes
+            };
 
             Channel(EventLoop *loop, int fd);
             ~Channel();
@@ -46,6 +57,9 @@ namespace mymuduo
             void setErrorCallback(EventCallback cb) { errorCallback_ = std::move(cb); }
 
             int fd() { return fd_; }
+            Type type() const { return type_; }
+            void setType(Type type) { type_ = type; }
+            static const char *typeName(Type type);
             int events() { return events_; }
             int index() { return index_; }
             /**
@@ -114,6 +128,7 @@ namespace mymuduo
              */
             int events_, revents_;
             int index_; // used by Poller, 在fd数组中的下标
+            Type type_;
             bool tied_;
             bool addedToLoop_;
             bool eventHandling_;
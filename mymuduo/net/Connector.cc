@@ -113,13 +113,12 @@ void Connector::connect()
     case EFAULT:
     case ENOTSOCK:
         LOG_SYSERR << "connect error in Connector::startInLoop " << savedErrno;
-        sockets::close(sockfd);
+        fail(sockfd);
         break;
 
     default:
         LOG_SYSERR << "Unexpected error in Connector::startInLoop " << savedErrno;
-        sockets::close(sockfd);
-        // connectErrorCallback_();
+        fail(sockfd);
         break;
     }
 }
@@ -138,6 +137,7 @@ void Connector::connecting(int sockfd)
     setState(kConnecting);
     assert(!channel_);
     channel_.reset(new Channel(loop_, sockfd));
+    channel_->setType(Channel::kConnectorChannel);
     channel_->setWriteCallback(
         std::bind(&Connector::handleWrite, this)); // FIXME: unsafe
     channel_->setErrorCallback(
@@ -227,8 +227,24 @@ void Connector::handleError()
     }
 }
 
+void Connector::fail(int sockfd)
+{
+    sockets::close(sockfd);
+    setState(kDisconnected);
+    if (connect_ && connectFailedCallback_)
+    {
+        connect_ = false;
+        connectFailedCallback_();
+    }
+}
+
 void Connector::retry(int sockfd)
 {
+    if (connectFailedCallback_)
+    {
+        fail(sockfd);
+        return;
+    }
     sockets::close(sockfd);
     setState(kDisconnected);
     if (connect_)
@@ -26,10 +26,13 @@ namespace mymuduo
         {
         public:
             typedef std::function<void(int sockfd)> NewConnectionCallback;
+            typedef std::function<void()> ConnectFailedCallback;
             Connector(EventLoop *loop, const InetAddress &serverAddr);
             ~Connector();
 
             void setNewConnectionCallback(const NewConnectionCallback &cb) { newConnectionCallback_ = cb; }
+            /// 设置后连接失败不再按 back-off 重试，而是停止并回调，由调用方决定下一步（比如换一个地址）
+            void setConnectFailedCallback(const ConnectFailedCallback &cb) { connectFailedCallback_ = cb; }
             void start();   // in any thread
             void restart(); // int loop thread
             void stop();    // in any thread
@@ -54,6 +57,8 @@ namespace mymuduo
             void handleWrite();
             void handleError();
             void retry(int sockfd);
+            // 无法重试的错误
+            void fail(int sockfd);
             int removeAndResetChannel();
             void resetChannel();
 
@@ -64,6 +69,7 @@ namespace mymuduo
             States state_; // FIXME: use atomic variable
             std::unique_ptr<Channel> channel_;
             NewConnectionCallback newConnectionCallback_;
+            ConnectFailedCallback connectFailedCallback_;
             int retryDelayMs_;
         };
     }
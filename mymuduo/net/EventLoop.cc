@@ -65,7 +65,8 @@ EventLoop::EventLoop()
       poller_(Poller::newDefaultPoller(this)),
       timerQueue_(new TimerQueue(this)),
       wakeupFd_(createEventfd()),
-      wakeupChannel_(new Channel(this, wakeupFd_))
+      wakeupChannel_(new Channel(this, wakeupFd_)),
+      metricsEnabled_(false)
 {
     LOG_DEBUG << "EventLoop created " << this << " in Thread" << threadId_;
     // 一个线程一个 EventLoop，所以不存在线程安全的问题
@@ -77,6 +78,7 @@ EventLoop::EventLoop()
     {
         t_loopInThisThread = this;
     }
+    wakeupChannel_->setType(Channel::kWakeupChannel);
     wakeupChannel_->setReadCallback(
         std::bind(&EventLoop::handleRead, this));
     wakeupChannel_->enableReading();
@@ -107,10 +109,18 @@ void EventLoop::loop()
     looping_ = true;
     quit_ = false;
 
+    Timestamp lastEnd;
     while (!quit_)
     {
         activeChannels_.clear();
         pollReturnTime_ = poller_->poll(kPollTimeMs, &activeChannels_);
+        metrics_.addIteration();
+        if (metricsEnabled_)
+        {
+            lastEnd = handleEventsWithMetrics(lastEnd);
+            continue;
+        }
+        lastEnd = Timestamp::invalid();
         for (Channel *channel : activeChannels_)
         {
             channel->handleEvent(pollReturnTime_);
@@ -121,6 +131,32 @@ void EventLoop::loop()
     looping_ = false;
 }
 
+/**
+ * poll 返回的时间就是回调开始的时间，每个回调结束时读一次时钟，
+ * 它既是这个回调的结束也是下一个回调的开始，functor 执行完后的时间又作为下一轮 poll 的开始
+ */
+Timestamp EventLoop::handleEventsWithMetrics(Timestamp lastEnd)
+{
+    if (lastEnd.valid())
+    {
+        metrics_.recordPollWait(pollReturnTime_.microSecondsSinceEpoch() - lastEnd.microSecondsSinceEpoch());
+    }
+    Timestamp start = pollReturnTime_;
+    for (Channel *channel : activeChannels_)
+    {
+        // 回调中 Channel 可能被销毁，先取出类型
+        Channel::Type type = channel->type();
+        channel->handleEvent(pollReturnTime_);
+        Timestamp now(Timestamp::now());
+        metrics_.recordCallback(type, now.microSecondsSinceEpoch() - start.microSecondsSinceEpoch());
+        start = now;
+    }
+    doPendingFunctors();
+    Timestamp end(Timestamp::now());
+    metrics_.recordIteration(end.microSecondsSinceEpoch() - pollReturnTime_.microSecondsSinceEpoch());
+    return end;
+}
+
 /**
  * 检查断言之后调用 Poller::updateChannel()，EventLoop不关心Poller是如何管理Channel列表的
  */
@@ -129,6 +165,8 @@ void EventLoop::updateChannel(Channel *channel)
     assert(channel->ownerLoop() == this);
     assertInLoopThread();
     poller_->updateChannel(channel);
+    // Channel 数不依赖 setMetricsEnabled，在注册和注销时更新
+    metrics_.setChannels(poller_->numChannels());
 }
 
 /**
@@ -138,6 +176,7 @@ void EventLoop::updateChannel(Channel *channel)
 void EventLoop::removeChannel(Channel *channel)
 {
     poller_->removeChannel(channel);
+    metrics_.setChannels(poller_->numChannels());
 }
 
 bool EventLoop::hasChannel(Channel *channel)
@@ -224,6 +263,7 @@ void EventLoop::doPendingFunctors()
         MutexLockGuard lock(mutex_);
         functors.swap(pendingFunctors_);
     }
+    metrics_.recordFunctors(functors.size());
     for (size_t i = 0; i < functors.size(); ++i)
     {
         functors[i]();
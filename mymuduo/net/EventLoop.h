@@ -5,10 +5,12 @@
 #include <functional>
 #include <boost/scoped_ptr.hpp>
 
+#include "mymuduo/base/Atomic.h"
 #include "mymuduo/base/Mutex.h"
 #include "mymuduo/base/Timestamp.h"
 #include "mymuduo/base/CurrentThread.h"
 #include "mymuduo/net/Callbacks.h"
+#include "mymuduo/net/LoopMetrics.h"
 #include "mymuduo/net/TimerId.h"
 
 namespace mymuduo
@@ -44,10 +46,21 @@ namespace mymuduo
             MutexLock mutex_;
             std::vector<Functor> pendingFunctors_; // pending - 悬而未决的，待定的
 
+            // 文件发送统计，IO 线程更新，其他线程只读
+            mutable AtomicInt64 coldFileReads_;
+            mutable AtomicInt64 fileSendStalls_;
+            mutable AtomicInt64 fileSendStallMicros_;
+
+            bool metricsEnabled_;
+            LoopMetrics metrics_;
+
             void abortNotInLoopThread();
 
             void handleRead(); // Weaked up
             void doPendingFunctors();
+            // 开启统计时的一轮循环：分发事件、执行 functor，并记录各部分的耗时
+            // lastEnd 为上一轮结束（即本轮 poll 开始）的时间，返回本轮结束的时间
+            Timestamp handleEventsWithMetrics(Timestamp lastEnd);
 
         public:
             /*
@@ -101,6 +114,32 @@ namespace mymuduo
                 }
             }
 
+            /**
+             * 本线程上文件发送的统计，可以在任意线程读取：
+             * coldFileReads 为发现数据不在页缓存、交给线程池预读的次数，
+             * fileSendStalls/fileSendStallMicros 为明显阻塞了 IO 线程（超过 1ms）的 sendfile 次数和总耗时
+             */
+            void countColdFileRead() { coldFileReads_.increment(); }
+            void countFileSendStall(int64_t micros)
+            {
+                fileSendStalls_.increment();
+                fileSendStallMicros_.add(micros);
+            }
+            int64_t coldFileReads() const { return coldFileReads_.get(); }
+            int64_t fileSendStalls() const { return fileSendStalls_.get(); }
+            int64_t fileSendStallMicros() const { return fileSendStallMicros_.get(); }
+
+            /**
+             * 开启后记录每轮循环、poll 等待和各类 Channel 回调的耗时分布，见 LoopMetrics。
+             * 计数器不受影响，总是更新。在 loop() 之前或者 IO 线程中调用
+             */
+            void setMetricsEnabled(bool on) { metricsEnabled_ = on; }
+            bool metricsEnabled() const { return metricsEnabled_; }
+            /// 供 IO 线程中的组件更新计数器
+            LoopMetrics &metrics() { return metrics_; }
+            /// 可以在任意线程调用，不加锁
+            LoopMetrics::Snapshot metricsSnapshot() const { return metrics_.snapshot(); }
+
             /*
              * 返回该线程对应的唯一 EventLoop，作为静态成员函数，返回的指针也是每个线程共享的
              */
@@ -13,7 +13,8 @@ EventLoopThreadPool::EventLoopThreadPool(EventLoop *baseLoop, const string &name
       name_(nameArg),
       started_(false),
       numThreads_(0),
-      next_(0)
+      next_(0),
+      metricsEnabled_(false)
 {
 }
 
@@ -36,6 +37,11 @@ void EventLoopThreadPool::start(const ThreadInitCallback &cb)
     EventLoopThread *t = new EventLoopThread(cb, buf);
     threads_.push_back(std::unique_ptr<EventLoopThread>(t));
     loops_.push_back(t->startLoop());
+    if (metricsEnabled_)
+    {
+      EventLoop *loop = loops_.back();
+      loop->runInLoop(std::bind(&EventLoop::setMetricsEnabled, loop, true));
+    }
   }
   // 如果没有设置线程池大小，则默认在创建线程上执行
   if (numThreads_ == 0 && cb)
@@ -88,3 +94,36 @@ std::vector<EventLoop *> EventLoopThreadPool::getAllLoops()
     return loops_;
   }
 }
+
+void EventLoopThreadPool::setMetricsEnabled(bool on)
+{
+  metricsEnabled_ = on;
+  baseLoop_->runInLoop(std::bind(&EventLoop::setMetricsEnabled, baseLoop_, on));
+  for (EventLoop *loop : loops_)
+  {
+    loop->runInLoop(std::bind(&EventLoop::setMetricsEnabled, loop, on));
+  }
+}
+
+LoopMetrics::Snapshot EventLoopThreadPool::metricsSnapshot() const
+{
+  // loops_ 只在 start() 中修改，之后可以在其他线程中遍历
+  LoopMetrics::Snapshot snap = baseLoop_->metricsSnapshot();
+  for (EventLoop *loop : loops_)
+  {
+    snap.merge(loop->metricsSnapshot());
+  }
+  return snap;
+}
+
+std::vector<LoopMetrics::Snapshot> EventLoopThreadPool::loopMetricsSnapshots() const
+{
+  std::vector<LoopMetrics::Snapshot> snaps;
+  snaps.reserve(loops_.size() + 1);
+  snaps.push_back(baseLoop_->metricsSnapshot());
+  for (EventLoop *loop : loops_)
+  {
+    snaps.push_back(loop->metricsSnapshot());
+  }
+  return snaps;
+}
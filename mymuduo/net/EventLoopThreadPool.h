@@ -3,6 +3,7 @@
 
 #include "mymuduo/base/noncopyable.h"
 #include "mymuduo/base/Types.h"
+#include "mymuduo/net/LoopMetrics.h"
 
 #include <functional>
 #include <memory>
@@ -34,6 +35,13 @@ namespace mymuduo
 
       std::vector<EventLoop *> getAllLoops();
 
+      /// 对 baseLoop 和所有 IO 线程开启耗时统计，见 EventLoop::setMetricsEnabled。start() 前后都可以调用
+      void setMetricsEnabled(bool on);
+      /// 合并 baseLoop 和所有 IO 线程的统计，start() 之后可以在任意线程调用
+      LoopMetrics::Snapshot metricsSnapshot() const;
+      /// 各个 EventLoop 的统计，第 0 个为 baseLoop，之后依次为 IO 线程。start() 之后可以在任意线程调用
+      std::vector<LoopMetrics::Snapshot> loopMetricsSnapshots() const;
+
       bool started() const
       {
         return started_;
@@ -50,6 +58,7 @@ namespace mymuduo
       bool started_;
       int numThreads_;
       int next_;
+      bool metricsEnabled_;
       std::vector<std::unique_ptr<EventLoopThread>> threads_;
       std::vector<EventLoop *> loops_;
     };
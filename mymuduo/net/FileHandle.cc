@@ -0,0 +1,49 @@
+#include "mymuduo/net/FileHandle.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <algorithm>
+#include <vector>
+
+using namespace mymuduo;
+using namespace mymuduo::net;
+
+bool FileHandle::isResident(off_t offset, size_t len) const
+{
+    static const off_t kPageSize = ::sysconf(_SC_PAGESIZE);
+    off_t begin = offset - offset % kPageSize;
+    size_t mapLen = len + static_cast<size_t>(offset - begin);
+    void *addr = ::mmap(NULL, mapLen, PROT_READ, MAP_SHARED, fd_, begin);
+    if (addr == MAP_FAILED)
+    {
+        return true;
+    }
+    std::vector<unsigned char> pages((mapLen + static_cast<size_t>(kPageSize) - 1) / static_cast<size_t>(kPageSize));
+    int ret = ::mincore(addr, mapLen, pages.data());
+    ::munmap(addr, mapLen);
+    if (ret != 0)
+    {
+        return true;
+    }
+    for (unsigned char page : pages)
+    {
+        if (!(page & 1))
+            return false;
+    }
+    return true;
+}
+
+void FileHandle::readIntoPageCache(off_t offset, size_t len) const
+{
+    ::posix_fadvise(fd_, offset, static_cast<off_t>(len), POSIX_FADV_SEQUENTIAL);
+    const size_t kBufSize = 128 * 1024;
+    std::unique_ptr<char[]> buf(new char[kBufSize]);
+    while (len > 0)
+    {
+        ssize_t n = ::pread(fd_, buf.get(), std::min(len, kBufSize), offset);
+        if (n <= 0)
+            break;
+        offset += n;
+        len -= static_cast<size_t>(n);
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef MY_MUDUO_NET_FILEHANDLE_H
+#define MY_MUDUO_NET_FILEHANDLE_H
+
+#include "mymuduo/base/noncopyable.h"
+
+#include <memory>
+#include <sys/types.h>
+#include <unistd.h>
+
+namespace mymuduo
+{
+    namespace net
+    {
+        /**
+         * 以引用计数共享的只读文件描述符，最后一个持有者释放时 close。
+         * 发送方使用 sendfile/pread 的显式偏移，不修改文件偏移量，
+         * 因此多个连接可以同时从同一个 fd 发送同一文件的不同部分
+         */
+        class FileHandle : noncopyable
+        {
+        public:
+            explicit FileHandle(int fd) : fd_(fd) {}
+            ~FileHandle()
+            {
+                if (fd_ >= 0)
+                {
+                    ::close(fd_);
+                }
+            }
+
+            int fd() const { return fd_; }
+
+            /// [offset, offset + len) 是否全部在页缓存中（mmap + mincore），无法判断时按在缓存中处理
+            bool isResident(off_t offset, size_t len) const;
+            /// 把 [offset, offset + len) 读入页缓存，会阻塞，在线程池的工作线程中调用
+            void readIntoPageCache(off_t offset, size_t len) const;
+
+        private:
+            const int fd_;
+        };
+
+        typedef std::shared_ptr<FileHandle> FileHandlePtr;
+    }
+}
+
+#endif
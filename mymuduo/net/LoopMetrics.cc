@@ -0,0 +1,132 @@
+#include "mymuduo/net/LoopMetrics.h"
+
+#include <algorithm>
+
+using namespace mymuduo;
+using namespace mymuduo::net;
+
+HistogramSnapshot::HistogramSnapshot()
+    : count(0),
+      sum(0)
+{
+    std::fill(buckets, buckets + kBuckets, 0);
+}
+
+void HistogramSnapshot::merge(const HistogramSnapshot &other)
+{
+    for (int i = 0; i < kBuckets; ++i)
+    {
+        buckets[i] += other.buckets[i];
+    }
+    count += other.count;
+    sum += other.sum;
+}
+
+int64_t HistogramSnapshot::upperBound(int i)
+{
+    return i + 1 < kBuckets ? static_cast<int64_t>(1) << i : -1;
+}
+
+int64_t HistogramSnapshot::percentile(double q) const
+{
+    if (count == 0)
+    {
+        return 0;
+    }
+    // 第 rank 个值所在的桶
+    int64_t rank = std::max(static_cast<int64_t>(q * static_cast<double>(count) + 0.5), static_cast<int64_t>(1));
+    int64_t seen = 0;
+    for (int i = 0; i + 1 < kBuckets; ++i)
+    {
+        seen += buckets[i];
+        if (seen >= rank)
+        {
+            return upperBound(i);
+        }
+    }
+    // 落在没有上限的桶中，只能返回最大的有限上限
+    return upperBound(kBuckets - 2);
+}
+
+int HistogramSnapshot::bucketOf(int64_t value)
+{
+    int i = 0;
+    if (value > 1)
+    {
+        // value 落在 (2^(i-1), 2^i]
+        i = 64 - __builtin_clzll(static_cast<unsigned long long>(value - 1));
+        i = std::min(i, kBuckets - 1);
+    }
+    return i;
+}
+
+void LoopHistogram::record(int64_t value)
+{
+    buckets_[HistogramSnapshot::bucketOf(value)].add(1);
+    count_.add(1);
+    sum_.add(value);
+}
+
+HistogramSnapshot LoopHistogram::snapshot() const
+{
+    HistogramSnapshot snap;
+    for (int i = 0; i < HistogramSnapshot::kBuckets; ++i)
+    {
+        snap.buckets[i] = buckets_[i].get();
+    }
+    snap.count = count_.get();
+    snap.sum = sum_.get();
+    return snap;
+}
+
+LoopMetrics::Snapshot::Snapshot()
+    : loops(0),
+      iterations(0),
+      functorsRun(0),
+      timersFired(0),
+      bytesRead(0),
+      bytesWritten(0),
+      bytesSentFile(0),
+      channels(0)
+{
+}
+
+void LoopMetrics::Snapshot::merge(const Snapshot &other)
+{
+    loops += other.loops;
+    iterations += other.iterations;
+    functorsRun += other.functorsRun;
+    timersFired += other.timersFired;
+    bytesRead += other.bytesRead;
+    bytesWritten += other.bytesWritten;
+    bytesSentFile += other.bytesSentFile;
+    channels += other.channels;
+    iterationMicros.merge(other.iterationMicros);
+    pollWaitMicros.merge(other.pollWaitMicros);
+    functorQueueDepth.merge(other.functorQueueDepth);
+    for (int i = 0; i < Channel::kNumChannelTypes; ++i)
+    {
+        callbackMicros[i].merge(other.callbackMicros[i]);
+    }
+}
+
+LoopMetrics::Snapshot LoopMetrics::snapshot() const
+{
+    Snapshot snap;
+    snap.loops = 1;
+    snap.iterations = iterations_.get();
+    snap.functorsRun = functorsRun_.get();
+    snap.timersFired = timersFired_.get();
+    snap.bytesRead = bytesRead_.get();
+    snap.bytesWritten = bytesWritten_.get();
+    snap.bytesSentFile = bytesSentFile_.get();
+    snap.channels = channels_.get();
+    snap.iterationMicros = iterationMicros_.snapshot();
+    snap.pollWaitMicros = pollWaitMicros_.snapshot();
+    snap.functorQueueDepth = functorQueueDepth_.snapshot();
+    for (int i = 0; i < Channel::kNumChannelTypes; ++i)
+    {
+        snap.callbackMicros[i] = callbackMicros_[i].snapshot();
+    }
+    return snap;
+}
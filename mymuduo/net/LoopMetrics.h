@@ -0,0 +1,130 @@
+#ifndef MY_MUDUO_NET_LOOPMETRICS_H
+#define MY_MUDUO_NET_LOOPMETRICS_H
+
+#include "mymuduo/base/noncopyable.h"
+#include "mymuduo/net/Channel.h"
+
+#include <atomic>
+#include <stdint.h>
+
+namespace mymuduo
+{
+    namespace net
+    {
+        /**
+         * 只由 IO 线程写、任意线程读的计数器。只有一个写者，更新是普通的读-加-写，
+         * 不需要带 lock 前缀的原子指令，也不会与其他线程争用缓存行；读者可能看到稍旧的值
+         */
+        class LoopCounter : noncopyable
+        {
+        public:
+            LoopCounter() : value_(0) {}
+
+            void add(int64_t n) { value_.store(value_.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+            void set(int64_t n) { value_.store(n, std::memory_order_relaxed); }
+            int64_t get() const { return value_.load(std::memory_order_relaxed); }
+
+        private:
+            std::atomic<int64_t> value_;
+        };
+
+        /// 直方图在某一时刻的拷贝，多个 EventLoop 的拷贝可以合并
+        struct HistogramSnapshot
+        {
+            // 第 0 个桶统计不大于 1 的值，第 i 个桶统计 (2^(i-1), 2^i]，最后一个桶没有上限
+            static const int kBuckets = 24;
+
+            HistogramSnapshot();
+            void merge(const HistogramSnapshot &other);
+            /// 第 i 个桶的上限，最后一个桶返回 -1 表示无穷大
+            static int64_t upperBound(int i);
+            /// value 所在的桶
+            static int bucketOf(int64_t value);
+            /// 分位数的估计值（所在桶的上限），q 取 [0, 1]，没有数据时为 0
+            int64_t percentile(double q) const;
+            double mean() const { return count > 0 ? static_cast<double>(sum) / static_cast<double>(count) : 0.0; }
+
+            int64_t buckets[kBuckets];
+            int64_t count;
+            int64_t sum;
+        };
+
+        /// 按 2 的幂次固定分桶，记录一次只需要求最高位再做三次加法
+        class LoopHistogram : noncopyable
+        {
+        public:
+            void record(int64_t value);
+            /// 与 IO 线程的写入并发时，各个桶、count 与 sum 之间可能相差正在记录的几个值
+            HistogramSnapshot snapshot() const;
+
+        private:
+            LoopCounter buckets_[HistogramSnapshot::kBuckets];
+            LoopCounter count_;
+            LoopCounter sum_;
+        };
+
+        /**
+         * 一个 EventLoop 的运行统计，由所属的 IO 线程更新，可以在任意线程调用 snapshot() 读取，
+         * 读取不加锁，也不打扰 IO 线程。
+         *
+         * 计数器（循环次数、执行的 functor、触发的定时器、读写的字节数）总是更新，代价只是几次加法；
+         * 耗时直方图需要额外读时钟，只有 EventLoop::setMetricsEnabled(true) 之后才记录，
+         * 每轮循环多读一次时钟，每处理一个就绪的 Channel 再多读一次
+         */
+        class LoopMetrics : noncopyable
+        {
+        public:
+            struct Snapshot
+            {
+                Snapshot();
+                void merge(const Snapshot &other);
+
+                int loops; // 合并了多少个 EventLoop
+                int64_t iterations;
+                int64_t functorsRun;
+                int64_t timersFired;
+                int64_t bytesRead;
+                int64_t bytesWritten;
+                int64_t bytesSentFile; // bytesWritten 中由 sendfile 发出、不经过用户态缓冲区的部分
+                int64_t channels; // 注册在 Poller 中的 Channel 数
+                HistogramSnapshot iterationMicros; // 一轮循环处理事件和 functor 的时间，不含 poll 等待
+                HistogramSnapshot pollWaitMicros;
+                HistogramSnapshot functorQueueDepth; // 每轮 doPendingFunctors 取出的 functor 数
+                HistogramSnapshot callbackMicros[Channel::kNumChannelTypes];
+            };
+
+            Snapshot snapshot() const;
+
+            // 以下只能在 IO 线程中调用
+            void addIteration() { iterations_.add(1); }
+            void addTimersFired(size_t n) { timersFired_.add(static_cast<int64_t>(n)); }
+            void addBytesRead(int64_t n) { bytesRead_.add(n); }
+            void addBytesWritten(int64_t n) { bytesWritten_.add(n); }
+            void addBytesSentFile(int64_t n) { bytesSentFile_.add(n); }
+            void setChannels(size_t n) { channels_.set(static_cast<int64_t>(n)); }
+            void recordFunctors(size_t depth)
+            {
+                functorsRun_.add(static_cast<int64_t>(depth));
+                functorQueueDepth_.record(static_cast<int64_t>(depth));
+            }
+            void recordIteration(int64_t micros) { iterationMicros_.record(micros); }
+            void recordPollWait(int64_t micros) { pollWaitMicros_.record(micros); }
+            void recordCallback(Channel::Type type, int64_t micros) { callbackMicros_[type].record(micros); }
+
+        private:
+            LoopCounter iterations_;
+            LoopCounter functorsRun_;
+            LoopCounter timersFired_;
+            LoopCounter bytesRead_;
+            LoopCounter bytesWritten_;
+            LoopCounter bytesSentFile_;
+            LoopCounter channels_;
+            LoopHistogram iterationMicros_;
+            LoopHistogram pollWaitMicros_;
+            LoopHistogram functorQueueDepth_;
+            LoopHistogram callbackMicros_[Channel::kNumChannelTypes];
+        };
+    }
+}
+
+#endif // MY_MUDUO_NET_LOOPMETRICS_H
@@ -34,6 +34,7 @@ namespace mymuduo
             virtual void updateChannel(Channel *channel) = 0;
 
             bool hasChannel(Channel *channel);
+            size_t numChannels() const { return channels_.size(); }
             void assertInLoopThread() const { ownerLoop_->assertInLoopThread(); }
             static Poller *newDefaultPoller(EventLoop *loop);
 
@@ -45,7 +45,6 @@ TcpClient::TcpClient(EventLoop *loop,
       nextConnId_(1)
 {
     connector_->setNewConnectionCallback(std::bind(&TcpClient::newConnection, this, _1));
-    // FIXME setConnectFailedCallback
     LOG_INFO << "TcpClient::TcpClient[" << name_ << "] - connector " << get_pointer(connector_);
 }
 
@@ -69,6 +68,9 @@ TcpClient::~TcpClient()
         {
             conn->forceClose();
         }
+        // 可能正处在 Connector 的回调之中，或者 Connector 还有排队的 resetChannel，
+        // 交给 EventLoop 延后释放
+        loop_->queueInLoop(std::bind(&detail::removeConnector, connector_));
     }
     else
     {
@@ -78,6 +80,11 @@ TcpClient::~TcpClient()
     }
 }
 
+void TcpClient::setConnectFailedCallback(const std::function<void()> &cb)
+{
+    connector_->setConnectFailedCallback(cb);
+}
+
 void TcpClient::connect()
 {
     // FIXME: check state
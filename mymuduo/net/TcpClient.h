@@ -60,6 +60,11 @@ namespace mymuduo
             void setConnectionCallback(ConnectionCallback cb) { connectionCallback_ = std::move(cb); }
             void setMessageCallback(MessageCallback cb) { messageCallback_ = std::move(cb); }
             void setWriteCompleteCallback(WriteCompleteCallback cb) { writeCompleteCallback_ = std::move(cb); }
+            /**
+             * 连接失败时回调，设置后不再自动重试。回调可能在 connect() 中同步发生，
+             * 不要在回调中析构 TcpClient
+             */
+            void setConnectFailedCallback(const std::function<void()> &cb);
         };
     }
 }
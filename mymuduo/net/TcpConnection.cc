@@ -1,16 +1,53 @@
 #include "mymuduo/net/TcpConnection.h"
 
 #include "mymuduo/base/Logging.h"
+#include "mymuduo/base/ThreadPool.h"
 #include "mymuduo/net/SocketsOps.h"
 #include "mymuduo/net/EventLoop.h"
 #include "mymuduo/net/Channel.h"
 #include "mymuduo/net/Socket.h"
 
+#include <fcntl.h>
+#include <linux/errqueue.h>
+#include <netinet/in.h>
 #include <sys/sendfile.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <vector>
 
 using namespace mymuduo;
 using namespace mymuduo::net;
 
+namespace
+{
+    const size_t kDefaultMaxWriteBytes = 256 * 1024;
+    // 每次检查页缓存的范围，连续发送时大约每 1MB 做一次 mmap + mincore
+    const size_t kResidencyWindow = 1024 * 1024;
+    const int64_t kFileStallMicros = 1000;
+    // 限速时每次至少攒够这么多令牌再发送，避免大量很小的写
+    const size_t kMinThrottledWrite = 16 * 1024;
+    const double kMinThrottleDelay = 0.001;
+    // 隧道模式的 pipe 容量，设置失败时使用内核默认的 64KB
+    const int kSplicePipeSize = 256 * 1024;
+    // 收到这么多完成通知之后，内核拷贝的比例超过一半就改回普通发送
+    const int64_t kZeroCopyProbe = 16;
+
+    // 统计耗时过长的 sendfile，它们通常是在等待磁盘
+    ssize_t timedSendfile(EventLoop *loop, int outFd, int inFd, off_t *offset, size_t count)
+    {
+        int64_t start = Timestamp::now().microSecondsSinceEpoch();
+        ssize_t n = ::sendfile(outFd, inFd, offset, count);
+        int savedErrno = errno;
+        int64_t used = Timestamp::now().microSecondsSinceEpoch() - start;
+        if (used >= kFileStallMicros)
+        {
+            loop->countFileSendStall(used);
+        }
+        errno = savedErrno;
+        return n;
+    }
+}
+
 void mymuduo::net::defaultConnectionCallback(const TcpConnectionPtr &conn)
 {
     LOG_TRACE << conn->localAddr().toIpPort() << " -> "
@@ -29,15 +66,33 @@ TcpConnection::TcpConnection(EventLoop *loop, std::string &name,
     : loop_(loop),
       name_(name),
       state_(kConnecting),
+      reading_(true),
       inputBuffer_(),
-      sendFd_(-1),
-      sendLen_(0),
       socket_(new Socket(sockfd)),
       channel_(new Channel(loop_, sockfd)),
       localAddr_(localAddr),
       peerAddr_(peerAddr),
-      highWaterMark_(64 * 1024 * 1024)
+      highWaterMark_(64 * 1024 * 1024),
+      inputHighWaterMark_(0),
+      maxWriteBytes_(kDefaultMaxWriteBytes),
+      fileReadPool_(NULL),
+      filePrefetching_(false),
+      throttled_(false),
+      splicing_(false),
+      spliceEof_(false),
+      splicePaused_(false),
+      splicedBytes_(0),
+      zeroCopyThreshold_(0),
+      zeroCopyEnabled_(false),
+      zeroCopyNextId_(0),
+      zeroCopySends_(0),
+      zeroCopyCompleted_(0),
+      zeroCopyCopied_(0),
+      coalescing_(false),
+      flushScheduled_(false),
+      writeSyscalls_(0)
 {
+    channel_->setType(Channel::kConnectionChannel);
     channel_->setReadCallback(std::bind(&TcpConnection::handleRead, this, _1));
     channel_->setWriteCallback(std::bind(&TcpConnection::handleWrite, this));
     channel_->setCloseCallback(std::bind(&TcpConnection::handleClose, this));
@@ -75,10 +130,28 @@ void TcpConnection::handleRead(Timestamp receiveTime)
     将来的一个改进措施是：
         如果n == writable＋sizeof extrabuf，就再读一次
     */
+    if (splicing_)
+    {
+        TcpConnectionPtr target(spliceTarget_.lock());
+        if (target && target->state_ != kDisconnected)
+        {
+            handleSpliceRead(target);
+            return;
+        }
+        // 对端已经断开，回到 Buffer 路径
+        splicing_ = false;
+        spliceTarget_.reset();
+    }
     ssize_t n = inputBuffer_.readFd(channel_->fd(), &savedErrno);
     if (n > 0)
     {
+        loop_->metrics().addBytesRead(n);
         messageCallback_(shared_from_this(), &inputBuffer_, receiveTime);
+        if (inputHighWaterMark_ > 0 && inputBuffer_.readableBytes() >= inputHighWaterMark_ && reading_)
+        {
+            LOG_DEBUG << name_ << " input backlog " << inputBuffer_.readableBytes() << " bytes, stop reading";
+            stopReadInLoop();
+        }
     }
     else if (n == 0)
     {
@@ -93,80 +166,410 @@ void TcpConnection::handleRead(Timestamp receiveTime)
     }
 }
 
+/**
+ * 发送队列依次为 outputBuffer_、第一个文件、它的 trailer、第二个文件……
+ * 只有队首发送完毕才轮到下一段，保证与调用 send()/sendFile() 的顺序一致。
+ *
+ * 每次可写事件最多发送 maxWriteBytes_ 字节，用完后即返回，剩余的数据等下一轮。
+ * Poller 是水平触发的，仍然可写的连接在下一轮会再次就绪，而 epoll 把刚报告过的 fd
+ * 放回就绪队列的末尾，因此同一个 IO 线程上所有待发送的连接轮流各发送一份配额，
+ * 大文件传输不会让其他连接饿死
+ */
 void TcpConnection::handleWrite()
 {
     loop_->assertInLoopThread();
-    // 需要同时处理 sendBuffer 和 sendFile
-    // 由于在 http 连接流程中，sendFile 前可能有 buffer 数据还在 socket缓冲区
-    // 而发送 buffer 数据时，file 数据一定已经被对方接收了
-    // 所以优先处理 buffer 数据的发送
-    if (channel_->isWriting())
+    if (!channel_->isWriting())
+    {
+        LOG_TRACE << "Connection fd = " << channel_->fd()
+                  << " is down, no more writing";
+        return;
+    }
+    flushOutput();
+}
+
+void TcpConnection::flushOutput()
+{
+    size_t limit = maxWriteBytes_;
+    if (rateLimited())
     {
-        if (outputBuffer_.readableBytes())
+        size_t allowance = rateAllowance();
+        if (allowance == 0)
+        {
+            throttle();
+            return;
+        }
+        limit = std::min(limit, allowance);
+    }
+    size_t written = writeQueued(limit);
+    if (written > 0 && rateLimited())
+    {
+        chargeRate(written);
+    }
+    // 出错断开，或者开始等待预读、等待队首文件的令牌
+    if (state_ == kDisconnected || filePrefetching_ || throttled_)
+    {
+        return;
+    }
+    if (outputBuffer_.readableBytes() == 0 && pendingSegments_.empty() && splicePipeBytes() == 0)
+    {
+        writeCompleted();
+    }
+    else if (!channel_->isWriting())
+    {
+        channel_->enableWriting();
+    }
+}
+
+/**
+ * 合并写模式下本轮循环中排队的数据在这里写出。已经在等待可写事件时交给 handleWrite()，
+ * 预读或限速暂停期间由 filePrefetched()/unthrottle() 重新安排
+ */
+void TcpConnection::flushCoalesced()
+{
+    flushScheduled_ = false;
+    if (state_ == kDisconnected || channel_->isWriting() || throttled_ || filePrefetching_)
+    {
+        return;
+    }
+    flushOutput();
+}
+
+size_t TcpConnection::writeQueued(size_t limit)
+{
+    size_t budget = limit;
+    while (budget > 0)
+    {
+        if (outputBuffer_.readableBytes() || (!pendingSegments_.empty() && pendingSegments_.front().owner))
         {
             // 如果第一次write(2)没有能够发送完全部数据的话，第二次调用write(2)几乎肯定会返回EAGAIN。
             // 在非阻塞模式下调用了阻塞操作，在该操作没有完成就返回这个错误，
             // 这个错误不会破坏socket的同步，不用管它，下次循环接着recv就可以。对非阻塞socket而言，EAGAIN不是一种错误
             // 因此muduo决定节省一次系统调用，这么做不影响程序的正确性，却能降低延迟
-            ssize_t n = ::write(channel_->fd(), outputBuffer_.peek(), outputBuffer_.readableBytes());
-            if (n > 0)
+            size_t want = 0;
+            ssize_t n = writeGathered(budget, &want);
+            if (n <= 0)
+            {
+                // 一旦发生错误，handleRead()会读到0字节，继而关闭连接
+                if (n < 0 && errno != EAGAIN)
+                    LOG_SYSERR << "TcpConnection::handleWrite";
+                break;
+            }
+            budget -= static_cast<size_t>(n);
+            if (static_cast<size_t>(n) < want)
+                break; // 内核发送缓冲区已满
+        }
+        else if (!pendingSegments_.empty())
+        {
+            PendingSegment &pending = pendingSegments_.front();
+            size_t want = std::min(pending.remaining, budget);
+            if (pending.limiter)
             {
-                outputBuffer_.retrieve(n);
-                if (outputBuffer_.readableBytes() == 0 && sendLen_ == 0)
+                // 文件自己的限速只在它位于队首时生效
+                want = std::min(want, pending.limiter->available());
+                if (want == 0)
                 {
-                    // 一旦发送完毕，立刻停止观察writable事件，避免busy loop
-                    channel_->disableWriting();
-                    if (writeCompleteCallback_)
-                    {
-                        loop_->queueInLoop(std::bind(writeCompleteCallback_, shared_from_this()));
-                    }
-                    // 该状态表示连接需要关闭，但是还未写完数据，因此写端在此关闭
-                    if (state_ == kDisconnecting)
-                    {
-                        shutdownInLoop();
-                    }
+                    throttle();
+                    break;
                 }
             }
-            else
+            if (fileReadPool_ && !frontFileResident(want))
             {
-                // 一旦发生错误，handleRead()会读到0字节，继而关闭连接
-                LOG_SYSERR << "TcpConnection::handleWrite";
+                // 数据读入页缓存之后 filePrefetched() 会重新打开可写事件
+                channel_->disableWriting();
+                break;
             }
-        }
-        else
-        {
-            ssize_t n = ::sendfile(socket_->fd(), sendFd_, NULL, sendLen_);
+            ssize_t n = timedSendfile(loop_, socket_->fd(), pending.file->fd(), &pending.offset, want);
+            ++writeSyscalls_;
             if (n > 0)
             {
-                sendLen_ -= n;
-                if (sendLen_ == 0)
+                loop_->metrics().addBytesSentFile(n);
+                pending.remaining -= static_cast<size_t>(n);
+                budget -= static_cast<size_t>(n);
+                if (pending.limiter)
+                    pending.limiter->consume(static_cast<size_t>(n));
+                if (pending.remaining == 0)
+                {
+                    // 文件之后的数据成为新的队首
+                    outputBuffer_.swap(pending.trailer);
+                    pendingSegments_.pop_front();
+                }
+                else if (static_cast<size_t>(n) < want)
                 {
-                    channel_->disableWriting();
-                    ::close(sendFd_);
-                    sendFd_ = -1;
-                    if (state_ == kDisconnecting)
-                    {
-                        shutdownInLoop();
-                    }
+                    break;
                 }
             }
+            else if (n < 0 && errno == EAGAIN)
+            {
+                // 对端窗口已满，等待下一次可写
+                break;
+            }
             else
             {
-
+                // 出错或文件被截断，响应已经无法完整发送，只能断开连接
                 LOG_SYSERR << "TcpConnection::handleWrite send file len = "
-                           << n << " remain len = " << sendLen_;
-                ::close(sendFd_);
-                sendFd_ = -1;
-                sendLen_ = 0;
-                channel_->disableWriting();
+                           << n << " remain len = " << pending.remaining;
+                pendingSegments_.clear();
+                outputBuffer_.retrieveAll();
+                forceCloseInLoop();
+                break;
             }
         }
+        else if (splicePipeBytes() > 0)
+        {
+            // 隧道对端写入 pipe 的数据，从 pipe 直接搬到 socket
+            size_t want = std::min(splicePipe_->bytes, budget);
+            ssize_t n = ::splice(splicePipe_->fds[0], NULL, channel_->fd(), NULL, want,
+                                 SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            ++writeSyscalls_;
+            if (n <= 0)
+            {
+                if (n < 0 && errno != EAGAIN)
+                    LOG_SYSERR << "TcpConnection::handleWrite splice";
+                break;
+            }
+            splicePipe_->bytes -= static_cast<size_t>(n);
+            splicedBytes_ += n;
+            budget -= static_cast<size_t>(n);
+            spliceDrained();
+            if (static_cast<size_t>(n) < want)
+                break;
+        }
+        else
+        {
+            break;
+        }
+    }
+    loop_->metrics().addBytesWritten(static_cast<int64_t>(limit - budget));
+    return limit - budget;
+}
+
+/**
+ * iovec 依次是 outputBuffer_、队首的共享数据、它的 trailer、下一段共享数据……直到遇到文件。
+ * 写出之后按同样的顺序消耗，共享数据只前移偏移量，发送完毕时释放引用
+ */
+ssize_t TcpConnection::writeGathered(size_t limit, size_t *want)
+{
+    if (zeroCopyThreshold_ > 0 && outputBuffer_.readableBytes() == 0 && pendingSegments_.front().owner &&
+        pendingSegments_.front().remaining >= zeroCopyThreshold_)
+    {
+        // 大块的共享数据单独零拷贝发送，不与需要拷贝的 Buffer 合并
+        PendingSegment &segment = pendingSegments_.front();
+        *want = std::min(segment.remaining, limit);
+        ssize_t n = sendZeroCopy(segment.data + segment.offset, *want, segment.owner);
+        if (n > 0)
+        {
+            segment.offset += static_cast<off_t>(n);
+            segment.remaining -= static_cast<size_t>(n);
+            if (segment.remaining == 0)
+            {
+                outputBuffer_.swap(segment.trailer);
+                pendingSegments_.pop_front();
+            }
+        }
+        return n;
+    }
+
+    const int kMaxIov = 16;
+    struct iovec vec[kMaxIov];
+    int count = 0;
+    size_t total = 0;
+    auto add = [&vec, &count, &total, limit](const char *data, size_t len) {
+        if (len > 0 && count < kMaxIov && total < limit)
+        {
+            len = std::min(len, limit - total);
+            vec[count].iov_base = const_cast<char *>(data);
+            vec[count].iov_len = len;
+            ++count;
+            total += len;
+        }
+    };
+    add(outputBuffer_.peek(), outputBuffer_.readableBytes());
+    PendingSegment *nextFile = NULL;
+    for (PendingSegment &segment : pendingSegments_)
+    {
+        if (segment.file)
+        {
+            nextFile = &segment;
+            break;
+        }
+        // 需要零拷贝发送的大段留给下一次单独发送
+        if (zeroCopyThreshold_ > 0 && segment.remaining >= zeroCopyThreshold_)
+            break;
+        add(segment.data + segment.offset, segment.remaining);
+        add(segment.trailer.peek(), segment.trailer.readableBytes());
+    }
+    *want = total;
+    ssize_t n;
+    if (coalescing_ && nextFile && total < limit && count < kMaxIov &&
+        fileSendableNow(nextFile, limit - total))
+    {
+        // 首部之后紧跟着本轮就能发出的 sendfile：MSG_MORE 让内核暂不发出不满一个报文段的首部，与文件数据一起发送。
+        // 文件还要等待预读或令牌时不能这样做，否则首部要等到内核的 cork 超时（约 200ms）才发出
+        struct msghdr msg;
+        memZero(&msg, sizeof msg);
+        msg.msg_iov = vec;
+        msg.msg_iovlen = static_cast<size_t>(count);
+        n = ::sendmsg(channel_->fd(), &msg, MSG_MORE);
     }
     else
     {
-        LOG_TRACE << "Connection fd = " << channel_->fd()
-                  << " is down, no more writing";
+        n = count == 1 ? ::write(channel_->fd(), vec[0].iov_base, vec[0].iov_len)
+                       : sockets::writev(channel_->fd(), vec, count);
+    }
+    ++writeSyscalls_;
+    if (n <= 0)
+    {
+        return n;
+    }
+
+    size_t left = static_cast<size_t>(n);
+    size_t taken = std::min(left, outputBuffer_.readableBytes());
+    outputBuffer_.retrieve(taken);
+    left -= taken;
+    while (outputBuffer_.readableBytes() == 0 && !pendingSegments_.empty() && pendingSegments_.front().owner)
+    {
+        PendingSegment &segment = pendingSegments_.front();
+        taken = std::min(left, segment.remaining);
+        segment.offset += static_cast<off_t>(taken);
+        segment.remaining -= taken;
+        left -= taken;
+        if (segment.remaining > 0)
+            break;
+        // 共享数据之后的 trailer 成为新的队首
+        outputBuffer_.swap(segment.trailer);
+        pendingSegments_.pop_front();
+        taken = std::min(left, outputBuffer_.readableBytes());
+        outputBuffer_.retrieve(taken);
+        left -= taken;
+    }
+    return n;
+}
+
+size_t TcpConnection::rateAllowance() const
+{
+    size_t allowance = SIZE_MAX;
+    for (const TokenBucketPtr &bucket : rateLimiters_)
+    {
+        allowance = std::min(allowance, bucket->available());
+    }
+    return allowance;
+}
+
+void TcpConnection::chargeRate(size_t bytes)
+{
+    for (const TokenBucketPtr &bucket : rateLimiters_)
+    {
+        bucket->consume(bytes);
+    }
+}
+
+TokenBucket *TcpConnection::frontLimiter() const
+{
+    if (outputBuffer_.readableBytes() == 0 && !pendingSegments_.empty() && pendingSegments_.front().file)
+    {
+        return pendingSegments_.front().limiter.get();
     }
+    return NULL;
+}
+
+/**
+ * 令牌不足时停止观察可写事件，用定时器在令牌足够发送一小段数据时恢复，
+ * 不会因为等待令牌而在可写事件上空转
+ */
+void TcpConnection::throttle()
+{
+    const size_t chunk = std::min(maxWriteBytes_, kMinThrottledWrite);
+    TokenBucket *limiter = frontLimiter();
+    double delay = limiter ? limiter->waitTime(chunk) : 0.0;
+    for (const TokenBucketPtr &bucket : rateLimiters_)
+    {
+        delay = std::max(delay, bucket->waitTime(chunk));
+    }
+    channel_->disableWriting();
+    throttled_ = true;
+    std::weak_ptr<TcpConnection> weakConn(shared_from_this());
+    loop_->runAfter(std::max(delay, kMinThrottleDelay), [weakConn] {
+        TcpConnectionPtr conn(weakConn.lock());
+        if (conn)
+            conn->unthrottle();
+    });
+}
+
+void TcpConnection::unthrottle()
+{
+    throttled_ = false;
+    if (state_ != kDisconnected && (outputBuffer_.readableBytes() > 0 || !pendingSegments_.empty() ||
+                                    splicePipeBytes() > 0))
+    {
+        startWriting();
+    }
+}
+
+void TcpConnection::startWriting()
+{
+    if (!channel_->isWriting() && !throttled_ && !filePrefetching_)
+    {
+        if (!coalescing_)
+        {
+            channel_->enableWriting();
+        }
+        else if (!flushScheduled_)
+        {
+            // 在 IO 线程中排队的回调在本轮处理完就绪事件之后执行，此前的 send() 都会合并进来
+            flushScheduled_ = true;
+            loop_->queueInLoop(std::bind(&TcpConnection::flushCoalesced, shared_from_this()));
+        }
+    }
+}
+
+bool TcpConnection::canWriteDirectly() const
+{
+    return !coalescing_ && !channel_->isWriting() && !throttled_ && !filePrefetching_ && !rateLimited() &&
+           outputBuffer_.readableBytes() == 0 && pendingSegments_.empty() && splicePipeBytes() == 0;
+}
+
+void TcpConnection::setRateLimiters(const std::vector<TokenBucketPtr> &buckets)
+{
+    loop_->assertInLoopThread();
+    rateLimiters_ = buckets;
+}
+
+// 发送队列清空，立刻停止观察writable事件，避免busy loop
+void TcpConnection::writeCompleted()
+{
+    if (channel_->isWriting())
+    {
+        channel_->disableWriting();
+    }
+    if (writeCompleteCallback_)
+    {
+        loop_->queueInLoop(std::bind(writeCompleteCallback_, shared_from_this()));
+    }
+    // 该状态表示连接需要关闭，但是还未写完数据，因此写端在此关闭
+    if (state_ == kDisconnecting)
+    {
+        shutdownInLoop();
+    }
+}
+
+void TcpConnection::appendOutput(const char *data, size_t len)
+{
+    if (pendingSegments_.empty())
+        outputBuffer_.append(data, len);
+    else
+        pendingSegments_.back().trailer.append(data, len);
+}
+
+size_t TcpConnection::queuedBytes() const
+{
+    size_t n = outputBuffer_.readableBytes();
+    for (const PendingSegment &pending : pendingSegments_)
+    {
+        n += pending.trailer.readableBytes();
+        if (pending.owner)
+            n += pending.remaining;
+    }
+    return n + splicePipeBytes();
 }
 
 /**
@@ -182,6 +585,14 @@ void TcpConnection::handleClose()
     channel_->disableAll();
 
     TcpConnectionPtr guardThis(shared_from_this());
+    if (splicePipe_)
+    {
+        // pipe 中的数据已经无法送达，让暂停的源连接继续读取，它会发现本连接已断开
+        splicePipe_->bytes = 0;
+        TcpConnectionPtr source(splicePipe_->source.lock());
+        if (source)
+            source->resumeSpliceRead();
+    }
     connectionCallback_(guardThis);
     // must be the last line
     closeCallback_(guardThis);
@@ -189,11 +600,117 @@ void TcpConnection::handleClose()
 
 void TcpConnection::handleError()
 {
+    // 零拷贝的完成通知同样以 POLLERR 报告
+    if (zeroCopyEnabled_ && readZeroCopyCompletions())
+    {
+        return;
+    }
     int err = sockets::getSocketError(channel_->fd());
     LOG_ERROR << "TcpConnection::handleError [" << name_
               << "] - SO_ERROR = " << err << " " << strerror_tl(err);
 }
 
+bool TcpConnection::setZeroCopyThreshold(size_t bytes)
+{
+    loop_->assertInLoopThread();
+    if (bytes > 0 && !zeroCopyEnabled_)
+    {
+        int on = 1;
+        if (::setsockopt(socket_->fd(), SOL_SOCKET, SO_ZEROCOPY, &on, static_cast<socklen_t>(sizeof on)) < 0)
+        {
+            LOG_SYSERR << "TcpConnection::setZeroCopyThreshold [" << name_ << "]";
+            return false;
+        }
+        zeroCopyEnabled_ = true;
+    }
+    zeroCopyThreshold_ = bytes;
+    return true;
+}
+
+double TcpConnection::zeroCopyHitRatio() const
+{
+    if (zeroCopyCompleted_ == 0)
+        return 0.0;
+    return static_cast<double>(zeroCopyCompleted_ - zeroCopyCopied_) / static_cast<double>(zeroCopyCompleted_);
+}
+
+ssize_t TcpConnection::sendZeroCopy(const char *data, size_t len, const std::shared_ptr<const void> &owner)
+{
+    struct iovec vec;
+    vec.iov_base = const_cast<char *>(data);
+    vec.iov_len = len;
+    struct msghdr msg;
+    memZero(&msg, sizeof msg);
+    msg.msg_iov = &vec;
+    msg.msg_iovlen = 1;
+    ssize_t n = ::sendmsg(channel_->fd(), &msg, MSG_ZEROCOPY);
+    ++writeSyscalls_;
+    if (n < 0 && errno == ENOBUFS)
+    {
+        // 超过了 optmem 的限制，这一次普通发送
+        ++writeSyscalls_;
+        return ::write(channel_->fd(), vec.iov_base, len);
+    }
+    if (n >= 0)
+    {
+        // 每次成功的 sendmsg 占用一个序号，完成通知按序号区间报告
+        zeroCopyPending_.push_back(std::make_pair(zeroCopyNextId_++, owner));
+        ++zeroCopySends_;
+    }
+    return n;
+}
+
+bool TcpConnection::readZeroCopyCompletions()
+{
+    bool got = false;
+    while (true)
+    {
+        char control[128];
+        struct msghdr msg;
+        memZero(&msg, sizeof msg);
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof control;
+        if (::recvmsg(channel_->fd(), &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+        {
+            break;
+        }
+        got = true;
+        for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm != NULL; cm = CMSG_NXTHDR(&msg, cm))
+        {
+            if (!(cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) &&
+                !(cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR))
+            {
+                continue;
+            }
+            struct sock_extended_err err;
+            ::memcpy(&err, CMSG_DATA(cm), sizeof err);
+            if (err.ee_errno != 0 || err.ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+            {
+                continue;
+            }
+            // [ee_info, ee_data] 区间内的发送都已完成，可以释放对应的共享数据
+            uint32_t last = err.ee_data;
+            int64_t count = static_cast<int64_t>(err.ee_data - err.ee_info) + 1;
+            zeroCopyCompleted_ += count;
+            if (err.ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+            {
+                zeroCopyCopied_ += count;
+            }
+            while (!zeroCopyPending_.empty() && static_cast<int32_t>(last - zeroCopyPending_.front().first) >= 0)
+            {
+                zeroCopyPending_.pop_front();
+            }
+        }
+    }
+    if (zeroCopyThreshold_ > 0 && zeroCopyCompleted_ >= kZeroCopyProbe && zeroCopyHitRatio() < 0.5)
+    {
+        LOG_DEBUG << "TcpConnection::readZeroCopyCompletions [" << name_ << "] kernel copied "
+                  << zeroCopyCopied_ << " of " << zeroCopyCompleted_ << ", zero copy disabled";
+        zeroCopyThreshold_ = 0;
+    }
+    return got;
+}
+
 void TcpConnection::connectEstablished()
 {
     loop_->assertInLoopThread();
@@ -235,10 +752,77 @@ void TcpConnection::shutdown()
 void TcpConnection::shutdownInLoop()
 {
     loop_->assertInLoopThread();
-    if (!channel_->isWriting())
+    // 预读或限速期间暂时关闭了可写事件，但数据还没有发送完
+    if (!channel_->isWriting() && !filePrefetching_ && !throttled_ && !flushScheduled_)
     {
         socket_->shutdownWrite();
+        // 隧道模式下读方向已经结束，两个方向都完成了
+        if (spliceEof_ && state_ != kDisconnected)
+        {
+            handleClose();
+        }
+    }
+}
+
+bool TcpConnection::fileResident(PendingSegment *pending, size_t want)
+{
+    if (pending->offset + static_cast<off_t>(want) <= pending->residentEnd)
+        return true;
+    size_t len = std::min(pending->remaining, std::max(want, kResidencyWindow));
+    if (pending->file->isResident(pending->offset, len))
+    {
+        pending->residentEnd = pending->offset + static_cast<off_t>(len);
+        return true;
     }
+    return false;
+}
+
+bool TcpConnection::fileSendableNow(PendingSegment *pending, size_t budget)
+{
+    if (pending->limiter && pending->limiter->available() == 0)
+        return false;
+    return !fileReadPool_ || (!filePrefetching_ && fileResident(pending, std::min(pending->remaining, budget)));
+}
+
+bool TcpConnection::frontFileResident(size_t want)
+{
+    PendingSegment &pending = pendingSegments_.front();
+    if (filePrefetching_)
+        return false;
+    if (fileResident(&pending, want))
+        return true;
+
+    size_t len = std::min(pending.remaining, std::max(want, kResidencyWindow));
+    off_t end = pending.offset + static_cast<off_t>(len);
+
+    // 连接在预读完成前关闭时，回调中的 weak_ptr 失效，结果直接丢弃
+    loop_->countColdFileRead();
+    filePrefetching_ = true;
+    std::weak_ptr<TcpConnection> weakConn(shared_from_this());
+    FileHandlePtr file = pending.file;
+    off_t offset = pending.offset;
+    EventLoop *loop = loop_;
+    fileReadPool_->run([weakConn, file, offset, len, end, loop] {
+        file->readIntoPageCache(offset, len);
+        loop->queueInLoop([weakConn, end] {
+            TcpConnectionPtr conn(weakConn.lock());
+            if (conn)
+                conn->filePrefetched(end);
+        });
+    });
+    return false;
+}
+
+void TcpConnection::filePrefetched(off_t end)
+{
+    loop_->assertInLoopThread();
+    filePrefetching_ = false;
+    if (state_ == kDisconnected || pendingSegments_.empty() || !pendingSegments_.front().file)
+        return;
+    // 即使预读没有读满（比如文件被截断）也不再检查这一段，由 sendfile 报告错误，避免反复预读
+    PendingSegment &pending = pendingSegments_.front();
+    pending.residentEnd = std::max(pending.residentEnd, end);
+    startWriting();
 }
 
 void TcpConnection::forceClose()
@@ -261,59 +845,294 @@ void TcpConnection::forceCloseInLoop()
     }
 }
 
+void TcpConnection::startRead()
+{
+    loop_->runInLoop(std::bind(&TcpConnection::startReadInLoop, shared_from_this()));
+}
+
+void TcpConnection::startReadInLoop()
+{
+    loop_->assertInLoopThread();
+    if (state_ == kDisconnected)
+    {
+        return;
+    }
+    if (!reading_ || !channel_->isReading())
+    {
+        channel_->enableReading();
+        // 隧道模式自己的暂停与恢复不通知
+        if (!reading_ && !splicing_ && readResumeCallback_)
+        {
+            loop_->queueInLoop(std::bind(readResumeCallback_, shared_from_this()));
+        }
+        reading_ = true;
+    }
+}
+
+void TcpConnection::stopRead()
+{
+    loop_->runInLoop(std::bind(&TcpConnection::stopReadInLoop, shared_from_this()));
+}
+
+void TcpConnection::stopReadInLoop()
+{
+    loop_->assertInLoopThread();
+    if (state_ == kDisconnected)
+    {
+        return;
+    }
+    if (reading_ || channel_->isReading())
+    {
+        channel_->disableReading();
+        reading_ = false;
+    }
+}
+
+TcpConnection::SplicePipe::SplicePipe()
+    : bytes(0),
+      capacity(0),
+      eof(false)
+{
+    if (::pipe2(fds, O_NONBLOCK | O_CLOEXEC) < 0)
+    {
+        LOG_SYSERR << "TcpConnection::SplicePipe pipe2";
+        fds[0] = fds[1] = -1;
+        return;
+    }
+    ::fcntl(fds[1], F_SETPIPE_SZ, kSplicePipeSize);
+    int size = ::fcntl(fds[1], F_GETPIPE_SZ);
+    capacity = size > 0 ? static_cast<size_t>(size) : 64 * 1024;
+}
+
+TcpConnection::SplicePipe::~SplicePipe()
+{
+    if (fds[0] >= 0)
+    {
+        ::close(fds[0]);
+        ::close(fds[1]);
+    }
+}
+
+void TcpConnection::startSplice(const TcpConnectionPtr &peer)
+{
+    loop_->runInLoop(std::bind(&TcpConnection::startSpliceInLoop, shared_from_this(), peer));
+}
+
+void TcpConnection::startSpliceInLoop(const TcpConnectionPtr &peer)
+{
+    loop_->assertInLoopThread();
+    if (peer->getLoop() != loop_)
+    {
+        LOG_ERROR << "TcpConnection::startSplice [" << name_ << "] peer " << peer->name()
+                  << " belongs to another EventLoop";
+        return;
+    }
+    if (state_ == kDisconnected || peer->state_ == kDisconnected)
+    {
+        return;
+    }
+    if (!peer->splicePipe_)
+    {
+        std::unique_ptr<SplicePipe> pipe(new SplicePipe);
+        if (pipe->fds[0] < 0)
+        {
+            // 创建 pipe 失败，继续使用 Buffer 路径
+            return;
+        }
+        peer->splicePipe_.swap(pipe);
+    }
+    peer->splicePipe_->source = shared_from_this();
+    // 已经读入的数据先按原来的路径发出，排在 pipe 中的数据之前
+    if (inputBuffer_.readableBytes() > 0)
+    {
+        peer->send(&inputBuffer_);
+    }
+    spliceTarget_ = peer;
+    splicing_ = true;
+}
+
+void TcpConnection::stopSplice()
+{
+    loop_->runInLoop(std::bind(&TcpConnection::stopSpliceInLoop, shared_from_this()));
+}
+
+void TcpConnection::stopSpliceInLoop()
+{
+    loop_->assertInLoopThread();
+    if (!splicing_)
+    {
+        return;
+    }
+    splicing_ = false;
+    TcpConnectionPtr target(spliceTarget_.lock());
+    spliceTarget_.reset();
+    if (target && target->splicePipeBytes() > 0)
+    {
+        // pipe 排空时 spliceDrained() 恢复读取
+        pauseSpliceRead();
+    }
+}
+
+/**
+ * 用 splice 把 socket 中的数据搬进 target 的 pipe，target 空闲时立刻再搬到它的 socket，
+ * 数据只在内核的页之间移动。pipe 满时暂停读取，由 target 的 spliceDrained() 恢复
+ */
+void TcpConnection::handleSpliceRead(const TcpConnectionPtr &target)
+{
+    SplicePipe *pipe = target->splicePipe_.get();
+    if (pipe->bytes >= pipe->capacity)
+    {
+        pauseSpliceRead();
+        return;
+    }
+    ssize_t n = ::splice(channel_->fd(), NULL, pipe->fds[1], NULL, pipe->capacity - pipe->bytes,
+                         SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (n > 0)
+    {
+        loop_->metrics().addBytesRead(n);
+        bool direct = target->canWriteDirectly();
+        pipe->bytes += static_cast<size_t>(n);
+        if (direct)
+        {
+            target->writeQueued(target->maxWriteBytes_);
+        }
+        if (target->splicePipeBytes() > 0)
+        {
+            target->startWriting();
+        }
+        if (pipe->bytes >= pipe->capacity)
+        {
+            pauseSpliceRead();
+        }
+    }
+    else if (n == 0)
+    {
+        // 对端关闭了写端：pipe 排空后关闭 target 的写端，把半关闭传递过去
+        spliceEof_ = true;
+        splicePaused_ = false;
+        stopReadInLoop();
+        pipe->eof = true;
+        if (pipe->bytes == 0)
+        {
+            target->shutdown();
+        }
+        // 写端已经关闭时两个方向都结束了，否则由 shutdownInLoop() 在发送完毕后关闭连接
+        if (state_ == kDisconnecting && !channel_->isWriting() && !filePrefetching_ && !throttled_ &&
+            !flushScheduled_)
+        {
+            handleClose();
+        }
+    }
+    else if (errno == EAGAIN)
+    {
+        // socket 可读而 pipe 写不进去，说明 pipe 实际已满
+        if (pipe->bytes > 0)
+            pauseSpliceRead();
+    }
+    else
+    {
+        LOG_SYSERR << "TcpConnection::handleSpliceRead";
+        handleError();
+    }
+}
+
+void TcpConnection::spliceDrained()
+{
+    SplicePipe *pipe = splicePipe_.get();
+    TcpConnectionPtr source(pipe->source.lock());
+    if (source && (pipe->bytes == 0 || (source->splicing_ && pipe->bytes < pipe->capacity)))
+    {
+        source->resumeSpliceRead();
+    }
+    if (pipe->bytes == 0 && pipe->eof)
+    {
+        shutdown();
+    }
+}
+
+void TcpConnection::pauseSpliceRead()
+{
+    if (reading_)
+    {
+        stopReadInLoop();
+        splicePaused_ = true;
+    }
+}
+
+void TcpConnection::resumeSpliceRead()
+{
+    if (splicePaused_)
+    {
+        splicePaused_ = false;
+        if (!spliceEof_)
+            startReadInLoop();
+    }
+}
+
 void TcpConnection::sendFile(const int fd, const size_t count)
+{
+    off_t offset = ::lseek(fd, 0, SEEK_CUR);
+    sendFile(std::make_shared<FileHandle>(fd), offset < 0 ? 0 : offset, count);
+}
+
+void TcpConnection::sendFile(const FileHandlePtr &file, off_t offset, size_t count)
+{
+    sendFile(file, offset, count, TokenBucketPtr());
+}
+
+void TcpConnection::sendFile(const FileHandlePtr &file, off_t offset, size_t count, const TokenBucketPtr &limiter)
 {
     if (state_ == kConnected)
     {
-        this->sendFd_ = fd;
-        this->sendLen_ = count;
         if (loop_->isInLoopThread())
-            sendFileInLoop();
+            sendFileInLoop(file, offset, count, limiter);
         else
-            loop_->runInLoop(std::bind(&TcpConnection::sendFileInLoop, this));
+            loop_->runInLoop(std::bind(&TcpConnection::sendFileInLoop, this, file, offset, count, limiter));
     }
 }
 
-void TcpConnection::sendFileInLoop()
+void TcpConnection::sendFileInLoop(const FileHandlePtr &file, off_t offset, size_t count, const TokenBucketPtr &limiter)
 {
     loop_->assertInLoopThread();
-    ssize_t nwrote = 0;
     bool faultError = false;
     if (state_ == kDisconnected)
     {
         LOG_WARN << "disconnected, give up sending file";
         return;
     }
-    if (!channel_->isWriting() && outputBuffer_.readableBytes() == 0)
+    size_t remaining = count;
+    // 打开了预读或者文件自己限速时先排队，由 handleWrite 检查页缓存和令牌后再发送
+    if (!fileReadPool_ && !limiter && canWriteDirectly())
     {
-        // 没有在发缓冲区数据/文件数据时才可以发送
-        nwrote = ::sendfile(socket_->fd(), sendFd_, nullptr, sendLen_);
+        // 没有在发缓冲区数据/文件数据时才可以直接发送，同样最多发送一份配额，剩余部分交给 handleWrite
+        ssize_t nwrote = timedSendfile(loop_, socket_->fd(), file->fd(), &offset, std::min(remaining, maxWriteBytes_));
+        ++writeSyscalls_;
         if (nwrote >= 0)
         {
-            sendLen_ -= nwrote;
-            if (sendLen_ == 0)
-                ::close(sendFd_);
+            loop_->metrics().addBytesWritten(nwrote);
+            loop_->metrics().addBytesSentFile(nwrote);
+            remaining -= static_cast<size_t>(nwrote);
         }
-        else
+        else if (errno != EWOULDBLOCK)
         {
-            nwrote = 0;
-            if (errno != EWOULDBLOCK)
+            LOG_SYSERR << "TcpConnection::sendFileInLoop";
+            if (errno == EPIPE || errno == ECONNRESET) // FIXME: any others?
             {
-                LOG_SYSERR << "TcpConnection::sendFileInLoop";
-                if (errno == EPIPE || errno == ECONNRESET) // FIXME: any others?
-                {
-                    faultError = true;
-                }
+                faultError = true;
             }
         }
     }
-    if (!faultError && sendLen_ > 0)
+    if (!faultError && remaining > 0)
     {
-        if (!channel_->isWriting())
-        {
-            // 监听可写事件
-            channel_->enableWriting();
-        }
+        pendingSegments_.push_back(PendingSegment());
+        PendingSegment &pending = pendingSegments_.back();
+        pending.file = file;
+        pending.offset = offset;
+        pending.remaining = remaining;
+        pending.residentEnd = offset;
+        pending.limiter = limiter;
+        // 监听可写事件
+        startWriting();
     }
 }
 
@@ -333,7 +1152,6 @@ void TcpConnection::send(const std::string &message)
     }
 }
 
-// FIXME efficiency!!!
 void TcpConnection::send(Buffer *buf)
 {
     if (state_ == kConnected)
@@ -345,12 +1163,69 @@ void TcpConnection::send(Buffer *buf)
         }
         else
         {
-            void (TcpConnection::*fp)(const StringPiece &message) = &TcpConnection::sendInLoop;
-            loop_->runInLoop(
-                std::bind(fp,
-                          this, // FIXME
-                          buf->retrieveAllAsString()));
-            // std::forward<string>(message)));
+            // 交换出 buf 的内存交给 IO 线程，不再拷贝成 string
+            std::shared_ptr<Buffer> moved(std::make_shared<Buffer>());
+            moved->swap(*buf);
+            loop_->runInLoop([this, moved]() { sendInLoop(moved->peek(), moved->readableBytes()); });
+        }
+    }
+}
+
+void TcpConnection::send(const std::shared_ptr<const std::string> &payload)
+{
+    if (state_ == kConnected)
+    {
+        if (loop_->isInLoopThread())
+            sendPayloadInLoop(payload);
+        else
+            loop_->runInLoop(std::bind(&TcpConnection::sendPayloadInLoop, this, payload));
+    }
+}
+
+void TcpConnection::send(const std::vector<SendSegment> &segments)
+{
+    if (state_ == kConnected)
+    {
+        if (loop_->isInLoopThread())
+        {
+            sendSegmentsInLoop(segments.data(), segments.size());
+        }
+        else
+        {
+            // 没有 owner 的段在返回后可能失效，拷贝一份交给 IO 线程
+            std::shared_ptr<std::vector<SendSegment>> copy(std::make_shared<std::vector<SendSegment>>(segments));
+            for (SendSegment &segment : *copy)
+            {
+                if (!segment.owner)
+                {
+                    std::shared_ptr<const std::string> data(
+                        std::make_shared<const std::string>(static_cast<const char *>(segment.data), segment.len));
+                    segment.data = data->data();
+                    segment.owner = data;
+                }
+            }
+            loop_->runInLoop([this, copy]() { sendSegmentsInLoop(copy->data(), copy->size()); });
+        }
+    }
+}
+
+void TcpConnection::send(Buffer *buf, const std::shared_ptr<const std::string> &body)
+{
+    if (state_ == kConnected)
+    {
+        if (loop_->isInLoopThread())
+        {
+            sendInLoop(StringPiece(buf->peek(), static_cast<int>(buf->readableBytes())), body);
+            buf->retrieveAll();
+        }
+        else
+        {
+            // 同 send(Buffer*)，交换出首部的内存，不拷贝
+            std::shared_ptr<Buffer> moved(std::make_shared<Buffer>());
+            moved->swap(*buf);
+            loop_->runInLoop([this, moved, body]() {
+                sendInLoop(StringPiece(moved->peek(), static_cast<int>(moved->readableBytes())), body);
+            });
         }
     }
 }
@@ -382,12 +1257,14 @@ void TcpConnection::sendInLoop(const char *data, const size_t len)
         LOG_WARN << "disconnected, give up writing";
         return;
     }
-    if (!channel_->isWriting() && outputBuffer_.readableBytes() == 0)
+    if (canWriteDirectly())
     {
         // 没有在发数据
         nwrote = sockets::write(channel_->fd(), data, len);
+        ++writeSyscalls_;
         if (nwrote >= 0)
         {
+            loop_->metrics().addBytesWritten(nwrote);
             remaining = len - nwrote;
             if (remaining == 0 && writeCompleteCallback_)
             {
@@ -410,18 +1287,143 @@ void TcpConnection::sendInLoop(const char *data, const size_t len)
     assert(remaining <= len);
     if (!faultError && remaining > 0)
     {
-        size_t oldlen = outputBuffer_.readableBytes();
+        size_t oldlen = queuedBytes();
         if (oldlen + remaining >= highWaterMark_ && oldlen < highWaterMark_ && highWaterMarkCallback_)
         {
             loop_->queueInLoop(std::bind(highWaterMarkCallback_, shared_from_this(), oldlen + remaining));
         }
-        outputBuffer_.append(static_cast<const char *>(data) + nwrote, remaining);
-        if (!channel_->isWriting())
+        appendOutput(static_cast<const char *>(data) + nwrote, remaining);
+        // 监听可写事件
+        startWriting();
+    }
+}
+
+void TcpConnection::sendInLoop(const StringPiece &header, const std::shared_ptr<const std::string> &body)
+{
+    SendSegment segments[2] = {SendSegment(header.data(), static_cast<size_t>(header.size())),
+                               SendSegment(body->data(), body->size(), body)};
+    sendSegmentsInLoop(segments, 2);
+}
+
+void TcpConnection::sendPayloadInLoop(const std::shared_ptr<const std::string> &payload)
+{
+    SendSegment segment(payload->data(), payload->size(), payload);
+    sendSegmentsInLoop(&segment, 1);
+}
+
+/**
+ * 各段分别位于不同的内存，空闲时用一次 writev 写出，省去拼接的拷贝，
+ * 小响应也只占一次系统调用和一个 TCP 报文段。
+ * 没写完的部分依次排队：有 owner 的段按引用排队，其余拷贝到发送队列
+ */
+void TcpConnection::sendSegmentsInLoop(const SendSegment *segments, size_t count)
+{
+    loop_->assertInLoopThread();
+    if (state_ == kDisconnected)
+    {
+        LOG_WARN << "disconnected, give up writing";
+        return;
+    }
+    size_t total = 0;
+    bool zeroCopy = false;
+    for (size_t i = 0; i < count; ++i)
+    {
+        total += segments[i].len;
+        if (zeroCopyThreshold_ > 0 && segments[i].owner && segments[i].len >= zeroCopyThreshold_)
+            zeroCopy = true;
+    }
+    if (total == 0)
+    {
+        return;
+    }
+
+    size_t nwrote = 0;
+    bool direct = canWriteDirectly();
+    if (direct && !zeroCopy)
+    {
+        const int kMaxIov = 16;
+        struct iovec vec[kMaxIov];
+        int iovcnt = 0;
+        for (size_t i = 0; i < count && iovcnt < kMaxIov; ++i)
         {
-            // 监听可写事件
-            channel_->enableWriting();
+            if (segments[i].len == 0)
+                continue;
+            vec[iovcnt].iov_base = const_cast<void *>(segments[i].data);
+            vec[iovcnt].iov_len = segments[i].len;
+            ++iovcnt;
+        }
+        ssize_t n = iovcnt == 1 ? sockets::write(channel_->fd(), vec[0].iov_base, vec[0].iov_len)
+                                : sockets::writev(channel_->fd(), vec, iovcnt);
+        ++writeSyscalls_;
+        if (n >= 0)
+        {
+            loop_->metrics().addBytesWritten(n);
+            nwrote = static_cast<size_t>(n);
+            if (nwrote == total && writeCompleteCallback_)
+            {
+                loop_->queueInLoop(std::bind(writeCompleteCallback_, shared_from_this()));
+            }
+        }
+        else if (errno != EWOULDBLOCK)
+        {
+            LOG_SYSERR << "TcpConnection::sendInLoop";
+            if (errno == EPIPE || errno == ECONNRESET)
+            {
+                return;
+            }
+        }
+    }
+    if (nwrote == total)
+    {
+        return;
+    }
+
+    size_t oldlen = queuedBytes();
+    size_t remaining = total - nwrote;
+    if (oldlen + remaining >= highWaterMark_ && oldlen < highWaterMark_ && highWaterMarkCallback_)
+    {
+        loop_->queueInLoop(std::bind(highWaterMarkCallback_, shared_from_this(), oldlen + remaining));
+    }
+    size_t skip = nwrote;
+    for (size_t i = 0; i < count; ++i)
+    {
+        const SendSegment &segment = segments[i];
+        if (skip >= segment.len)
+        {
+            skip -= segment.len;
+            continue;
+        }
+        const char *data = static_cast<const char *>(segment.data) + skip;
+        size_t len = segment.len - skip;
+        skip = 0;
+        if (segment.owner)
+            queueShared(data, len, segment.owner);
+        else
+            appendOutput(data, len);
+    }
+    if (direct && zeroCopy)
+    {
+        // 拷贝的段用 writev 写出，大的共享段单独零拷贝发送
+        writeQueued(maxWriteBytes_);
+        if (outputBuffer_.readableBytes() == 0 && pendingSegments_.empty() && splicePipeBytes() == 0)
+        {
+            if (writeCompleteCallback_)
+                loop_->queueInLoop(std::bind(writeCompleteCallback_, shared_from_this()));
+            return;
         }
     }
+    startWriting();
+}
+
+void TcpConnection::queueShared(const char *data, size_t len, const std::shared_ptr<const void> &owner)
+{
+    pendingSegments_.push_back(PendingSegment());
+    PendingSegment &pending = pendingSegments_.back();
+    pending.owner = owner;
+    pending.data = data;
+    pending.offset = 0;
+    pending.remaining = len;
+    pending.residentEnd = 0;
 }
 
 /**
@@ -3,16 +3,23 @@
 
 #include "mymuduo/net/Buffer.h"
 #include "mymuduo/net/Callbacks.h"
+#include "mymuduo/net/FileHandle.h"
 #include "mymuduo/net/InetAddress.h"
+#include "mymuduo/net/TokenBucket.h"
 #include "mymuduo/base/noncopyable.h"
 #include "mymuduo/base/StringPiece.h"
 #include "mymuduo/base/Types.h"
 
 #include <boost/scoped_ptr.hpp>
 #include <boost/any.hpp>
+#include <deque>
+#include <memory>
+#include <vector>
 
 namespace mymuduo
 {
+    class ThreadPool;
+
     namespace net
     {
         class Socket;
@@ -20,6 +27,20 @@ namespace mymuduo
         class Channel;
         class EventLoop;
 
+        /**
+         * 聚集发送的一段数据。owner 不为空时，没有立即写出的部分按引用排队，owner 保证这段内存有效；
+         * owner 为空时 data 只在 send() 调用期间有效，没有写出的部分拷贝到发送队列
+         */
+        struct SendSegment
+        {
+            SendSegment(const void *d, size_t n) : data(d), len(n) {}
+            SendSegment(const void *d, size_t n, const std::shared_ptr<const void> &o) : data(d), len(n), owner(o) {}
+
+            const void *data;
+            size_t len;
+            std::shared_ptr<const void> owner;
+        };
+
         /**
          * TcpConnection是muduo里唯一默认使用shared_ptr来管理的class，
          * 也是唯一继承enable_shared_from_this的class，这源于其模糊的生命期
@@ -48,6 +69,40 @@ namespace mymuduo
                 highWaterMark_ = highWaterMark;
             }
             void setWriteCompleteCallback(const WriteCompleteCallback &cb) { writeCompleteCallback_ = cb; }
+            /**
+             * 输入侧的高水位：MessageCallback 返回后 inputBuffer_ 中仍有不少于 bytes 字节没有取走，
+             * 说明处理跟不上，自动暂停读取，数据留在内核接收缓冲区中，由 TCP 窗口把压力传回对端。
+             * 取走数据后调用 startRead() 恢复。0 表示不限制（默认）。只能在 IO 线程中调用
+             */
+            void setInputHighWaterMark(size_t bytes) { inputHighWaterMark_ = bytes; }
+            /// 暂停的读取（自动暂停或者 stopRead()）恢复时调用
+            void setReadResumeCallback(const ReadResumeCallback &cb) { readResumeCallback_ = cb; }
+            /**
+             * 每次可写事件最多发送的字节数，默认 256KB。
+             * 大文件分多轮发送，每轮之间 EventLoop 会处理其他就绪的连接，
+             * 避免一次 sendfile 占用 IO 线程太久而拖慢同一线程上的小请求
+             */
+            void setMaxWriteBytes(size_t bytes) { maxWriteBytes_ = bytes > 0 ? bytes : 1; }
+            /**
+             * 设置后，sendfile 之前先用 mincore 检查即将发送的部分是否在页缓存中，
+             * 不在时由 pool 的工作线程把数据读入页缓存，完成后才继续发送，
+             * 冷文件的磁盘读取不会阻塞 IO 线程。为空（默认）时直接 sendfile
+             */
+            void setFileReadPool(ThreadPool *pool) { fileReadPool_ = pool; }
+            ThreadPool *fileReadPool() const { return fileReadPool_; }
+            /**
+             * 合并写：开启后 send()/sendFile() 不再立即写 socket，只追加到发送队列，
+             * 在本轮事件循环处理完就绪事件之后统一写出一次。一个回调中多次的小 send
+             * 合并成一次 writev，首部之后紧跟本轮就能发出的文件数据时首部带 MSG_MORE 发出，与文件数据合成完整的报文段。
+             * 代价是数据晚一点点（同一轮循环之内）离开进程。只能在 IO 线程中调用
+             */
+            void setWriteCoalescing(bool on) { coalescing_ = on; }
+            /**
+             * 发送限速：outputBuffer_ 和 sendfile 发出的每个字节都要从 buckets 中的每个令牌桶取得令牌，
+             * 令牌不足时停止发送，由 EventLoop 的定时器在令牌足够时恢复。
+             * 令牌桶可以在多个连接之间共享，从而实现按客户端 IP 或全局的限速。只能在 IO 线程中调用
+             */
+            void setRateLimiters(const std::vector<TokenBucketPtr> &buckets);
 
             // context_ 目前主要用于存储 HttpContext
             void setContext(const boost::any &context) { context_ = context; }
@@ -58,18 +113,89 @@ namespace mymuduo
             void connectDestroyed();
             void send(const std::string &message);
             void send(Buffer *buf);
+            // 先发送 buf 再发送 body，两者用一次 writev 写出，body 以引用计数共享，跨线程时也不拷贝
+            void send(Buffer *buf, const std::shared_ptr<const std::string> &body);
+            /**
+             * 发送只读的共享数据。没有立即写完时按引用排队，不拷贝到 outputBuffer_，
+             * 之后与前后的数据一起用 writev 写出。同一份数据广播给大量连接时，所有连接共享一次分配。
+             * payload 在发送完毕或连接断开之前不能被修改
+             */
+            void send(const std::shared_ptr<const std::string> &payload);
+            /**
+             * 按顺序发送多段数据，空闲时用一次 writev 写出，不需要先拼接到一块内存。
+             * 只有没写完的部分才会被拷贝（没有 owner 的段）或保留引用（有 owner 的段）。
+             * 跨线程调用时没有 owner 的段会先拷贝一份
+             */
+            void send(const std::vector<SendSegment> &segments);
+            /**
+             * 不小于 bytes 的共享数据改用 MSG_ZEROCOPY 发送，内核直接从 payload 的内存发送，
+             * payload 的引用一直保留到内核在错误队列中报告发送完成。
+             * 完成通知显示内核大多仍在拷贝（比如发往本机回环）时自动改回普通发送。
+             * 0 表示关闭（默认）。只能在 IO 线程中调用，socket 不支持 SO_ZEROCOPY 时返回 false
+             */
+            bool setZeroCopyThreshold(size_t bytes);
+            /// 以 MSG_ZEROCOPY 发出的次数，只能在 IO 线程中访问
+            int64_t zeroCopySends() const { return zeroCopySends_; }
+            /// 已完成的零拷贝发送中内核没有拷贝的比例，没有完成通知时为 0，只能在 IO 线程中访问
+            double zeroCopyHitRatio() const;
+            /// 发送数据所用的系统调用次数（write/writev/sendmsg/sendfile/splice），只能在 IO 线程中访问
+            int64_t writeSyscalls() const { return writeSyscalls_; }
+            // 取得 fd 的所有权，从 fd 当前的文件偏移开始发送 count 字节
             void sendFile(const int fd, const size_t count);
+            // 从 offset 开始发送 count 字节，使用 sendfile 的显式偏移，不改变 file 的文件偏移，
+            // 发送完毕或连接断开后释放对 file 的引用。
+            // 可以连续发送多个文件并与 send() 交替调用，数据按调用顺序到达对端
+            void sendFile(const FileHandlePtr &file, off_t offset, size_t count);
+            /**
+             * 同上，这个文件的数据还要从 limiter 取得令牌（比如视频按码率发送）。
+             * limiter 跟随文件分段排队，只在该分段位于队首时生效，不影响前后的其他数据
+             */
+            void sendFile(const FileHandlePtr &file, off_t offset, size_t count, const TokenBucketPtr &limiter);
             void shutdown();
             void setTcpNoDelay(bool on);
             void forceClose();
             void forceCloseInLoop();
 
+            /**
+             * 暂停/恢复读取 socket 数据，用于上层处理跟不上时施加背压，
+             * 暂停期间数据留在内核接收缓冲区中，TCP 窗口会随之收缩。可以在任意线程中调用
+             */
+            void startRead();
+            void stopRead();
+
+            /**
+             * 隧道模式：此后从本连接读到的数据经由一个 pipe 用 splice(2) 直接写入 peer 的 socket，
+             * 不再拷贝到用户态的 Buffer，也不再调用 MessageCallback。
+             * 两个方向各调用一次（a->startSplice(b); b->startSplice(a);）即构成 TCP 转发隧道。
+             *
+             *  - 调用时 inputBuffer_ 中尚未取走的数据先照常发给 peer，因此可以先在 Buffer 路径上
+             *    检查开头的数据（比如协议头），再切换到隧道
+             *  - pipe 满时暂停读取本连接，peer 写出一部分后恢复，积压的数据不超过 pipe 的容量
+             *  - 读到 EOF 时，pipe 中的数据写完后关闭 peer 的写端（半关闭）；
+             *    本连接的两个方向都结束后自动关闭
+             *  - 隧道期间不要再对 peer 调用 send()，否则可能与 pipe 中的数据乱序
+             *
+             * 两个连接必须属于同一个 EventLoop。peer 断开后本连接回到 Buffer 路径
+             */
+            void startSplice(const TcpConnectionPtr &peer);
+            /// 回到 Buffer 路径，pipe 中剩余的数据发给 peer 之后才继续读取，保证顺序
+            void stopSplice();
+            /// 作为 peer 经由 pipe 写出的字节数，只能在 IO 线程中访问
+            int64_t splicedBytes() const { return splicedBytes_; }
+            bool isReading() const { return reading_; } // NOT thread safe, may race with start/stopReadInLoop
+
             bool connected() { return state_ == kConnected; }
             EventLoop *getLoop() { return loop_; }
             std::string name() { return name_; }
             InetAddress localAddr() { return localAddr_; }
             InetAddress peerAddr() { return peerAddr_; }
 
+            // 只能在 IO 线程中访问
+            Buffer *inputBuffer() { return &inputBuffer_; }
+            Buffer *outputBuffer() { return &outputBuffer_; }
+            // 尚未写入 socket 的字节数，包括排队中的文件
+            size_t queuedBytes() const;
+
         private:
             /**
              *    ---(established)---<  Connecting
@@ -97,18 +223,80 @@ namespace mymuduo
             void sendInLoop(const std::string &message);
             void sendInLoop(const StringPiece &message);
             void sendInLoop(const char *data, const size_t len);
-            void sendFileInLoop();
+            void sendInLoop(const StringPiece &header, const std::shared_ptr<const std::string> &body);
+            void sendPayloadInLoop(const std::shared_ptr<const std::string> &payload);
+            void sendSegmentsInLoop(const SendSegment *segments, size_t count);
+            // 由 owner 保证有效的一段内存按引用排到发送队列的末尾
+            void queueShared(const char *data, size_t len, const std::shared_ptr<const void> &owner);
+            // outputBuffer_ 和紧随其后的共享数据用一次 writev 写出，want 返回尝试写出的字节数
+            ssize_t writeGathered(size_t limit, size_t *want);
+            // 以 MSG_ZEROCOPY 发送一段共享数据，owner 的引用保留到完成通知
+            ssize_t sendZeroCopy(const char *data, size_t len, const std::shared_ptr<const void> &owner);
+            // 读取错误队列中的零拷贝完成通知，队列为空时返回 false
+            bool readZeroCopyCompletions();
+            void sendFileInLoop(const FileHandlePtr &file, off_t offset, size_t count, const TokenBucketPtr &limiter);
+            // 追加到发送队列的末尾
+            void appendOutput(const char *data, size_t len);
+            void writeCompleted();
+            // 从队首开始最多发送 limit 字节，返回实际发送的字节数
+            size_t writeQueued(size_t limit);
+            // 发送队列为空、没有暂停且不限速时，新数据可以不经排队直接写 socket
+            bool canWriteDirectly() const;
+            // 没有因为预读或限速而暂停时开始关注可写事件，合并写模式下改为安排本轮循环末尾的 flushOutput()
+            void startWriting();
+            // 按配额发送队列中的数据，写完时调用 writeCompleted()，否则等待可写事件
+            void flushOutput();
+            void flushCoalesced();
+            bool rateLimited() const { return !rateLimiters_.empty(); }
+            size_t rateAllowance() const;
+            void chargeRate(size_t bytes);
+            // 队首是带有 limiter 的文件分段时返回它的 limiter
+            TokenBucket *frontLimiter() const;
+            void throttle();
+            void unthrottle();
             void shutdownInLoop();
+            // 队首文件接下来的部分是否已在页缓存中，不在时开始预读并返回 false
+            bool frontFileResident(size_t want);
+            struct PendingSegment;
+            // 文件分段接下来的 want 字节是否已在页缓存中，只检查，不预读
+            bool fileResident(PendingSegment *pending, size_t want);
+            // 文件分段成为队首后能否立即发送：不需要预读，也不缺令牌
+            bool fileSendableNow(PendingSegment *pending, size_t budget);
+            void filePrefetched(off_t end);
+            void startReadInLoop();
+            void stopReadInLoop();
+            void startSpliceInLoop(const TcpConnectionPtr &peer);
+            void stopSpliceInLoop();
+            // 隧道模式下的 handleRead，从 socket 搬到 target 的 pipe
+            void handleSpliceRead(const TcpConnectionPtr &target);
+            // 从 pipe 写出 n 字节之后调用，必要时恢复读取源连接，或者在 EOF 之后关闭写端
+            void spliceDrained();
+            void pauseSpliceRead();
+            void resumeSpliceRead();
+            size_t splicePipeBytes() const { return splicePipe_ ? splicePipe_->bytes : 0; }
 
             EventLoop *loop_;
             std::string name_;
             StateE state_;
+            bool reading_; // 是否在监听可读事件
 
             Buffer inputBuffer_;
             Buffer outputBuffer_;
 
-            int sendFd_;     // sendFile 保存在本地的 fd
-            size_t sendLen_; // 当前需要发送的数据长度
+            // 排在 outputBuffer_ 之后的分段：等待 sendfile 的文件，或者以引用计数共享的只读数据。
+            // 在它之后调用 send() 的数据暂存在 trailer 中，该分段发送完毕后再移入 outputBuffer_
+            struct PendingSegment
+            {
+                FileHandlePtr file;
+                std::shared_ptr<const void> owner; // 共享数据的所有者，file 为空时有效
+                const char *data;                  // 共享数据的起点
+                off_t offset;      // 文件：下一次 sendfile 的起始偏移；共享数据：已发送的字节数
+                size_t remaining;  // 尚未发送的长度
+                off_t residentEnd; // [offset, residentEnd) 已确认在页缓存中
+                TokenBucketPtr limiter; // 只限制这个文件的发送速度，可以为空
+                Buffer trailer;
+            };
+            std::deque<PendingSegment> pendingSegments_;
 
             // TcpConnection拥有TCP socket，它 的析构函数会close(fd)（在Socket的析构函数中发生）
             boost::scoped_ptr<Socket> socket_;
@@ -119,6 +307,44 @@ namespace mymuduo
             InetAddress localAddr_;
             InetAddress peerAddr_;
             size_t highWaterMark_;
+            size_t inputHighWaterMark_;
+            size_t maxWriteBytes_;
+            ThreadPool *fileReadPool_;
+            bool filePrefetching_; // 队首文件正在线程池中预读，期间不发送文件数据
+            std::vector<TokenBucketPtr> rateLimiters_;
+            bool throttled_; // 令牌不足，等待定时器恢复发送
+
+            // 隧道模式下对端写给本连接的数据，排在发送队列的最后
+            struct SplicePipe
+            {
+                SplicePipe();
+                ~SplicePipe();
+
+                int fds[2];
+                size_t bytes;    // pipe 中尚未写入 socket 的字节数
+                size_t capacity; // pipe 的容量，积压达到它时暂停读取源连接
+                bool eof;        // 源连接已经读到 EOF
+                std::weak_ptr<TcpConnection> source;
+            };
+            std::unique_ptr<SplicePipe> splicePipe_;
+            std::weak_ptr<TcpConnection> spliceTarget_;
+            bool splicing_;      // 读到的数据送往 spliceTarget_ 的 pipe
+            bool spliceEof_;     // 隧道模式下读到了 EOF，读方向已经结束
+            bool splicePaused_;  // 因为 pipe 满或者等待 pipe 排空而暂停了读取
+            int64_t splicedBytes_;
+
+            size_t zeroCopyThreshold_;
+            bool zeroCopyEnabled_; // 已经打开了 SO_ZEROCOPY
+            uint32_t zeroCopyNextId_;
+            // 内核尚未报告完成的零拷贝发送，按发送的序号排列
+            std::deque<std::pair<uint32_t, std::shared_ptr<const void>>> zeroCopyPending_;
+            int64_t zeroCopySends_;
+            int64_t zeroCopyCompleted_;
+            int64_t zeroCopyCopied_;
+
+            bool coalescing_;
+            bool flushScheduled_; // 已经安排了本轮循环末尾的 flushCoalesced()
+            int64_t writeSyscalls_;
 
             CloseCallback closeCallback_;
             MessageCallback messageCallback_;
@@ -136,6 +362,7 @@ namespace mymuduo
              * 上下两个水龙头要轮流开合，类似PWM
              */
             HighWaterMarkCallback highWaterMarkCallback_;
+            ReadResumeCallback readResumeCallback_;
 
             boost::any context_;
         };
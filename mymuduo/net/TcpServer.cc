@@ -26,6 +26,8 @@ TcpServer::TcpServer(EventLoop *loop,
       threadPool_(new EventLoopThreadPool(loop, nameArg)),
       messageCallback_(defaultMessageCallback),
       connectionCallback_(defaultConnectionCallback),
+      fileReadPool_(NULL),
+      writeCoalescing_(false),
       nextConnId_(1)
 {
     acceptor_->setNewConnectionCallback(std::bind(&TcpServer::newConnection, this, _1, _2));
@@ -93,10 +95,14 @@ void TcpServer::newConnection(int sockfd, const InetAddress &peerAddr)
                                             localAddr,
                                             peerAddr));
     connections_[connName] = conn;
+    acceptedConnections_.add(1);
+    numConnections_.set(static_cast<int64_t>(connections_.size()));
     conn->setConnectionCallback(connectionCallback_);
     conn->setMessageCallback(messageCallback_);
     conn->setCloseCallback(std::bind(&TcpServer::removeConnection, this, _1));
     conn->setWriteCompleteCallback(writeCompleteCallback_);
+    conn->setFileReadPool(fileReadPool_);
+    conn->setWriteCoalescing(writeCoalescing_);
     // ioLoop和loop_间的线程切换都发生在连接建立和断开的时刻，不影响正常业务的性能
     ioLoop->runInLoop(std::bind(&TcpConnection::connectEstablished, conn));
 }
@@ -120,6 +126,7 @@ void TcpServer::removeConnectionInLoop(const TcpConnectionPtr &conn)
     size_t n = connections_.erase(conn->name());
     assert(n == 1);
     (void)n;
+    numConnections_.set(static_cast<int64_t>(connections_.size()));
     EventLoop *ioLoop = conn->getLoop();
     // 用boost::bind让TcpConnection的生命期长到调用 connectDestroyed()的时刻
     ioLoop->queueInLoop(std::bind(&TcpConnection::connectDestroyed, conn));
@@ -23,10 +23,13 @@
  *      如果要管理数组对象需要使用boost::scoped_array类。
  */
 #include "mymuduo/base/Types.h"
+#include "mymuduo/net/LoopMetrics.h"
 #include "mymuduo/net/TcpConnection.h"
 
 namespace mymuduo
 {
+    class ThreadPool;
+
     namespace net
     {
         class EventLoopThreadPool;
@@ -63,7 +66,14 @@ namespace mymuduo
             void setMessageCallback(const MessageCallback &cb) { messageCallback_ = cb; };
             void setWriteCompleteCallback(const WriteCompleteCallback &cb) { writeCompleteCallback_ = cb; }
             void setThreadInitCallback(const ThreadInitCallback &cb) { threadInitCallback_ = cb; }
-            std::shared_ptr<EventLoopThreadPool> threadPool() { return threadPool_; }
+            /// 新连接发送文件时，不在页缓存中的部分交给 pool 预读，见 TcpConnection::setFileReadPool
+            void setFileReadPool(ThreadPool *pool) { fileReadPool_ = pool; }
+            /// 新连接开启合并写，见 TcpConnection::setWriteCoalescing
+            void setWriteCoalescing(bool on) { writeCoalescing_ = on; }
+            std::shared_ptr<EventLoopThreadPool> threadPool() const { return threadPool_; }
+            /// 累计接受的连接数与当前存活的连接数，由 baseLoop 更新，可以在任意线程读取
+            int64_t acceptedConnections() const { return acceptedConnections_.get(); }
+            int64_t numConnections() const { return numConnections_.get(); }
 
         private:
             typedef std::map<std::string, TcpConnectionPtr> ConnectionMap;
@@ -96,6 +106,8 @@ namespace mymuduo
             ConnectionCallback connectionCallback_;
             WriteCompleteCallback writeCompleteCallback_;
             ThreadInitCallback threadInitCallback_;
+            ThreadPool *fileReadPool_;
+            bool writeCoalescing_;
 
             AtomicInt32 started_;
             int nextConnId_;
@@ -106,6 +118,8 @@ namespace mymuduo
              * 这时就需要使用 std::bind 来延长其生命周期，直到完成 onDestroyed
              */
             ConnectionMap connections_;
+            LoopCounter acceptedConnections_;
+            LoopCounter numConnections_;
         };
     }
 }
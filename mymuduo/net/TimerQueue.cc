@@ -99,6 +99,7 @@ TimerQueue::TimerQueue(EventLoop *loop)
       timers_()
 {
     // 绑定回调函数, 开启监听
+    timerfdChannel_.setType(Channel::kTimerChannel);
     timerfdChannel_.setReadCallback(std::bind(&TimerQueue::handleRead, this));
     timerfdChannel_.enableReading();
 }
@@ -145,6 +146,7 @@ void TimerQueue::handleRead()
     readTimerfd(timerfd_, now);
 
     std::vector<Entry> expired = getExpired(now);
+    loop_->metrics().addTimersFired(expired.size());
 
     callingExpiredTimers_ = true;
     cancelingTimers_.clear();
@@ -0,0 +1,62 @@
+#include "mymuduo/net/TokenBucket.h"
+
+#include "mymuduo/base/Timestamp.h"
+
+#include <algorithm>
+
+using namespace mymuduo;
+using namespace mymuduo::net;
+
+TokenBucket::TokenBucket(double rate, size_t capacity)
+    : rate_(rate),
+      capacity_(static_cast<double>(std::max(capacity, static_cast<size_t>(1)))),
+      tokens_(capacity_),
+      last_(Timestamp::now().microSecondsSinceEpoch())
+{
+}
+
+TokenBucket::TokenBucket(double rate, size_t capacity, size_t initial)
+    : rate_(rate),
+      capacity_(static_cast<double>(std::max(capacity, static_cast<size_t>(1)))),
+      tokens_(static_cast<double>(initial)),
+      last_(Timestamp::now().microSecondsSinceEpoch())
+{
+}
+
+void TokenBucket::refill()
+{
+    int64_t now = Timestamp::now().microSecondsSinceEpoch();
+    if (now <= last_)
+        return;
+    // 初始突发期间令牌数可能高于 capacity，此时不再补充
+    if (tokens_ < capacity_)
+    {
+        double elapsed = static_cast<double>(now - last_) / Timestamp::kMicroSecondsPerSecond;
+        tokens_ = std::min(capacity_, tokens_ + elapsed * rate_);
+    }
+    last_ = now;
+}
+
+size_t TokenBucket::available()
+{
+    MutexLockGuard lock(mutex_);
+    refill();
+    return tokens_ > 0 ? static_cast<size_t>(tokens_) : 0;
+}
+
+void TokenBucket::consume(size_t bytes)
+{
+    MutexLockGuard lock(mutex_);
+    refill();
+    tokens_ -= static_cast<double>(bytes);
+}
+
+double TokenBucket::waitTime(size_t bytes)
+{
+    MutexLockGuard lock(mutex_);
+    refill();
+    double want = std::min(static_cast<double>(bytes), capacity_);
+    if (tokens_ >= want)
+        return 0.0;
+    return rate_ > 0 ? (want - tokens_) / rate_ : 1.0;
+}
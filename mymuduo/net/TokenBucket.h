@@ -0,0 +1,49 @@
+#ifndef MY_MUDUO_NET_TOKENBUCKET_H
+#define MY_MUDUO_NET_TOKENBUCKET_H
+
+#include "mymuduo/base/Mutex.h"
+#include "mymuduo/base/noncopyable.h"
+
+#include <memory>
+
+namespace mymuduo
+{
+    namespace net
+    {
+        /**
+         * 令牌桶限速：令牌以 rate（字节/秒）的速度补充，最多积攒 capacity 个，
+         * 发送多少字节就消耗多少令牌。initial 可以大于 capacity，用于开始时的一次突发
+         * （比如视频先快速填满播放器的缓冲，之后按码率匀速发送），突发用完后不再超过 capacity。
+         * 线程安全，同一个令牌桶可以被不同 IO 线程上的多个连接共享
+         */
+        class TokenBucket : noncopyable
+        {
+        public:
+            TokenBucket(double rate, size_t capacity);
+            TokenBucket(double rate, size_t capacity, size_t initial);
+
+            /// 当前可用的令牌数
+            size_t available();
+            /// 消耗 bytes 个令牌，可以透支，透支的部分由之后补充的令牌抵消
+            void consume(size_t bytes);
+            /// 令牌数达到 bytes（不超过 capacity）还要等待的秒数
+            double waitTime(size_t bytes);
+
+            double rate() const { return rate_; }
+            size_t capacity() const { return static_cast<size_t>(capacity_); }
+
+        private:
+            void refill() REQUIRES(mutex_);
+
+            const double rate_;
+            const double capacity_;
+            MutexLock mutex_;
+            double tokens_ GUARDED_BY(mutex_);
+            int64_t last_ GUARDED_BY(mutex_); // 上次补充的时间，微秒
+        };
+
+        typedef std::shared_ptr<TokenBucket> TokenBucketPtr;
+    }
+}
+
+#endif
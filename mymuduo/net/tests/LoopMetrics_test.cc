@@ -0,0 +1,126 @@
+#include "mymuduo/net/LoopMetrics.h"
+#include "mymuduo/net/Channel.h"
+#include "mymuduo/net/EventLoop.h"
+#include "mymuduo/net/EventLoopThreadPool.h"
+#include "mymuduo/base/CountDownLatch.h"
+#include "mymuduo/base/Logging.h"
+#include "mymuduo/base/tests/TestCheck.h"
+
+#include <stdio.h>
+#include <unistd.h>
+#include <thread>
+
+using namespace mymuduo;
+using namespace mymuduo::net;
+
+void testHistogram()
+{
+    LoopHistogram histogram;
+    const int64_t values[] = {0, 1, 2, 3, 4, 5, 1000};
+    for (int64_t value : values)
+    {
+        histogram.record(value);
+    }
+    histogram.record(static_cast<int64_t>(1) << 40);
+    HistogramSnapshot snap = histogram.snapshot();
+    CHECK(snap.count == 8);
+    CHECK(snap.sum == 1015 + (static_cast<int64_t>(1) << 40));
+    CHECK(snap.buckets[0] == 2); // 0, 1
+    CHECK(snap.buckets[1] == 1); // 2
+    CHECK(snap.buckets[2] == 2); // 3, 4
+    CHECK(snap.buckets[3] == 1); // 5
+    CHECK(snap.buckets[10] == 1); // 1000 <= 1024
+    CHECK(snap.buckets[HistogramSnapshot::kBuckets - 1] == 1);
+    CHECK(HistogramSnapshot::upperBound(10) == 1024);
+    CHECK(HistogramSnapshot::upperBound(HistogramSnapshot::kBuckets - 1) == -1);
+    CHECK(snap.percentile(0.5) == 4);
+    CHECK(snap.percentile(0.85) == 1024);
+
+    HistogramSnapshot merged = snap;
+    merged.merge(snap);
+    CHECK(merged.count == 16 && merged.buckets[2] == 4);
+    CHECK(HistogramSnapshot().percentile(0.99) == 0);
+}
+
+// 定时器、跨线程的 functor 都应当计入开启了统计的 EventLoop
+void testLoop()
+{
+    EventLoop loop;
+    loop.setMetricsEnabled(true);
+    int fired = 0;
+    loop.runEvery(0.01, [&fired, &loop] {
+        if (++fired == 5)
+            loop.quit();
+    });
+    std::thread poster([&loop] {
+        for (int i = 0; i < 10; ++i)
+            loop.queueInLoop([] {});
+    });
+    loop.loop();
+    poster.join();
+
+    LoopMetrics::Snapshot snap = loop.metricsSnapshot();
+    CHECK(snap.loops == 1);
+    CHECK(snap.iterations >= 5);
+    CHECK(snap.timersFired >= 5);
+    CHECK(snap.functorsRun >= 10);
+    CHECK(snap.channels >= 2); // wakeup 与 timerfd
+    CHECK(snap.iterationMicros.count == snap.iterations);
+    CHECK(snap.pollWaitMicros.count == snap.iterations - 1);
+    CHECK(snap.functorQueueDepth.count == snap.iterations);
+    CHECK(snap.callbackMicros[Channel::kTimerChannel].count >= 5);
+    // 定时器之间 poll 大约等待 10ms
+    CHECK(snap.pollWaitMicros.percentile(0.99) >= 4096);
+}
+
+// 不开启统计时计数器和 Channel 数同样有效
+void testChannels()
+{
+    EventLoop loop;
+    CHECK(loop.metricsSnapshot().channels >= 1); // wakeup
+    int fds[2];
+    CHECK(::pipe(fds) == 0);
+    size_t before = static_cast<size_t>(loop.metricsSnapshot().channels);
+    {
+        Channel channel(&loop, fds[0]);
+        channel.enableReading();
+        CHECK(static_cast<size_t>(loop.metricsSnapshot().channels) == before + 1);
+        channel.disableAll();
+        channel.remove();
+    }
+    CHECK(static_cast<size_t>(loop.metricsSnapshot().channels) == before);
+    ::close(fds[0]);
+    ::close(fds[1]);
+}
+
+void testPool()
+{
+    EventLoop baseLoop;
+    EventLoopThreadPool pool(&baseLoop, "metrics");
+    pool.setThreadNum(2);
+    pool.setMetricsEnabled(true);
+    pool.start();
+    CountDownLatch latch(2);
+    for (int i = 0; i < 2; ++i)
+    {
+        EventLoop *loop = pool.getNextLoop();
+        loop->runInLoop([loop, &latch] {
+            CHECK(loop->metricsEnabled());
+            latch.countDown();
+        });
+    }
+    latch.wait();
+    LoopMetrics::Snapshot snap = pool.metricsSnapshot();
+    CHECK(snap.loops == 3);
+    CHECK(snap.functorsRun >= 2);
+}
+
+int main()
+{
+    Logger::setLogLevel(Logger::WARN);
+    testHistogram();
+    testLoop();
+    testChannels();
+    testPool();
+    return testResult();
+}
@@ -0,0 +1,115 @@
+#include "mymuduo/net/TcpConnection.h"
+#include "mymuduo/net/EventLoop.h"
+#include "mymuduo/net/TcpServer.h"
+#include "mymuduo/base/Logging.h"
+#include "mymuduo/base/tests/TestCheck.h"
+
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <thread>
+
+using namespace mymuduo;
+using namespace mymuduo::net;
+
+// 客户端一次写入 4MB，服务端的处理方从不在 MessageCallback 中取走数据，
+// 只由定时器周期性地取走并从另一个线程恢复读取，输入缓冲区不应随之无限增长
+const uint16_t kPort = 19852;
+const size_t kUploadSize = 4 * 1024 * 1024;
+const size_t kInputHighWaterMark = 64 * 1024;
+
+EventLoop *g_loop;
+TcpConnectionPtr g_conn;
+size_t g_received = 0;
+size_t g_maxBacklog = 0;
+int g_pauses = 0;
+int g_resumes = 0;
+
+void client()
+{
+    ::usleep(100 * 1000);
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memZero(&addr, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(kPort);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof addr) < 0)
+    {
+        perror("connect");
+        ++g_failures;
+        g_loop->quit();
+        return;
+    }
+    string data(kUploadSize, 'x');
+    size_t written = 0;
+    while (written < data.size())
+    {
+        ssize_t n = ::write(fd, data.data() + written, data.size() - written);
+        if (n <= 0)
+            break;
+        written += static_cast<size_t>(n);
+    }
+    CHECK(written == kUploadSize);
+    ::close(fd);
+}
+
+void onConnection(const TcpConnectionPtr &conn)
+{
+    if (conn->connected())
+    {
+        conn->setInputHighWaterMark(kInputHighWaterMark);
+        conn->setReadResumeCallback([](const TcpConnectionPtr &) { ++g_resumes; });
+        g_conn = conn;
+    }
+    else
+    {
+        g_received += conn->inputBuffer()->readableBytes();
+        g_conn.reset();
+        g_loop->quit();
+    }
+}
+
+void onMessage(const TcpConnectionPtr &, Buffer *buf, Timestamp)
+{
+    g_maxBacklog = std::max(g_maxBacklog, buf->readableBytes());
+}
+
+// 取走积压的数据，在其他线程中恢复读取
+void drain()
+{
+    if (!g_conn || g_conn->isReading())
+        return;
+    ++g_pauses;
+    g_received += g_conn->inputBuffer()->readableBytes();
+    g_conn->inputBuffer()->retrieveAll();
+    TcpConnectionPtr conn(g_conn);
+    std::thread resumer([conn] { conn->startRead(); });
+    resumer.join();
+}
+
+int main()
+{
+    Logger::setLogLevel(Logger::WARN);
+    EventLoop loop;
+    g_loop = &loop;
+    TcpServer server(&loop, InetAddress(kPort, true), "TcpBackpressure_test");
+    server.setConnectionCallback(onConnection);
+    server.setMessageCallback(onMessage);
+    server.start();
+    loop.runEvery(0.01, drain);
+
+    std::thread clientThread(client);
+    loop.loop();
+    clientThread.join();
+
+    // 每次读取最多是缓冲区的可写空间加上 64KB 的栈上缓冲，积压不会远超高水位
+    printf("pauses: %d, resumes: %d, max backlog: %zu\n", g_pauses, g_resumes, g_maxBacklog);
+    CHECK(g_received == kUploadSize);
+    CHECK(g_pauses > 0);
+    CHECK(g_resumes == g_pauses);
+    CHECK(g_maxBacklog < 4 * kInputHighWaterMark);
+
+    return testResult();
+}
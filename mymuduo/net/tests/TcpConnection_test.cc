@@ -0,0 +1,197 @@
+#include "mymuduo/net/TcpConnection.h"
+#include "mymuduo/net/EventLoop.h"
+#include "mymuduo/net/TcpServer.h"
+#include "mymuduo/base/Logging.h"
+#include "mymuduo/base/ThreadPool.h"
+#include "mymuduo/base/tests/TestCheck.h"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <thread>
+#include <vector>
+
+using namespace mymuduo;
+using namespace mymuduo::net;
+
+const uint16_t kPort = 19838;
+const int kClients = 4;
+const size_t kFileSize = 1024 * 1024;
+
+string g_content;
+FileHandlePtr g_file;
+std::shared_ptr<const string> g_payload; // 所有连接共享的一份数据
+double g_rate = 0; // 每个连接的限速，0 表示不限速
+size_t g_zeroCopyThreshold = 0;
+int64_t g_zeroCopySends = 0;
+bool g_coalescing = false;
+int64_t g_callbackSyscalls = 0; // 在 onConnection 中同步发出的系统调用
+int64_t g_writeSyscalls = 0;
+
+// 内存数据、共享数据与文件交错发送，每次可写事件只发送 16KB，检查对端收到的顺序和内容
+void onConnection(const TcpConnectionPtr &conn)
+{
+    if (conn->connected())
+    {
+        conn->setMaxWriteBytes(16 * 1024);
+        if (g_rate > 0)
+        {
+            conn->setRateLimiters(std::vector<TokenBucketPtr>(1, std::make_shared<TokenBucket>(g_rate, 64 * 1024)));
+        }
+        if (g_zeroCopyThreshold > 0)
+        {
+            conn->setZeroCopyThreshold(g_zeroCopyThreshold);
+        }
+        conn->setWriteCoalescing(g_coalescing);
+        conn->send("head\n");
+        conn->sendFile(g_file, 0, kFileSize);
+        conn->send("mid\n");
+        conn->send(g_payload);
+        conn->send(g_payload);
+        conn->send("mid\n");
+        conn->sendFile(g_file, 100, kFileSize - 100);
+        // 借用的片段在调用返回前写出或拷贝，共享的片段按引用排队
+        std::vector<SendSegment> segments;
+        segments.push_back(SendSegment(g_payload->data(), g_payload->size(), g_payload));
+        segments.push_back(SendSegment("tail\n", 5));
+        conn->send(segments);
+        conn->shutdown();
+        g_callbackSyscalls += conn->writeSyscalls();
+    }
+    else
+    {
+        g_writeSyscalls += conn->writeSyscalls();
+        g_zeroCopySends += conn->zeroCopySends();
+        if (conn->zeroCopySends() > 0)
+            printf("zero copy sends: %ld, hit ratio: %.2f\n", conn->zeroCopySends(), conn->zeroCopyHitRatio());
+    }
+}
+
+string expected()
+{
+    return "head\n" + g_content + "mid\n" + *g_payload + *g_payload + "mid\n" + g_content.substr(100) + *g_payload +
+           "tail\n";
+}
+
+string fetch(uint16_t port)
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memZero(&addr, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    string data;
+    if (::connect(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof addr) == 0)
+    {
+        char buf[8192];
+        ssize_t n;
+        while ((n = ::read(fd, buf, sizeof buf)) > 0)
+        {
+            data.append(buf, static_cast<size_t>(n));
+        }
+    }
+    ::close(fd);
+    return data;
+}
+
+// 多个连接同时在同一个 IO 线程上发送，返回该线程上预读冷文件的次数
+int64_t runClients(uint16_t port, ThreadPool *readPool)
+{
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(port, true), "TcpConnection_test");
+    server.setConnectionCallback(onConnection);
+    server.setFileReadPool(readPool);
+    server.start();
+
+    std::vector<string> results(kClients);
+    std::thread clients([&results, &loop, port] {
+        std::vector<std::thread> threads;
+        for (int i = 0; i < kClients; ++i)
+        {
+            threads.emplace_back([&results, i, port] { results[i] = fetch(port); });
+        }
+        for (auto &t : threads)
+        {
+            t.join();
+        }
+        loop.quit();
+    });
+    loop.loop();
+    clients.join();
+
+    const string want = expected();
+    for (const string &result : results)
+    {
+        CHECK(result.size() == want.size());
+        CHECK(result == want);
+    }
+    CHECK(loop.metricsSnapshot().bytesWritten == static_cast<int64_t>(want.size()) * kClients);
+    return loop.coldFileReads();
+}
+
+int main()
+{
+    Logger::setLogLevel(Logger::WARN);
+    char path[] = "/tmp/tcpconnection_testXXXXXX";
+    int fd = ::mkstemp(path);
+    ::unlink(path);
+    g_content.resize(kFileSize);
+    for (size_t i = 0; i < kFileSize; ++i)
+    {
+        g_content[i] = static_cast<char>('a' + i % 26);
+    }
+    CHECK(::write(fd, g_content.data(), kFileSize) == static_cast<ssize_t>(kFileSize));
+    g_file = std::make_shared<FileHandle>(fd);
+    string payload(256 * 1024, '\0');
+    for (size_t i = 0; i < payload.size(); ++i)
+    {
+        payload[i] = static_cast<char>('A' + i % 26);
+    }
+    g_payload = std::make_shared<const string>(payload);
+
+    runClients(kPort, NULL);
+    CHECK(g_callbackSyscalls > 0);
+    const int64_t plainSyscalls = g_writeSyscalls;
+
+    // 把文件从页缓存中清出去，发送时应当先由线程池预读
+    ::fdatasync(fd);
+    ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    ThreadPool readPool("FileRead");
+    readPool.start(2);
+    int64_t coldReads = runClients(static_cast<uint16_t>(kPort + 1), &readPool);
+    // tmpfs 上的文件不会被清出页缓存，此时没有预读
+    printf("cold file reads: %ld\n", coldReads);
+    readPool.stop();
+
+    // 每个连接约 2.8MB，限速 8MB/s 时至少需要 0.3 秒，定时器恢复发送后内容仍然完整
+    g_rate = 8 * 1024 * 1024;
+    Timestamp start = Timestamp::now();
+    runClients(static_cast<uint16_t>(kPort + 2), NULL);
+    double elapsed = timeDifference(Timestamp::now(), start);
+    printf("rate limited: %.3f seconds\n", elapsed);
+    CHECK(elapsed > 0.2);
+    // 共享数据改用 MSG_ZEROCOPY 发送，内容不变。回环上内核总是拷贝，此时会自动改回普通发送
+    g_rate = 0;
+    g_zeroCopyThreshold = 8 * 1024;
+    runClients(static_cast<uint16_t>(kPort + 3), NULL);
+    CHECK(g_zeroCopySends > 0);
+    g_zeroCopyThreshold = 0;
+
+    // 合并写：回调中的发送全部留到循环末尾，首部与随后的文件数据合并发出
+    g_coalescing = true;
+    g_callbackSyscalls = 0;
+    g_writeSyscalls = 0;
+    runClients(static_cast<uint16_t>(kPort + 4), NULL);
+    printf("write syscalls: plain %ld, coalesced %ld\n", plainSyscalls, g_writeSyscalls);
+    CHECK(g_callbackSyscalls == 0);
+    g_coalescing = false;
+
+    // 发送完毕后排队的引用都已释放
+    CHECK(g_payload.use_count() == 1);
+
+    return testResult();
+}
@@ -0,0 +1,190 @@
+#include "mymuduo/net/TcpConnection.h"
+#include "mymuduo/net/EventLoop.h"
+#include "mymuduo/net/TcpClient.h"
+#include "mymuduo/net/TcpServer.h"
+#include "mymuduo/base/Logging.h"
+#include "mymuduo/base/tests/TestCheck.h"
+
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <thread>
+
+using namespace mymuduo;
+using namespace mymuduo::net;
+
+// 客户端 -> 隧道 -> 后端。客户端发送 4MB 后半关闭，后端读到 EOF 后回复 1MB 再关闭
+const uint16_t kTunnelPort = 19850;
+const uint16_t kBackendPort = 19851;
+const size_t kUploadSize = 4 * 1024 * 1024;
+const size_t kReplySize = 1024 * 1024;
+
+EventLoop *g_loop;
+std::unique_ptr<TcpClient> g_backend;
+TcpConnectionPtr g_front;
+bool g_headerSeen = false;
+int g_closed = 0;
+int64_t g_toBackend = 0;
+int64_t g_toClient = 0;
+
+string pattern(size_t size, int seed)
+{
+    string data(size, '\0');
+    for (size_t i = 0; i < size; ++i)
+        data[i] = static_cast<char>((i * 7 + static_cast<size_t>(seed)) % 251);
+    return data;
+}
+
+int listenOn(uint16_t port)
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    int on = 1;
+    ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof on);
+    struct sockaddr_in addr;
+    memZero(&addr, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::bind(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof addr) < 0 || ::listen(fd, 4) < 0)
+    {
+        perror("listen");
+    }
+    return fd;
+}
+
+string readAll(int fd)
+{
+    string data;
+    char buf[65536];
+    ssize_t n;
+    while ((n = ::read(fd, buf, sizeof buf)) > 0)
+        data.append(buf, static_cast<size_t>(n));
+    return data;
+}
+
+bool writeAll(int fd, const string &data)
+{
+    size_t written = 0;
+    while (written < data.size())
+    {
+        ssize_t n = ::write(fd, data.data() + written, data.size() - written);
+        if (n <= 0)
+            return false;
+        written += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+void backend(int listenFd)
+{
+    int fd = ::accept(listenFd, NULL, NULL);
+    string upload = readAll(fd);
+    CHECK(upload.size() == kUploadSize);
+    CHECK(upload == pattern(kUploadSize, 1));
+    CHECK(writeAll(fd, pattern(kReplySize, 2)));
+    ::close(fd);
+    ::close(listenFd);
+}
+
+void client()
+{
+    ::usleep(100 * 1000);
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memZero(&addr, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(kTunnelPort);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof addr) < 0)
+    {
+        perror("connect");
+        ++g_failures;
+        g_loop->quit();
+        return;
+    }
+    // 首部之后紧跟着数据，其中一部分会在切换到隧道之前读入 inputBuffer_
+    CHECK(writeAll(fd, "CONNECT\n" + pattern(kUploadSize, 1)));
+    ::shutdown(fd, SHUT_WR);
+    string reply = readAll(fd);
+    CHECK(reply.size() == kReplySize);
+    CHECK(reply == pattern(kReplySize, 2));
+    ::close(fd);
+}
+
+void onClosed()
+{
+    if (++g_closed == 2)
+        g_loop->queueInLoop([] { g_loop->quit(); });
+}
+
+void onBackendConnection(const TcpConnectionPtr &conn)
+{
+    if (conn->connected())
+    {
+        g_front->startSplice(conn);
+        conn->startSplice(g_front);
+        g_front->startRead();
+    }
+    else
+    {
+        g_toBackend = conn->splicedBytes();
+        onClosed();
+    }
+}
+
+void onFrontConnection(const TcpConnectionPtr &conn)
+{
+    if (conn->connected())
+    {
+        g_front = conn;
+    }
+    else
+    {
+        g_toClient = conn->splicedBytes();
+        g_front.reset();
+        onClosed();
+    }
+}
+
+// 在 Buffer 路径上检查首部，连上后端后切换到隧道
+void onFrontMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+{
+    if (g_headerSeen)
+        return;
+    const char *eol = buf->findEOL();
+    if (!eol)
+        return;
+    CHECK(string(buf->peek(), eol) == "CONNECT");
+    buf->retrieveUntil(eol + 1);
+    g_headerSeen = true;
+    conn->stopRead();
+    g_backend.reset(new TcpClient(g_loop, InetAddress(kBackendPort, true), "backend"));
+    g_backend->setConnectionCallback(onBackendConnection);
+    g_backend->connect();
+}
+
+int main()
+{
+    Logger::setLogLevel(Logger::WARN);
+    EventLoop loop;
+    g_loop = &loop;
+    TcpServer server(&loop, InetAddress(kTunnelPort, true), "TcpTunnel_test");
+    server.setConnectionCallback(onFrontConnection);
+    server.setMessageCallback(onFrontMessage);
+    server.start();
+
+    std::thread backendThread(backend, listenOn(kBackendPort));
+    std::thread clientThread(client);
+    loop.loop();
+    clientThread.join();
+    backendThread.join();
+    g_backend.reset();
+
+    // 除了切换前读入 inputBuffer_ 的部分，数据都经由 pipe 转发
+    printf("spliced to backend: %ld, to client: %ld\n", g_toBackend, g_toClient);
+    CHECK(g_toBackend > 0 && g_toBackend <= static_cast<int64_t>(kUploadSize));
+    CHECK(g_toClient == static_cast<int64_t>(kReplySize));
+
+    return testResult();
+}